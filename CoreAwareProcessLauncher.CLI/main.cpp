@@ -9,10 +9,31 @@ int wmain(int argc, wchar_t* argv[])
         //g_logger = std::make_unique<ApplicationLogger>(true, L"capl_debug.log");  // Temporary debug logger
         //g_logger->Log(ApplicationLogger::Level::DEBUG, "CLI starting, parsing arguments...");
 
+		// Thin client: the daemon parses, places and launches
+		std::vector<std::wstring> daemonArgs;
+		std::wstring pipeName;
+		if (DaemonClient::TakeDaemonArguments(argc, argv, daemonArgs, pipeName)) {
+			WCHAR directory[MAX_PATH];
+			GetCurrentDirectoryW(MAX_PATH, directory);
+			return static_cast<int>(
+				DaemonClient::Launch(pipeName, directory, daemonArgs));
+		}
+
+		LONGLONG parseStart = PhaseTrace::Now();
 		CommandLineOptions options = ParseCommandLine(argc, argv);
 
+		// Tracing starts once --trace is known; parsing is recorded after
+		// the fact and the file is written however main is left
+		std::unique_ptr<PhaseTrace::Session> trace;
+		if (!options.tracePath.empty()) {
+			trace = std::make_unique<PhaseTrace::Session>(options.tracePath);
+			PhaseTrace::Record("ParseCommandLine", parseStart,
+				PhaseTrace::Now());
+		}
+
 		if (options.enableLogging) {
 			g_logger = std::make_unique<ApplicationLogger>(true, options.logPath);
+			ApplicationLogger::FlushOnFailure();
 			g_logger->Log(ApplicationLogger::Level::INFO, "CAPL CLI +  starting...");
 		}
 
@@ -21,96 +42,188 @@ int wmain(int argc, wchar_t* argv[])
 			return 0;
 		}
 
+		if (!options.analyzePath.empty()) {
+			g_messageHandler->ShowQueryResult(SchedTraceAnalyzer::FormatReport(
+				SchedTraceAnalyzer::Analyze(SchedTrace::Read(options.analyzePath))));
+			return 0;
+		}
+
+		if (options.topMode) {
+			TopView(options.topRefreshMs).Run();
+			return 0;
+		}
+
+		if (options.daemonMode) {
+			LaunchDaemon daemon(options.pipeName.empty()
+				? LaunchDaemon::GetDefaultPipeName() : options.pipeName);
+			daemon.Run();
+			return 0;
+		}
+
 		if (options.queryMode) {
 			g_logger->Log(ApplicationLogger::Level::INFO, "Running in query mode");
+			if (options.queryFormat == CommandLineOptions::QueryFormat::JSON) {
+				g_messageHandler->ShowQueryResult(Utilities::ConvertToWideString(
+					TopologySnapshot::Capture(true).FormatJson()));
+				return 0;
+			}
 			g_messageHandler->ShowQueryResult(CpuInfo::QuerySystemInfo());
 			return 0;
 		}
 
-		// Get appropriate core mask based on affinity mode
-		DWORD_PTR coreMask = 0;
-		auto caps = CpuInfo::GetCapabilities();
-
-		switch (options.affinityMode) {
-		case CommandLineOptions::CoreAffinityMode::P_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(
-					L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetPCoreMask();
-			break;
-
-		case CommandLineOptions::CoreAffinityMode::E_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(
-					L"This CPU does not support hybrid architecture"));
+		if (options.sweepMode) {
+			g_logger->Log(ApplicationLogger::Level::INFO, "Running in sweep mode");
+			auto steps = ScalabilitySweep::Run(options);
+			if (!options.resultsPath.empty()) {
+				ScalabilitySweep::WriteResults(options.resultsPath, steps);
 			}
-			coreMask = CpuInfo::GetECoreMask();
-			break;
+			g_messageHandler->ShowQueryResult(ScalabilitySweep::FormatReport(steps));
+			return 0;
+		}
 
-		case CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(
-					L"This CPU does not support hybrid architecture"));
+		if (options.repeatCount > 0) {
+			g_logger->Log(ApplicationLogger::Level::INFO, "Running in benchmark mode");
+			auto runs = Benchmark::Run(options);
+			if (!options.resultsPath.empty()) {
+				Benchmark::WriteResults(options.resultsPath, runs);
 			}
-			coreMask = CpuInfo::GetLpECoreMask();
-			break;
+			g_messageHandler->ShowQueryResult(Benchmark::FormatReport(runs));
+			return 0;
+		}
 
-		case CommandLineOptions::CoreAffinityMode::ALL_E_CORES:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(
-					L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetECoreMask() | CpuInfo::GetLpECoreMask();
-			break;
+		if (options.tuneMode) {
+			g_logger->Log(ApplicationLogger::Level::INFO, "Running in tune mode");
+			auto candidates = AffinityTuner::GenerateCandidates(
+				AffinityTuner::DetectCoreClasses());
+			auto winner = AffinityTuner::Tune(options, candidates);
+
+			ProfileStore::Profile profile;
+			profile.mask = winner.mask;
+			profile.label = winner.label;
+			profile.wallSeconds = winner.Median();
+			ProfileStore::Save(
+				options.profilePath.empty() ? ProfileStore::GetDefaultPath()
+				                            : options.profilePath,
+				ProcessManager::ResolveExecutablePath(options.targetPath),
+				profile);
+
+			g_messageHandler->ShowQueryResult(
+				AffinityTuner::FormatReport(candidates, winner));
+			return 0;
+		}
 
-		case CommandLineOptions::CoreAffinityMode::ALL_CORES:
+		// Get appropriate core mask based on affinity mode
+		DWORD_PTR coreMask;
 		{
-			SYSTEM_INFO sysInfo;
-			GetSystemInfo(&sysInfo);
-			coreMask = (1ULL << sysInfo.dwNumberOfProcessors) - 1;
+			PhaseTrace::Scope resolveTrace("Resolve core mask");
+			coreMask = AffinityResolver::Resolve(options);
 		}
-		break;
 
-		case CommandLineOptions::CoreAffinityMode::CUSTOM:
-			coreMask = CpuInfo::CoreListToMask(options.cores);
-			break;
+		// Registered for other launches until the program has exited
+		auto reservation = CoreReservation::FromOptions(coreMask, options);
+		if (reservation) {
+			coreMask = reservation->GetMask();
+		}
 
-		default:
-			throw std::runtime_error(Utilities::ConvertToNarrowString(
-				L"Invalid affinity mode"));
+		std::unique_ptr<EmiEnergyMeter> energyMeter;
+		std::unique_ptr<EnergyProfiler> energyProfiler;
+		if (options.measureEnergy) {
+			energyMeter = EmiEnergyMeter::Open();
+			energyProfiler = std::make_unique<EnergyProfiler>(*energyMeter);
 		}
 
-		// Apply inversion if requested
-		if (options.invertSelection) {
-			SYSTEM_INFO sysInfo;
-			GetSystemInfo(&sysInfo);
-			DWORD_PTR fullMask = (1ULL << sysInfo.dwNumberOfProcessors) - 1;
-			coreMask = fullMask & ~coreMask;
-			g_logger->Log(ApplicationLogger::Level::INFO,
-				"Inverted core mask: 0x" + std::format("{:X}", coreMask));
+		// Undo power settings pinned by runs that were killed
+		FrequencyPinning::RecoverJournals();
+
+		// Restored when this scope ends, whether the launch worked or not
+		std::unique_ptr<FrequencyPinning> frequencyPinning;
+		if (options.freqMinKhz > 0 || options.freqMaxKhz > 0 || options.epp >= 0) {
+			frequencyPinning = std::make_unique<FrequencyPinning>(
+				FrequencyPinning::FromOptions(options),
+				FrequencyPinning::DescribeMask(coreMask),
+				PowerPlanStore::Active(),
+				FrequencyPinning::GetDefaultJournalPath());
+			frequencyPinning->Pin();
 		}
 
-		// Validate final mask
-		if (coreMask == 0) {
-			throw std::runtime_error(Utilities::ConvertToNarrowString(
-				L"Resulting core mask is empty"));
+		std::vector<ProcessMonitor*> monitors;
+		std::unique_ptr<ThermalPolicy> thermalPolicy;
+		if (options.thermalAction != CommandLineOptions::ThermalAction::NONE) {
+			thermalPolicy = ThermalPolicy::Create(options);
+			monitors.push_back(thermalPolicy.get());
+		}
+		std::unique_ptr<LatencyProfile> latencyProfile;
+		if (options.latencyCritical) {
+			latencyProfile = std::make_unique<LatencyProfile>(
+				LatencyProfile::FromOptions(options));
+			monitors.push_back(latencyProfile.get());
+		}
+		if (reservation) {
+			monitors.push_back(reservation.get());
+		}
+		std::unique_ptr<ResourceMonitor> resourceMonitor;
+		if (!options.monitorPath.empty()) {
+			resourceMonitor = ResourceMonitor::Create(options);
+			monitors.push_back(resourceMonitor.get());
+		}
+
+		std::unique_ptr<SchedTraceRecorder> schedTrace;
+		if (!options.schedTracePath.empty()) {
+			schedTrace = std::make_unique<SchedTraceRecorder>();
+			monitors.push_back(schedTrace.get());
+		}
+		std::unique_ptr<MetricsExporter> metrics;
+		if (!options.metricsPath.empty()) {
+			metrics = MetricsExporter::Create(options);
+			monitors.push_back(metrics.get());
+		}
+
+		// Joules are read over the same window as the wall time
+		if (energyProfiler) {
+			energyProfiler->Start();
 		}
 
 		// Launch the process
+		ProcessStats stats;
 		if (!ProcessManager::LaunchProcess(
 			options.targetPath,
 			options.targetArgs,
 			options.targetWorkingDir,
-			coreMask)) {
+			coreMask,
+			&stats,
+			monitors,
+			SchedulingResolver::Resolve(options))) {
 			throw std::runtime_error(Utilities::ConvertToNarrowString(
 				L"Failed to launch process"));
 		}
+
+		if (energyProfiler) {
+			g_messageHandler->ShowQueryResult(EnergyProfiler::FormatReport(
+				energyProfiler->Stop(stats.wallSeconds)));
+		}
+
+		if (thermalPolicy) {
+			g_messageHandler->ShowQueryResult(thermalPolicy->FormatTransitions());
+		}
+
+		if (resourceMonitor) {
+			resourceMonitor->WriteResults(options.monitorPath);
+			g_messageHandler->ShowQueryResult(resourceMonitor->FormatSummary());
+		}
+
+		if (schedTrace) {
+			schedTrace->GetTrace().Write(options.schedTracePath);
+			g_messageHandler->ShowInfo(std::format(
+				L"Scheduling trace: {} records written to {}; run caplcli "
+				L"analyze {} for the report",
+				schedTrace->GetTrace().records.size(),
+				options.schedTracePath, options.schedTracePath));
+		}
 	}
 	catch (const std::exception& e) {
 		if (g_logger) {
-			g_logger->Log(ApplicationLogger::Level::ERR,
-				"Fatal error: " + std::string(e.what()));
+			g_logger->Log(ApplicationLogger::Level::ERR, "Fatal error: {}",
+				e.what());
 		}
 		if (g_messageHandler) {
 			g_messageHandler->ShowError(Utilities::ConvertToWideString(e.what()));
@@ -1,9 +1,20 @@
 // utilities.h
 #pragma once
 #include <string>
+#include <string_view>
 #include <fstream>
 #include <memory>
-#include <ctime>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <vector>
 
 namespace Utilities {
 // --------------------------------Defaults----------------------------------
@@ -13,22 +24,214 @@ std::wstring ConvertToWideString(const std::string &utf8);
 std::string ConvertToNarrowString(const std::wstring &wide);
 bool PathExists(const std::wstring &path);
 bool IsDirectory(const std::wstring &path);
+std::string EscapeJson(const std::string &text);
 } // namespace Utilities
 // --------------------------ApplicationLogger ---------------------------
+// Callers only copy a binary record into a fixed, lock-free ring (many
+// producers, one consumer); a background thread timestamps, formats and
+// writes the records in batches. With logging disabled Log() returns after
+// one flag check, before any argument is copied or formatted
+namespace LogArgs {
+// Bounds-checked payload writer; needed counts every byte asked for
+struct Writer {
+    char *pos;
+    char *end;
+    size_t needed = 0;
+    void Put(const void *data, size_t size) {
+        needed += size;
+        if (pos && static_cast<size_t>(end - pos) >= size) {
+            memcpy(pos, data, size);
+            pos += size;
+        } else {
+            pos = nullptr;
+        }
+    }
+    void PutText(const void *data, size_t length, size_t unit) {
+        uint32_t count = static_cast<uint32_t>(length);
+        Put(&count, sizeof(count));
+        Put(data, length * unit);
+    }
+};
+
+struct Reader {
+    const char *pos;
+    void Get(void *data, size_t size) {
+        memcpy(data, pos, size);
+        pos += size;
+    }
+    std::string_view GetText() {
+        uint32_t count;
+        Get(&count, sizeof(count));
+        std::string_view text(pos, count);
+        pos += count;
+        return text;
+    }
+};
+
+// Numbers, enums and pointers are copied as they are
+template <typename T> struct Codec {
+    static_assert(std::is_trivially_copyable_v<T>,
+                  "Log arguments must be strings or trivially copyable");
+    using Decoded = T;
+    static void Encode(Writer &writer, const T &value) {
+        writer.Put(&value, sizeof(value));
+    }
+    static T Decode(Reader &reader) {
+        T value;
+        reader.Get(&value, sizeof(value));
+        return value;
+    }
+};
+
+// Narrow strings are copied and formatted in place
+struct NarrowText {
+    using Decoded = std::string_view;
+    static void Encode(Writer &writer, std::string_view text) {
+        writer.PutText(text.data(), text.size(), sizeof(char));
+    }
+    static std::string_view Decode(Reader &reader) {
+        return reader.GetText();
+    }
+};
+template <> struct Codec<std::string> : NarrowText {};
+template <> struct Codec<std::string_view> : NarrowText {};
+template <> struct Codec<const char *> : NarrowText {};
+template <> struct Codec<char *> : NarrowText {};
+
+// Wide strings are converted to UTF-8 by the flusher, not the caller
+struct WideText {
+    using Decoded = std::string;
+    static void Encode(Writer &writer, std::wstring_view text) {
+        writer.PutText(text.data(), text.size(), sizeof(wchar_t));
+    }
+    static std::string Decode(Reader &reader) {
+        uint32_t count;
+        reader.Get(&count, sizeof(count));
+        std::wstring text(count, L'\0'); // The payload may be unaligned
+        reader.Get(text.data(), count * sizeof(wchar_t));
+        return Utilities::ConvertToNarrowString(text);
+    }
+};
+template <> struct Codec<std::wstring> : WideText {};
+template <> struct Codec<std::wstring_view> : WideText {};
+template <> struct Codec<const wchar_t *> : WideText {};
+template <> struct Codec<wchar_t *> : WideText {};
+
+// The format string is checked against what the flusher formats
+template <typename... Args>
+using Format =
+    std::format_string<typename Codec<std::decay_t<Args>>::Decoded...>;
+} // namespace LogArgs
+
 class ApplicationLogger {
   public:
     enum class Level { INFO, WARNING, ERR, DEBUG };
 
     ApplicationLogger(bool enabled = false,
                       const std::wstring &logPath = L""); // Constructor
-    ~ApplicationLogger();                                 // Destructor
+    ~ApplicationLogger(); // Writes what is left and stops the flusher
+
+    bool IsEnabled() const { return m_enabled; }
 
-    void Log(Level level, const std::string &message);
+    // Nothing is copied when logging is disabled; literals need no string
+    void Log(Level level, std::string_view message);
+
+    // Copies the arguments and formats them on the flusher thread; wide
+    // strings may be passed as they are
+    template <typename... Args>
+        requires(sizeof...(Args) > 0)
+    void Log(Level level, LogArgs::Format<Args...> format, Args &&...args) {
+        if (!m_enabled)
+            return;
+        size_t position;
+        Slot *slot = Claim(position);
+        if (!slot)
+            return;
+
+        LogArgs::Writer writer{slot->payload, slot->payload + PAYLOAD_SIZE};
+        (LogArgs::Codec<std::decay_t<Args>>::Encode(writer, args), ...);
+        if (writer.pos) {
+            slot->formatter = &FormatRecord<std::decay_t<Args>...>;
+            slot->format = format.get();
+            slot->size = static_cast<uint16_t>(writer.pos - slot->payload);
+        } else {
+            // Too big for a slot: format it here and keep what fits
+            std::vector<char> payload(writer.needed);
+            LogArgs::Writer full{payload.data(),
+                                 payload.data() + payload.size()};
+            (LogArgs::Codec<std::decay_t<Args>>::Encode(full, args), ...);
+            std::string text;
+            FormatRecord<std::decay_t<Args>...>(format.get(), payload.data(),
+                                                text);
+            StoreText(slot, text);
+        }
+        Commit(slot, position, level);
+    }
+
+    // Blocks until every record logged so far is written
+    void Flush();
+    // Gives up after timeout and returns false; a thread that died while
+    // logging leaves a record that is never committed
+    bool Flush(std::chrono::milliseconds timeout);
+
+    // Writes what g_logger holds before a std::terminate or an unhandled
+    // SEH exception ends the process; the previous handlers still run
+    static void FlushOnFailure();
+
+    // Records that did not fit into the ring and were dropped
+    uint64_t GetDroppedCount() const { return m_dropped.load(); }
 
   private:
+    static constexpr size_t SLOT_COUNT = 2048; // Power of two
+    static constexpr size_t PAYLOAD_SIZE = 480; // Longer text is cut and marked
+
+    using Formatter = void (*)(std::string_view format, const char *payload,
+                               std::string &out);
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        long long time; // system_clock ticks
+        Level level;
+        uint16_t size;
+        Formatter formatter; // nullptr: payload is the finished message
+        std::string_view format;
+        char payload[PAYLOAD_SIZE];
+    };
+
+    template <typename... Args>
+    static void FormatRecord(std::string_view format, const char *payload,
+                             std::string &out) {
+        LogArgs::Reader reader{payload};
+        // Braced initializers are evaluated left to right
+        std::tuple<typename LogArgs::Codec<Args>::Decoded...> values{
+            LogArgs::Codec<Args>::Decode(reader)...};
+        std::apply(
+            [&](auto &...value) {
+                std::vformat_to(std::back_inserter(out), format,
+                                std::make_format_args(value...));
+            },
+            values);
+    }
+
+    Slot *Claim(size_t &position);
+    void StoreText(Slot *slot, std::string_view text);
+    void Commit(Slot *slot, size_t position, Level level);
+    void RunFlusher();
+    size_t Drain(std::string &batch);
+
     bool m_enabled;
     std::wstring m_logPath;
     std::ofstream m_logFile;
+
+    std::unique_ptr<Slot[]> m_slots;
+    std::atomic<size_t> m_enqueue{0};
+    std::atomic<size_t> m_dequeue{0};  // Only the flusher advances it
+    std::atomic<size_t> m_written{0};  // Records on disk (for Flush)
+    std::atomic<uint64_t> m_dropped{0};
+    std::atomic<bool> m_stopping{false};
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    std::thread m_flusher;
 };
 
 // Global logger instance
@@ -0,0 +1,310 @@
+// affinity.cpp
+#include "pch.h"
+#include "affinity.h"
+#include "cpu.h"
+#include "cpuload.h"
+#include "latency.h"
+#include "process.h"
+#include "profiles.h"
+#include "utilities.h"
+#include <algorithm>
+#include <format>
+
+using Utilities::ConvertToNarrowString;
+
+DWORD_PTR AffinityResolver::Resolve(const CommandLineOptions& options) {
+	if (options.latencyCritical) {
+		return LatencyProfile::GetReservedMask();
+	}
+
+	DWORD_PTR coreMask;
+	if (options.affinityMode == CommandLineOptions::CoreAffinityMode::LEARNED) {
+		coreMask = GetLearnedMask(options);
+	} else if (options.affinityMode ==
+		CommandLineOptions::CoreAffinityMode::IDLE) {
+		coreMask = GetIdleMask(options);
+	} else {
+		coreMask = GetModeMask(options.affinityMode, options.cores);
+	}
+
+	// Apply inversion if requested
+	if (options.invertSelection) {
+		coreMask = InvertMask(coreMask);
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"Inverted core mask: 0x{:X}", coreMask);
+	}
+
+	if (options.llcDomain >= 0) {
+		coreMask = RestrictToCacheDomain(coreMask, options.llcDomain,
+			CpuInfo::GetCacheDomainMasks(3));
+	}
+
+	// A job object or a restricted parent may not allow every processor
+	DWORD_PTR allowed = CpuInfo::GetAllowedMask();
+	if ((coreMask & ~allowed) != 0) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Cores 0x{:X} are outside the allowed set 0x{:X} and were dropped",
+			coreMask & ~allowed, allowed);
+		coreMask &= allowed;
+		if (coreMask == 0) {
+			throw std::runtime_error(ConvertToNarrowString(std::format(
+				L"None of the selected cores is in the allowed set 0x{:X}",
+				allowed)));
+		}
+	}
+
+	// Validate final mask
+	if (coreMask == 0) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Resulting core mask is empty"));
+	}
+
+	return coreMask;
+}
+
+DWORD_PTR AffinityResolver::GetModeMask(
+	CommandLineOptions::CoreAffinityMode mode,
+	const std::vector<int>& cores) {
+
+	switch (mode) {
+	case CommandLineOptions::CoreAffinityMode::P_CORES_ONLY:
+	case CommandLineOptions::CoreAffinityMode::E_CORES_ONLY:
+	case CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY:
+	case CommandLineOptions::CoreAffinityMode::ALL_E_CORES:
+		RequireHybrid();
+		return GetClassMask(mode, CpuInfo::GetCoreTypeMasks());
+
+	case CommandLineOptions::CoreAffinityMode::ALL_CORES:
+		return GetAllCoresMask();
+
+	case CommandLineOptions::CoreAffinityMode::CUSTOM:
+		return CpuInfo::CoreListToMask(cores);
+
+	// Only hints were given (--uclamp-min/--uclamp-max): keep the mask
+	// CAPL itself was started with
+	case CommandLineOptions::CoreAffinityMode::NOT_SET: {
+		DWORD_PTR processMask = 0, systemMask = 0;
+		if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask,
+			&systemMask)) {
+			return GetAllCoresMask();
+		}
+		return processMask;
+	}
+
+	case CommandLineOptions::CoreAffinityMode::LEARNED:
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Learned mode needs the target program to look up its profile"));
+
+	case CommandLineOptions::CoreAffinityMode::IDLE:
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Idle mode needs a core count and a load sample"));
+
+	default:
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Invalid affinity mode"));
+	}
+}
+
+DWORD_PTR AffinityResolver::GetClassMask(
+	CommandLineOptions::CoreAffinityMode mode,
+	const CpuInfo::CoreTypeMasks& types) {
+
+	switch (mode) {
+	case CommandLineOptions::CoreAffinityMode::P_CORES_ONLY:
+		return types.pCoreMask;
+	case CommandLineOptions::CoreAffinityMode::E_CORES_ONLY:
+		return types.eCoreMask;
+	case CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY:
+		return types.lpECoreMask;
+	case CommandLineOptions::CoreAffinityMode::ALL_E_CORES:
+		return types.eCoreMask | types.lpECoreMask;
+	default:
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Not a core class mode: " + GetModeName(mode)));
+	}
+}
+
+DWORD_PTR AffinityResolver::InvertMask(DWORD_PTR mask) {
+	return GetAllCoresMask() & ~mask;
+}
+
+DWORD_PTR AffinityResolver::GetAllCoresMask() {
+	return CpuInfo::GetAllowedMask();
+}
+
+DWORD_PTR AffinityResolver::RestrictToCacheDomain(DWORD_PTR mask,
+	int domain, const std::vector<DWORD_PTR>& domainMasks) {
+	if (domain >= static_cast<int>(domainMasks.size())) {
+		throw std::runtime_error(ConvertToNarrowString(std::format(
+			L"--llc-domain {} does not exist; this CPU has {} L3 domain(s)",
+			domain, domainMasks.size())));
+	}
+	return mask & domainMasks[domain];
+}
+
+std::wstring AffinityResolver::GetModeName(
+	CommandLineOptions::CoreAffinityMode mode) {
+
+	switch (mode) {
+	case CommandLineOptions::CoreAffinityMode::P_CORES_ONLY:
+		return L"p";
+	case CommandLineOptions::CoreAffinityMode::E_CORES_ONLY:
+		return L"e";
+	case CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY:
+		return L"lp";
+	case CommandLineOptions::CoreAffinityMode::ALL_E_CORES:
+		return L"alle";
+	case CommandLineOptions::CoreAffinityMode::ALL_CORES:
+		return L"all";
+	case CommandLineOptions::CoreAffinityMode::LEARNED:
+		return L"learned";
+	case CommandLineOptions::CoreAffinityMode::IDLE:
+		return L"idle";
+	case CommandLineOptions::CoreAffinityMode::CUSTOM:
+		return L"cores";
+	default:
+		return L"unset";
+	}
+}
+
+DWORD_PTR AffinityResolver::GetLearnedMask(const CommandLineOptions& options) {
+	std::wstring database = options.profilePath.empty()
+		? ProfileStore::GetDefaultPath() : options.profilePath;
+	std::wstring executable =
+		ProcessManager::ResolveExecutablePath(options.targetPath);
+
+	auto profile = ProfileStore::Load(database, executable);
+	if (!profile) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"No learned profile for " + executable +
+			L"; run with --tune first"));
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Using learned profile '{}' mask: 0x{:X}", profile->label,
+		profile->mask);
+	return profile->mask;
+}
+
+DWORD_PTR AffinityResolver::GetIdleMask(const CommandLineOptions& options) {
+	DWORD_PTR classMask = GetModeMask(options.idleClass, {});
+
+	CpuLoadSampler sampler;
+	Sleep(options.idleWindowMs);
+	auto busy = sampler.Sample();
+
+	DWORD_PTR mask = PickIdlestCores(busy, classMask, options.idleCoreCount,
+		CpuInfo::GetPhysicalCoreMasks(), CpuInfo::GetCacheDomainMasks(3));
+	if (CpuInfo::CountBits(mask) < options.idleCoreCount) {
+		throw std::runtime_error(ConvertToNarrowString(std::format(
+			L"--mode idle:{} needs more cores than the {} in 0x{:X}",
+			options.idleCoreCount, CpuInfo::CountBits(classMask), classMask)));
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Idlest {} core(s) over {} ms: 0x{:X} ({:.1f}% busy on average)",
+		options.idleCoreCount, options.idleWindowMs, mask,
+		CpuLoadSampler::Average(busy, mask) * 100.0);
+	return mask;
+}
+
+DWORD_PTR AffinityResolver::PickIdlestCores(const std::vector<double>& busy,
+	DWORD_PTR classMask, int count,
+	const std::vector<DWORD_PTR>& physicalCores,
+	const std::vector<DWORD_PTR>& cacheDomains) {
+
+	// Prefer a single L3 domain that can hold the whole selection
+	DWORD_PTR best = 0;
+	double bestCost = 0.0;
+	for (DWORD_PTR domain : cacheDomains) {
+		if (CpuInfo::CountBits(classMask & domain) < count) {
+			continue;
+		}
+		double cost = 0.0;
+		DWORD_PTR mask = RankIdlestCores(busy, classMask & domain, count,
+			physicalCores, cost);
+		if (best == 0 || cost < bestCost) {
+			best = mask;
+			bestCost = cost;
+		}
+	}
+	if (best != 0) {
+		return best;
+	}
+
+	double cost = 0.0;
+	return RankIdlestCores(busy, classMask, count, physicalCores, cost);
+}
+
+DWORD_PTR AffinityResolver::RankIdlestCores(const std::vector<double>& busy,
+	DWORD_PTR classMask, int count,
+	const std::vector<DWORD_PTR>& physicalCores, double& cost) {
+
+	auto load = [&busy](int cpu) {
+		return cpu < static_cast<int>(busy.size()) ? busy[cpu] : 1.0;
+	};
+	auto coreLoad = [&load](DWORD_PTR core) {
+		double sum = 0.0;
+		for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); cpu++) {
+			if (core & (DWORD_PTR(1) << cpu)) {
+				sum += load(cpu);
+			}
+		}
+		return sum;
+	};
+
+	// First pass ranks physical cores, second pass the leftover threads
+	std::vector<std::pair<double, int>> primary;
+	std::vector<std::pair<double, int>> siblings;
+	DWORD_PTR covered = 0;
+	for (DWORD_PTR core : physicalCores) {
+		DWORD_PTR threads = core & classMask;
+		covered |= core;
+		if (threads == 0) {
+			continue;
+		}
+		int idlest = -1;
+		for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); cpu++) {
+			if (threads & (DWORD_PTR(1) << cpu)) {
+				if (idlest < 0 || load(cpu) < load(idlest)) {
+					if (idlest >= 0) {
+						siblings.push_back({ load(idlest), idlest });
+					}
+					idlest = cpu;
+				} else {
+					siblings.push_back({ load(cpu), cpu });
+				}
+			}
+		}
+		primary.push_back({ coreLoad(core), idlest });
+	}
+	// Processors missing from the topology count as cores of their own
+	for (int cpu = 0; cpu < static_cast<int>(sizeof(DWORD_PTR) * 8); cpu++) {
+		DWORD_PTR bit = DWORD_PTR(1) << cpu;
+		if ((classMask & bit) && !(covered & bit)) {
+			primary.push_back({ load(cpu), cpu });
+		}
+	}
+	std::sort(primary.begin(), primary.end());
+	std::sort(siblings.begin(), siblings.end());
+	primary.insert(primary.end(), siblings.begin(), siblings.end());
+
+	DWORD_PTR mask = 0;
+	cost = 0.0;
+	for (const auto& [score, cpu] : primary) {
+		if (CpuInfo::CountBits(mask) >= count) {
+			break;
+		}
+		mask |= DWORD_PTR(1) << cpu;
+		cost += score;
+	}
+	return mask;
+}
+
+void AffinityResolver::RequireHybrid() {
+	auto caps = CpuInfo::GetCapabilities();
+	if (!caps.isHybrid || !caps.supportsLeaf1A) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"This CPU does not support hybrid architecture"));
+	}
+}
@@ -0,0 +1,40 @@
+// affinity.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "cpu.h"
+
+// Turns the affinity options from the command line into a process mask
+class AffinityResolver {
+public:
+    static DWORD_PTR Resolve(const CommandLineOptions& options);
+    static DWORD_PTR GetModeMask(
+        CommandLineOptions::CoreAffinityMode mode,
+        const std::vector<int>& cores);
+    // The mask of a core class mode (p, e, lp, alle) within types
+    static DWORD_PTR GetClassMask(CommandLineOptions::CoreAffinityMode mode,
+        const CpuInfo::CoreTypeMasks& types);
+    static DWORD_PTR InvertMask(DWORD_PTR mask);
+    static DWORD_PTR GetAllCoresMask();
+    static std::wstring GetModeName(CommandLineOptions::CoreAffinityMode mode);
+    // Keeps the part of mask that shares the given L3 instance
+    static DWORD_PTR RestrictToCacheDomain(DWORD_PTR mask, int domain,
+        const std::vector<DWORD_PTR>& domainMasks);
+    // The count least-busy threads of classMask: one per physical core
+    // (ranked by the load of the whole core) before any SMT sibling, from
+    // the cheapest single cache domain that has enough of them
+    static DWORD_PTR PickIdlestCores(const std::vector<double>& busy,
+        DWORD_PTR classMask, int count,
+        const std::vector<DWORD_PTR>& physicalCores,
+        const std::vector<DWORD_PTR>& cacheDomains);
+
+private:
+    static DWORD_PTR GetLearnedMask(const CommandLineOptions& options);
+    static DWORD_PTR GetIdleMask(const CommandLineOptions& options);
+    static DWORD_PTR RankIdlestCores(const std::vector<double>& busy,
+        DWORD_PTR classMask, int count,
+        const std::vector<DWORD_PTR>& physicalCores, double& cost);
+    static void RequireHybrid();
+};
@@ -0,0 +1,343 @@
+// benchmark.cpp
+#include "pch.h"
+#include "benchmark.h"
+#include "affinity.h"
+#include "energy.h"
+#include "process.h"
+#include "scheduling.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+
+using Utilities::ConvertToNarrowString;
+
+std::vector<Benchmark::RunResult> Benchmark::Run(
+	const CommandLineOptions& options) {
+
+	struct PlannedRun {
+		CommandLineOptions::CoreAffinityMode mode;
+		DWORD_PTR mask;
+		int iteration;
+	};
+
+	// --cores leaves benchmarkModes empty, so fall back to the single mode
+	std::vector<CommandLineOptions::CoreAffinityMode> modes =
+		options.benchmarkModes;
+	if (modes.empty()) {
+		modes.push_back(options.affinityMode);
+	}
+
+	// Resolve every mask up front so a bad mode fails before any run
+	std::vector<PlannedRun> warmups;
+	std::vector<PlannedRun> measured;
+	for (auto mode : modes) {
+		CommandLineOptions modeOptions = options;
+		modeOptions.affinityMode = mode;
+		DWORD_PTR mask = AffinityResolver::Resolve(modeOptions);
+
+		for (int i = 0; i < options.warmupCount; i++) {
+			warmups.push_back({ mode, mask, i });
+		}
+		for (int i = 0; i < options.repeatCount; i++) {
+			measured.push_back({ mode, mask, i });
+		}
+	}
+
+	if (options.shuffleRuns) {
+		std::random_device seed;
+		std::mt19937 generator(seed());
+		std::shuffle(measured.begin(), measured.end(), generator);
+	}
+
+	std::unique_ptr<EnergyMeter> meter;
+	if (options.measureEnergy) {
+		meter = EmiEnergyMeter::Open();
+	}
+
+	bool cacheWarningShown = false;
+	EnergyReport energy;
+	SchedulingSettings scheduling = SchedulingResolver::Resolve(options);
+	auto launch = [&](const PlannedRun& run) {
+		if (options.dropCache && !DropFileCache() && !cacheWarningShown) {
+			cacheWarningShown = true;
+			g_logger->Log(ApplicationLogger::Level::WARNING,
+				"Could not purge the file cache; run as administrator");
+			if (g_messageHandler) {
+				g_messageHandler->ShowInfo(
+					L"Warning: could not purge the file cache "
+					L"(requires administrator rights)");
+			}
+		}
+
+		std::unique_ptr<EnergyProfiler> profiler;
+		if (meter) {
+			profiler = std::make_unique<EnergyProfiler>(*meter);
+			profiler->Start();
+		}
+
+		ProcessStats stats;
+		if (!ProcessManager::LaunchProcess(
+			options.targetPath,
+			options.targetArgs,
+			options.targetWorkingDir,
+			run.mask,
+			&stats,
+			{},
+			scheduling)) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"Failed to launch process"));
+		}
+
+		if (profiler) {
+			energy = profiler->Stop(stats.wallSeconds);
+		}
+		return stats;
+	};
+
+	for (const auto& run : warmups) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"Warm-up run {} for mode {}", run.iteration + 1,
+			AffinityResolver::GetModeName(run.mode));
+		launch(run);
+	}
+
+	std::vector<RunResult> results;
+	results.reserve(measured.size());
+	for (const auto& run : measured) {
+		ProcessStats stats = launch(run);
+
+		RunResult result;
+		result.modeName = AffinityResolver::GetModeName(run.mode);
+		result.mask = run.mask;
+		result.iteration = run.iteration;
+		result.exitCode = stats.exitCode;
+		result.wallSeconds = stats.wallSeconds;
+		result.cpuSeconds = stats.userSeconds + stats.kernelSeconds;
+		if (meter) {
+			result.hasEnergy = true;
+			result.energyJoules = energy.packageJoules;
+			result.energyDelay = energy.energyDelay;
+		}
+		results.push_back(result);
+
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"Run {} ({}): wall {:.6f}s, cpu {:.6f}s, exit {}",
+			run.iteration + 1, result.modeName, result.wallSeconds,
+			result.cpuSeconds, result.exitCode);
+	}
+
+	return results;
+}
+
+std::wstring Benchmark::FormatReport(const std::vector<RunResult>& runs) {
+	// Keep modes in the order they were first measured
+	std::vector<std::wstring> modeOrder;
+	std::map<std::wstring, std::vector<const RunResult*>> byMode;
+	for (const auto& run : runs) {
+		if (byMode.find(run.modeName) == byMode.end()) {
+			modeOrder.push_back(run.modeName);
+		}
+		byMode[run.modeName].push_back(&run);
+	}
+
+	std::wstringstream ss;
+	ss << L"\nBenchmark Results:\n";
+
+	for (const auto& modeName : modeOrder) {
+		const auto& modeRuns = byMode[modeName];
+		std::vector<double> wall, cpu, energy, energyDelay;
+		int failures = 0;
+		for (const auto* run : modeRuns) {
+			wall.push_back(run->wallSeconds);
+			cpu.push_back(run->cpuSeconds);
+			if (run->hasEnergy) {
+				energy.push_back(run->energyJoules);
+				energyDelay.push_back(run->energyDelay);
+			}
+			if (run->exitCode != 0) {
+				failures++;
+			}
+		}
+
+		ss << std::format(L"\nMode: {} (mask 0x{:X}, {} runs",
+			modeName, modeRuns.front()->mask, modeRuns.size());
+		if (failures > 0) {
+			ss << std::format(L", {} with non-zero exit code", failures);
+		}
+		ss << L")\n";
+		ss << std::format(L"  {:<6} {:>10} {:>10} {:>10} {:>10} {:>10} "
+			L"{:>10} {:>10}  {}\n", L"", L"mean", L"median", L"stddev",
+			L"min", L"max", L"p95", L"p99", L"95% CI");
+
+		auto printRow = [&ss](const wchar_t* label, const SampleStatistics& s) {
+			ss << std::format(L"  {:<6} {:>10.4f} {:>10.4f} {:>10.4f} "
+				L"{:>10.4f} {:>10.4f} {:>10.4f} {:>10.4f}  [{:.4f}, {:.4f}]\n",
+				label, s.mean, s.median, s.stddev, s.min, s.max, s.p95, s.p99,
+				s.ciLow, s.ciHigh);
+		};
+		printRow(L"wall", ComputeStatistics(wall));
+		printRow(L"cpu", ComputeStatistics(cpu));
+		if (!energy.empty()) {
+			printRow(L"joule", ComputeStatistics(energy));
+			printRow(L"edp", ComputeStatistics(energyDelay));
+		}
+	}
+
+	return ss.str();
+}
+
+void Benchmark::WriteResults(
+	const std::wstring& path,
+	const std::vector<RunResult>& runs) {
+
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("Cannot write results file: " +
+			ConvertToNarrowString(path));
+	}
+
+	if (path.ends_with(L".json")) {
+		out << "{\n  \"runs\": [\n";
+		for (size_t i = 0; i < runs.size(); i++) {
+			const auto& run = runs[i];
+			out << std::format("    {{\"mode\": \"{}\", \"mask\": \"0x{:X}\", "
+				"\"iteration\": {}, \"exitCode\": {}, \"wallSeconds\": {:.6f}, "
+				"\"cpuSeconds\": {:.6f}",
+				Utilities::EscapeJson(ConvertToNarrowString(run.modeName)),
+				run.mask, run.iteration, run.exitCode, run.wallSeconds,
+				run.cpuSeconds);
+			if (run.hasEnergy) {
+				out << std::format(", \"energyJoules\": {:.6f}, "
+					"\"energyDelay\": {:.6f}", run.energyJoules,
+					run.energyDelay);
+			}
+			out << "}" << (i + 1 < runs.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+	} else {
+		bool hasEnergy = !runs.empty() && runs.front().hasEnergy;
+		out << "mode,mask,iteration,exit_code,wall_seconds,cpu_seconds"
+			<< (hasEnergy ? ",energy_joules,energy_delay" : "") << "\n";
+		for (const auto& run : runs) {
+			out << std::format("{},0x{:X},{},{},{:.6f},{:.6f}",
+				ConvertToNarrowString(run.modeName), run.mask, run.iteration,
+				run.exitCode, run.wallSeconds, run.cpuSeconds);
+			if (hasEnergy) {
+				out << std::format(",{:.6f},{:.6f}", run.energyJoules,
+					run.energyDelay);
+			}
+			out << "\n";
+		}
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Benchmark results written to {}", path);
+}
+
+SampleStatistics Benchmark::ComputeStatistics(std::vector<double> samples) {
+	SampleStatistics stats;
+	stats.count = samples.size();
+	if (samples.empty()) {
+		return stats;
+	}
+
+	std::sort(samples.begin(), samples.end());
+	stats.min = samples.front();
+	stats.max = samples.back();
+	stats.median = Percentile(samples, 50.0);
+	stats.p95 = Percentile(samples, 95.0);
+	stats.p99 = Percentile(samples, 99.0);
+
+	double sum = 0.0;
+	for (double value : samples) {
+		sum += value;
+	}
+	stats.mean = sum / samples.size();
+
+	if (samples.size() > 1) {
+		double squares = 0.0;
+		for (double value : samples) {
+			squares += (value - stats.mean) * (value - stats.mean);
+		}
+		stats.stddev = std::sqrt(squares / (samples.size() - 1));
+	}
+
+	double halfWidth = samples.size() > 1
+		? StudentT95(samples.size() - 1) * stats.stddev /
+		  std::sqrt(static_cast<double>(samples.size()))
+		: 0.0;
+	stats.ciLow = stats.mean - halfWidth;
+	stats.ciHigh = stats.mean + halfWidth;
+
+	return stats;
+}
+
+// Linear interpolation between closest ranks; expects sorted input
+double Benchmark::Percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) {
+		return 0.0;
+	}
+	double rank = (p / 100.0) * (sorted.size() - 1);
+	size_t lower = static_cast<size_t>(rank);
+	size_t upper = (std::min)(lower + 1, sorted.size() - 1);
+	double fraction = rank - lower;
+	return sorted[lower] + (sorted[upper] - sorted[lower]) * fraction;
+}
+
+// Two-sided 95% critical values of Student's t distribution
+double Benchmark::StudentT95(size_t degreesOfFreedom) {
+	static const double table[] = {
+		12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+		2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+		2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+	};
+	if (degreesOfFreedom == 0) {
+		return 0.0;
+	}
+	if (degreesOfFreedom <= std::size(table)) {
+		return table[degreesOfFreedom - 1];
+	}
+	return 1.960;
+}
+
+bool Benchmark::DropFileCache() {
+	// Purging the standby list needs SeProfileSingleProcessPrivilege
+	HANDLE token;
+	if (!OpenProcessToken(GetCurrentProcess(),
+		TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+		return false;
+	}
+	TOKEN_PRIVILEGES privileges = {};
+	privileges.PrivilegeCount = 1;
+	privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+	bool privileged =
+		LookupPrivilegeValueW(NULL, SE_PROF_SINGLE_PROCESS_NAME,
+			&privileges.Privileges[0].Luid) &&
+		AdjustTokenPrivileges(token, FALSE, &privileges, 0, NULL, NULL) &&
+		GetLastError() == ERROR_SUCCESS;
+	CloseHandle(token);
+	if (!privileged) {
+		return false;
+	}
+
+	using NtSetSystemInformationFn = LONG(WINAPI*)(INT, PVOID, ULONG);
+	auto ntSetSystemInformation = reinterpret_cast<NtSetSystemInformationFn>(
+		GetProcAddress(GetModuleHandleW(L"ntdll.dll"),
+			"NtSetSystemInformation"));
+	if (!ntSetSystemInformation) {
+		return false;
+	}
+
+	const INT SystemMemoryListInformation = 80;
+	INT command = 3;  // MemoryFlushModifiedList
+	ntSetSystemInformation(SystemMemoryListInformation, &command,
+		sizeof(command));
+	command = 4;      // MemoryPurgeStandbyList
+	return ntSetSystemInformation(SystemMemoryListInformation, &command,
+		sizeof(command)) >= 0;
+}
@@ -0,0 +1,48 @@
+// benchmark.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "options.h"
+
+// Summary of a set of measurements (seconds)
+struct SampleStatistics {
+    size_t count = 0;
+    double mean = 0.0;
+    double median = 0.0;
+    double stddev = 0.0;  // Sample standard deviation
+    double min = 0.0;
+    double max = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double ciLow = 0.0;   // 95% confidence interval of the mean
+    double ciHigh = 0.0;
+};
+
+class Benchmark {
+public:
+    struct RunResult {
+        std::wstring modeName;
+        DWORD_PTR mask = 0;
+        int iteration = 0;
+        DWORD exitCode = 0;
+        double wallSeconds = 0.0;
+        double cpuSeconds = 0.0;
+        bool hasEnergy = false;    // Set when run with --energy
+        double energyJoules = 0.0; // Package energy
+        double energyDelay = 0.0;  // Energy-delay product (J*s)
+    };
+
+    static std::vector<RunResult> Run(const CommandLineOptions& options);
+    static std::wstring FormatReport(const std::vector<RunResult>& runs);
+    static void WriteResults(
+        const std::wstring& path,
+        const std::vector<RunResult>& runs);
+
+    static SampleStatistics ComputeStatistics(std::vector<double> samples);
+    static double Percentile(const std::vector<double>& sorted, double p);
+    static bool DropFileCache();
+
+private:
+    static double StudentT95(size_t degreesOfFreedom);
+};
@@ -2,11 +2,18 @@
 #include "pch.h"
 #include "cpu.h"
 #include "utilities.h"
+#include "trace.h"
 #include <intrin.h>
+#include <powerbase.h>
 #include <sstream>
+#include <cstring>
 #include <format>
+#include <mutex>
+
+#pragma comment(lib, "powrprof.lib")
 
 CpuInfo::CpuCapabilities CpuInfo::GetCapabilities() {
+	PhaseTrace::Scope trace("CPUID brand and leaves");
 	CpuCapabilities caps = {};  // Initialize all members to 0/false/empty
 	int cpuInfo[4] = { 0 };
 
@@ -33,9 +40,10 @@ CpuInfo::CpuCapabilities CpuInfo::GetCapabilities() {
 
 	// Detect core types if leaf 0x1A is supported
 	if (caps.supportsLeaf1A) {
-		caps.pCoreMask = GetPCoreMask();
-		caps.eCoreMask = GetECoreMask();
-		caps.lpECoreMask = GetLpECoreMask();
+		auto masks = GetCoreTypeMasks();
+		caps.pCoreMask = masks.pCoreMask;
+		caps.eCoreMask = masks.eCoreMask;
+		caps.lpECoreMask = masks.lpECoreMask;
 		caps.isHybrid = (caps.pCoreMask != 0);
 	}
 
@@ -83,91 +91,174 @@ std::wstring CpuInfo::GetDetailedInfo() {
 }
 
 DWORD_PTR CpuInfo::GetPCoreMask() {
-    int cpuInfo[4] = {0};
-    DWORD_PTR mask = 0;
-    
-    SYSTEM_INFO sysInfo;
-    GetSystemInfo(&sysInfo);
-    
-    for (DWORD i = 0; i < sysInfo.dwNumberOfProcessors; i++) {
-        DWORD_PTR threadMask = 1ULL << i;
-        SetThreadAffinityMask(GetCurrentThread(), threadMask);
-        Sleep(0);
-        
-        ExecuteCpuid(cpuInfo, 0x1A, 0);
-        uint32_t coreType = (cpuInfo[0] >> 24) & 0xFF;
-        
-        if (coreType == 0x40) {
-            mask |= threadMask;
-        }
-    }
-    
-    SetThreadAffinityMask(GetCurrentThread(), 
-        (1ULL << sysInfo.dwNumberOfProcessors) - 1);
-    
-    return mask;
+	return GetCoreTypeMasks().pCoreMask;
 }
 
 DWORD_PTR CpuInfo::GetECoreMask() {
-	int cpuInfo[4] = { 0 };
-	DWORD_PTR mask = 0;
-
-	SYSTEM_INFO sysInfo;
-	GetSystemInfo(&sysInfo);
+	return GetCoreTypeMasks().eCoreMask;
+}
 
-	for (DWORD i = 0; i < sysInfo.dwNumberOfProcessors; i++) {
-		DWORD_PTR threadMask = 1ULL << i;
-		SetThreadAffinityMask(GetCurrentThread(), threadMask);
-		Sleep(0);
+DWORD_PTR CpuInfo::GetLpECoreMask() {
+	return GetCoreTypeMasks().lpECoreMask;
+}
 
-		// Check if it's an E-core
-		ExecuteCpuid(cpuInfo, 0x1A, 0);
-		uint32_t coreType = (cpuInfo[0] >> 24) & 0xFF;
+CpuInfo::CoreTypeMasks CpuInfo::GetCoreTypeMasks() {
+	const CpuModel* model;
+	return GetCoreTypeMasks(model);
+}
 
-		if (coreType == 0x20) {  // If it's an E-core
-			// Make sure it's not an LP-core
-			ExecuteCpuid(cpuInfo, 0x1F, 0);
-			if (!(cpuInfo[3] & 0x40)) {  // Check if bit 6 is NOT set
-				mask |= threadMask;
+// Probing moves this thread across every processor, so the result is kept
+// for later launches (and the daemon) until the allowed set changes; the
+// model table match is kept with it
+CpuInfo::CoreTypeMasks CpuInfo::GetCoreTypeMasks(const CpuModel*& knownModel) {
+	static std::mutex lock;
+	static bool valid = false;
+	static DWORD_PTR probedAllowed = 0;
+	static CoreTypeMasks masks = {};
+	static const CpuModel* model = nullptr;
+
+	DWORD_PTR allowed = GetAllowedMask();
+	std::lock_guard<std::mutex> guard(lock);
+	if (!valid || probedAllowed != allowed) {
+		// Known SKUs need no sweep; their layout comes from the model table
+		CpuModels::Layout layout;
+		model = MatchModel(layout);
+		if (model) {
+			masks = { layout.pCoreMask & allowed, layout.eCoreMask & allowed,
+				layout.lpECoreMask & allowed };
+			if (g_logger) {
+				g_logger->Log(ApplicationLogger::Level::INFO,
+					"Core types of {} from the model table", model->name);
 			}
+		} else {
+			masks = ProbeCoreTypes(allowed);
 		}
+		probedAllowed = allowed;
+		valid = true;
 	}
+	knownModel = model;
+	return masks;
+}
 
-	SetThreadAffinityMask(GetCurrentThread(),
-		(1ULL << sysInfo.dwNumberOfProcessors) - 1);
+CpuSignature CpuInfo::GetSignature() {
+	CpuSignature signature;
+	int cpuInfo[4] = { 0 };
+	ExecuteCpuid(cpuInfo, 0, 0);
+	char vendor[13] = {};
+	memcpy(vendor, &cpuInfo[1], 4);
+	memcpy(vendor + 4, &cpuInfo[3], 4);
+	memcpy(vendor + 8, &cpuInfo[2], 4);
+	signature.intel = strcmp(vendor, "GenuineIntel") == 0;
+
+	ExecuteCpuid(cpuInfo, 1, 0);
+	uint32_t eax = static_cast<uint32_t>(cpuInfo[0]);
+	signature.stepping = eax & 0xF;
+	signature.model = (eax >> 4) & 0xF;
+	signature.family = (eax >> 8) & 0xF;
+	if (signature.family == 6 || signature.family == 15) {
+		signature.model += ((eax >> 16) & 0xF) << 4;
+	}
+	if (signature.family == 15) {
+		signature.family += (eax >> 20) & 0xFF;
+	}
+	return signature;
+}
 
-	return mask;
+const CpuModel* CpuInfo::GetKnownModel() {
+	const CpuModel* model;
+	GetCoreTypeMasks(model);
+	return model;
 }
 
-DWORD_PTR CpuInfo::GetLpECoreMask() {
-	int cpuInfo[4] = { 0 };
-	DWORD_PTR mask = 0;
+const CpuModel* CpuInfo::MatchModel(CpuModels::Layout& layout) {
+	PhaseTrace::Scope trace("CPU model table");
+	CpuSignature signature = GetSignature();
+	if (!signature.intel) {
+		return nullptr;
+	}
+	auto cores = GetPhysicalCores();
+	int logicalProcessors = 0;
+	for (const auto& core : cores) {
+		logicalProcessors += CountBits(core.mask);
+	}
 
-	SYSTEM_INFO sysInfo;
-	GetSystemInfo(&sysInfo);
+	// A VM or a disabled core changes the counts; such machines are probed
+	const CpuModel* model = CpuModels::Find(signature.family, signature.model,
+		signature.stepping, static_cast<int>(cores.size()), logicalProcessors);
+	if (!model || !CpuModels::BuildLayout(*model, cores, layout)) {
+		return nullptr;
+	}
+	return model;
+}
 
-	for (DWORD i = 0; i < sysInfo.dwNumberOfProcessors; i++) {
-		DWORD_PTR threadMask = 1ULL << i;
-		SetThreadAffinityMask(GetCurrentThread(), threadMask);
+CpuInfo::CoreTypeMasks CpuInfo::ProbeCoreTypes(DWORD_PTR allowed) {
+	PhaseTrace::Scope trace("CPUID core type sweep");
+	int cpuInfo[4] = { 0 };
+	CoreTypeMasks masks = {};
+	DWORD_PTR previous = 0;
+
+	// CPUID can only run on processors this process is allowed to use
+	for (DWORD i = 0; i < sizeof(DWORD_PTR) * 8; i++) {
+		DWORD_PTR threadMask = DWORD_PTR(1) << i;
+		if (!(allowed & threadMask)) {
+			continue;
+		}
+		DWORD_PTR old = SetThreadAffinityMask(GetCurrentThread(), threadMask);
+		if (previous == 0) {
+			previous = old;
+		}
 		Sleep(0);
 
-		// Check if it's an E-core first
 		ExecuteCpuid(cpuInfo, 0x1A, 0);
 		uint32_t coreType = (cpuInfo[0] >> 24) & 0xFF;
 
-		if (coreType == 0x20) {  // If it's an E-core
-			// Check leaf 0x1F for LP-core signature
+		if (coreType == 0x40) {
+			masks.pCoreMask |= threadMask;
+		} else if (coreType == 0x20) {
+			// Leaf 0x1F bit 6 marks the LP E-cores
 			ExecuteCpuid(cpuInfo, 0x1F, 0);
-			if (cpuInfo[3] & 0x40) {  // Check if bit 6 is set
-				mask |= threadMask;
+			if (cpuInfo[3] & 0x40) {
+				masks.lpECoreMask |= threadMask;
+			} else {
+				masks.eCoreMask |= threadMask;
 			}
 		}
 	}
 
-	SetThreadAffinityMask(GetCurrentThread(),
-		(1ULL << sysInfo.dwNumberOfProcessors) - 1);
+	if (previous != 0) {
+		SetThreadAffinityMask(GetCurrentThread(), previous);
+	}
+	return masks;
+}
 
-	return mask;
+DWORD_PTR CpuInfo::GetSystemMask() {
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	// Shifting by the full width is undefined, so 64 processors need care
+	return sysInfo.dwNumberOfProcessors >= sizeof(DWORD_PTR) * 8
+		? ~DWORD_PTR(0)
+		: (DWORD_PTR(1) << sysInfo.dwNumberOfProcessors) - 1;
+}
+
+DWORD_PTR CpuInfo::GetAllowedMask() {
+	PhaseTrace::Scope trace("Allowed processors");
+	DWORD_PTR processMask = 0, systemMask = 0;
+	if (!GetProcessAffinityMask(GetCurrentProcess(), &processMask,
+		&systemMask) || processMask == 0) {
+		processMask = GetSystemMask();
+	}
+
+	// A job affinity limit also binds processes started later in the job
+	BOOL inJob = FALSE;
+	JOBOBJECT_BASIC_LIMIT_INFORMATION limits = {};
+	if (IsProcessInJob(GetCurrentProcess(), NULL, &inJob) && inJob &&
+		QueryInformationJobObject(NULL, JobObjectBasicLimitInformation,
+			&limits, sizeof(limits), NULL) &&
+		(limits.LimitFlags & JOB_OBJECT_LIMIT_AFFINITY) &&
+		(processMask & limits.Affinity) != 0) {
+		processMask &= limits.Affinity;
+	}
+	return processMask;
 }
 
 DWORD_PTR CpuInfo::CoreListToMask(const std::vector<int>& cores) {
@@ -178,6 +269,171 @@ DWORD_PTR CpuInfo::CoreListToMask(const std::vector<int>& cores) {
 	return mask;
 }
 
+std::vector<DWORD_PTR> CpuInfo::GetPhysicalCoreMasks() {
+	std::vector<DWORD_PTR> coreMasks;
+	for (const auto& core : GetPhysicalCores()) {
+		coreMasks.push_back(core.mask);
+	}
+	return coreMasks;
+}
+
+std::vector<CpuModels::Core> CpuInfo::GetPhysicalCores() {
+	PhaseTrace::Scope trace("Physical core masks");
+	std::vector<CpuModels::Core> cores;
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationProcessorCore, nullptr, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return cores;
+	}
+
+	std::vector<BYTE> buffer(length);
+	auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+		buffer.data());
+	if (!GetLogicalProcessorInformationEx(RelationProcessorCore, info, &length)) {
+		return cores;
+	}
+
+	for (DWORD offset = 0; offset < length;) {
+		auto entry = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+			buffer.data() + offset);
+		// Masks are per processor group; CAPL only handles group 0
+		if (entry->Processor.GroupMask[0].Group == 0) {
+			cores.push_back({ entry->Processor.GroupMask[0].Mask,
+				entry->Processor.EfficiencyClass });
+		}
+		offset += entry->Size;
+	}
+
+	return cores;
+}
+
+DWORD_PTR CpuInfo::RemoveSmtSiblings(DWORD_PTR mask) {
+	return RemoveSmtSiblings(mask, GetPhysicalCoreMasks());
+}
+
+DWORD_PTR CpuInfo::RemoveSmtSiblings(DWORD_PTR mask,
+	const std::vector<DWORD_PTR>& coreMasks) {
+	DWORD_PTR result = 0;
+	for (DWORD_PTR coreMask : coreMasks) {
+		DWORD_PTR threads = coreMask & mask;
+		if (threads != 0) {
+			result |= threads & (~threads + 1);  // Lowest set bit
+		}
+	}
+	return result;
+}
+
+std::vector<DWORD_PTR> CpuInfo::GetCacheDomainMasks(BYTE level) {
+	std::vector<DWORD_PTR> masks;
+	for (const auto& domain : GetCacheDomains(level)) {
+		masks.push_back(domain.mask);
+	}
+	return masks;
+}
+
+std::vector<CpuInfo::CacheDomain> CpuInfo::GetCacheDomains(BYTE level) {
+	PhaseTrace::Scope trace("Cache domains");
+	std::vector<CacheDomain> domains;
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationCache, nullptr, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return domains;
+	}
+
+	std::vector<BYTE> buffer(length);
+	auto info = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+		buffer.data());
+	if (!GetLogicalProcessorInformationEx(RelationCache, info, &length)) {
+		return domains;
+	}
+
+	for (DWORD offset = 0; offset < length;) {
+		auto entry = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+			buffer.data() + offset);
+		const CACHE_RELATIONSHIP& cache = entry->Cache;
+		// Instruction caches would duplicate the L1 data domains
+		if (cache.Level == level && cache.Type != CacheInstruction &&
+			cache.GroupMask.Group == 0) {
+			domains.push_back({ cache.GroupMask.Mask, cache.CacheSize });
+		}
+		offset += entry->Size;
+	}
+
+	return domains;
+}
+
+int CpuInfo::CountBits(DWORD_PTR mask) {
+	int count = 0;
+	while (mask) {
+		mask &= mask - 1;
+		count++;
+	}
+	return count;
+}
+
+// Layout returned by CallNtPowerInformation(ProcessorInformation); the
+// SDK documents it but does not declare it
+struct ProcessorPowerInformation {
+	ULONG Number;
+	ULONG MaxMhz;
+	ULONG CurrentMhz;
+	ULONG MhzLimit;
+	ULONG MaxIdleState;
+	ULONG CurrentIdleState;
+};
+
+std::vector<CpuInfo::ProcessorFrequency> CpuInfo::GetProcessorFrequencies() {
+	std::vector<ProcessorFrequency> frequencies;
+	std::vector<BYTE> buffer;
+	GetProcessorFrequencies(frequencies, buffer);
+	return frequencies;
+}
+
+void CpuInfo::GetProcessorFrequencies(
+	std::vector<ProcessorFrequency>& frequencies, std::vector<BYTE>& buffer) {
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	buffer.resize(sysInfo.dwNumberOfProcessors *
+		sizeof(ProcessorPowerInformation));
+
+	frequencies.clear();
+	if (CallNtPowerInformation(ProcessorInformation, NULL, 0,
+		buffer.data(), static_cast<ULONG>(buffer.size())) != 0) {
+		return;
+	}
+	auto processors = reinterpret_cast<const ProcessorPowerInformation*>(
+		buffer.data());
+	for (DWORD i = 0; i < sysInfo.dwNumberOfProcessors; i++) {
+		frequencies.push_back({ processors[i].Number, processors[i].MaxMhz,
+			processors[i].CurrentMhz, processors[i].MhzLimit });
+	}
+}
+
+std::vector<BYTE> CpuInfo::GetEfficiencyClasses() {
+	PhaseTrace::Scope trace("Efficiency classes");
+	std::vector<BYTE> classes(sizeof(DWORD_PTR) * 8, 0);
+	ULONG length = 0;
+	GetSystemCpuSetInformation(NULL, 0, &length, GetCurrentProcess(), 0);
+	std::vector<BYTE> buffer(length);
+	if (!GetSystemCpuSetInformation(
+		reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(buffer.data()),
+		length, &length, GetCurrentProcess(), 0)) {
+		return classes;
+	}
+
+	for (ULONG offset = 0; offset < length;) {
+		auto info = reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(
+			buffer.data() + offset);
+		if (info->Type == CpuSetInformation && info->CpuSet.Group == 0 &&
+			info->CpuSet.LogicalProcessorIndex < classes.size()) {
+			classes[info->CpuSet.LogicalProcessorIndex] =
+				info->CpuSet.EfficiencyClass;
+		}
+		offset += info->Size;
+	}
+	return classes;
+}
+
 void CpuInfo::ExecuteCpuid(int cpuInfo[4], int leaf, int subleaf) {
 	__cpuidex(cpuInfo, leaf, subleaf);
 }
@@ -191,8 +447,17 @@ std::wstring CpuInfo::QuerySystemInfo() {
 	ss << L"\n";  // Start with newline
 	ss << L"System CPU Information:\n"
 		<< L"Processor: " << caps.brandString << L"\n"
-		<< L"Number of processors: " << sysInfo.dwNumberOfProcessors << L"\n"
-		<< L"Processor architecture: ";
+		<< L"Number of processors: " << sysInfo.dwNumberOfProcessors << L"\n";
+
+	// Inside a job (container) or a restricted parent only part is usable
+	DWORD_PTR allowedMask = GetAllowedMask();
+	if (allowedMask != GetSystemMask()) {
+		ss << L"Allowed processors: " << CountBits(allowedMask)
+			<< L" (mask 0x" << std::hex << allowedMask << std::dec
+			<< L"; all masks below are limited to these)\n";
+	}
+
+	ss << L"Processor architecture: ";
 
 	switch (sysInfo.wProcessorArchitecture) {
 	case PROCESSOR_ARCHITECTURE_AMD64:
@@ -208,10 +473,15 @@ std::wstring CpuInfo::QuerySystemInfo() {
 	ss << L"Hybrid Architecture: " << (caps.isHybrid ? L"Yes" : L"No") << L"\n"
 		<< L"Supports Core Type Detection: " << (caps.supportsLeaf1A ? L"Yes" : L"No") << L"\n";
 
+	if (const CpuModel* model = GetKnownModel()) {
+		ss << L"Known model: " << model->name << L" (core types from the "
+			<< L"model table)\n";
+	}
+
 	if (caps.isHybrid) {
-		DWORD_PTR pCoreMask = GetPCoreMask();
-		DWORD_PTR eCoreMask = GetECoreMask();
-		DWORD_PTR lpECoreMask = GetLpECoreMask();
+		DWORD_PTR pCoreMask = caps.pCoreMask;
+		DWORD_PTR eCoreMask = caps.eCoreMask;
+		DWORD_PTR lpECoreMask = caps.lpECoreMask;
 
 		ss << L"\nPerformance Cores:\n"
 			<< L"Mask: 0x" << std::hex << pCoreMask << L"\n"
@@ -246,11 +516,25 @@ std::wstring CpuInfo::QuerySystemInfo() {
 	}
 	else {
 		// Non-hybrid CPU output
-		DWORD_PTR allCoresMask = (1ULL << sysInfo.dwNumberOfProcessors) - 1;
+		DWORD_PTR allCoresMask = allowedMask;
 		ss << L"Core mask: 0x" << std::hex << allCoresMask << L"\n"
 			<< L"Available threads: ";
 		for (DWORD i = 0; i < sysInfo.dwNumberOfProcessors; i++) {
-			ss << std::dec << i << L" ";
+			if (allCoresMask & (DWORD_PTR(1) << i)) {
+				ss << std::dec << i << L" ";
+			}
+		}
+		ss << L"\n";
+	}
+
+	// Cores in different L3 domains do not evict each other's lines
+	auto l3Domains = GetCacheDomains(3);
+	if (l3Domains.size() > 1) {
+		ss << L"\nL3 Cache Domains (--llc-domain):\n";
+		for (size_t i = 0; i < l3Domains.size(); i++) {
+			ss << std::dec << i << L": " << l3Domains[i].sizeBytes / (1024 * 1024)
+				<< L" MB, mask 0x" << std::hex
+				<< (l3Domains[i].mask & allowedMask) << L"\n";
 		}
 	}
 
@@ -4,6 +4,7 @@
 #include <vector>
 #include <cstdint>
 #include <string>   
+#include "cpumodels.h"
 
 class CpuInfo {
 public:
@@ -17,10 +18,63 @@ public:
         DWORD_PTR lpECoreMask;
     };
 
+    // One instance of a cache level and the processors sharing it
+    struct CacheDomain {
+        DWORD_PTR mask;
+        DWORD sizeBytes;
+    };
+
+    struct CoreTypeMasks {
+        DWORD_PTR pCoreMask;
+        DWORD_PTR eCoreMask;
+        DWORD_PTR lpECoreMask;
+    };
+
+    // Clock data of one logical processor from CallNtPowerInformation
+    struct ProcessorFrequency {
+        ULONG number;
+        ULONG maxMhz;
+        ULONG currentMhz;
+        ULONG mhzLimit;      // Current firmware/thermal limit
+    };
+
     static DWORD_PTR GetPCoreMask();
     static DWORD_PTR GetECoreMask();
     static DWORD_PTR GetLpECoreMask();
+    // All three core types from one probe, cached per allowed set
+    static CoreTypeMasks GetCoreTypeMasks();
     static DWORD_PTR CoreListToMask(const std::vector<int>& cores);
+    // Every logical processor of the system (group 0)
+    static DWORD_PTR GetSystemMask();
+    // Processors this process may use: its affinity mask, narrowed by the
+    // affinity limit of a job object (e.g. a container) it runs in
+    static DWORD_PTR GetAllowedMask();
+    // One mask per physical core, holding its SMT sibling threads
+    static std::vector<DWORD_PTR> GetPhysicalCoreMasks();
+    // Same, with the efficiency class Windows gives each core
+    static std::vector<CpuModels::Core> GetPhysicalCores();
+    // Keeps only the first hardware thread of every physical core in mask
+    static DWORD_PTR RemoveSmtSiblings(DWORD_PTR mask);
+    static DWORD_PTR RemoveSmtSiblings(DWORD_PTR mask,
+        const std::vector<DWORD_PTR>& coreMasks);
+    // One mask per cache instance of the given level (e.g. 2 = L2 clusters)
+    static std::vector<DWORD_PTR> GetCacheDomainMasks(BYTE level);
+    static std::vector<CacheDomain> GetCacheDomains(BYTE level);
+    static int CountBits(DWORD_PTR mask);
+    static std::vector<ProcessorFrequency> GetProcessorFrequencies();
+    // Same, into frequencies; reuses the storage of both vectors
+    static void GetProcessorFrequencies(
+        std::vector<ProcessorFrequency>& frequencies, std::vector<BYTE>& buffer);
+    // Windows efficiency class per logical processor (higher is faster;
+    // all zero on non-hybrid CPUs)
+    static std::vector<BYTE> GetEfficiencyClasses();
+    static CpuSignature GetSignature();
+    // This machine's entry in the model table when the cores Windows
+    // reports match it, nullptr otherwise
+    static const CpuModel* GetKnownModel();
+    // The per-processor CPUID sweep; only used for CPUs the model table
+    // does not know, and by the tests to verify the table
+    static CoreTypeMasks ProbeCoreTypes(DWORD_PTR allowed);
     static std::wstring QuerySystemInfo();
     static CpuCapabilities GetCapabilities();
     static std::wstring GetDetailedInfo();
@@ -30,4 +84,7 @@ public:
 private:
     static void ExecuteCpuid(int cpuInfo[4], int leaf, int subleaf);
     static bool CheckCpuidSupport(int leaf);
+    static const CpuModel* MatchModel(CpuModels::Layout& layout);
+    // The cached core types and the model table entry they came from
+    static CoreTypeMasks GetCoreTypeMasks(const CpuModel*& knownModel);
 };
@@ -0,0 +1,92 @@
+// cpuload.cpp
+#include "pch.h"
+#include "cpuload.h"
+#include <algorithm>
+
+// SYSTEM_PROCESSOR_PERFORMANCE_INFORMATION from NtQuerySystemInformation
+struct ProcessorPerformanceInformation {
+	LARGE_INTEGER IdleTime;
+	LARGE_INTEGER KernelTime;
+	LARGE_INTEGER UserTime;
+	LARGE_INTEGER DpcTime;
+	LARGE_INTEGER InterruptTime;
+	ULONG InterruptCount;
+};
+
+CpuLoadSampler::CpuLoadSampler() : m_last(ReadTimes()) {}
+
+std::vector<double> CpuLoadSampler::Sample() {
+	auto now = ReadTimes();
+	auto busy = Utilization(m_last, now);
+	m_last = std::move(now);
+	return busy;
+}
+
+std::vector<double> CpuLoadSampler::Utilization(
+	const std::vector<Times>& before, const std::vector<Times>& after) {
+
+	std::vector<double> busy;
+	size_t count = (std::min)(before.size(), after.size());
+	for (size_t i = 0; i < count; i++) {
+		ULONGLONG total = after[i].total - before[i].total;
+		ULONGLONG idle = after[i].idle - before[i].idle;
+		busy.push_back(total == 0 ? 0.0
+			: 1.0 - static_cast<double>((std::min)(idle, total)) / total);
+	}
+	return busy;
+}
+
+double CpuLoadSampler::Average(const std::vector<double>& busy,
+	DWORD_PTR mask) {
+	double sum = 0.0;
+	int count = 0;
+	for (size_t i = 0; i < busy.size(); i++) {
+		if (mask & (DWORD_PTR(1) << i)) {
+			sum += busy[i];
+			count++;
+		}
+	}
+	return count == 0 ? 0.0 : sum / count;
+}
+
+std::vector<CpuLoadSampler::Times> CpuLoadSampler::ReadTimes() {
+	std::vector<Times> times;
+	std::vector<BYTE> buffer;
+	ReadTimes(times, buffer);
+	return times;
+}
+
+void CpuLoadSampler::ReadTimes(std::vector<Times>& times,
+	std::vector<BYTE>& buffer) {
+	using NtQuerySystemInformationFn = LONG(WINAPI*)(INT, PVOID, ULONG, PULONG);
+	static auto ntQuerySystemInformation =
+		reinterpret_cast<NtQuerySystemInformationFn>(GetProcAddress(
+			GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+
+	times.clear();
+	if (!ntQuerySystemInformation) {
+		return;
+	}
+
+	SYSTEM_INFO sysInfo;
+	GetSystemInfo(&sysInfo);
+	buffer.resize(sysInfo.dwNumberOfProcessors *
+		sizeof(ProcessorPerformanceInformation));
+
+	const INT SystemProcessorPerformanceInformation = 8;
+	ULONG returned = 0;
+	if (ntQuerySystemInformation(SystemProcessorPerformanceInformation,
+		buffer.data(), static_cast<ULONG>(buffer.size()), &returned) < 0) {
+		return;
+	}
+
+	auto info = reinterpret_cast<const ProcessorPerformanceInformation*>(
+		buffer.data());
+	size_t count = returned / sizeof(ProcessorPerformanceInformation);
+	for (size_t i = 0; i < count; i++) {
+		times.push_back({
+			static_cast<ULONGLONG>(info[i].IdleTime.QuadPart),
+			static_cast<ULONGLONG>(info[i].KernelTime.QuadPart +
+				info[i].UserTime.QuadPart) });
+	}
+}
@@ -0,0 +1,30 @@
+// cpuload.h
+#pragma once
+#include <windows.h>
+#include <vector>
+
+// Per-processor busy fraction from the kernel's idle/kernel/user times
+class CpuLoadSampler {
+public:
+    struct Times {
+        ULONGLONG idle;
+        ULONGLONG total;    // Kernel (including idle) + user
+    };
+
+    CpuLoadSampler();
+
+    // Busy fraction (0..1) of every logical processor in group 0 since
+    // the previous call or construction
+    std::vector<double> Sample();
+    static std::vector<double> Utilization(const std::vector<Times>& before,
+        const std::vector<Times>& after);
+    // Mean busy fraction of the processors in mask
+    static double Average(const std::vector<double>& busy, DWORD_PTR mask);
+    static std::vector<Times> ReadTimes();
+    // Same, into times; reuses the storage of both vectors once they are
+    // large enough, so periodic samplers do not allocate
+    static void ReadTimes(std::vector<Times>& times, std::vector<BYTE>& buffer);
+
+private:
+    std::vector<Times> m_last;
+};
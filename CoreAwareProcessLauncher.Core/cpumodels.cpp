@@ -0,0 +1,40 @@
+// cpumodels.cpp
+#include "pch.h"
+#include "cpumodels.h"
+#include "cpu.h"
+#include <algorithm>
+
+bool CpuModels::BuildLayout(const CpuModel& model, std::vector<Core> cores,
+	Layout& layout) {
+
+	if (static_cast<int>(cores.size()) != model.PhysicalCores()) {
+		return false;
+	}
+	std::sort(cores.begin(), cores.end(), [](const Core& a, const Core& b) {
+		return (a.mask & (~a.mask + 1)) < (b.mask & (~b.mask + 1));
+	});
+
+	layout = {};
+	BYTE slowestPCore = 0xFF, fastestOther = 0;
+	int eEnd = model.pCores + model.eCores;
+	for (int i = 0; i < static_cast<int>(cores.size()); i++) {
+		const Core& core = cores[i];
+		int threads = CpuInfo::CountBits(core.mask);
+		if (i < model.pCores) {
+			if (threads != model.pThreadsPerCore) {
+				return false;
+			}
+			layout.pCoreMask |= core.mask;
+			slowestPCore = (std::min)(slowestPCore, core.efficiencyClass);
+			continue;
+		}
+		if (threads != 1) {
+			return false;
+		}
+		fastestOther = (std::max)(fastestOther, core.efficiencyClass);
+		(i >= eEnd ? layout.lpECoreMask : layout.eCoreMask) |= core.mask;
+	}
+
+	// Windows ranks the P-cores above the rest on every hybrid part
+	return slowestPCore > fastestOther;
+}
@@ -0,0 +1,129 @@
+// cpumodels.h
+#pragma once
+#include <windows.h>
+#include <cstdint>
+#include <vector>
+
+// CPUID leaf 1 signature with the extended family and model folded in
+struct CpuSignature {
+    bool intel = false;
+    uint32_t family = 0;
+    uint32_t model = 0;
+    uint32_t stepping = 0;
+};
+
+// Core layout of one hybrid Intel SKU. Windows numbers the P-core threads
+// first, then the E-cores and last the LP E-cores, so the classes follow
+// from the counts without running CPUID on every processor
+struct CpuModel {
+    const char* name;
+    uint32_t family;
+    uint32_t model;
+    uint32_t minStepping;
+    uint32_t maxStepping;
+    int pCores;
+    int pThreadsPerCore;     // 2 with Hyper-Threading
+    int eCores;
+    int lpECores;
+
+    constexpr int PhysicalCores() const {
+        return pCores + eCores + lpECores;
+    }
+    constexpr int LogicalProcessors() const {
+        return pCores * pThreadsPerCore + eCores + lpECores;
+    }
+};
+
+class CpuModels {
+public:
+    // Model numbers as in Intel's SDM (and Linux's intel-family.h)
+    static constexpr CpuModel TABLE[] = {
+        // Alder Lake-S
+        { "Alder Lake-S 8P+8E", 6, 0x97, 0, 15, 8, 2, 8, 0 },
+        { "Alder Lake-S 8P+4E", 6, 0x97, 0, 15, 8, 2, 4, 0 },
+        { "Alder Lake-S 6P+4E", 6, 0x97, 0, 15, 6, 2, 4, 0 },
+        // Alder Lake-H/P/U
+        { "Alder Lake-H 6P+8E", 6, 0x9A, 0, 15, 6, 2, 8, 0 },
+        { "Alder Lake-P 4P+8E", 6, 0x9A, 0, 15, 4, 2, 8, 0 },
+        { "Alder Lake-U 2P+8E", 6, 0x9A, 0, 15, 2, 2, 8, 0 },
+        { "Alder Lake-U 2P+4E", 6, 0x9A, 0, 15, 2, 2, 4, 0 },
+        { "Alder Lake-U 1P+4E", 6, 0x9A, 0, 15, 1, 2, 4, 0 },
+        // Raptor Lake-S and its refresh
+        { "Raptor Lake-S 8P+16E", 6, 0xB7, 0, 15, 8, 2, 16, 0 },
+        { "Raptor Lake-S 8P+12E", 6, 0xB7, 0, 15, 8, 2, 12, 0 },
+        { "Raptor Lake-S 8P+8E", 6, 0xB7, 0, 15, 8, 2, 8, 0 },
+        { "Raptor Lake-S 6P+8E", 6, 0xB7, 0, 15, 6, 2, 8, 0 },
+        { "Raptor Lake-S 6P+4E", 6, 0xBF, 0, 15, 6, 2, 4, 0 },
+        { "Raptor Lake-S 4P+4E", 6, 0xBF, 0, 15, 4, 2, 4, 0 },
+        // Raptor Lake-H/P/U
+        { "Raptor Lake-H 6P+8E", 6, 0xBA, 0, 15, 6, 2, 8, 0 },
+        { "Raptor Lake-P 4P+8E", 6, 0xBA, 0, 15, 4, 2, 8, 0 },
+        { "Raptor Lake-U 2P+8E", 6, 0xBA, 0, 15, 2, 2, 8, 0 },
+        { "Raptor Lake-U 2P+4E", 6, 0xBA, 0, 15, 2, 2, 4, 0 },
+        { "Raptor Lake-U 1P+4E", 6, 0xBA, 0, 15, 1, 2, 4, 0 },
+        // Meteor Lake-H/U: two LP E-cores on the SoC tile
+        { "Meteor Lake-H 6P+8E+2LP", 6, 0xAA, 0, 15, 6, 2, 8, 2 },
+        { "Meteor Lake-H 4P+8E+2LP", 6, 0xAA, 0, 15, 4, 2, 8, 2 },
+        { "Meteor Lake-U 2P+8E+2LP", 6, 0xAA, 0, 15, 2, 2, 8, 2 },
+        { "Meteor Lake-U 2P+4E+2LP", 6, 0xAA, 0, 15, 2, 2, 4, 2 },
+        // Lunar Lake: all four E-cores sit on the low-power island
+        { "Lunar Lake 4P+4LP", 6, 0xBD, 0, 15, 4, 1, 0, 4 },
+        // Arrow Lake: no Hyper-Threading, except the Meteor Lake-based U
+        { "Arrow Lake-S 8P+16E", 6, 0xC6, 0, 15, 8, 1, 16, 0 },
+        { "Arrow Lake-S 8P+12E", 6, 0xC6, 0, 15, 8, 1, 12, 0 },
+        { "Arrow Lake-S 6P+8E", 6, 0xC6, 0, 15, 6, 1, 8, 0 },
+        { "Arrow Lake-S 6P+4E", 6, 0xC6, 0, 15, 6, 1, 4, 0 },
+        { "Arrow Lake-H 6P+8E+2LP", 6, 0xC5, 0, 15, 6, 1, 8, 2 },
+        { "Arrow Lake-H 4P+8E+2LP", 6, 0xC5, 0, 15, 4, 1, 8, 2 },
+        { "Arrow Lake-U 2P+8E+2LP", 6, 0xB5, 0, 15, 2, 2, 8, 2 },
+    };
+
+    // The entry for the signature and the core counts Windows reports, or
+    // nullptr; the counts tell the SKUs of one model number apart
+    static constexpr const CpuModel* Find(uint32_t family, uint32_t model,
+        uint32_t stepping, int physicalCores, int logicalProcessors) {
+        for (const CpuModel& entry : TABLE) {
+            if (entry.family == family && entry.model == model &&
+                stepping >= entry.minStepping && stepping <= entry.maxStepping &&
+                entry.PhysicalCores() == physicalCores &&
+                entry.LogicalProcessors() == logicalProcessors) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    // Every entry fits in group 0 and no two entries share a key
+    static constexpr bool IsConsistent() {
+        for (const CpuModel& entry : TABLE) {
+            if (entry.pCores <= 0 || entry.eCores + entry.lpECores <= 0 ||
+                entry.pThreadsPerCore < 1 || entry.pThreadsPerCore > 2 ||
+                entry.LogicalProcessors() > static_cast<int>(sizeof(DWORD_PTR) * 8) ||
+                Find(entry.family, entry.model, entry.minStepping,
+                    entry.PhysicalCores(), entry.LogicalProcessors()) != &entry) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // One physical core as Windows reports it
+    struct Core {
+        DWORD_PTR mask;
+        BYTE efficiencyClass;  // Higher is faster
+    };
+
+    struct Layout {
+        DWORD_PTR pCoreMask = 0;
+        DWORD_PTR eCoreMask = 0;
+        DWORD_PTR lpECoreMask = 0;
+    };
+
+    // Assigns the classes of model to cores in processor order. Fails when
+    // the cores do not match: another core count, SMT on the wrong cores or
+    // P-cores that Windows does not rank above the others
+    static bool BuildLayout(const CpuModel& model, std::vector<Core> cores,
+        Layout& layout);
+};
+
+static_assert(CpuModels::IsConsistent(), "Inconsistent CPU model table");
@@ -0,0 +1,467 @@
+// daemon.cpp
+#include "pch.h"
+#include "daemon.h"
+#include "affinity.h"
+#include "cpu.h"
+#include "options.h"
+#include "process.h"
+#include "reservation.h"
+#include "scheduling.h"
+#include "utilities.h"
+#include <format>
+#include <sddl.h>
+#include <sstream>
+#include <thread>
+
+#pragma comment(lib, "advapi32.lib")
+
+using Utilities::ConvertToNarrowString;
+
+static std::wstring GetPipePath(const std::wstring& pipeName) {
+	return L"\\\\.\\pipe\\" + pipeName;
+}
+
+// Security descriptor (for LocalFree) that lets only the current user open
+// the pipe, so other accounts cannot submit launches
+static PSECURITY_DESCRIPTOR CreateOwnerOnlyDescriptor() {
+	HANDLE token = NULL;
+	if (!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token)) {
+		return nullptr;
+	}
+	DWORD size = 0;
+	GetTokenInformation(token, TokenUser, nullptr, 0, &size);
+	std::vector<BYTE> buffer(size);
+	LPWSTR sid = nullptr;
+	if (size > 0 && GetTokenInformation(token, TokenUser, buffer.data(), size,
+		&size)) {
+		ConvertSidToStringSidW(
+			reinterpret_cast<TOKEN_USER*>(buffer.data())->User.Sid, &sid);
+	}
+	CloseHandle(token);
+	if (!sid) {
+		return nullptr;
+	}
+
+	// Protected DACL with one entry: full access for this user
+	PSECURITY_DESCRIPTOR descriptor = nullptr;
+	std::wstring sddl = std::format(L"D:P(A;;GA;;;{})", sid);
+	LocalFree(sid);
+	if (!ConvertStringSecurityDescriptorToSecurityDescriptorW(sddl.c_str(),
+		SDDL_REVISION_1, &descriptor, NULL)) {
+		return nullptr;
+	}
+	return descriptor;
+}
+
+// Works for both the overlapped daemon end and the synchronous client end
+static bool ReadMessage(HANDLE pipe, std::string& message) {
+	message.clear();
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	char buffer[4096];
+	bool complete = false;
+	while (!complete) {
+		DWORD read = 0;
+		ResetEvent(overlapped.hEvent);
+		if (!ReadFile(pipe, buffer, sizeof(buffer), NULL, &overlapped) &&
+			GetLastError() != ERROR_IO_PENDING &&
+			GetLastError() != ERROR_MORE_DATA) {
+			break;
+		}
+		BOOL done = GetOverlappedResult(pipe, &overlapped, &read, TRUE);
+		if (!done && GetLastError() != ERROR_MORE_DATA) {
+			break;
+		}
+		message.append(buffer, read);
+		complete = done != FALSE;
+	}
+	CloseHandle(overlapped.hEvent);
+	return complete;
+}
+
+static bool WriteMessage(HANDLE pipe, const void* data, size_t size) {
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	DWORD written = 0;
+	bool ok = (WriteFile(pipe, data, static_cast<DWORD>(size), NULL,
+		&overlapped) || GetLastError() == ERROR_IO_PENDING) &&
+		GetOverlappedResult(pipe, &overlapped, &written, TRUE) &&
+		written == size;
+	CloseHandle(overlapped.hEvent);
+	return ok;
+}
+
+static bool WriteMessage(HANDLE pipe, const std::string& message) {
+	return WriteMessage(pipe, message.data(), message.size());
+}
+
+// Tells the client the pid and mask while the child is still suspended
+class StartReporter : public ProcessMonitor {
+public:
+	explicit StartReporter(HANDLE pipe) : m_pipe(pipe) {}
+
+	DWORD GetIntervalMs() const override {
+		return INFINITE;
+	}
+
+	void OnStart(HANDLE process, DWORD processId,
+		DWORD_PTR affinityMask) override {
+		WriteMessage(m_pipe, std::format("STARTED {} 0x{:X}", processId,
+			affinityMask));
+	}
+
+	void OnTick(HANDLE process) override {}
+
+private:
+	HANDLE m_pipe;
+};
+
+// Options that need a console, files or machine-wide state stay with
+// direct invocations
+static void RequireDaemonSupport(const CommandLineOptions& options) {
+	if (options.showHelp || options.queryMode || options.tuneMode ||
+		options.sweepMode || options.repeatCount > 0 ||
+		options.measureEnergy || options.latencyCritical ||
+		options.thermalAction != CommandLineOptions::ThermalAction::NONE ||
+		!options.monitorPath.empty() || !options.schedTracePath.empty() ||
+		!options.analyzePath.empty() || !options.metricsPath.empty() ||
+		options.topMode || options.freqMinKhz > 0 ||
+		options.freqMaxKhz > 0 || options.epp >= 0 || options.daemonMode ||
+		!options.tracePath.empty() || options.enableLogging ||
+		!options.logPath.empty()) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"The daemon only launches programs; --help, --query, --tune, "
+			L"--sweep, --repeat, --energy, --latency-critical, "
+			L"--thermal-policy, --monitor, --sched-trace, analyze, "
+			L"--metrics-file, top, --freq, --epp, --trace and --log need a "
+			L"direct invocation"));
+	}
+}
+
+LaunchDaemon::LaunchDaemon(const std::wstring& pipeName)
+	: m_pipeName(pipeName),
+	m_stopEvent(CreateEventW(NULL, TRUE, FALSE, NULL)),
+	m_listeningEvent(CreateEventW(NULL, TRUE, FALSE, NULL)) {}
+
+LaunchDaemon::~LaunchDaemon() {
+	CloseHandle(m_listeningEvent);
+	CloseHandle(m_stopEvent);
+}
+
+std::wstring LaunchDaemon::GetDefaultPipeName() {
+	return L"capld";
+}
+
+HANDLE LaunchDaemon::CreateInstance(const std::wstring& path, bool first) {
+	PSECURITY_DESCRIPTOR descriptor = CreateOwnerOnlyDescriptor();
+	if (!descriptor) {
+		throw std::runtime_error(ConvertToNarrowString(std::format(
+			L"Cannot build the security descriptor of pipe {}: error {}",
+			path, GetLastError())));
+	}
+	SECURITY_ATTRIBUTES security = { sizeof(security), descriptor, FALSE };
+
+	// The first instance fails if anyone else already owns the name, so
+	// a squatter cannot receive the requests meant for the daemon
+	HANDLE pipe = CreateNamedPipeW(path.c_str(),
+		PIPE_ACCESS_DUPLEX | FILE_FLAG_OVERLAPPED |
+		(first ? FILE_FLAG_FIRST_PIPE_INSTANCE : 0),
+		PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT |
+		PIPE_REJECT_REMOTE_CLIENTS,
+		PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, &security);
+	DWORD error = GetLastError();
+	LocalFree(descriptor);
+	if (pipe == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error(ConvertToNarrowString(std::format(
+			L"Cannot create pipe {}: error {}{}", path, error,
+			error == ERROR_ACCESS_DENIED ? L" (is another process using "
+			L"that pipe name?)" : L"")));
+	}
+	return pipe;
+}
+
+void LaunchDaemon::Run() {
+	// Probe the topology now so requests only pay for the launch itself
+	CpuInfo::GetCoreTypeMasks();
+
+	std::wstring path = GetPipePath(m_pipeName);
+	HANDLE pipe = CreateInstance(path, true);
+	SetEvent(m_listeningEvent);
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Launch daemon listening on {}", path);
+
+	OVERLAPPED overlapped = {};
+	overlapped.hEvent = CreateEventW(NULL, TRUE, FALSE, NULL);
+	while (true) {
+		// Wait for a client or Stop(), whichever comes first
+		ResetEvent(overlapped.hEvent);
+		bool connected = ConnectNamedPipe(pipe, &overlapped) != FALSE;
+		DWORD error = GetLastError();
+		if (!connected && error == ERROR_IO_PENDING) {
+			HANDLE events[] = { overlapped.hEvent, m_stopEvent };
+			DWORD ignored = 0;
+			if (WaitForMultipleObjects(2, events, FALSE, INFINITE) !=
+				WAIT_OBJECT_0) {
+				CancelIo(pipe);
+				GetOverlappedResult(pipe, &overlapped, &ignored, TRUE);
+				CloseHandle(pipe);
+				break;
+			}
+			connected = GetOverlappedResult(pipe, &overlapped, &ignored,
+				FALSE) != FALSE;
+		} else if (error == ERROR_PIPE_CONNECTED) {
+			connected = true;
+		}
+		if (!connected) {
+			DisconnectNamedPipe(pipe);
+			continue;
+		}
+
+		// The next instance exists before this one can close, so the name
+		// never becomes free for another process to take
+		HANDLE next = INVALID_HANDLE_VALUE;
+		try {
+			next = CreateInstance(path, false);
+		} catch (...) {
+			CloseHandle(overlapped.hEvent);
+			CloseHandle(pipe);
+			throw;
+		}
+		m_activeClients++;
+		std::thread([this, pipe]() {
+			Serve(pipe);
+			m_activeClients--;
+			}).detach();
+		pipe = next;
+	}
+	CloseHandle(overlapped.hEvent);
+	ResetEvent(m_listeningEvent);
+
+	while (m_activeClients > 0) {
+		Sleep(10);
+	}
+	g_logger->Log(ApplicationLogger::Level::INFO, "Launch daemon stopped");
+}
+
+bool LaunchDaemon::WaitUntilListening(DWORD timeoutMs) const {
+	return WaitForSingleObject(m_listeningEvent, timeoutMs) == WAIT_OBJECT_0;
+}
+
+void LaunchDaemon::Stop() {
+	SetEvent(m_stopEvent);
+}
+
+void LaunchDaemon::Serve(HANDLE pipe) {
+	std::string request;
+	if (ReadMessage(pipe, request)) {
+		std::wstring message(reinterpret_cast<const wchar_t*>(request.data()),
+			request.size() / sizeof(wchar_t));
+		std::string reply;
+		try {
+			reply = HandleRequest(pipe, message);
+		}
+		catch (const std::exception& e) {
+			g_logger->Log(ApplicationLogger::Level::ERR,
+				"Daemon request failed: {}", e.what());
+			reply = "ERROR " + std::string(e.what());
+		}
+		WriteMessage(pipe, reply);
+		FlushFileBuffers(pipe);
+	}
+	DisconnectNamedPipe(pipe);
+	CloseHandle(pipe);
+}
+
+std::string LaunchDaemon::HandleRequest(HANDLE pipe,
+	const std::wstring& message) {
+
+	std::wstring clientDir;
+	std::vector<std::wstring> args = DecodeRequest(message, clientDir);
+	ResolveClientDirectory(args, clientDir);
+	args.insert(args.begin(), L"capld");
+	std::vector<wchar_t*> argv;
+	for (auto& arg : args) {
+		argv.push_back(arg.data());
+	}
+
+	CommandLineOptions options =
+		ParseCommandLine(static_cast<int>(argv.size()), argv.data());
+	RequireDaemonSupport(options);
+
+	// Relative paths are the client's, not the daemon's
+	if (options.targetWorkingDir.empty()) {
+		options.targetWorkingDir = clientDir;
+	}
+	std::wstring local = options.targetWorkingDir + L"\\" + options.targetPath;
+	if (options.targetPath.find(L':') == std::wstring::npos &&
+		Utilities::PathExists(local)) {
+		options.targetPath = local;
+	}
+
+	DWORD_PTR coreMask = AffinityResolver::Resolve(options);
+	auto reservation = CoreReservation::FromOptions(coreMask, options);
+	StartReporter reporter(pipe);
+	std::vector<ProcessMonitor*> monitors = { &reporter };
+	if (reservation) {
+		coreMask = reservation->GetMask();
+		monitors.push_back(reservation.get());
+	}
+
+	ProcessStats stats;
+	if (!ProcessManager::LaunchProcess(options.targetPath, options.targetArgs,
+		options.targetWorkingDir, coreMask, &stats, monitors,
+		SchedulingResolver::Resolve(options))) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Failed to launch process"));
+	}
+	return std::format("EXITED {} {:.6f}", stats.exitCode, stats.wallSeconds);
+}
+
+void LaunchDaemon::ResolveClientDirectory(std::vector<std::wstring>& args,
+	const std::wstring& clientDir) {
+
+	for (size_t i = 0; i + 1 < args.size(); i++) {
+		if (args[i] == L"--") {
+			break;
+		}
+		if (args[i] != L"--dir" && args[i] != L"-d") {
+			continue;
+		}
+		std::wstring& dir = args[++i];
+		if (dir.empty() || dir.starts_with(L"-") ||
+			(dir.size() >= 2 && dir[1] == L':') || dir.starts_with(L"\\\\")) {
+			continue;
+		}
+		// "\build" is rooted on the client's drive
+		std::wstring joined = dir.starts_with(L"\\")
+			? clientDir.substr(0, 2) + dir
+			: clientDir + L"\\" + dir;
+		WCHAR fullPath[MAX_PATH];
+		DWORD length = GetFullPathNameW(joined.c_str(), MAX_PATH, fullPath, NULL);
+		dir = length > 0 && length < MAX_PATH ? std::wstring(fullPath) : joined;
+	}
+}
+
+std::wstring LaunchDaemon::EncodeRequest(const std::wstring& workingDir,
+	const std::vector<std::wstring>& args) {
+	std::wstring message = workingDir;
+	message.push_back(L'\0');
+	for (const auto& arg : args) {
+		message += arg;
+		message.push_back(L'\0');
+	}
+	return message;
+}
+
+std::vector<std::wstring> LaunchDaemon::DecodeRequest(
+	const std::wstring& message, std::wstring& workingDir) {
+
+	std::vector<std::wstring> fields;
+	size_t start = 0;
+	while (start < message.size()) {
+		size_t end = message.find(L'\0', start);
+		if (end == std::wstring::npos) {
+			end = message.size();
+		}
+		fields.push_back(message.substr(start, end - start));
+		start = end + 1;
+	}
+	if (fields.empty()) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Empty launch request"));
+	}
+	workingDir = fields.front();
+	fields.erase(fields.begin());
+	return fields;
+}
+
+bool DaemonClient::TakeDaemonArguments(int argc, wchar_t* argv[],
+	std::vector<std::wstring>& args, std::wstring& pipeName) {
+
+	bool viaDaemon = false;
+	for (int i = 1; i < argc && std::wstring(argv[i]) != L"--"; i++) {
+		viaDaemon = viaDaemon || std::wstring(argv[i]) == L"--via-daemon";
+	}
+	if (!viaDaemon) {
+		return false;
+	}
+
+	pipeName = LaunchDaemon::GetDefaultPipeName();
+	args.clear();
+	bool program = false;
+	for (int i = 1; i < argc; i++) {
+		std::wstring arg = argv[i];
+		if (!program && arg == L"--via-daemon") {
+			continue;
+		}
+		if (!program && arg == L"--pipe" && i + 1 < argc) {
+			pipeName = argv[++i];
+			continue;
+		}
+		program = program || arg == L"--";
+		args.push_back(arg);
+	}
+	return true;
+}
+
+DWORD DaemonClient::Launch(const std::wstring& pipeName,
+	const std::wstring& workingDir, const std::vector<std::wstring>& args,
+	const std::function<void(const Started&)>& onStarted) {
+
+	std::wstring path = GetPipePath(pipeName);
+	HANDLE pipe = INVALID_HANDLE_VALUE;
+	while (pipe == INVALID_HANDLE_VALUE) {
+		pipe = CreateFileW(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0,
+			NULL, OPEN_EXISTING, 0, NULL);
+		if (pipe != INVALID_HANDLE_VALUE) {
+			break;
+		}
+		// Every instance is busy accepting; one frees up shortly
+		if (GetLastError() != ERROR_PIPE_BUSY) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"No launch daemon is listening on " + path +
+				L"; start one with caplcli --daemon"));
+		}
+		if (!WaitNamedPipeW(path.c_str(), 5000)) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"Timed out waiting for the launch daemon on " + path));
+		}
+	}
+
+	DWORD mode = PIPE_READMODE_MESSAGE;
+	SetNamedPipeHandleState(pipe, &mode, NULL, NULL);
+
+	std::wstring request = LaunchDaemon::EncodeRequest(workingDir, args);
+	if (!WriteMessage(pipe, request.data(), request.size() * sizeof(wchar_t))) {
+		CloseHandle(pipe);
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Cannot send the launch request to the daemon"));
+	}
+
+	std::string reply;
+	while (ReadMessage(pipe, reply)) {
+		std::istringstream fields(reply);
+		std::string kind;
+		fields >> kind;
+		if (kind == "STARTED") {
+			Started started = {};
+			fields >> started.processId >> std::hex >> started.mask;
+			if (onStarted) {
+				onStarted(started);
+			}
+		} else if (kind == "EXITED") {
+			DWORD exitCode = 0;
+			fields >> exitCode;
+			CloseHandle(pipe);
+			return exitCode;
+		} else {
+			CloseHandle(pipe);
+			throw std::runtime_error(kind == "ERROR" && reply.size() > 6
+				? reply.substr(6) : "Unexpected daemon reply: " + reply);
+		}
+	}
+
+	CloseHandle(pipe);
+	throw std::runtime_error(ConvertToNarrowString(
+		L"The launch daemon closed the connection"));
+}
@@ -0,0 +1,68 @@
+// daemon.h
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Resident launcher (caplcli --daemon): keeps the topology probes warm and
+// serves launch requests over a named pipe, one thread per client.
+//
+// A request is one message: the client's working directory followed by
+// the caplcli arguments, each terminated by L'\0'. The daemon answers with
+// text messages: "STARTED <pid> 0x<mask>", then "EXITED <code> <seconds>",
+// or a single "ERROR <reason>".
+class LaunchDaemon {
+public:
+    explicit LaunchDaemon(const std::wstring& pipeName = GetDefaultPipeName());
+    ~LaunchDaemon();
+
+    static std::wstring GetDefaultPipeName();
+    // Serves until Stop(), then waits for the clients still being served.
+    // Throws if another process already owns the pipe name
+    void Run();
+    void Stop();
+    // True once Run() accepts connections
+    bool WaitUntilListening(DWORD timeoutMs) const;
+
+    static std::wstring EncodeRequest(const std::wstring& workingDir,
+        const std::vector<std::wstring>& args);
+    static std::vector<std::wstring> DecodeRequest(const std::wstring& message,
+        std::wstring& workingDir);
+    // Makes relative --dir values relative to the client's directory
+    // instead of the daemon's; the program's own arguments are left alone
+    static void ResolveClientDirectory(std::vector<std::wstring>& args,
+        const std::wstring& clientDir);
+
+private:
+    // Pipe instance that only the current user may open
+    static HANDLE CreateInstance(const std::wstring& path, bool first);
+    void Serve(HANDLE pipe);
+    std::string HandleRequest(HANDLE pipe, const std::wstring& message);
+
+    std::wstring m_pipeName;
+    HANDLE m_stopEvent;
+    HANDLE m_listeningEvent;
+    std::atomic<int> m_activeClients{ 0 };
+};
+
+// The thin side of --via-daemon
+class DaemonClient {
+public:
+    struct Started {
+        DWORD processId;
+        DWORD_PTR mask;
+    };
+
+    // Finds --via-daemon (and --pipe <name>) before "--", strips them and
+    // returns true when the launch should go through the daemon
+    static bool TakeDaemonArguments(int argc, wchar_t* argv[],
+        std::vector<std::wstring>& args, std::wstring& pipeName);
+
+    // Sends the request and blocks until the program exits; returns its
+    // exit code and throws when the daemon rejects or cannot be reached
+    static DWORD Launch(const std::wstring& pipeName,
+        const std::wstring& workingDir, const std::vector<std::wstring>& args,
+        const std::function<void(const Started&)>& onStarted = nullptr);
+};
@@ -0,0 +1,245 @@
+// energy.cpp
+#include "pch.h"
+#include <initguid.h>  // Defines GUID_DEVICE_ENERGY_METER from emi.h
+#include "energy.h"
+#include "utilities.h"
+#include <emi.h>
+#include <algorithm>
+#include <setupapi.h>
+#include <format>
+#include <sstream>
+
+#pragma comment(lib, "setupapi.lib")
+
+using Utilities::ConvertToNarrowString;
+
+// EMI reports energy in picowatt-hours
+const double JOULES_PER_PICOWATT_HOUR = 3600.0 / 1e12;
+
+EmiEnergyMeter::~EmiEnergyMeter() {
+	for (auto& device : m_devices) {
+		CloseHandle(device.handle);
+	}
+}
+
+std::unique_ptr<EmiEnergyMeter> EmiEnergyMeter::Open() {
+	std::unique_ptr<EmiEnergyMeter> meter(new EmiEnergyMeter());
+
+	HDEVINFO deviceInfo = SetupDiGetClassDevsW(&GUID_DEVICE_ENERGY_METER,
+		NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+	if (deviceInfo == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Cannot enumerate energy meter devices");
+	}
+
+	SP_DEVICE_INTERFACE_DATA interfaceData = { sizeof(interfaceData) };
+	for (DWORD index = 0; SetupDiEnumDeviceInterfaces(deviceInfo, NULL,
+		&GUID_DEVICE_ENERGY_METER, index, &interfaceData); index++) {
+
+		DWORD size = 0;
+		SetupDiGetDeviceInterfaceDetailW(deviceInfo, &interfaceData, NULL, 0,
+			&size, NULL);
+		if (size == 0) {
+			continue;
+		}
+
+		std::vector<BYTE> detailBuffer(size);
+		auto detail = reinterpret_cast<PSP_DEVICE_INTERFACE_DETAIL_DATA_W>(
+			detailBuffer.data());
+		detail->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA_W);
+		if (!SetupDiGetDeviceInterfaceDetailW(deviceInfo, &interfaceData,
+			detail, size, NULL, NULL)) {
+			continue;
+		}
+
+		Device device;
+		if (OpenDevice(detail->DevicePath, device)) {
+			meter->m_devices.push_back(std::move(device));
+		}
+	}
+	SetupDiDestroyDeviceInfoList(deviceInfo);
+
+	if (meter->m_devices.empty()) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"No energy meter found (requires Windows 10 or later and a CPU "
+			L"whose RAPL counters are exposed through EMI)"));
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Opened {} energy meter device(s)", meter->m_devices.size());
+	return meter;
+}
+
+bool EmiEnergyMeter::OpenDevice(const std::wstring& path, Device& device) {
+	device.handle = CreateFileW(path.c_str(), GENERIC_READ,
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if (device.handle == INVALID_HANDLE_VALUE) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Cannot open energy meter {}", path);
+		return false;
+	}
+
+	DWORD returned = 0;
+	EMI_VERSION version = {};
+	EMI_METADATA_SIZE metadataSize = {};
+	if (!DeviceIoControl(device.handle, IOCTL_EMI_GET_VERSION, NULL, 0,
+			&version, sizeof(version), &returned, NULL) ||
+		!DeviceIoControl(device.handle, IOCTL_EMI_GET_METADATA_SIZE, NULL, 0,
+			&metadataSize, sizeof(metadataSize), &returned, NULL)) {
+		CloseHandle(device.handle);
+		return false;
+	}
+
+	std::vector<BYTE> metadata(metadataSize.MetadataSize);
+	if (!DeviceIoControl(device.handle, IOCTL_EMI_GET_METADATA, NULL, 0,
+		metadata.data(), static_cast<DWORD>(metadata.size()), &returned,
+		NULL)) {
+		CloseHandle(device.handle);
+		return false;
+	}
+
+	device.version = version.EmiVersion;
+	if (device.version == EMI_VERSION_V1) {
+		auto v1 = reinterpret_cast<EMI_METADATA_V1*>(metadata.data());
+		device.channels.push_back(std::wstring(v1->MeteredHardwareName,
+			v1->MeteredHardwareNameSize / sizeof(WCHAR)).c_str());
+	} else {
+		auto v2 = reinterpret_cast<EMI_METADATA_V2*>(metadata.data());
+		EMI_CHANNEL_V2* channel = &v2->Channels[0];
+		for (USHORT i = 0; i < v2->ChannelCount; i++) {
+			// c_str() drops the terminating NUL counted in ChannelNameSize
+			device.channels.push_back(std::wstring(channel->ChannelName,
+				channel->ChannelNameSize / sizeof(WCHAR)).c_str());
+			channel = EMI_CHANNEL_V2_NEXT_CHANNEL(channel);
+		}
+	}
+	return !device.channels.empty();
+}
+
+std::vector<EnergyCounter> EmiEnergyMeter::Read() {
+	std::vector<EnergyCounter> counters;
+	for (const auto& device : m_devices) {
+		std::vector<EMI_CHANNEL_MEASUREMENT_DATA> data(device.channels.size());
+		DWORD returned = 0;
+		size_t measured = 0;
+		if (DeviceIoControl(device.handle, IOCTL_EMI_GET_MEASUREMENT, NULL, 0,
+			data.data(),
+			static_cast<DWORD>(data.size() * sizeof(EMI_CHANNEL_MEASUREMENT_DATA)),
+			&returned, NULL)) {
+			measured = returned / sizeof(EMI_CHANNEL_MEASUREMENT_DATA);
+		} else {
+			g_logger->Log(ApplicationLogger::Level::WARNING,
+				"Energy meter measurement failed");
+		}
+
+		for (size_t i = 0; i < device.channels.size(); i++) {
+			EnergyCounter counter;
+			counter.domain = GetDomainName(device.channels[i]);
+			counter.range = 0;  // 64-bit counter
+			counter.joulesPerUnit = JOULES_PER_PICOWATT_HOUR;
+			counter.valid = i < measured;
+			if (counter.valid) {
+				counter.raw = data[i].AbsoluteEnergy;
+			}
+			counters.push_back(counter);
+		}
+	}
+	return counters;
+}
+
+// Maps Intel RAPL channel names such as "RAPL_Package0_PP0" to domains
+std::wstring EmiEnergyMeter::GetDomainName(const std::wstring& channelName) {
+	if (channelName.ends_with(L"_PKG")) {
+		return L"package";
+	} else if (channelName.ends_with(L"_PP0")) {
+		return L"core";
+	} else if (channelName.ends_with(L"_PP1")) {
+		return L"uncore";
+	} else if (channelName.ends_with(L"_DRAM")) {
+		return L"dram";
+	}
+	return channelName;
+}
+
+EnergyProfiler::EnergyProfiler(EnergyMeter& meter) : m_meter(meter) {}
+
+void EnergyProfiler::Start() {
+	m_start = m_meter.Read();
+}
+
+EnergyReport EnergyProfiler::Stop(double wallSeconds) {
+	return BuildReport(m_start, m_meter.Read(), wallSeconds);
+}
+
+ULONGLONG EnergyProfiler::CounterDelta(ULONGLONG before, ULONGLONG after,
+	ULONGLONG range) {
+	if (range == 0) {
+		return after - before;  // Unsigned arithmetic wraps at 2^64
+	}
+	if (after >= before) {
+		return after - before;
+	}
+	return range - before + after;  // Counter wrapped once
+}
+
+EnergyReport EnergyProfiler::BuildReport(
+	const std::vector<EnergyCounter>& before,
+	const std::vector<EnergyCounter>& after,
+	double wallSeconds) {
+
+	EnergyReport report;
+	report.wallSeconds = wallSeconds;
+
+	// Counters are matched by position: both readings come from the
+	// same devices in the same order
+	size_t count = (std::min)(before.size(), after.size());
+	for (size_t i = 0; i < count; i++) {
+		// A failed read leaves its slot invalid; that channel is left out
+		if (!before[i].valid || !after[i].valid) {
+			continue;
+		}
+		double joules = CounterDelta(before[i].raw, after[i].raw,
+			after[i].range) * after[i].joulesPerUnit;
+
+		auto existing = std::find_if(report.domains.begin(),
+			report.domains.end(), [&](const EnergyReport::Domain& domain) {
+				return domain.name == after[i].domain;
+			});
+		if (existing != report.domains.end()) {
+			existing->joules += joules;  // Same domain on another package
+		} else {
+			report.domains.push_back({ after[i].domain, joules });
+		}
+	}
+
+	double total = 0.0;
+	bool hasPackage = false;
+	for (const auto& domain : report.domains) {
+		if (domain.name == L"package") {
+			report.packageJoules = domain.joules;
+			hasPackage = true;
+		}
+		total += domain.joules;
+	}
+	if (!hasPackage) {
+		report.packageJoules = total;
+	}
+
+	if (wallSeconds > 0.0) {
+		report.averageWatts = report.packageJoules / wallSeconds;
+	}
+	report.energyDelay = report.packageJoules * wallSeconds;
+	return report;
+}
+
+std::wstring EnergyProfiler::FormatReport(const EnergyReport& report) {
+	std::wstringstream ss;
+	ss << L"\nEnergy:\n";
+	for (const auto& domain : report.domains) {
+		ss << std::format(L"  {:<10} {:>12.3f} J\n", domain.name, domain.joules);
+	}
+	ss << std::format(L"  Wall time:      {:.3f} s\n", report.wallSeconds)
+		<< std::format(L"  Average power:  {:.3f} W\n", report.averageWatts)
+		<< std::format(L"  Energy-delay:   {:.3f} J*s\n", report.energyDelay);
+	return ss.str();
+}
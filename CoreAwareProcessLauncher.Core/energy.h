@@ -0,0 +1,82 @@
+// energy.h
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Raw reading of one energy counter (RAPL domain)
+struct EnergyCounter {
+    std::wstring domain;        // "package", "core", "uncore", "dram", ...
+    ULONGLONG raw = 0;          // Counter value in device units
+    ULONGLONG range = 0;        // Counter wraps at this value, 0 = 2^64
+    double joulesPerUnit = 0.0;
+    // False when the device could not be read; the slot is still present
+    // so later counters keep their position
+    bool valid = true;
+};
+
+// Source of energy counters; the launcher uses the Windows Energy Meter
+// Interface, tests substitute their own readings
+class EnergyMeter {
+public:
+    virtual ~EnergyMeter() = default;
+    virtual std::vector<EnergyCounter> Read() = 0;
+};
+
+// Energy Meter Interface devices (RAPL counters exposed by Windows 10+)
+class EmiEnergyMeter : public EnergyMeter {
+public:
+    ~EmiEnergyMeter() override;
+    std::vector<EnergyCounter> Read() override;
+
+    // Throws if the system exposes no energy meter
+    static std::unique_ptr<EmiEnergyMeter> Open();
+
+private:
+    struct Device {
+        HANDLE handle = INVALID_HANDLE_VALUE;
+        USHORT version = 0;
+        std::vector<std::wstring> channels;
+    };
+
+    EmiEnergyMeter() = default;
+    static bool OpenDevice(const std::wstring& path, Device& device);
+    static std::wstring GetDomainName(const std::wstring& channelName);
+
+    std::vector<Device> m_devices;
+};
+
+struct EnergyReport {
+    struct Domain {
+        std::wstring name;
+        double joules = 0.0;
+    };
+
+    std::vector<Domain> domains;
+    double packageJoules = 0.0;  // Package domain, or sum when absent
+    double wallSeconds = 0.0;
+    double averageWatts = 0.0;
+    double energyDelay = 0.0;    // Energy-delay product (J*s)
+};
+
+// Reads the counters before and after a launch
+class EnergyProfiler {
+public:
+    explicit EnergyProfiler(EnergyMeter& meter);
+
+    void Start();
+    EnergyReport Stop(double wallSeconds);
+
+    static ULONGLONG CounterDelta(ULONGLONG before, ULONGLONG after,
+        ULONGLONG range);
+    static EnergyReport BuildReport(
+        const std::vector<EnergyCounter>& before,
+        const std::vector<EnergyCounter>& after,
+        double wallSeconds);
+    static std::wstring FormatReport(const EnergyReport& report);
+
+private:
+    EnergyMeter& m_meter;
+    std::vector<EnergyCounter> m_start;
+};
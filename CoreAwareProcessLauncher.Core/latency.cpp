@@ -0,0 +1,94 @@
+// latency.cpp
+#include "pch.h"
+#include "latency.h"
+#include "affinity.h"
+#include "cpu.h"
+#include "scheduling.h"
+#include "utilities.h"
+#include <format>
+
+// SCHED_FIFO priority the profile asks for
+const int LATENCY_REALTIME_PRIORITY = 50;
+
+LatencyProfile::LatencyProfile(const Settings& settings)
+	: m_settings(settings) {}
+
+LatencyProfile::~LatencyProfile() {
+	Restore();  // In case the launch failed before OnExit
+}
+
+DWORD_PTR LatencyProfile::GetReservedMask() {
+	auto caps = CpuInfo::GetCapabilities();
+	DWORD_PTR cores = caps.isHybrid ? CpuInfo::GetPCoreMask()
+	                                : AffinityResolver::GetAllCoresMask();
+	return CpuInfo::RemoveSmtSiblings(cores);
+}
+
+SchedulingSettings LatencyProfile::GetSchedulingSettings() {
+	SchedulingSettings scheduling;
+	scheduling.priorityClass = REALTIME_PRIORITY_CLASS;
+	scheduling.setThreadPriority = true;
+	scheduling.threadPriority =
+		SchedulingResolver::RealtimeToThreadPriority(LATENCY_REALTIME_PRIORITY);
+	scheduling.highQos = true;
+	return scheduling;
+}
+
+LatencyProfile::Settings LatencyProfile::FromOptions(
+	const CommandLineOptions& options) {
+	Settings settings;
+	settings.workingSetMB = options.memlockMB;
+	settings.disableIdle = options.idleDisable;
+	return settings;
+}
+
+DWORD LatencyProfile::GetIntervalMs() const {
+	return INFINITE;  // Nothing to poll; only start and exit matter
+}
+
+void LatencyProfile::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+
+	// The closest thing to RLIMIT_MEMLOCK: a large minimum working set
+	// keeps the child's pages resident and lets it VirtualLock them
+	SIZE_T minimum = static_cast<SIZE_T>(m_settings.workingSetMB) << 20;
+	if (!SetProcessWorkingSetSizeEx(process, minimum, minimum * 2,
+		QUOTA_LIMITS_HARDWS_MIN_DISABLE | QUOTA_LIMITS_HARDWS_MAX_DISABLE)) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Could not raise the working set to {} MB: error {}",
+			m_settings.workingSetMB, GetLastError());
+	}
+
+	if (m_settings.disableIdle) {
+		try {
+			FrequencyPinning::Request request;
+			request.disableIdle = true;
+			auto pinning = std::make_unique<FrequencyPinning>(request,
+				FrequencyPinning::Target(), PowerPlanStore::Active(),
+				FrequencyPinning::GetDefaultJournalPath(L"idle"));
+			pinning->Pin();
+			m_idlePinning = std::move(pinning);
+		} catch (const std::exception& e) {
+			g_logger->Log(ApplicationLogger::Level::WARNING,
+				"Could not disable processor idle states: {}", e.what());
+		}
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Latency profile active: mask 0x{:X}, working set {} MB, "
+		"idle disabled: {}", affinityMask, m_settings.workingSetMB,
+		m_idlePinning != nullptr);
+}
+
+void LatencyProfile::OnTick(HANDLE process) {}
+
+void LatencyProfile::OnExit(HANDLE process) {
+	Restore();
+}
+
+void LatencyProfile::Restore() {
+	if (m_idlePinning) {
+		m_idlePinning->Restore();
+		m_idlePinning.reset();
+	}
+}
@@ -0,0 +1,41 @@
+// latency.h
+#pragma once
+#include <windows.h>
+#include <memory>
+#include "options.h"
+#include "powerplan.h"
+#include "process.h"
+
+// Holds the system-wide settings of --latency-critical for the lifetime
+// of the child and puts them back when it exits. The timer resolution is
+// per process since Windows 10 2004, so the child has to request its own
+class LatencyProfile : public ProcessMonitor {
+public:
+    struct Settings {
+        int workingSetMB = 256;   // Minimum working set of the child
+        bool disableIdle = false;    // Keep processors out of idle states
+    };
+
+    explicit LatencyProfile(const Settings& settings);
+    ~LatencyProfile();
+
+    // P-cores (all cores on non-hybrid CPUs) with one thread per
+    // physical core, so the SMT siblings stay idle
+    static DWORD_PTR GetReservedMask();
+    static SchedulingSettings GetSchedulingSettings();
+    static Settings FromOptions(const CommandLineOptions& options);
+
+    DWORD GetIntervalMs() const override;
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+    void OnExit(HANDLE process) override;
+
+private:
+    void Restore();
+
+    Settings m_settings;
+    // Journaled like --freq, so a killed launcher's change is undone by
+    // the next launch
+    std::unique_ptr<FrequencyPinning> m_idlePinning;
+};
@@ -0,0 +1,260 @@
+// metrics.cpp
+#include "pch.h"
+#include "metrics.h"
+#include "utilities.h"
+#include <winternl.h>
+#include <psapi.h>
+#include <algorithm>
+#include <format>
+#include <iterator>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+const char* const CLASS_NAMES[MetricsSample::CLASS_COUNT] = {
+	"p", "e", "lp", "other" };
+
+// Label values escape backslash, quote and newline
+std::string EscapeLabel(const std::string& value) {
+	std::string escaped;
+	for (char c : value) {
+		if (c == '\\' || c == '"') {
+			escaped += '\\';
+			escaped += c;
+		} else if (c == '\n') {
+			escaped += "\\n";
+		} else {
+			escaped += c;
+		}
+	}
+	return escaped;
+}
+
+} // namespace
+
+MetricsExporter::MetricsExporter(const std::wstring& path, DWORD intervalMs,
+	const CpuInfo::CoreTypeMasks& masks)
+	: m_path(path), m_temporaryPath(path + L".tmp"), m_intervalMs(intervalMs) {
+	DWORD_PTR allowed = CpuInfo::GetAllowedMask();
+	m_classMasks[MetricsSample::P_CORES] = masks.pCoreMask & allowed;
+	m_classMasks[MetricsSample::E_CORES] = masks.eCoreMask & allowed;
+	m_classMasks[MetricsSample::LP_E_CORES] = masks.lpECoreMask & allowed;
+	// Everything on non-hybrid CPUs
+	m_classMasks[MetricsSample::OTHER_CORES] = allowed &
+		~(masks.pCoreMask | masks.eCoreMask | masks.lpECoreMask);
+}
+
+std::unique_ptr<MetricsExporter> MetricsExporter::Create(
+	const CommandLineOptions& options) {
+	return std::make_unique<MetricsExporter>(options.metricsPath,
+		options.metricsIntervalMs, CpuInfo::GetCoreTypeMasks());
+}
+
+DWORD MetricsExporter::GetIntervalMs() const {
+	return m_intervalMs;
+}
+
+void MetricsExporter::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+	m_processId = processId;
+	m_sample = {};
+	m_lastCpuSeconds = 0.0;
+
+	WCHAR image[MAX_PATH];
+	DWORD length = MAX_PATH;
+	std::string program;
+	if (QueryFullProcessImageNameW(process, 0, image, &length)) {
+		std::wstring path(image, length);
+		program = ConvertToNarrowString(path.substr(path.find_last_of(L'\\') + 1));
+	}
+	m_labels = std::format("pid=\"{}\",program=\"{}\"", processId,
+		EscapeLabel(program));
+
+	// Sized once here; ticks only reuse the storage
+	m_text.reserve(4096);
+	CpuLoadSampler::ReadTimes(m_lastTimes, m_loadBuffer);
+	m_times.reserve(m_lastTimes.size());
+	TakeSample(process);
+	Publish();
+}
+
+void MetricsExporter::OnTick(HANDLE process) {
+	TakeSample(process);
+	Publish();
+}
+
+void MetricsExporter::OnExit(HANDLE process) {
+	TakeSample(process);
+	m_sample.running = false;
+	Publish();
+}
+
+const MetricsSample& MetricsExporter::GetLastSample() const {
+	return m_sample;
+}
+
+void MetricsExporter::TakeSample(HANDLE process) {
+	FILETIME creationTime, exitTime, kernelTime, userTime;
+	if (GetProcessTimes(process, &creationTime, &exitTime, &kernelTime,
+		&userTime)) {
+		double cpuSeconds = ProcessManager::FileTimeToSeconds(kernelTime) +
+			ProcessManager::FileTimeToSeconds(userTime);
+		DWORD_PTR mask = 0, systemMask = 0;
+		if (!GetProcessAffinityMask(process, &mask, &systemMask)) {
+			mask = CpuInfo::GetAllowedMask();
+		}
+		CpuLoadSampler::ReadTimes(m_times, m_loadBuffer);
+		SplitByClass(cpuSeconds - m_lastCpuSeconds, m_lastTimes, m_times, mask,
+			m_classMasks, m_sample.cpuSeconds);
+		m_lastTimes.swap(m_times);
+		m_lastCpuSeconds = cpuSeconds;
+	}
+
+	PROCESS_MEMORY_COUNTERS memory = { sizeof(memory) };
+	if (GetProcessMemoryInfo(process, &memory, sizeof(memory))) {
+		m_sample.residentBytes = memory.WorkingSetSize;
+	}
+	m_sample.threads = CountThreads();
+
+	CpuInfo::GetProcessorFrequencies(m_frequencies, m_frequencyBuffer);
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		double lowest = 1.0;
+		for (const auto& processor : m_frequencies) {
+			if (processor.number < sizeof(DWORD_PTR) * 8 &&
+				(m_classMasks[c] & (DWORD_PTR(1) << processor.number)) &&
+				processor.maxMhz > 0) {
+				lowest = (std::min)(lowest,
+					static_cast<double>(processor.mhzLimit) / processor.maxMhz);
+			}
+		}
+		m_sample.frequencyLimitRatio[c] = lowest;
+		m_sample.frequencyLimited[c] = lowest < 0.85;
+	}
+}
+
+void MetricsExporter::SplitByClass(double seconds,
+	const std::vector<CpuLoadSampler::Times>& before,
+	const std::vector<CpuLoadSampler::Times>& after, DWORD_PTR mask,
+	const DWORD_PTR (&classMasks)[MetricsSample::CLASS_COUNT],
+	double (&cpuSeconds)[MetricsSample::CLASS_COUNT]) {
+
+	double busy[MetricsSample::CLASS_COUNT] = {};
+	double processors[MetricsSample::CLASS_COUNT] = {};
+	double totalBusy = 0.0, totalProcessors = 0.0;
+	size_t count = (std::min)(before.size(), after.size());
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		for (size_t i = 0; i < count && i < sizeof(DWORD_PTR) * 8; i++) {
+			if (!(mask & classMasks[c] & (DWORD_PTR(1) << i))) {
+				continue;
+			}
+			ULONGLONG total = after[i].total - before[i].total;
+			ULONGLONG idle = after[i].idle - before[i].idle;
+			busy[c] += static_cast<double>(total - (std::min)(idle, total));
+			processors[c] += 1.0;
+		}
+		totalBusy += busy[c];
+		totalProcessors += processors[c];
+	}
+
+	// Idle machine: split by processor count instead
+	const double* weights = totalBusy > 0.0 ? busy : processors;
+	double totalWeight = totalBusy > 0.0 ? totalBusy : totalProcessors;
+	if (totalWeight == 0.0) {
+		cpuSeconds[MetricsSample::OTHER_CORES] += seconds;
+		return;
+	}
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		cpuSeconds[c] += seconds * weights[c] / totalWeight;
+	}
+}
+
+DWORD MetricsExporter::CountThreads() {
+	if (!ProcessManager::QueryProcessList(m_processBuffer)) {
+		return 0;
+	}
+
+	for (size_t offset = 0;;) {
+		auto entry = reinterpret_cast<const SYSTEM_PROCESS_INFORMATION*>(
+			m_processBuffer.data() + offset);
+		if (reinterpret_cast<ULONG_PTR>(entry->UniqueProcessId) == m_processId) {
+			return entry->NumberOfThreads;
+		}
+		if (entry->NextEntryOffset == 0) {
+			return 0;
+		}
+		offset += entry->NextEntryOffset;
+	}
+}
+
+void MetricsExporter::FormatMetrics(const MetricsSample& sample,
+	const std::string& labels,
+	const DWORD_PTR (&classMasks)[MetricsSample::CLASS_COUNT],
+	std::string& out) {
+
+	auto to = std::back_inserter(out);
+	std::format_to(to, "# HELP capl_cpu_seconds CPU time of the program per "
+		"core class, split by class load when its mask spans classes.\n"
+		"# TYPE capl_cpu_seconds counter\n");
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		if (classMasks[c] != 0) {
+			std::format_to(to, "capl_cpu_seconds_total{{{},class=\"{}\"}} {:.6f}\n",
+				labels, CLASS_NAMES[c], sample.cpuSeconds[c]);
+		}
+	}
+	std::format_to(to, "# HELP capl_threads Threads of the program.\n"
+		"# TYPE capl_threads gauge\ncapl_threads{{{}}} {}\n",
+		labels, sample.threads);
+	std::format_to(to, "# HELP capl_resident_memory_bytes Working set of the "
+		"program.\n# TYPE capl_resident_memory_bytes gauge\n"
+		"capl_resident_memory_bytes{{{}}} {}\n", labels, sample.residentBytes);
+
+	std::format_to(to, "# HELP capl_frequency_limit_ratio Lowest clock limit "
+		"in the core class over its maximum clock.\n"
+		"# TYPE capl_frequency_limit_ratio gauge\n");
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		if (classMasks[c] != 0) {
+			std::format_to(to, "capl_frequency_limit_ratio{{{},class=\"{}\"}} "
+				"{:.3f}\n", labels, CLASS_NAMES[c],
+				sample.frequencyLimitRatio[c]);
+		}
+	}
+	std::format_to(to, "# HELP capl_frequency_limited Whether the core class "
+		"is limited below 85% of its maximum clock.\n"
+		"# TYPE capl_frequency_limited gauge\n");
+	for (int c = 0; c < MetricsSample::CLASS_COUNT; c++) {
+		if (classMasks[c] != 0) {
+			std::format_to(to, "capl_frequency_limited{{{},class=\"{}\"}} {}\n",
+				labels, CLASS_NAMES[c], sample.frequencyLimited[c] ? 1 : 0);
+		}
+	}
+	std::format_to(to, "# HELP capl_up Whether the program is running.\n"
+		"# TYPE capl_up gauge\ncapl_up{{{}}} {}\n# EOF\n", labels,
+		sample.running ? 1 : 0);
+}
+
+void MetricsExporter::Publish() {
+	m_text.clear();
+	FormatMetrics(m_sample, m_labels, m_classMasks, m_text);
+
+	// Written next to the target, then renamed over it
+	HANDLE file = CreateFileW(m_temporaryPath.c_str(), GENERIC_WRITE, 0, NULL,
+		CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Cannot write the metrics file {}: error {}", m_temporaryPath,
+			GetLastError());
+		return;
+	}
+	DWORD written = 0;
+	BOOL ok = ::WriteFile(file, m_text.data(),
+		static_cast<DWORD>(m_text.size()), &written, NULL);
+	CloseHandle(file);
+	if (!ok || written != m_text.size() ||
+		!MoveFileExW(m_temporaryPath.c_str(), m_path.c_str(),
+			MOVEFILE_REPLACE_EXISTING)) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Cannot publish the metrics file {}: error {}", m_path,
+			GetLastError());
+	}
+}
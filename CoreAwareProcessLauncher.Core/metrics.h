@@ -0,0 +1,82 @@
+// metrics.h
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "cpuload.h"
+#include "options.h"
+#include "process.h"
+
+// Values of one --metrics-file tick
+struct MetricsSample {
+    enum CoreClass { P_CORES, E_CORES, LP_E_CORES, OTHER_CORES, CLASS_COUNT };
+
+    double cpuSeconds[CLASS_COUNT] = {};  // Cumulative since the start
+    DWORD threads = 0;
+    SIZE_T residentBytes = 0;
+    // Lowest firmware/thermal clock limit in the class as a fraction of its
+    // maximum; limited below 85% (like --thermal-policy)
+    double frequencyLimitRatio[CLASS_COUNT] = {};
+    bool frequencyLimited[CLASS_COUNT] = {};
+    bool running = true;
+};
+
+// Writes the launched program's metrics as OpenMetrics text every interval
+// (--metrics-file, --metrics-interval) for a textfile collector. The file
+// is replaced with a rename, so readers never see a partial file. Buffers
+// are sized on the first tick and reused afterwards
+class MetricsExporter : public ProcessMonitor {
+public:
+    MetricsExporter(const std::wstring& path, DWORD intervalMs,
+        const CpuInfo::CoreTypeMasks& masks);
+
+    static std::unique_ptr<MetricsExporter> Create(
+        const CommandLineOptions& options);
+
+    DWORD GetIntervalMs() const override;
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+    void OnExit(HANDLE process) override;
+
+    const MetricsSample& GetLastSample() const;
+
+    // Appends the text for sample; classes whose mask is 0 are left out
+    static void FormatMetrics(const MetricsSample& sample,
+        const std::string& labels,
+        const DWORD_PTR (&classMasks)[MetricsSample::CLASS_COUNT],
+        std::string& out);
+
+    // Splits CPU time across the classes in proportion to how busy their
+    // processors in mask were; exact when mask holds one class
+    static void SplitByClass(double seconds,
+        const std::vector<CpuLoadSampler::Times>& before,
+        const std::vector<CpuLoadSampler::Times>& after, DWORD_PTR mask,
+        const DWORD_PTR (&classMasks)[MetricsSample::CLASS_COUNT],
+        double (&cpuSeconds)[MetricsSample::CLASS_COUNT]);
+
+private:
+    void TakeSample(HANDLE process);
+    DWORD CountThreads();
+    void Publish();
+
+    std::wstring m_path;
+    std::wstring m_temporaryPath;
+    DWORD m_intervalMs;
+    DWORD_PTR m_classMasks[MetricsSample::CLASS_COUNT] = {};
+    DWORD m_processId = 0;
+    std::string m_labels;
+    double m_lastCpuSeconds = 0.0;
+    MetricsSample m_sample;
+
+    // Reused on every tick
+    std::vector<CpuLoadSampler::Times> m_lastTimes;
+    std::vector<CpuLoadSampler::Times> m_times;
+    std::vector<BYTE> m_loadBuffer;
+    std::vector<CpuInfo::ProcessorFrequency> m_frequencies;
+    std::vector<BYTE> m_frequencyBuffer;
+    std::vector<BYTE> m_processBuffer;
+    std::string m_text;
+};
@@ -0,0 +1,536 @@
+// monitor.cpp
+#include "pch.h"
+#include "monitor.h"
+#include "affinity.h"
+#include "cpu.h"
+#include "utilities.h"
+#include <evntcons.h>
+#include <tlhelp32.h>
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <psapi.h>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+// Classic provider of the kernel thread events (CSwitch, thread start)
+const GUID THREAD_EVENTS = { 0x3d6fa8d1, 0xfe05, 0x11d0,
+	{ 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+const GUID LLC_SESSION_GUID = { 0x2f0b7d1e, 0x93c4, 0x4a6b,
+	{ 0x8e, 0x51, 0x07, 0xd2, 0xc6, 0x3a, 0x9f, 0x14 } };
+
+const UCHAR OPCODE_THREAD_START = 1;
+const UCHAR OPCODE_THREAD_RUNDOWN = 3;
+const UCHAR OPCODE_CSWITCH = 36;
+
+// Owned by the launcher whose session reads the counters; a session that
+// exists while nobody owns this is stale
+const wchar_t LLC_OWNER_MUTEX[] = L"Global\\CAPL LLC Counters";
+
+DWORD ReadUInt32(const BYTE* data, size_t offset) {
+	DWORD value;
+	memcpy(&value, data + offset, sizeof(value));
+	return value;
+}
+
+} // namespace
+
+std::unique_ptr<LlcCounterSession> LlcCounterSession::Start(
+	DWORD processId) {
+	HANDLE owner = CreateMutexW(NULL, FALSE, LLC_OWNER_MUTEX);
+	if (!owner) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: cannot create their lock: error {}",
+			GetLastError());
+		return nullptr;
+	}
+	DWORD wait = WaitForSingleObject(owner, 0);
+	if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+		CloseHandle(owner);
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"LLC counters unavailable: another launcher is reading them");
+		return nullptr;
+	}
+	// Nobody owned the name, so a session under it was left behind by a
+	// launcher that was killed
+	if (StopNamedSession() == ERROR_SUCCESS) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Stopped a stale LLC counter session");
+	}
+
+	std::unique_ptr<LlcCounterSession> session(
+		new LlcCounterSession(owner, processId));
+	ULONG missSource = 0, referenceSource = 0;
+	if (!FindSources(missSource, referenceSource) ||
+		!session->Open(missSource, referenceSource)) {
+		return nullptr;
+	}
+	return session;
+}
+
+LlcCounterSession::LlcCounterSession(HANDLE owner, DWORD processId)
+	: m_owner(owner), m_processId(processId) {}
+
+LlcCounterSession::~LlcCounterSession() {
+	Stop();
+	ReleaseMutex(m_owner);
+	CloseHandle(m_owner);
+}
+
+bool LlcCounterSession::FindSources(ULONG& missSource,
+	ULONG& referenceSource) {
+	ULONG length = 0;
+	ULONG status = TraceQueryInformation(0, TraceProfileSourceListInfo,
+		nullptr, 0, &length);
+	std::vector<BYTE> buffer(length);
+	if (length > 0) {
+		status = TraceQueryInformation(0, TraceProfileSourceListInfo,
+			buffer.data(), length, &length);
+	}
+	if (length == 0 || status != ERROR_SUCCESS) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: cannot list the profile sources: "
+			"error {}", status);
+		return false;
+	}
+
+	bool foundMisses = false, foundReferences = false;
+	for (ULONG offset = 0; offset < length;) {
+		auto info = reinterpret_cast<PROFILE_SOURCE_INFO*>(
+			buffer.data() + offset);
+		if (wcscmp(info->Description, L"LLCMisses") == 0) {
+			missSource = info->Source;
+			foundMisses = true;
+		} else if (wcscmp(info->Description, L"LLCReference") == 0) {
+			referenceSource = info->Source;
+			foundReferences = true;
+		}
+		if (info->NextEntryOffset == 0) {
+			break;
+		}
+		offset += info->NextEntryOffset;
+	}
+	if (!foundMisses || !foundReferences) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: the PMU has no LLCMisses and "
+			"LLCReference sources");
+		return false;
+	}
+	return true;
+}
+
+bool LlcCounterSession::Open(ULONG missSource, ULONG referenceSource) {
+	m_sessionName = SESSION_NAME;
+	m_properties.assign(sizeof(EVENT_TRACE_PROPERTIES) +
+		(m_sessionName.size() + 1) * sizeof(wchar_t), 0);
+	auto properties = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(
+		m_properties.data());
+	properties->Wnode.BufferSize = static_cast<ULONG>(m_properties.size());
+	properties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+	properties->Wnode.ClientContext = 1;  // QueryPerformanceCounter time
+	properties->Wnode.Guid = LLC_SESSION_GUID;
+	properties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE |
+		EVENT_TRACE_SYSTEM_LOGGER_MODE;
+	properties->EnableFlags = EVENT_TRACE_FLAG_CSWITCH |
+		EVENT_TRACE_FLAG_THREAD;
+	properties->BufferSize = 256;  // KB; context switches come in bursts
+	properties->MinimumBuffers = 32;
+	properties->MaximumBuffers = 128;
+	properties->FlushTimer = 1;
+	properties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+
+	ULONG status = StartTraceW(&m_session, m_sessionName.c_str(), properties);
+	if (status != ERROR_SUCCESS) {
+		m_session = 0;
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: cannot start the kernel session "
+			"(administrator rights needed): error {}", status);
+		return false;
+	}
+	// Ctrl+C and closing the console end CAPL without unwinding; the
+	// kernel session would outlive it
+	SetConsoleCtrlHandler(&LlcCounterSession::OnConsoleControl, TRUE);
+
+	// Every context switch carries the counters of its processor
+	ULONG sources[] = { missSource, referenceSource };
+	CLASSIC_EVENT_ID cswitch = {};
+	cswitch.EventGuid = THREAD_EVENTS;
+	cswitch.Type = OPCODE_CSWITCH;
+	status = TraceSetInformation(m_session, TracePmcCounterListInfo,
+		sources, sizeof(sources));
+	if (status == ERROR_SUCCESS) {
+		status = TraceSetInformation(m_session, TracePmcEventListInfo,
+			&cswitch, sizeof(cswitch));
+	}
+	if (status != ERROR_SUCCESS) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: the PMU counters cannot be "
+			"attached: error {}", status);
+		Stop();
+		return false;
+	}
+
+	// The suspended main thread started before the consumer
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot != INVALID_HANDLE_VALUE) {
+		THREADENTRY32 entry = { sizeof(entry) };
+		for (BOOL more = Thread32First(snapshot, &entry); more;
+			more = Thread32Next(snapshot, &entry)) {
+			if (entry.th32OwnerProcessID == m_processId) {
+				m_threads.insert(entry.th32ThreadID);
+			}
+		}
+		CloseHandle(snapshot);
+	}
+
+	EVENT_TRACE_LOGFILEW logFile = {};
+	logFile.LoggerName = m_sessionName.data();
+	logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME |
+		PROCESS_TRACE_MODE_EVENT_RECORD | PROCESS_TRACE_MODE_RAW_TIMESTAMP;
+	logFile.EventRecordCallback = &LlcCounterSession::OnEvent;
+	logFile.Context = this;
+	m_consumer = OpenTraceW(&logFile);
+	if (m_consumer == INVALID_PROCESSTRACE_HANDLE) {
+		g_logger->Log(ApplicationLogger::Level::INFO,
+			"LLC counters unavailable: cannot open the session: error {}",
+			GetLastError());
+		Stop();
+		return false;
+	}
+	m_consumerThread = std::thread([this]() {
+		ProcessTrace(&m_consumer, 1, NULL, NULL);
+	});
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"LLC counter session started (sources {} and {})", missSource,
+		referenceSource);
+	return true;
+}
+
+ULONGLONG LlcCounterSession::GetMisses() const {
+	return m_misses;
+}
+
+ULONGLONG LlcCounterSession::GetReferences() const {
+	return m_references;
+}
+
+void LlcCounterSession::Stop() {
+	if (m_session != 0) {
+		SetConsoleCtrlHandler(&LlcCounterSession::OnConsoleControl, FALSE);
+		auto properties = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(
+			m_properties.data());
+		ControlTraceW(m_session, NULL, properties, EVENT_TRACE_CONTROL_STOP);
+		m_session = 0;
+	}
+	// ProcessTrace returns once the stopped session is drained
+	if (m_consumerThread.joinable()) {
+		m_consumerThread.join();
+	}
+	if (m_consumer != INVALID_PROCESSTRACE_HANDLE) {
+		CloseTrace(m_consumer);
+		m_consumer = INVALID_PROCESSTRACE_HANDLE;
+	}
+}
+
+ULONG LlcCounterSession::StopNamedSession() {
+	struct {
+		EVENT_TRACE_PROPERTIES properties;
+		wchar_t name[64];
+	} buffer = {};
+	buffer.properties.Wnode.BufferSize = sizeof(buffer);
+	buffer.properties.LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+	return ControlTraceW(0, SESSION_NAME, &buffer.properties,
+		EVENT_TRACE_CONTROL_STOP);
+}
+
+BOOL WINAPI LlcCounterSession::OnConsoleControl(DWORD controlType) {
+	StopNamedSession();
+	return FALSE;  // The default handler still ends the process
+}
+
+void WINAPI LlcCounterSession::OnEvent(PEVENT_RECORD event) {
+	static_cast<LlcCounterSession*>(event->UserContext)->HandleEvent(event);
+}
+
+void LlcCounterSession::HandleEvent(PEVENT_RECORD event) {
+	if (!IsEqualGUID(event->EventHeader.ProviderId, THREAD_EVENTS) ||
+		event->UserDataLength < 8) {
+		return;
+	}
+	auto data = static_cast<const BYTE*>(event->UserData);
+
+	switch (event->EventHeader.EventDescriptor.Opcode) {
+	case OPCODE_THREAD_START:
+	case OPCODE_THREAD_RUNDOWN:
+		// ProcessId, TThreadId, ...; ended threads stay in the set so
+		// their last time slice still counts
+		if (ReadUInt32(data, 0) == m_processId) {
+			m_threads.insert(ReadUInt32(data, 4));
+		}
+		break;
+	case OPCODE_CSWITCH: {
+		const ULONG64* counts = nullptr;
+		for (USHORT i = 0; i < event->ExtendedDataCount; i++) {
+			const auto& item = event->ExtendedData[i];
+			if (item.ExtType == EVENT_HEADER_EXT_TYPE_PMC_COUNTERS &&
+				item.DataSize >= 2 * sizeof(ULONG64)) {
+				counts = reinterpret_cast<const ULONG64*>(item.DataPtr);
+			}
+		}
+		if (!counts) {
+			break;
+		}
+		// The counters run per processor; what they counted since the
+		// previous switch there belongs to the thread now leaving
+		USHORT processor = event->BufferContext.ProcessorIndex;
+		if (processor >= m_lastCounts.size()) {
+			m_lastCounts.resize(processor + 1);
+		}
+		auto& last = m_lastCounts[processor];
+		if (!last.empty() && m_threads.count(ReadUInt32(data, 4))) {
+			m_misses += counts[0] - last[0];
+			m_references += counts[1] - last[1];
+		}
+		last.assign(counts, counts + 2);
+		break;
+	}
+	}
+}
+
+ResourceMonitor::ResourceMonitor(DWORD intervalMs,
+	const std::vector<DWORD_PTR>& domainMasks)
+	: m_intervalMs(intervalMs), m_domainMasks(domainMasks) {
+	if (m_domainMasks.empty()) {
+		m_domainMasks.push_back(AffinityResolver::GetAllCoresMask());
+	}
+}
+
+std::unique_ptr<ResourceMonitor> ResourceMonitor::Create(
+	const CommandLineOptions& options) {
+	return std::make_unique<ResourceMonitor>(options.monitorIntervalMs,
+		CpuInfo::GetCacheDomainMasks(3));
+}
+
+DWORD ResourceMonitor::GetIntervalMs() const {
+	return m_intervalMs;
+}
+
+void ResourceMonitor::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+	m_affinityMask = affinityMask;
+	m_startTick = GetTickCount64();
+	m_load.Sample();
+	m_samples.clear();
+
+	// Baselines so the first row only counts what happens after the start
+	QueryProcessCycleTime(process, &m_lastCycles);
+	PROCESS_MEMORY_COUNTERS memory = { sizeof(memory) };
+	if (GetProcessMemoryInfo(process, &memory, sizeof(memory))) {
+		m_lastPageFaults = memory.PageFaultCount;
+	}
+	GetProcessIoCounters(process, &m_lastIo);
+
+	// Started while the program is still suspended, so no switch is missed
+	m_llc = LlcCounterSession::Start(processId);
+	m_lastLlcMisses = 0;
+	m_lastLlcReferences = 0;
+}
+
+void ResourceMonitor::OnTick(HANDLE process) {
+	TakeSample(process);
+}
+
+void ResourceMonitor::OnExit(HANDLE process) {
+	// Count the switches still buffered before the last row
+	if (m_llc) {
+		m_llc->Stop();
+	}
+	// The handle stays valid after exit, so the last row holds the totals
+	TakeSample(process);
+}
+
+void ResourceMonitor::TakeSample(HANDLE process) {
+	ResourceSample sample;
+	sample.seconds = (GetTickCount64() - m_startTick) / 1000.0;
+
+	ULONG64 cycles = 0;
+	if (QueryProcessCycleTime(process, &cycles)) {
+		sample.cycles = cycles - m_lastCycles;
+		m_lastCycles = cycles;
+	}
+
+	PROCESS_MEMORY_COUNTERS_EX memory = { sizeof(memory) };
+	if (GetProcessMemoryInfo(process,
+		reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&memory), sizeof(memory))) {
+		sample.workingSetBytes = memory.WorkingSetSize;
+		sample.privateBytes = memory.PrivateUsage;
+		sample.pageFaults = memory.PageFaultCount - m_lastPageFaults;
+		m_lastPageFaults = memory.PageFaultCount;
+	}
+
+	IO_COUNTERS io = {};
+	if (GetProcessIoCounters(process, &io)) {
+		sample.readBytes = io.ReadTransferCount - m_lastIo.ReadTransferCount;
+		sample.writeBytes = io.WriteTransferCount - m_lastIo.WriteTransferCount;
+		m_lastIo = io;
+	}
+
+	if (m_llc) {
+		ULONGLONG misses = m_llc->GetMisses();
+		ULONGLONG references = m_llc->GetReferences();
+		sample.hasLlc = true;
+		sample.llcMisses = misses - m_lastLlcMisses;
+		sample.llcReferences = references - m_lastLlcReferences;
+		m_lastLlcMisses = misses;
+		m_lastLlcReferences = references;
+	}
+
+	auto busy = m_load.Sample();
+	for (DWORD_PTR domain : m_domainMasks) {
+		sample.domainBusy.push_back(CpuLoadSampler::Average(busy, domain));
+	}
+
+	m_samples.push_back(sample);
+}
+
+const std::vector<ResourceSample>& ResourceMonitor::GetSamples() const {
+	return m_samples;
+}
+
+ResourceSummary ResourceMonitor::Summarize(
+	const std::vector<ResourceSample>& samples, size_t domainCount) {
+
+	ResourceSummary summary;
+	summary.meanDomainBusy.assign(domainCount, 0.0);
+	summary.peakDomainBusy.assign(domainCount, 0.0);
+	for (const auto& sample : samples) {
+		summary.seconds = (std::max)(summary.seconds, sample.seconds);
+		summary.totalCycles += sample.cycles;
+		summary.peakWorkingSetBytes =
+			(std::max)(summary.peakWorkingSetBytes, sample.workingSetBytes);
+		summary.peakPrivateBytes =
+			(std::max)(summary.peakPrivateBytes, sample.privateBytes);
+		summary.totalPageFaults += sample.pageFaults;
+		summary.totalReadBytes += sample.readBytes;
+		summary.totalWriteBytes += sample.writeBytes;
+		summary.hasLlc = summary.hasLlc || sample.hasLlc;
+		summary.totalLlcMisses += sample.llcMisses;
+		summary.totalLlcReferences += sample.llcReferences;
+		for (size_t i = 0; i < domainCount && i < sample.domainBusy.size(); i++) {
+			summary.meanDomainBusy[i] += sample.domainBusy[i];
+			summary.peakDomainBusy[i] =
+				(std::max)(summary.peakDomainBusy[i], sample.domainBusy[i]);
+		}
+	}
+	if (!samples.empty()) {
+		for (double& mean : summary.meanDomainBusy) {
+			mean /= samples.size();
+		}
+	}
+	return summary;
+}
+
+std::wstring ResourceMonitor::FormatSummary() const {
+	auto summary = Summarize(m_samples, m_domainMasks.size());
+	const double MB = 1024.0 * 1024.0;
+
+	std::wstringstream ss;
+	ss << L"\nResource Monitor Summary:\n";
+	ss << std::format(L"  Samples:            {} over {:.1f}s\n",
+		m_samples.size(), summary.seconds);
+	ss << std::format(L"  Cycles:             {:.3f} G\n",
+		summary.totalCycles / 1e9);
+	ss << std::format(L"  Peak working set:   {:.1f} MB\n",
+		summary.peakWorkingSetBytes / MB);
+	ss << std::format(L"  Peak private bytes: {:.1f} MB\n",
+		summary.peakPrivateBytes / MB);
+	ss << std::format(L"  Page faults:        {}\n", summary.totalPageFaults);
+	ss << std::format(L"  I/O read / write:   {:.1f} / {:.1f} MB\n",
+		summary.totalReadBytes / MB, summary.totalWriteBytes / MB);
+	if (summary.hasLlc) {
+		ss << std::format(L"  LLC misses / refs:  {:.3f} / {:.3f} M "
+			L"({:.1f}% missed)\n", summary.totalLlcMisses / 1e6,
+			summary.totalLlcReferences / 1e6,
+			summary.totalLlcReferences > 0
+				? 100.0 * summary.totalLlcMisses / summary.totalLlcReferences
+				: 0.0);
+	} else {
+		ss << L"  LLC counters:       not available (needs administrator "
+			L"rights and PMU support)\n";
+	}
+	for (size_t i = 0; i < m_domainMasks.size(); i++) {
+		ss << std::format(L"  L3 domain {} (0x{:X}){}: {:.1f}% busy, "
+			L"peak {:.1f}%\n", i, m_domainMasks[i],
+			(m_domainMasks[i] & m_affinityMask) ? L" *" : L"",
+			summary.meanDomainBusy[i] * 100.0,
+			summary.peakDomainBusy[i] * 100.0);
+	}
+	ss << L"  (* = domain in the program's mask)\n";
+	return ss.str();
+}
+
+// A counter of the results file, or missing when it was not read
+static std::string LlcValue(bool hasLlc, ULONGLONG value,
+	const char* missing) {
+	return hasLlc ? std::to_string(value) : missing;
+}
+
+void ResourceMonitor::WriteResults(const std::wstring& path) const {
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("Cannot write results file: " +
+			ConvertToNarrowString(path));
+	}
+
+	if (path.ends_with(L".json")) {
+		out << "{\n  \"domains\": [";
+		for (size_t i = 0; i < m_domainMasks.size(); i++) {
+			out << std::format("{}\"0x{:X}\"", i > 0 ? ", " : "",
+				m_domainMasks[i]);
+		}
+		out << "],\n  \"samples\": [\n";
+		for (size_t i = 0; i < m_samples.size(); i++) {
+			const auto& sample = m_samples[i];
+			out << std::format("    {{\"seconds\": {:.3f}, \"cycles\": {}, "
+				"\"workingSetBytes\": {}, \"privateBytes\": {}, "
+				"\"pageFaults\": {}, \"readBytes\": {}, \"writeBytes\": {}, "
+				"\"llcMisses\": {}, \"llcReferences\": {}, \"domainBusy\": [",
+				sample.seconds, sample.cycles, sample.workingSetBytes,
+				sample.privateBytes, sample.pageFaults, sample.readBytes,
+				sample.writeBytes, LlcValue(sample.hasLlc, sample.llcMisses,
+					"null"),
+				LlcValue(sample.hasLlc, sample.llcReferences, "null"));
+			for (size_t d = 0; d < sample.domainBusy.size(); d++) {
+				out << std::format("{}{:.4f}", d > 0 ? ", " : "",
+					sample.domainBusy[d]);
+			}
+			out << "]}" << (i + 1 < m_samples.size() ? "," : "") << "\n";
+		}
+		out << "  ]\n}\n";
+	} else {
+		out << "seconds,cycles,working_set_bytes,private_bytes,page_faults,"
+			"read_bytes,write_bytes,llc_misses,llc_references";
+		for (size_t d = 0; d < m_domainMasks.size(); d++) {
+			out << ",l3_" << d << "_busy";
+		}
+		out << "\n";
+		for (const auto& sample : m_samples) {
+			out << std::format("{:.3f},{},{},{},{},{},{},{},{}",
+				sample.seconds, sample.cycles, sample.workingSetBytes,
+				sample.privateBytes, sample.pageFaults, sample.readBytes,
+				sample.writeBytes,
+				LlcValue(sample.hasLlc, sample.llcMisses, ""),
+				LlcValue(sample.hasLlc, sample.llcReferences, ""));
+			for (double busy : sample.domainBusy) {
+				out << std::format(",{:.4f}", busy);
+			}
+			out << "\n";
+		}
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Monitor results written to {}", path);
+}
@@ -0,0 +1,126 @@
+// monitor.h
+#pragma once
+#include <windows.h>
+#include <evntrace.h>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "cpuload.h"
+#include "options.h"
+#include "process.h"
+
+// One row of the --monitor time series; counters are deltas since the
+// previous row, sizes are the values at the time of the sample
+struct ResourceSample {
+    double seconds = 0.0;          // Since the program started
+    ULONGLONG cycles = 0;          // Cycles charged to the program
+    SIZE_T workingSetBytes = 0;
+    SIZE_T privateBytes = 0;
+    DWORD pageFaults = 0;
+    ULONGLONG readBytes = 0;
+    ULONGLONG writeBytes = 0;
+    bool hasLlc = false;           // The PMU counters below were read
+    ULONGLONG llcMisses = 0;
+    ULONGLONG llcReferences = 0;
+    std::vector<double> domainBusy; // Machine-wide busy fraction per L3
+};
+
+struct ResourceSummary {
+    double seconds = 0.0;
+    ULONGLONG totalCycles = 0;
+    SIZE_T peakWorkingSetBytes = 0;
+    SIZE_T peakPrivateBytes = 0;
+    ULONGLONG totalPageFaults = 0;
+    ULONGLONG totalReadBytes = 0;
+    ULONGLONG totalWriteBytes = 0;
+    bool hasLlc = false;
+    ULONGLONG totalLlcMisses = 0;
+    ULONGLONG totalLlcReferences = 0;
+    std::vector<double> meanDomainBusy;
+    std::vector<double> peakDomainBusy;
+};
+
+// Last-level cache misses and references of one process, read from the
+// PMU counters that a kernel ETW session attaches to every context switch.
+// Needs administrator rights; one launcher uses the counters at a time
+class LlcCounterSession {
+public:
+    static constexpr const wchar_t* SESSION_NAME = L"CAPL LLC Counters";
+
+    // Null when the counters cannot be read: no administrator rights, no
+    // LLCMisses/LLCReference profile source, or another launcher uses them
+    static std::unique_ptr<LlcCounterSession> Start(DWORD processId);
+    ~LlcCounterSession();
+
+    ULONGLONG GetMisses() const;
+    ULONGLONG GetReferences() const;
+    // Stops the session once the events still buffered are counted
+    void Stop();
+
+private:
+    LlcCounterSession(HANDLE owner, DWORD processId);
+
+    bool Open(ULONG missSource, ULONG referenceSource);
+    static bool FindSources(ULONG& missSource, ULONG& referenceSource);
+    static void WINAPI OnEvent(PEVENT_RECORD event);
+    void HandleEvent(PEVENT_RECORD event);
+    // Stops whatever session runs under SESSION_NAME; also used on Ctrl+C
+    static ULONG StopNamedSession();
+    static BOOL WINAPI OnConsoleControl(DWORD controlType);
+
+    HANDLE m_owner;                  // Held while this session runs
+    DWORD m_processId;
+    std::wstring m_sessionName;
+    std::vector<BYTE> m_properties;  // EVENT_TRACE_PROPERTIES and the name
+    TRACEHANDLE m_session = 0;
+    TRACEHANDLE m_consumer = INVALID_PROCESSTRACE_HANDLE;
+    std::thread m_consumerThread;
+    // Only touched by the consumer thread once it runs
+    std::unordered_set<DWORD> m_threads;
+    std::vector<std::vector<ULONG64>> m_lastCounts; // Per processor
+    std::atomic<ULONGLONG> m_misses = 0;
+    std::atomic<ULONGLONG> m_references = 0;
+};
+
+// Samples the launched program and the L3 domains it runs on (--monitor).
+// The LLC miss and reference counts come from LlcCounterSession when it
+// can start; the process counters are always sampled
+class ResourceMonitor : public ProcessMonitor {
+public:
+    ResourceMonitor(DWORD intervalMs, const std::vector<DWORD_PTR>& domainMasks);
+
+    static std::unique_ptr<ResourceMonitor> Create(
+        const CommandLineOptions& options);
+
+    DWORD GetIntervalMs() const override;
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+    void OnExit(HANDLE process) override;
+
+    const std::vector<ResourceSample>& GetSamples() const;
+    static ResourceSummary Summarize(const std::vector<ResourceSample>& samples,
+        size_t domainCount);
+    std::wstring FormatSummary() const;
+    // CSV, or JSON when the path ends in .json
+    void WriteResults(const std::wstring& path) const;
+
+private:
+    void TakeSample(HANDLE process);
+
+    DWORD m_intervalMs;
+    std::vector<DWORD_PTR> m_domainMasks;
+    DWORD_PTR m_affinityMask = 0;
+    CpuLoadSampler m_load;
+    ULONGLONG m_startTick = 0;
+    ULONG64 m_lastCycles = 0;
+    DWORD m_lastPageFaults = 0;
+    IO_COUNTERS m_lastIo = {};
+    std::unique_ptr<LlcCounterSession> m_llc;
+    ULONGLONG m_lastLlcMisses = 0;
+    ULONGLONG m_lastLlcReferences = 0;
+    std::vector<ResourceSample> m_samples;
+};
@@ -1,7 +1,9 @@
 // options.cpp
 #include "pch.h"
 #include "options.h"
+#include "cpu.h"
 #include "utilities.h"
+#include <algorithm>
 #include <format>
 #include <iostream>
 #include <sstream>
@@ -13,13 +15,232 @@ using Utilities::PathExists;
 
 CommandLineOptions::CommandLineOptions()
     : invertSelection(false), queryMode(false), enableLogging(false),
-      showHelp(false) {}
+      showHelp(false), repeatCount(0), warmupCount(0), dropCache(false),
+      shuffleRuns(false), tuneMode(false), tuneRunsSet(false),
+      tuneRuns(3),
+      sweepMode(false), measureEnergy(false), powerBudgetWatts(0.0),
+      temperatureLimitCelsius(0.0), pollIntervalSet(false),
+      pollIntervalMs(1000), schedPriority(0),
+      niceSet(false), niceValue(0), priorityClass(0), ioPriority(-1),
+      ecoQos(false), uclampMin(-1), uclampMax(-1), softAffinity(false),
+      latencyCritical(false), memlockSet(false), memlockMB(256),
+      idleDisable(false),
+      freqMinKhz(0), freqMaxKhz(0), epp(-1), llcDomain(-1),
+      monitorIntervalSet(false), monitorIntervalMs(1000),
+      metricsIntervalSet(false), metricsIntervalMs(5000),
+      topMode(false), topRefreshMs(1000),
+      exclusive(false), freeCoreCount(0), idleCoreCount(0),
+      idleWindowSet(false), idleWindowMs(50), shareTopology(false),
+      exportTopology(false), daemonMode(false) {}
+
+static CommandLineOptions::CoreAffinityMode
+ParseAffinityMode(const std::wstring &mode) {
+    if (mode == L"p") {
+        return CommandLineOptions::CoreAffinityMode::P_CORES_ONLY;
+    } else if (mode == L"e") {
+        return CommandLineOptions::CoreAffinityMode::E_CORES_ONLY;
+    } else if (mode == L"lp") {
+        return CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY;
+    } else if (mode == L"alle") {
+        return CommandLineOptions::CoreAffinityMode::ALL_E_CORES;
+    } else if (mode == L"all") {
+        return CommandLineOptions::CoreAffinityMode::ALL_CORES;
+    } else if (mode == L"learned") {
+        return CommandLineOptions::CoreAffinityMode::LEARNED;
+    }
+    throw std::runtime_error(ConvertToNarrowString(
+        L"Invalid mode. Use: p, e, lp, alle, all, learned"));
+}
+
+// Parses --sched batch|idle|other|fifo:<prio>|rr:<prio>
+static void ParseSchedPolicy(const std::wstring &value,
+                             CommandLineOptions &options) {
+    using SchedPolicy = CommandLineOptions::SchedPolicy;
+    size_t colon = value.find(L':');
+    std::wstring policy = value.substr(0, colon);
+
+    if (policy == L"fifo" || policy == L"rr") {
+        if (colon == std::wstring::npos) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--sched " + policy + L" requires a priority, e.g. " +
+                policy + L":50"));
+        }
+        std::wstring priority = value.substr(colon + 1);
+        int number = 0;
+        try {
+            size_t consumed = 0;
+            number = std::stoi(priority, &consumed);
+            if (consumed != priority.length()) {
+                throw std::invalid_argument("trailing characters");
+            }
+        } catch (...) {
+            number = 0;
+        }
+        if (number < 1 || number > 99) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--sched priority must be between 1 and 99, got: " +
+                priority));
+        }
+        options.schedPolicy =
+            policy == L"fifo" ? SchedPolicy::FIFO : SchedPolicy::RR;
+        options.schedPriority = number;
+        return;
+    }
+
+    if (colon != std::wstring::npos) {
+        throw std::runtime_error(ConvertToNarrowString(
+            L"Only fifo and rr take a priority: " + value));
+    }
+    if (policy == L"other") {
+        options.schedPolicy = SchedPolicy::OTHER;
+    } else if (policy == L"batch") {
+        options.schedPolicy = SchedPolicy::BATCH;
+    } else if (policy == L"idle") {
+        options.schedPolicy = SchedPolicy::IDLE;
+    } else {
+        throw std::runtime_error(ConvertToNarrowString(
+            L"Invalid scheduling policy. Use: other, batch, idle, "
+            L"fifo:<1-99>, rr:<1-99>"));
+    }
+}
+
+static DWORD ParsePriorityClass(const std::wstring &value) {
+    if (value == L"idle") {
+        return IDLE_PRIORITY_CLASS;
+    } else if (value == L"below") {
+        return BELOW_NORMAL_PRIORITY_CLASS;
+    } else if (value == L"normal") {
+        return NORMAL_PRIORITY_CLASS;
+    } else if (value == L"above") {
+        return ABOVE_NORMAL_PRIORITY_CLASS;
+    } else if (value == L"high") {
+        return HIGH_PRIORITY_CLASS;
+    } else if (value == L"realtime") {
+        return REALTIME_PRIORITY_CLASS;
+    }
+    throw std::runtime_error(ConvertToNarrowString(
+        L"Invalid priority. Use: idle, below, normal, above, high, realtime"));
+}
+
+// Values are IO_PRIORITY_HINT (IoPriorityVeryLow..IoPriorityHigh)
+static int ParseIoPriority(const std::wstring &value) {
+    if (value == L"idle") {
+        return 0;
+    } else if (value == L"low") {
+        return 1;
+    } else if (value == L"normal") {
+        return 2;
+    } else if (value == L"high") {
+        return 3;
+    }
+    throw std::runtime_error(ConvertToNarrowString(
+        L"Invalid I/O priority. Use: idle, low, normal, high"));
+}
+
+// Parses the integer value of a numeric option such as --repeat
+static int ParseCountArgument(const std::wstring &value,
+                              const std::wstring &option, int minimum) {
+    int count = 0;
+    try {
+        size_t consumed = 0;
+        count = std::stoi(value, &consumed);
+        if (consumed != value.length()) {
+            throw std::invalid_argument("trailing characters");
+        }
+    } catch (...) {
+        throw std::runtime_error(ConvertToNarrowString(
+            option + L" requires a numeric argument, got: " + value));
+    }
+    if (count < minimum) {
+        throw std::runtime_error(ConvertToNarrowString(std::format(
+            L"{} must be at least {}", option, minimum)));
+    }
+    return count;
+}
+
+// Parses --mode idle:<n>[:<class>]
+static void ParseIdleMode(const std::wstring &value,
+                          CommandLineOptions &options) {
+    std::wstring rest = value.substr(5);
+    size_t colon = rest.find(L':');
+    options.idleCoreCount =
+        ParseCountArgument(rest.substr(0, colon), L"--mode idle:", 1);
+    if (colon == std::wstring::npos) {
+        options.idleClass = CommandLineOptions::CoreAffinityMode::ALL_CORES;
+        return;
+    }
+    options.idleClass = ParseAffinityMode(rest.substr(colon + 1));
+    if (options.idleClass == CommandLineOptions::CoreAffinityMode::LEARNED) {
+        throw std::runtime_error(ConvertToNarrowString(
+            L"--mode idle: class must be p, e, lp, alle or all"));
+    }
+}
+
+// Parses the decimal value of an option such as --power-budget
+static double ParseNumberArgument(const std::wstring &value,
+                                  const std::wstring &option) {
+    double number = 0.0;
+    try {
+        size_t consumed = 0;
+        number = std::stod(value, &consumed);
+        if (consumed != value.length()) {
+            throw std::invalid_argument("trailing characters");
+        }
+    } catch (...) {
+        throw std::runtime_error(ConvertToNarrowString(
+            option + L" requires a numeric argument, got: " + value));
+    }
+    if (number <= 0.0) {
+        throw std::runtime_error(ConvertToNarrowString(
+            option + L" must be greater than zero"));
+    }
+    return number;
+}
+
+// Parses --freq min:<khz>,max:<khz> (either part may be omitted)
+static void ParseFrequencyLimits(const std::wstring &value,
+                                 CommandLineOptions &options) {
+    std::wstringstream ss(value);
+    std::wstring part;
+    while (std::getline(ss, part, L',')) {
+        size_t colon = part.find(L':');
+        std::wstring key = part.substr(0, colon);
+        if (colon == std::wstring::npos || (key != L"min" && key != L"max")) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"Invalid --freq value. Use: min:<khz>,max:<khz>"));
+        }
+        int khz = ParseCountArgument(part.substr(colon + 1), L"--freq " + key,
+                                     1);
+        if (key == L"min") {
+            options.freqMinKhz = khz;
+        } else {
+            options.freqMaxKhz = khz;
+        }
+    }
+}
+
+// Linux EPP names on the Windows 0..100 scale
+static int ParseEnergyPreference(const std::wstring &value) {
+    if (value == L"performance") {
+        return 0;
+    } else if (value == L"balance_performance") {
+        return 33;
+    } else if (value == L"balance_power") {
+        return 66;
+    } else if (value == L"power") {
+        return 100;
+    }
+    throw std::runtime_error(ConvertToNarrowString(
+        L"Invalid --epp value. Use: performance, balance_performance, "
+        L"balance_power, power"));
+}
 
 CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
     CommandLineOptions options;
     bool foundDelimiter = false;
     bool foundMode = false;
     bool foundCores = false;
+    std::wstring launchOption; // First option --daemon does not take
     bool targetDirErr = false;
     std::string targetDirErrMsg = "";
     bool foundLogpath = false;
@@ -27,34 +248,48 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
     std::string logpathErrMsg = "";
 
     g_logger->Log(ApplicationLogger::Level::INFO,
-                  "Starting command line parsing with " + std::to_string(argc) +
-                      " arguments");
+                  "Starting command line parsing with {} arguments", argc);
 
     if (argc == 1) {
         options.showHelp = true;
         return options;
     }
 
+    // caplcli analyze <file> reports on a --sched-trace recording
+    if (std::wstring(argv[1]) == L"analyze") {
+        if (argc != 3) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"analyze takes the path of a --sched-trace file"));
+        }
+        options.analyzePath = argv[2];
+        return options;
+    }
+
+    // caplcli top [--refresh <ms>] shows the live per-processor view
+    if (std::wstring(argv[1]) == L"top") {
+        if (argc == 4 && std::wstring(argv[2]) == L"--refresh") {
+            options.topRefreshMs = ParseCountArgument(argv[3], argv[2], 100);
+        } else if (argc != 2) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"top only takes --refresh <ms>"));
+        }
+        options.topMode = true;
+        return options;
+    }
+
     // Print the raw command line
-    g_logger->Log(ApplicationLogger::Level::DEBUG,
-                  "Raw command line: " +
-                      ConvertToNarrowString(GetCommandLineW()));
+    g_logger->Log(ApplicationLogger::Level::DEBUG, "Raw command line: {}",
+                  GetCommandLineW());
     for (int i = 0; i < argc; i++) {
-        std::wstring arg = argv[i];
         g_logger->Log(ApplicationLogger::Level::DEBUG,
-                      "Arg[" + std::to_string(i) +
-                          "] length: " + std::to_string(arg.length()));
-        g_logger->Log(ApplicationLogger::Level::DEBUG,
-                      "Arg[" + std::to_string(i) +
-                          "] raw: " + ConvertToNarrowString(arg));
+                      "Arg[{}] ({} chars): {}", i, wcslen(argv[i]), argv[i]);
     }
 
     for (int i = 1; i < argc; i++) {
         std::wstring arg = argv[i];
 
         g_logger->Log(ApplicationLogger::Level::DEBUG,
-                      "Processing argument: '" + ConvertToNarrowString(arg) +
-                          "'");
+                      "Processing argument: '{}'", arg);
 
         if (arg == L"--") {
             foundDelimiter = true;
@@ -67,6 +302,10 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             }
             break; // Stop processing arguments after --
         }
+        if (launchOption.empty() && arg != L"--daemon" && arg != L"--pipe" &&
+            arg != L"--log" && arg != L"-l" && arg != L"--logpath") {
+            launchOption = arg;
+        }
         // --help
         if (arg == L"--help" || arg == L"-h" || arg == L"-?" || arg == L"/?") {
             g_logger->Log(ApplicationLogger::Level::INFO,
@@ -78,6 +317,22 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
         } else if (arg == L"--query" || arg == L"-q") {
             options.queryMode = true;
 
+            // --format
+        } else if (arg == L"--format") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--format option requires text or json"));
+            }
+            std::wstring format = argv[++i];
+            if (format == L"text") {
+                options.queryFormat = CommandLineOptions::QueryFormat::TEXT;
+            } else if (format == L"json") {
+                options.queryFormat = CommandLineOptions::QueryFormat::JSON;
+            } else {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"Invalid query format. Use: text, json"));
+            }
+
             // --dir
         } else if ((arg == L"--dir" || arg == L"-d")) {
             if (i + 1 >= argc) { // Check if there's a next argument
@@ -115,26 +370,32 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             // --mode
         } else if ((arg == L"--mode" || arg == L"-m") && i + 1 < argc) {
             foundMode = true;
-            std::wstring mode = argv[++i];
-            if (mode == L"p") {
-                options.affinityMode =
-                    CommandLineOptions::CoreAffinityMode::P_CORES_ONLY;
-            } else if (mode == L"e") {
-                options.affinityMode =
-                    CommandLineOptions::CoreAffinityMode::E_CORES_ONLY;
-            } else if (mode == L"lp") {
-                options.affinityMode =
-                    CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY;
-            } else if (mode == L"alle") {
-                options.affinityMode =
-                    CommandLineOptions::CoreAffinityMode::ALL_E_CORES;
-            } else if (mode == L"all") {
-                options.affinityMode =
-                    CommandLineOptions::CoreAffinityMode::ALL_CORES;
-            } else {
+            std::wstring modeList = argv[++i];
+            std::wstringstream ss(modeList);
+            std::wstring mode;
+
+            options.benchmarkModes.clear();
+            while (std::getline(ss, mode, L',')) {
+                // <mode>:free:<n> picks n cores no other launch has reserved
+                size_t freeAt = mode.find(L":free:");
+                if (freeAt != std::wstring::npos) {
+                    options.freeCoreCount = ParseCountArgument(
+                        mode.substr(freeAt + 6), L"--mode :free:", 1);
+                    mode = mode.substr(0, freeAt);
+                }
+                if (mode.starts_with(L"idle:")) {
+                    ParseIdleMode(mode, options);
+                    options.benchmarkModes.push_back(
+                        CommandLineOptions::CoreAffinityMode::IDLE);
+                    continue;
+                }
+                options.benchmarkModes.push_back(ParseAffinityMode(mode));
+            }
+            if (options.benchmarkModes.empty()) {
                 throw std::runtime_error(ConvertToNarrowString(
-                    L"Invalid mode. Use: p, e, lp, alle, all"));
+                    L"Invalid mode. Use: p, e, lp, alle, all, learned"));
             }
+            options.affinityMode = options.benchmarkModes.front();
 		} else if ((arg == L"--mode" || arg == L"-m") && i + 1 >= argc) {
             foundMode = true;
 			i++;
@@ -198,6 +459,306 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
                 options.logPath = argv[++i];
             }
 
+            // --repeat
+        } else if (arg == L"--repeat") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--repeat option requires a run count"));
+            }
+            options.repeatCount = ParseCountArgument(argv[++i], arg, 1);
+
+            // --warmup
+        } else if (arg == L"--warmup") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--warmup option requires a run count"));
+            }
+            options.warmupCount = ParseCountArgument(argv[++i], arg, 0);
+
+            // --results
+        } else if (arg == L"--results") {
+            if (i + 1 >= argc || std::wstring(argv[i + 1]).starts_with(L"-")) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--results option requires a file name argument"));
+            }
+            options.resultsPath = argv[++i];
+            if (!options.resultsPath.ends_with(L".csv") &&
+                !options.resultsPath.ends_with(L".json")) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--results file must end in .csv or .json"));
+            }
+
+            // --drop-cache
+        } else if (arg == L"--drop-cache") {
+            options.dropCache = true;
+
+            // --shuffle
+        } else if (arg == L"--shuffle") {
+            options.shuffleRuns = true;
+
+            // --tune
+        } else if (arg == L"--tune") {
+            options.tuneMode = true;
+
+            // --tune-runs
+        } else if (arg == L"--tune-runs") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--tune-runs option requires a run count"));
+            }
+            options.tuneRuns = ParseCountArgument(argv[++i], arg, 1);
+            options.tuneRunsSet = true;
+
+            // --profiles
+        } else if (arg == L"--profiles") {
+            if (i + 1 >= argc || std::wstring(argv[i + 1]).starts_with(L"-")) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--profiles option requires a file name argument"));
+            }
+            options.profilePath = argv[++i];
+
+            // --sweep
+        } else if (arg == L"--sweep") {
+            options.sweepMode = true;
+
+            // --energy
+        } else if (arg == L"--energy") {
+            options.measureEnergy = true;
+
+            // --thermal-policy
+        } else if (arg == L"--thermal-policy") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--thermal-policy option requires widen or shift"));
+            }
+            std::wstring action = argv[++i];
+            if (action == L"widen") {
+                options.thermalAction =
+                    CommandLineOptions::ThermalAction::WIDEN;
+            } else if (action == L"shift") {
+                options.thermalAction =
+                    CommandLineOptions::ThermalAction::SHIFT;
+            } else {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"Invalid thermal policy. Use: widen, shift"));
+            }
+
+            // --power-budget
+        } else if (arg == L"--power-budget") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--power-budget option requires a value in watts"));
+            }
+            options.powerBudgetWatts = ParseNumberArgument(argv[++i], arg);
+
+            // --temp-limit
+        } else if (arg == L"--temp-limit") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--temp-limit option requires a value in Celsius"));
+            }
+            options.temperatureLimitCelsius =
+                ParseNumberArgument(argv[++i], arg);
+
+            // --poll-interval
+        } else if (arg == L"--poll-interval") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--poll-interval option requires a value in ms"));
+            }
+            options.pollIntervalMs = ParseCountArgument(argv[++i], arg, 50);
+            options.pollIntervalSet = true;
+
+            // --idle-window
+        } else if (arg == L"--idle-window") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--idle-window option requires a value in ms"));
+            }
+            options.idleWindowMs = ParseCountArgument(argv[++i], arg, 10);
+            options.idleWindowSet = true;
+            if (options.idleWindowMs > 1000) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--idle-window must be at most 1000 ms"));
+            }
+
+            // --exclusive
+        } else if (arg == L"--exclusive") {
+            options.exclusive = true;
+
+            // --monitor
+        } else if (arg == L"--monitor") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--monitor option requires a file path"));
+            }
+            options.monitorPath = argv[++i];
+
+            // --monitor-interval
+        } else if (arg == L"--monitor-interval") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--monitor-interval option requires a value in ms"));
+            }
+            options.monitorIntervalMs = ParseCountArgument(argv[++i], arg, 50);
+            options.monitorIntervalSet = true;
+
+            // --trace
+        } else if (arg == L"--trace") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--trace option requires a file path"));
+            }
+            options.tracePath = argv[++i];
+
+            // --sched-trace
+        } else if (arg == L"--sched-trace") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--sched-trace option requires a file path"));
+            }
+            options.schedTracePath = argv[++i];
+
+            // --metrics-file
+        } else if (arg == L"--metrics-file") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--metrics-file option requires a file path"));
+            }
+            options.metricsPath = argv[++i];
+
+            // --metrics-interval
+        } else if (arg == L"--metrics-interval") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--metrics-interval option requires a value in ms"));
+            }
+            options.metricsIntervalMs = ParseCountArgument(argv[++i], arg, 100);
+            options.metricsIntervalSet = true;
+
+            // --sched
+        } else if (arg == L"--sched") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--sched option requires a scheduling policy"));
+            }
+            ParseSchedPolicy(argv[++i], options);
+
+            // --nice
+        } else if (arg == L"--nice") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--nice option requires a value from -20 to 19"));
+            }
+            options.niceValue = ParseCountArgument(argv[++i], arg, -20);
+            if (options.niceValue > 19) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--nice must be at most 19"));
+            }
+            options.niceSet = true;
+
+            // --priority
+        } else if (arg == L"--priority") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--priority option requires a priority class"));
+            }
+            options.priorityClass = ParsePriorityClass(argv[++i]);
+
+            // --ioprio
+        } else if (arg == L"--ioprio") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--ioprio option requires an I/O priority"));
+            }
+            options.ioPriority = ParseIoPriority(argv[++i]);
+
+            // --ecoqos
+        } else if (arg == L"--ecoqos") {
+            options.ecoQos = true;
+
+            // --share-topology
+        } else if (arg == L"--share-topology") {
+            options.shareTopology = true;
+
+            // --export-topology
+        } else if (arg == L"--export-topology") {
+            options.exportTopology = true;
+
+            // --uclamp-min / --uclamp-max
+        } else if (arg == L"--uclamp-min" || arg == L"--uclamp-max") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    arg + L" option requires a value from 0 to 1024"));
+            }
+            int clamp = ParseCountArgument(argv[++i], arg, 0);
+            if (clamp > 1024) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    arg + L" must be at most 1024"));
+            }
+            if (arg == L"--uclamp-min") {
+                options.uclampMin = clamp;
+            } else {
+                options.uclampMax = clamp;
+            }
+
+            // --soft
+        } else if (arg == L"--soft") {
+            options.softAffinity = true;
+
+            // --latency-critical
+        } else if (arg == L"--latency-critical") {
+            options.latencyCritical = true;
+
+            // --memlock
+        } else if (arg == L"--memlock") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--memlock option requires a size in MB"));
+            }
+            options.memlockMB = ParseCountArgument(argv[++i], arg, 1);
+            options.memlockSet = true;
+
+            // --idle-disable
+        } else if (arg == L"--idle-disable") {
+            options.idleDisable = true;
+
+            // --freq
+        } else if (arg == L"--freq") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--freq option requires min:<khz>,max:<khz>"));
+            }
+            ParseFrequencyLimits(argv[++i], options);
+
+            // --epp
+        } else if (arg == L"--epp") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--epp option requires a preference"));
+            }
+            options.epp = ParseEnergyPreference(argv[++i]);
+
+            // --daemon
+        } else if (arg == L"--daemon") {
+            options.daemonMode = true;
+
+            // --pipe
+        } else if (arg == L"--pipe") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--pipe option requires a pipe name"));
+            }
+            options.pipeName = argv[++i];
+
+            // --llc-domain
+        } else if (arg == L"--llc-domain") {
+            if (i + 1 >= argc) {
+                throw std::runtime_error(ConvertToNarrowString(
+                    L"--llc-domain option requires a domain number"));
+            }
+            options.llcDomain = ParseCountArgument(argv[++i], arg, 0);
+
             // --Unknown option
         } else {
             throw std::runtime_error(
@@ -207,15 +768,35 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
 
     // Comprehensive validation
     try {
-        bool isQueryOrHelp = options.queryMode || options.showHelp;
+        // The daemon takes its launches from clients, not the command line
+        bool isQueryOrHelp =
+            options.queryMode || options.showHelp || options.daemonMode;
+
+        bool hasUclamp = options.uclampMin >= 0 || options.uclampMax >= 0;
 
         // Basic requirements
-        if (!options.queryMode && !options.showHelp &&
+        if (!isQueryOrHelp && !options.tuneMode &&
+            !options.sweepMode && !hasUclamp && !options.latencyCritical &&
             options.affinityMode ==
                 CommandLineOptions::CoreAffinityMode::NOT_SET) {
             throw std::runtime_error(ConvertToNarrowString(
-                L"Either of --query, --help, or Affinity mode "
-                L"(--mode or --cores) must be specified"));
+                L"Either of --query, --help, Affinity mode "
+                L"(--mode or --cores) or --uclamp-min/--uclamp-max must be "
+                L"specified"));
+        }
+        if (options.daemonMode && !launchOption.empty()) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--daemon only takes --pipe and the logging options; " +
+                launchOption + L" comes from the clients"));
+        }
+        if (options.daemonMode && foundDelimiter) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--daemon only takes --pipe and the logging options; "
+                L"the programs to launch come from the clients"));
+        }
+        if (!options.daemonMode && !options.pipeName.empty()) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--pipe must be used with --daemon or --via-daemon"));
         }
         if (!isQueryOrHelp && !foundDelimiter) {
             throw std::runtime_error(ConvertToNarrowString(
@@ -231,6 +812,11 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             throw std::runtime_error(
                 ConvertToNarrowString(L"--query cannot be used with --mode"));
         }
+        if (!options.queryMode &&
+            options.queryFormat != CommandLineOptions::QueryFormat::TEXT) {
+            throw std::runtime_error(
+                ConvertToNarrowString(L"--format must be used with --query"));
+        }
         if (foundCores && foundMode) {
             throw std::runtime_error(ConvertToNarrowString(
                 L"--mode and --cores cannot be used at the same time"));
@@ -239,6 +825,223 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             throw std::runtime_error(ConvertToNarrowString(
                 L"--invert must be used with --mode or --cores"));
         }
+        if (options.benchmarkModes.size() > 1 && options.repeatCount == 0) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"Multiple --mode values require --repeat"));
+        }
+        if (options.repeatCount == 0 && !options.sweepMode &&
+            (options.warmupCount > 0 || !options.resultsPath.empty())) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--warmup and --results must be used with --repeat or "
+                L"--sweep"));
+        }
+        if (options.repeatCount == 0 && !options.sweepMode &&
+            options.dropCache) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--drop-cache must be used with --repeat or --sweep"));
+        }
+        if (options.repeatCount == 0 && options.shuffleRuns) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--shuffle must be used with --repeat"));
+        }
+        if (options.sweepMode &&
+            (foundMode || foundCores || options.invertSelection ||
+             options.tuneMode || options.shuffleRuns)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--sweep cannot be used with --mode, --cores, --invert, "
+                L"--tune or --shuffle"));
+        }
+        if (options.measureEnergy &&
+            (options.queryMode || options.tuneMode || options.sweepMode)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--energy cannot be used with --query, --tune or --sweep"));
+        }
+        bool hasThermalPolicy = options.thermalAction !=
+                                CommandLineOptions::ThermalAction::NONE;
+        if (!hasThermalPolicy &&
+            (options.powerBudgetWatts > 0.0 ||
+             options.temperatureLimitCelsius > 0.0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--power-budget and --temp-limit must be used with "
+                L"--thermal-policy"));
+        }
+        if (!hasThermalPolicy && options.pollIntervalSet) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--poll-interval must be used with --thermal-policy"));
+        }
+        if (options.monitorPath.empty() && options.monitorIntervalSet) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--monitor-interval must be used with --monitor"));
+        }
+        if (!options.monitorPath.empty() &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--monitor cannot be used with --query, --tune, --sweep or "
+                L"--repeat"));
+        }
+        if (!options.schedTracePath.empty() &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--sched-trace cannot be used with --query, --tune, --sweep "
+                L"or --repeat"));
+        }
+        if (options.metricsPath.empty() && options.metricsIntervalSet) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--metrics-interval must be used with --metrics-file"));
+        }
+        if (!options.metricsPath.empty() &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--metrics-file cannot be used with --query, --tune, --sweep "
+                L"or --repeat"));
+        }
+        if (hasThermalPolicy &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--thermal-policy cannot be used with --query, --tune, "
+                L"--sweep or --repeat"));
+        }
+        int priorityOptions =
+            (options.schedPolicy != CommandLineOptions::SchedPolicy::NOT_SET) +
+            options.niceSet + (options.priorityClass != 0);
+        if (priorityOptions > 1) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--sched, --nice and --priority cannot be used together"));
+        }
+        if (options.queryMode &&
+            (priorityOptions > 0 || options.ioPriority >= 0 ||
+             options.ecoQos)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--query cannot be used with scheduling options"));
+        }
+        if (options.uclampMin >= 0 && options.uclampMax >= 0 &&
+            options.uclampMin > options.uclampMax) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--uclamp-min cannot be greater than --uclamp-max"));
+        }
+        if (options.ecoQos && options.uclampMin >= 512) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--ecoqos conflicts with a --uclamp-min of 512 or more"));
+        }
+        if (options.softAffinity && !foundMode && !foundCores) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--soft must be used with --mode or --cores"));
+        }
+        if (options.softAffinity &&
+            options.thermalAction != CommandLineOptions::ThermalAction::NONE) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--soft cannot be used with --thermal-policy"));
+        }
+        if (options.queryMode && (hasUclamp || options.softAffinity)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--query cannot be used with placement hints"));
+        }
+        if (!options.latencyCritical &&
+            (options.memlockSet || options.idleDisable)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--memlock and --idle-disable must be used with "
+                L"--latency-critical"));
+        }
+        if (options.latencyCritical &&
+            (foundMode || foundCores || options.invertSelection ||
+             priorityOptions > 0 || options.ecoQos || hasUclamp ||
+             options.softAffinity)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--latency-critical sets affinity and priority itself and "
+                L"cannot be used with --mode, --cores, --invert, --sched, "
+                L"--nice, --priority, --ecoqos, --uclamp-min/max or --soft"));
+        }
+        if (options.latencyCritical &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0 ||
+             options.thermalAction !=
+                 CommandLineOptions::ThermalAction::NONE)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--latency-critical cannot be used with --query, --tune, "
+                L"--sweep, --repeat or --thermal-policy"));
+        }
+        bool pinsFrequency = options.freqMinKhz > 0 ||
+                             options.freqMaxKhz > 0 || options.epp >= 0;
+        if (options.freqMinKhz > 0 && options.freqMaxKhz > 0 &&
+            options.freqMinKhz > options.freqMaxKhz) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--freq min cannot be greater than max"));
+        }
+        if (pinsFrequency &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--freq and --epp cannot be used with --query, --tune, "
+                L"--sweep or --repeat"));
+        }
+        if (options.freeCoreCount > 0 &&
+            (options.benchmarkModes.size() > 1 ||
+             options.affinityMode ==
+                 CommandLineOptions::CoreAffinityMode::LEARNED)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L":free:<n> needs a single core class, e.g. --mode p:free:2"));
+        }
+        bool idleMode = options.idleCoreCount > 0;
+        if (idleMode &&
+            (options.benchmarkModes.size() > 1 || options.freeCoreCount > 0 ||
+             options.repeatCount > 0 || options.tuneMode ||
+             options.sweepMode)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--mode idle: cannot be combined with other modes, :free:, "
+                L"--repeat, --tune or --sweep"));
+        }
+        if (!idleMode && options.idleWindowSet) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--idle-window must be used with --mode idle:<n>"));
+        }
+        if ((options.exclusive || options.freeCoreCount > 0) &&
+            (options.queryMode || options.tuneMode || options.sweepMode ||
+             options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--exclusive and :free:<n> cannot be used with --query, "
+                L"--tune, --sweep or --repeat"));
+        }
+        if (options.llcDomain >= 0 && !foundMode && !foundCores) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--llc-domain must be used with --mode or --cores"));
+        }
+        if (options.queryMode && options.sweepMode) {
+            throw std::runtime_error(
+                ConvertToNarrowString(L"--query cannot be used with --sweep"));
+        }
+        if (options.tuneMode && (foundMode || foundCores ||
+                                 options.invertSelection ||
+                                 options.repeatCount > 0)) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--tune cannot be used with --mode, --cores, --invert or "
+                L"--repeat"));
+        }
+        if (!options.tuneMode && options.tuneRunsSet) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--tune-runs must be used with --tune"));
+        }
+        bool usesLearned =
+            std::find(options.benchmarkModes.begin(),
+                      options.benchmarkModes.end(),
+                      CommandLineOptions::CoreAffinityMode::LEARNED) !=
+            options.benchmarkModes.end();
+        if (!options.tuneMode && !usesLearned &&
+            !options.profilePath.empty()) {
+            throw std::runtime_error(ConvertToNarrowString(
+                L"--profiles must be used with --tune or --mode learned"));
+        }
+        if (options.queryMode && options.tuneMode) {
+            throw std::runtime_error(
+                ConvertToNarrowString(L"--query cannot be used with --tune"));
+        }
+        if (options.queryMode && options.repeatCount > 0) {
+            throw std::runtime_error(
+                ConvertToNarrowString(L"--query cannot be used with --repeat"));
+        }
         if (isQueryOrHelp &&
             (!options.targetWorkingDir.empty() || targetDirErr)) {
             throw std::runtime_error(ConvertToNarrowString(
@@ -261,8 +1064,8 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             throw std::runtime_error(targetDirErrMsg);
         }
         g_logger->Log(ApplicationLogger::Level::INFO,
-                      "Working directory validated: " +
-                          ConvertToNarrowString(options.targetWorkingDir));
+                      "Working directory validated: {}",
+                      options.targetWorkingDir);
 
         // Logpath validation
         if (foundLogpath && !options.enableLogging) {
@@ -278,16 +1081,14 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
             throw std::runtime_error(logpathErrMsg);
         }
         g_logger->Log(ApplicationLogger::Level::INFO,
-                      "Logpath validated: " +
-                          ConvertToNarrowString(options.logPath));
+                      "Logpath validated: {}", options.logPath);
 
         // System limits for cores
         SYSTEM_INFO sysInfo;
         GetSystemInfo(&sysInfo);
         g_logger->Log(ApplicationLogger::Level::INFO,
-                      "System has " +
-                          std::to_string(sysInfo.dwNumberOfProcessors) +
-                          " processors");
+                      "System has {} processors",
+                      sysInfo.dwNumberOfProcessors);
 
         if (options.affinityMode ==
             CommandLineOptions::CoreAffinityMode::CUSTOM) {
@@ -309,14 +1110,28 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
                 }
             }
 
-            std::string coreList;
+            // Inside a job object (container) or under a restricted parent
+            // only part of the system may be usable
+            DWORD_PTR allowed = CpuInfo::GetAllowedMask();
             for (int core : options.cores) {
-                if (!coreList.empty())
-                    coreList += ",";
-                coreList += std::to_string(core);
+                if (!options.invertSelection &&
+                    !(allowed & (DWORD_PTR(1) << core))) {
+                    throw std::runtime_error(ConvertToNarrowString(std::format(
+                        L"Core {} is not in the allowed set 0x{:X} of this "
+                        L"process", core, allowed)));
+                }
+            }
+
+            if (g_logger->IsEnabled()) {
+                std::string coreList;
+                for (int core : options.cores) {
+                    if (!coreList.empty())
+                        coreList += ",";
+                    coreList += std::to_string(core);
+                }
+                g_logger->Log(ApplicationLogger::Level::INFO,
+                              "Valid core list specified: {}", coreList);
             }
-            g_logger->Log(ApplicationLogger::Level::INFO,
-                          "Valid core list specified: " + coreList);
         }
 
         // Log path validation
@@ -335,7 +1150,7 @@ CommandLineOptions ParseCommandLine(int argc, wchar_t *argv[]) {
                       "Command line validation completed successfully");
     } catch (const std::exception &e) {
         g_logger->Log(ApplicationLogger::Level::ERR,
-                      "Validation failed: " + std::string(e.what()));
+                      "Validation failed: {}", e.what());
         throw; // Re-throw for main() to handle
     }
 
@@ -350,21 +1165,133 @@ Usage: caplcli.exe [options] -- <program> [program arguments]
 Usage: caplgui.exe [options] -- <program> [program arguments]
 
 Core Affinity Modes:
-  --mode, -m <mode>      Predefined modes:
+  --mode, -m <mode>      Predefined modes (comma-separated with --repeat):
                          p     - P-cores only (0x40)
                          e     - E-cores only (0x20)
                          lp    - LP E-cores only (0x30)
                          alle  - All E-cores (E + LP)
                          all   - Lock to all cores
+                         learned - Mask saved by --tune for the program
   --cores <list>         Custom core selection (comma-separated)
-  --invert, -i           Invert core selection\n
+  --invert, -i           Invert core selection
+  --llc-domain <n>       Keep only the cores sharing L3 instance n (see
+                         --query), away from neighbours on other L3s
+  --mode idle:<n>[:m]    The n least-loaded cores (of mode m), sampled
+                         at launch; one per physical core first, kept
+                         in one L3 domain when it has enough cores
+  --idle-window <ms>     Sampling window of idle:<n> (default: 50)
+  --mode <m>:free:<n>    Take n cores of mode m that no other running
+                         launch has reserved (e.g. p:free:2)
+  --exclusive            Reserve the cores for this launch; fail if
+                         another running launch holds one of them\n
 
 Process Control:
   --dir, -d <path>       Working directory for target process
+  --share-topology       Pass the detected topology and the launch mask
+                         to the program in a read-only shared-memory
+                         blob named by CAPL_TOPOLOGY_FD (capl_topology.h)
+  --export-topology      Set CAPL_TOPOLOGY in the program's environment
+                         for capl_runtime.h thread pools
   -- <program> [args]     Program to launch with its arguments\n
 
+Benchmarking:
+  --repeat <n>           Run the program n times and report statistics
+  --warmup <n>           Unmeasured runs per mode before measuring
+  --results <file>       Write every run to a .csv or .json file
+  --drop-cache           Purge the file cache before each run (admin);
+                         with --sweep, before each run of every step
+  --shuffle              Randomize run order across several modes
+  --energy               Report package/core/uncore energy, average power
+                         and energy-delay product (per run with --repeat)
+  --sweep                Run on 1..N cores of each core class and report
+                         throughput, speedup and efficiency (--repeat sets
+                         runs per step, --results writes the table)
+
+Auto-tuning:
+  --tune                 Time the program under candidate masks and save
+                         the fastest one for --mode learned
+  --tune-runs <n>        Timed runs per candidate (default: 3)
+  --profiles <file>      Profile database (default: capl_profiles.ini)
+
+Scheduling:
+  --sched <policy>       other, batch, idle, fifo:<1-99> or rr:<1-99>
+                         (mapped to priority classes; fifo/rr need
+                         administrator rights for realtime)
+  --nice <n>             Unix nice value -20..19 mapped to a priority class
+  --priority <class>     idle, below, normal, above, high, realtime
+  --ioprio <level>       I/O priority: idle, low, normal, high
+  --ecoqos               Run with EcoQoS (efficiency mode)
+
+Placement Hints:
+  --uclamp-min <0-1024>  Utilization floor; 512 or more asks for P-cores
+                         (HighQoS) without locking the program there
+  --uclamp-max <0-1024>  Utilization ceiling; below 512 biases the program
+                         to E-cores (EcoQoS) without locking it there
+  --soft                 Apply --mode/--cores as a preferred CPU set
+                         instead of a hard affinity mask
+
+Low Latency:
+  --latency-critical     P-cores with SMT siblings left idle, realtime
+                         priority, HighQoS and a resident working set
+  --memlock <MB>         Minimum working set of the program (default: 256)
+  --idle-disable         Keep processors out of idle states while the
+                         program runs (restored on exit, even after a
+                         crash)
+
+Frequency Pinning (restored on exit, even after a crash):
+  --freq min:<kHz>,max:<kHz>
+                         Clock limits for the core classes in the mask
+  --epp <preference>     performance, balance_performance, balance_power
+                         or power for the core classes in the mask
+
+Thermal Policy:
+  --thermal-policy <a>   Move the program off throttled, hot or
+                         over-budget P-cores while that lasts:
+                         widen - add the E-cores to the mask
+                         shift - replace the P-cores with the E-cores
+  --power-budget <W>     Package power budget in watts (needs RAPL)
+  --temp-limit <C>       Thermal zone temperature limit in Celsius
+  --poll-interval <ms>   Sensor interval (default: 1000)
+
+Monitoring:
+  --monitor <file>       Sample the program's LLC misses and references
+                         (PMU, administrator), cycles, memory, page faults
+                         and I/O plus the load of every L3 domain; writes
+                         a time series (CSV, or JSON for .json) and shows
+                         a summary at exit
+  --monitor-interval <ms>
+                         Monitor sampling interval (default: 1000)
+  --trace <file>         Time each launch phase (parsing, CPU probes, path
+                         search, process creation, affinity, resume, run)
+                         and write Chrome trace-event JSON at exit
+  --sched-trace <file>   Record the program's context switches, wakeups
+                         and thread starts (ETW, administrator) for
+                         caplcli analyze
+  analyze <file>         Report per-thread residency per core and core
+                         class, migrations and run-queue wait of a
+                         --sched-trace recording
+  --metrics-file <file>  Keep an OpenMetrics file (node_exporter textfile
+                         collector) with the program's CPU seconds per
+                         core class, threads, working set and clock limits
+  --metrics-interval <ms>
+                         Metrics file refresh interval (default: 5000)
+  top [--refresh <ms>]   Live per-processor load, clock and CAPL launches,
+                         grouped by core class and L2 cluster
+                         (default refresh: 1000 ms; q to quit)
+
+Daemon:
+  --daemon               Stay resident and launch programs for clients
+                         over a named pipe, with the topology probed once
+  --via-daemon           Send this launch to the daemon instead of
+                         starting it here; exits with the program's code
+  --pipe <name>          Pipe name for --daemon/--via-daemon
+                         (default: capld)
+
 Utility Options:
   --query, -q            Show system information only
+  --format <f>           --query output: text (default) or json with every
+                         processor's core type, SMT siblings, core, module,
+                         die, package, NUMA node, caches and clocks
   --log, -l              Enable logging (disabled by default)
   --logpath <path>       Specify log file path (default: capl.log)
   --help, -h, -?, /?     Show this help
@@ -375,10 +1302,35 @@ Examples:
   caplcli.exe --mode alle -- cmd.exe /c \"batch.cmd\"
   caplgui.exe --cores 0,2,4 -- program.exe
   caplcli.exe --query
+  caplcli.exe --query --format json
+  caplcli.exe --mode p,e --repeat 10 --warmup 2 -- program.exe
+  caplcli.exe --tune -- program.exe
+  caplcli.exe --mode learned -- program.exe
+  caplcli.exe --mode e,p --repeat 5 --energy -- program.exe
+  caplcli.exe --sweep --repeat 3 --results sweep.csv -- program.exe
+  caplcli.exe --mode e --sched batch --ioprio low --ecoqos -- job.exe
+  caplcli.exe --uclamp-max 256 -- backup.exe
+  caplcli.exe --mode p --sched-trace run.sched -- program.exe
+  caplcli.exe analyze run.sched
+  caplcli.exe --mode e --metrics-file job.prom -- job.exe
+  caplcli.exe top --refresh 500
+  caplcli.exe --mode e --soft -- program.exe
+  caplcli.exe --latency-critical --idle-disable -- audio.exe
+  caplcli.exe --mode all --llc-domain 0 -- game.exe
+  caplcli.exe --mode p:free:2 -- job.exe
+  caplcli.exe --mode idle:4:p -- job.exe
+  caplcli.exe --daemon
+  caplcli.exe --via-daemon --mode e -- job.exe
+  caplcli.exe --mode p --freq min:3000000 --epp performance -- program.exe
+  caplcli.exe --mode p --thermal-policy shift --temp-limit 90 -- program.exe
+  caplcli.exe --mode all --llc-domain 1 --monitor run.csv -- program.exe
 
 Notes:
-  - Either --mode or --cores must be specified for launching
+  - Either --mode, --cores, --latency-critical or a --uclamp hint must be
+    specified for launching
   - Core numbers must be non-negative and within system limits
+  - Masks are limited to the processors CAPL may use (its own affinity
+    and any job object / container limit)
   - --mode all explicitly locks process to all cores, preventing
     Windows from dynamically restricting core usage)";
 }
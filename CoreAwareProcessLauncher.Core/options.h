@@ -17,17 +17,118 @@ struct CommandLineOptions {
         LP_CORES_ONLY, // Only LP E-cores
         ALL_E_CORES,   // Both E-cores and LP E-cores
         ALL_CORES,     // Lock to all cores
+        LEARNED,       // Mask saved by --tune for the target program
+        IDLE,          // Least-loaded cores sampled at launch (idle:<n>)
         CUSTOM,        // Custom core selection via --cores
         NOT_SET,        // Default state - not set
     } affinityMode = CoreAffinityMode::NOT_SET;
 
     std::vector<int> cores; // Used when mode is CUSTOM
+    // Every mode given to --mode (comma-separated); benchmarks run each one
+    std::vector<CoreAffinityMode> benchmarkModes;
     bool invertSelection;
     bool queryMode;
+    // --query output (--format)
+    enum class QueryFormat {
+        TEXT,
+        JSON,   // Full topology from one snapshot, for tools
+    } queryFormat = QueryFormat::TEXT;
     bool enableLogging;
     std::wstring logPath;
     bool showHelp;
 
+    // Benchmark mode (--repeat)
+    int repeatCount;         // Measured runs per mode, 0 = single launch
+    int warmupCount;         // Unmeasured runs per mode before measuring
+    std::wstring resultsPath; // .csv or .json results file
+    bool dropCache;          // Purge the standby list before every run
+    bool shuffleRuns;        // Randomize run order across modes
+
+    // Affinity auto-tuner (--tune)
+    bool tuneMode;
+    bool tuneRunsSet;         // --tune-runs was given
+    int tuneRuns;             // Timed runs per surviving candidate
+    std::wstring profilePath; // Profile database, empty = next to caplcli
+
+    // Per-core-class scalability sweep (--sweep)
+    bool sweepMode;
+
+    bool measureEnergy;      // Read RAPL energy counters around the launch
+
+    // Thermal- and power-aware placement (--thermal-policy)
+    enum class ThermalAction {
+        NONE,   // No dynamic placement
+        WIDEN,  // Add the E-cores while the P-cores are stressed
+        SHIFT,  // Move to the E-cores while the P-cores are stressed
+    } thermalAction = ThermalAction::NONE;
+    double powerBudgetWatts;        // 0 = no budget
+    double temperatureLimitCelsius; // 0 = no limit
+    bool pollIntervalSet;           // --poll-interval was given
+    int pollIntervalMs;
+
+    // Scheduling (--sched, --nice, --priority, --ioprio, --ecoqos)
+    enum class SchedPolicy {
+        NOT_SET,
+        OTHER,  // Normal priority class
+        BATCH,  // Below-normal priority class
+        IDLE,   // Idle priority class
+        FIFO,   // Realtime priority class
+        RR,     // Realtime priority class
+    } schedPolicy = SchedPolicy::NOT_SET;
+    int schedPriority;     // 1..99 for fifo and rr
+    bool niceSet;
+    int niceValue;         // -20..19
+    DWORD priorityClass;   // From --priority, 0 = inherit
+    int ioPriority;        // IO_PRIORITY_HINT, -1 = inherit
+    bool ecoQos;
+
+    // Soft placement hints (--uclamp-min, --uclamp-max, --soft)
+    int uclampMin;         // 0..1024, -1 = not set
+    int uclampMax;         // 0..1024, -1 = not set
+    bool softAffinity;     // Apply the mask as default CPU sets
+
+    // Low-latency launch profile (--latency-critical)
+    bool latencyCritical;
+    bool memlockSet;       // --memlock was given
+    int memlockMB;         // Minimum working set of the child
+    bool idleDisable;      // Keep processors out of idle states meanwhile
+
+    // Frequency and EPP pinning of the cores in the mask (--freq, --epp)
+    int freqMinKhz;        // 0 = unchanged
+    int freqMaxKhz;        // 0 = unchanged
+    int epp;               // 0 (performance)..100 (power), -1 = unchanged
+
+    int llcDomain;         // Keep the mask inside one L3 instance, -1 = off
+
+    std::wstring monitorPath; // Resource time series (--monitor), empty = off
+    bool monitorIntervalSet;  // --monitor-interval was given
+    int monitorIntervalMs;    // --monitor-interval
+    std::wstring tracePath;   // Launch phase trace (--trace), empty = off
+    std::wstring schedTracePath; // Context switch recording (--sched-trace)
+    std::wstring analyzePath;    // caplcli analyze <file>, empty = off
+    std::wstring metricsPath;    // OpenMetrics textfile (--metrics-file)
+    bool metricsIntervalSet;     // --metrics-interval was given
+    int metricsIntervalMs;       // --metrics-interval
+    bool topMode;                // caplcli top
+    int topRefreshMs;            // caplcli top --refresh
+
+    // Cross-launch core reservations (--exclusive, --mode <m>:free:<n>)
+    bool exclusive;        // Fail if another launch holds one of the cores
+    int freeCoreCount;     // Pick this many unreserved cores, 0 = off
+
+    // Load-aware selection (--mode idle:<n>[:class], --idle-window)
+    int idleCoreCount;
+    CoreAffinityMode idleClass = CoreAffinityMode::ALL_CORES;
+    bool idleWindowSet;    // --idle-window was given
+    int idleWindowMs;      // Utilization sampling window
+
+    bool shareTopology;    // Hand the topology to the child (--share-topology)
+    bool exportTopology;   // Set CAPL_TOPOLOGY in the child (--export-topology)
+
+    // Resident launcher (--daemon; clients use --via-daemon)
+    bool daemonMode;
+    std::wstring pipeName; // Empty = default pipe
+
     CommandLineOptions();
 };
 
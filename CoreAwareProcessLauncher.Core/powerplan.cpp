@@ -0,0 +1,521 @@
+// powerplan.cpp
+#include "pch.h"
+#include "powerplan.h"
+#include "cpu.h"
+#include "utilities.h"
+#include <algorithm>
+#include <combaseapi.h>
+#include <format>
+#include <powrprof.h>
+
+#pragma comment(lib, "ole32.lib")
+#pragma comment(lib, "powrprof.lib")
+
+using Utilities::ConvertToNarrowString;
+
+// capl_power_journal_<pid>_<purpose>.ini; runs before journals were per
+// run left capl_power_journal.ini, which the pattern also matches
+const std::wstring JOURNAL_FILE_PREFIX = L"capl_power_journal";
+
+// Held while a run reads, journals and writes the settings and while it
+// restores them; the plan is machine-wide, so the lock is too
+const wchar_t PINNING_MUTEX[] = L"Global\\CAPL Power Pinning";
+const DWORD PINNING_LOCK_TIMEOUT_MS = 10000;
+
+// Processor power settings; the "1" variants apply to efficiency class 1
+// (the P-cores of a hybrid CPU)
+static const PowerSetting PROCTHROTTLEMIN = { L"PROCTHROTTLEMIN",
+	{ 0x893dee8e, 0x2bef, 0x41e0, { 0x89, 0xc6, 0xb5, 0x5d, 0x09, 0x29, 0x96, 0x4c } } };
+static const PowerSetting PROCTHROTTLEMIN1 = { L"PROCTHROTTLEMIN1",
+	{ 0x893dee8e, 0x2bef, 0x41e0, { 0x89, 0xc6, 0xb5, 0x5d, 0x09, 0x29, 0x96, 0x4d } } };
+static const PowerSetting PROCFREQMAX = { L"PROCFREQMAX",
+	{ 0x75b0ae3f, 0xbce0, 0x45a7, { 0x8c, 0x89, 0xc9, 0x61, 0x1c, 0x25, 0xe1, 0x00 } } };
+static const PowerSetting PROCFREQMAX1 = { L"PROCFREQMAX1",
+	{ 0x75b0ae3f, 0xbce0, 0x45a7, { 0x8c, 0x89, 0xc9, 0x61, 0x1c, 0x25, 0xe1, 0x01 } } };
+static const PowerSetting PERFEPP = { L"PERFEPP",
+	{ 0x36687f9e, 0xe3a5, 0x4dbf, { 0xb1, 0xdc, 0x15, 0xeb, 0x38, 0x1c, 0x68, 0x63 } } };
+static const PowerSetting PERFEPP1 = { L"PERFEPP1",
+	{ 0x36687f9e, 0xe3a5, 0x4dbf, { 0xb1, 0xdc, 0x15, 0xeb, 0x38, 0x1c, 0x68, 0x64 } } };
+
+// Applies to every processor; --latency-critical --idle-disable sets it
+static const PowerSetting IDLEDISABLE = { L"IDLEDISABLE",
+	{ 0x5d76a2ca, 0xe8c0, 0x402f, { 0xa1, 0x33, 0x21, 0x58, 0x49, 0x2d, 0x58, 0xad } } };
+
+static const PowerSetting* const ALL_SETTINGS[] = {
+	&PROCTHROTTLEMIN, &PROCTHROTTLEMIN1, &PROCFREQMAX, &PROCFREQMAX1,
+	&PERFEPP, &PERFEPP1, &IDLEDISABLE,
+};
+
+static const PowerSetting* FindSetting(const std::wstring& name) {
+	for (const auto* setting : ALL_SETTINGS) {
+		if (name == setting->name) {
+			return setting;
+		}
+	}
+	return nullptr;
+}
+
+namespace {
+
+// Owns PINNING_MUTEX for its lifetime, if it could be taken in time
+class PinningLock {
+public:
+	PinningLock() : m_mutex(CreateMutexW(NULL, FALSE, PINNING_MUTEX)) {
+		if (!m_mutex) {
+			m_error = GetLastError();
+			return;
+		}
+		// Abandoned by a killed run: the journals on disk are still valid
+		DWORD wait = WaitForSingleObject(m_mutex, PINNING_LOCK_TIMEOUT_MS);
+		if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+			m_error = wait == WAIT_TIMEOUT ? ERROR_TIMEOUT : GetLastError();
+			CloseHandle(m_mutex);
+			m_mutex = NULL;
+		}
+	}
+	~PinningLock() {
+		if (m_mutex) {
+			ReleaseMutex(m_mutex);
+			CloseHandle(m_mutex);
+		}
+	}
+	PinningLock(const PinningLock&) = delete;
+	PinningLock& operator=(const PinningLock&) = delete;
+
+	bool IsHeld() const { return m_mutex != NULL; }
+	DWORD GetError() const { return m_error; }
+
+private:
+	HANDLE m_mutex;
+	DWORD m_error = ERROR_SUCCESS;
+};
+
+}
+
+// GetPrivateProfileString needs a full path or it looks in %WINDIR%
+static std::wstring GetFullPath(const std::wstring& path) {
+	WCHAR fullPath[MAX_PATH];
+	if (!GetFullPathNameW(path.c_str(), MAX_PATH, fullPath, NULL)) {
+		return path;
+	}
+	return fullPath;
+}
+
+PowerPlanStore::PowerPlanStore(const GUID& plan) : m_plan(plan) {}
+
+std::unique_ptr<PowerPlanStore> PowerPlanStore::Active() {
+	GUID* plan = nullptr;
+	if (PowerGetActiveScheme(NULL, &plan) != ERROR_SUCCESS) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Could not read the active power plan"));
+	}
+	auto store = std::make_unique<PowerPlanStore>(*plan);
+	LocalFree(plan);
+	return store;
+}
+
+std::unique_ptr<PowerPlanStore> PowerPlanStore::FromId(
+	const std::wstring& planId) {
+	GUID plan;
+	if (FAILED(CLSIDFromString(planId.c_str(), &plan))) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Invalid power plan id: " + planId));
+	}
+	return std::make_unique<PowerPlanStore>(plan);
+}
+
+bool PowerPlanStore::Read(const PowerSetting& setting, DWORD& ac, DWORD& dc) {
+	return PowerReadACValueIndex(NULL, &m_plan,
+		&GUID_PROCESSOR_SETTINGS_SUBGROUP, &setting.guid, &ac) ==
+		ERROR_SUCCESS &&
+		PowerReadDCValueIndex(NULL, &m_plan,
+			&GUID_PROCESSOR_SETTINGS_SUBGROUP, &setting.guid, &dc) ==
+		ERROR_SUCCESS;
+}
+
+bool PowerPlanStore::Write(const PowerSetting& setting, DWORD ac, DWORD dc) {
+	return PowerWriteACValueIndex(NULL, &m_plan,
+		&GUID_PROCESSOR_SETTINGS_SUBGROUP, &setting.guid, ac) ==
+		ERROR_SUCCESS &&
+		PowerWriteDCValueIndex(NULL, &m_plan,
+			&GUID_PROCESSOR_SETTINGS_SUBGROUP, &setting.guid, dc) ==
+		ERROR_SUCCESS;
+}
+
+bool PowerPlanStore::Apply() {
+	// Written values only take effect once the plan is (re)activated
+	GUID* active = nullptr;
+	if (PowerGetActiveScheme(NULL, &active) != ERROR_SUCCESS) {
+		return false;
+	}
+	bool isActive = IsEqualGUID(*active, m_plan);
+	LocalFree(active);
+	return !isActive || PowerSetActiveScheme(NULL, &m_plan) == ERROR_SUCCESS;
+}
+
+std::wstring PowerPlanStore::GetPlanId() const {
+	WCHAR id[64];
+	StringFromGUID2(m_plan, id, static_cast<int>(std::size(id)));
+	return id;
+}
+
+FrequencyPinning::FrequencyPinning(const Request& request,
+	const Target& target, std::unique_ptr<PowerSettingStore> store,
+	const std::wstring& journalPath)
+	: m_request(request), m_target(target), m_store(std::move(store)),
+	  m_journalPath(GetFullPath(journalPath)) {}
+
+FrequencyPinning::~FrequencyPinning() {
+	Restore();
+}
+
+FrequencyPinning::Request FrequencyPinning::FromOptions(
+	const CommandLineOptions& options) {
+	Request request;
+	request.minKhz = static_cast<ULONG>(options.freqMinKhz);
+	request.maxKhz = static_cast<ULONG>(options.freqMaxKhz);
+	request.epp = options.epp;
+	return request;
+}
+
+FrequencyPinning::Target FrequencyPinning::DescribeMask(DWORD_PTR mask) {
+	Target target;
+	auto classes = CpuInfo::GetEfficiencyClasses();
+	for (size_t i = 0; i < classes.size(); i++) {
+		if (mask & (DWORD_PTR(1) << i)) {
+			if (classes[i] == 0) {
+				target.efficientClass = true;
+			} else {
+				target.performanceClass = true;
+			}
+		}
+	}
+	for (const auto& processor : CpuInfo::GetProcessorFrequencies()) {
+		if (mask & (DWORD_PTR(1) << processor.number)) {
+			target.maxMhz = (std::max)(target.maxMhz, processor.maxMhz);
+		}
+	}
+	return target;
+}
+
+std::vector<FrequencyPinning::Change> FrequencyPinning::PlanChanges(
+	const Request& request, const Target& target) {
+
+	std::vector<Change> changes;
+	auto add = [&](const PowerSetting& classZero, const PowerSetting& classOne,
+		DWORD value) {
+		if (target.efficientClass) {
+			changes.push_back({ &classZero, value });
+		}
+		if (target.performanceClass) {
+			changes.push_back({ &classOne, value });
+		}
+	};
+
+	if (request.minKhz > 0) {
+		// Windows has no minimum clock, only a minimum processor state in
+		// percent of the rated maximum
+		if (target.maxMhz == 0) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"Cannot translate --freq min: processor clock is unknown"));
+		}
+		ULONG percent = (request.minKhz + target.maxMhz * 10 - 1) /
+			(target.maxMhz * 10);
+		add(PROCTHROTTLEMIN, PROCTHROTTLEMIN1, (std::min)(percent, 100UL));
+	}
+	if (request.maxKhz > 0) {
+		add(PROCFREQMAX, PROCFREQMAX1, request.maxKhz / 1000);
+	}
+	if (request.epp >= 0) {
+		add(PERFEPP, PERFEPP1, static_cast<DWORD>(request.epp));
+	}
+	if (request.disableIdle) {
+		changes.push_back({ &IDLEDISABLE, 1 });
+	}
+	return changes;
+}
+
+// Creation time of a process, to tell it apart from a later one that
+// reuses its id
+static ULONGLONG GetCreationTime(HANDLE process) {
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	return (ULONGLONG(creation.dwHighDateTime) << 32) | creation.dwLowDateTime;
+}
+
+// Directory of a file, with a trailing separator (or empty)
+static std::wstring GetDirectory(const std::wstring& path) {
+	size_t separator = path.find_last_of(L"\\/");
+	if (separator == std::wstring::npos) {
+		return L"";
+	}
+	return path.substr(0, separator + 1);
+}
+
+// Directory of the launcher, with a trailing separator (or empty)
+static std::wstring GetJournalDirectory() {
+	WCHAR modulePath[MAX_PATH];
+	DWORD length = GetModuleFileNameW(NULL, modulePath, MAX_PATH);
+	if (length == 0 || length == MAX_PATH) {
+		return L"";
+	}
+	return GetDirectory(std::wstring(modulePath, length));
+}
+
+// Every journal in directory, whoever wrote it
+static std::vector<std::wstring> ListJournals(const std::wstring& directory) {
+	std::vector<std::wstring> journals;
+	WIN32_FIND_DATAW found;
+	HANDLE search = FindFirstFileW(
+		(directory + JOURNAL_FILE_PREFIX + L"*.ini").c_str(), &found);
+	if (search == INVALID_HANDLE_VALUE) {
+		return journals;
+	}
+	do {
+		journals.push_back(directory + found.cFileName);
+	} while (FindNextFileW(search, &found));
+	FindClose(search);
+	return journals;
+}
+
+// Names of the settings a journal holds originals for
+static std::vector<std::wstring> ReadJournalSettings(const std::wstring& path) {
+	WCHAR value[512] = L"";
+	GetPrivateProfileStringW(L"Journal", L"Settings", L"", value,
+		static_cast<DWORD>(std::size(value)), path.c_str());
+
+	std::vector<std::wstring> settings;
+	std::wstring names = value;
+	size_t start = 0;
+	while (start < names.size()) {
+		size_t comma = names.find(L',', start);
+		settings.push_back(names.substr(start,
+			comma == std::wstring::npos ? std::wstring::npos : comma - start));
+		start = comma == std::wstring::npos ? names.size() : comma + 1;
+	}
+	return settings;
+}
+
+std::wstring FrequencyPinning::GetDefaultJournalPath(
+	const std::wstring& purpose) {
+	// Next to the launcher, so any later run finds it
+	return GetJournalDirectory() + std::format(L"{}_{}_{}.ini",
+		JOURNAL_FILE_PREFIX, GetCurrentProcessId(), purpose);
+}
+
+void FrequencyPinning::Pin() {
+	auto changes = PlanChanges(m_request, m_target);
+	if (changes.empty()) {
+		return;
+	}
+
+	PinningLock lock;
+	if (!lock.IsHeld()) {
+		throw std::runtime_error(std::format(
+			"Cannot lock the power settings for pinning: error {}",
+			lock.GetError()));
+	}
+
+	// Values another live run has pinned are not the originals, and two
+	// runs restoring in either order would leave one of them pinned
+	for (const auto& journal : ListJournals(GetDirectory(m_journalPath))) {
+		if (_wcsicmp(journal.c_str(), m_journalPath.c_str()) == 0 ||
+			!IsJournalOwnerAlive(journal)) {
+			continue;
+		}
+		auto pinned = ReadJournalSettings(journal);
+		for (const auto& change : changes) {
+			if (std::find(pinned.begin(), pinned.end(),
+				change.setting->name) != pinned.end()) {
+				throw std::runtime_error(ConvertToNarrowString(std::format(
+					L"{} is already pinned by the launch in process {}; "
+					L"run again once it has finished", change.setting->name,
+					GetPrivateProfileIntW(L"Journal", L"Pid", 0,
+						journal.c_str()))));
+			}
+		}
+	}
+
+	for (const auto& change : changes) {
+		Saved saved = { change.setting, 0, 0 };
+		if (!m_store->Read(*change.setting, saved.ac, saved.dc)) {
+			m_saved.clear();
+			throw std::runtime_error(ConvertToNarrowString(
+				std::wstring(L"Could not read power setting ") +
+				change.setting->name));
+		}
+		m_saved.push_back(saved);
+	}
+
+	// The journal must be on disk before the first value changes
+	WriteJournal();
+
+	for (const auto& change : changes) {
+		if (!m_store->Write(*change.setting, change.value, change.value)) {
+			Restore();
+			throw std::runtime_error(ConvertToNarrowString(
+				std::wstring(L"Could not write power setting ") +
+				change.setting->name));
+		}
+		g_logger->Log(ApplicationLogger::Level::INFO, "Pinned {} to {}",
+			change.setting->name, change.value);
+	}
+	if (!m_store->Apply()) {
+		Restore();
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Could not apply the pinned power settings"));
+	}
+}
+
+void FrequencyPinning::Restore() {
+	if (m_saved.empty()) {
+		return;
+	}
+
+	// Restoring unlocked still beats leaving the settings pinned
+	PinningLock lock;
+	if (!lock.IsHeld()) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Restoring the power settings without the lock: error {}",
+			lock.GetError());
+	}
+
+	bool restored = true;
+	for (const auto& saved : m_saved) {
+		restored = m_store->Write(*saved.setting, saved.ac, saved.dc) &&
+			restored;
+	}
+	restored = m_store->Apply() && restored;
+	m_saved.clear();
+
+	if (restored) {
+		DeleteFileW(m_journalPath.c_str());
+	} else {
+		// Keep the journal so the next run tries again
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Could not restore the power settings; journal kept at {}",
+			m_journalPath);
+	}
+}
+
+void FrequencyPinning::WriteJournal() const {
+	std::wstring names;
+	for (const auto& saved : m_saved) {
+		names += (names.empty() ? L"" : L",") + std::wstring(saved.setting->name);
+		WritePrivateProfileStringW(saved.setting->name, L"Ac",
+			std::to_wstring(saved.ac).c_str(), m_journalPath.c_str());
+		WritePrivateProfileStringW(saved.setting->name, L"Dc",
+			std::to_wstring(saved.dc).c_str(), m_journalPath.c_str());
+	}
+	WritePrivateProfileStringW(L"Journal", L"Plan",
+		m_store->GetPlanId().c_str(), m_journalPath.c_str());
+	WritePrivateProfileStringW(L"Journal", L"Pid",
+		std::to_wstring(GetCurrentProcessId()).c_str(), m_journalPath.c_str());
+	WritePrivateProfileStringW(L"Journal", L"Created",
+		std::to_wstring(GetCreationTime(GetCurrentProcess())).c_str(),
+		m_journalPath.c_str());
+	if (!WritePrivateProfileStringW(L"Journal", L"Settings", names.c_str(),
+		m_journalPath.c_str())) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Could not write the power journal " + m_journalPath));
+	}
+}
+
+bool FrequencyPinning::RecoverJournal(const std::wstring& journalPath,
+	PowerSettingStore& store) {
+
+	std::wstring path = GetFullPath(journalPath);
+	if (!Utilities::PathExists(path)) {
+		return false;
+	}
+
+	bool restored = true;
+	for (const auto& name : ReadJournalSettings(path)) {
+		const PowerSetting* setting = FindSetting(name);
+		if (!setting) {
+			continue;
+		}
+		DWORD ac = GetPrivateProfileIntW(name.c_str(), L"Ac", 0, path.c_str());
+		DWORD dc = GetPrivateProfileIntW(name.c_str(), L"Dc", 0, path.c_str());
+		restored = store.Write(*setting, ac, dc) && restored;
+	}
+	restored = store.Apply() && restored;
+
+	if (restored) {
+		DeleteFileW(path.c_str());
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Restored power settings left behind by an interrupted run");
+	}
+	return restored;
+}
+
+bool FrequencyPinning::RecoverJournal(const std::wstring& journalPath) {
+	std::wstring path = GetFullPath(journalPath);
+	if (!Utilities::PathExists(path)) {
+		return false;
+	}
+
+	WCHAR planId[64] = L"";
+	GetPrivateProfileStringW(L"Journal", L"Plan", L"", planId,
+		static_cast<DWORD>(std::size(planId)), path.c_str());
+	std::unique_ptr<PowerPlanStore> store;
+	try {
+		store = planId[0] != L'\0' ? PowerPlanStore::FromId(planId)
+		                            : PowerPlanStore::Active();
+	} catch (const std::exception& e) {
+		// Replaying a journal that cannot be read would only fail again
+		DeleteFileW(path.c_str());
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Discarded unreadable power journal {}: {}", path, e.what());
+		return false;
+	}
+	return RecoverJournal(path, *store);
+}
+
+int FrequencyPinning::RecoverJournals() {
+	// A journal being written has no owner yet and would look abandoned
+	PinningLock lock;
+	if (!lock.IsHeld()) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Power journals not checked; the pinning lock is busy: error {}",
+			lock.GetError());
+		return 0;
+	}
+
+	int restored = 0;
+	for (const auto& journal : ListJournals(GetJournalDirectory())) {
+		// A running launcher still holds its pinning; leave it alone
+		if (!IsJournalOwnerAlive(journal) && RecoverJournal(journal)) {
+			restored++;
+		}
+	}
+	return restored;
+}
+
+bool FrequencyPinning::IsJournalOwnerAlive(const std::wstring& journalPath) {
+	std::wstring path = GetFullPath(journalPath);
+	WCHAR value[32] = L"";
+	GetPrivateProfileStringW(L"Journal", L"Pid", L"0", value,
+		static_cast<DWORD>(std::size(value)), path.c_str());
+	DWORD processId = wcstoul(value, nullptr, 10);
+	GetPrivateProfileStringW(L"Journal", L"Created", L"0", value,
+		static_cast<DWORD>(std::size(value)), path.c_str());
+	ULONGLONG created = wcstoull(value, nullptr, 10);
+	if (processId == 0 || created == 0) {
+		return false;  // Written before journals had owners
+	}
+
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE,
+		processId);
+	if (!process) {
+		// Another user's launcher is alive but cannot be opened
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+	DWORD exitCode = 0;
+	bool alive = GetExitCodeProcess(process, &exitCode) &&
+		exitCode == STILL_ACTIVE && GetCreationTime(process) == created;
+	CloseHandle(process);
+	return alive;
+}
@@ -0,0 +1,114 @@
+// powerplan.h
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "options.h"
+
+// A processor setting of the power plan; names are the powercfg aliases
+struct PowerSetting {
+    const wchar_t* name;
+    GUID guid;
+};
+
+// Reads and writes processor power settings; tests substitute a store
+// that keeps the values in memory
+class PowerSettingStore {
+public:
+    virtual ~PowerSettingStore() = default;
+    virtual bool Read(const PowerSetting& setting, DWORD& ac, DWORD& dc) = 0;
+    virtual bool Write(const PowerSetting& setting, DWORD ac, DWORD dc) = 0;
+    virtual bool Apply() = 0;  // Make written values take effect
+    virtual std::wstring GetPlanId() const = 0;
+};
+
+// Settings of one Windows power plan
+class PowerPlanStore : public PowerSettingStore {
+public:
+    explicit PowerPlanStore(const GUID& plan);
+    static std::unique_ptr<PowerPlanStore> Active();
+    static std::unique_ptr<PowerPlanStore> FromId(const std::wstring& planId);
+
+    bool Read(const PowerSetting& setting, DWORD& ac, DWORD& dc) override;
+    bool Write(const PowerSetting& setting, DWORD ac, DWORD dc) override;
+    bool Apply() override;
+    std::wstring GetPlanId() const override;
+
+private:
+    GUID m_plan;
+};
+
+// Pins the frequency limits and energy-performance preference of the core
+// classes in a mask (and, for --idle-disable, the idle states) while a
+// child runs. The original values are journaled
+// to disk first so a crashed run can be undone by a later one. Every run
+// has its own journal holding its process id and creation time; only
+// journals whose owner is gone are replayed. Pinning and restoring hold a
+// machine-wide lock, and a setting that another live run has journaled is
+// refused rather than pinned on top
+class FrequencyPinning {
+public:
+    struct Request {
+        ULONG minKhz = 0;   // 0 = leave unchanged
+        ULONG maxKhz = 0;   // 0 = leave unchanged
+        int epp = -1;       // 0 (performance)..100 (power), -1 = unchanged
+        bool disableIdle = false;  // Idle states off on every processor
+    };
+
+    struct Target {
+        bool efficientClass = false;   // Class 0: E-cores, or all cores
+        bool performanceClass = false; // Class 1: P-cores
+        ULONG maxMhz = 0;              // Highest rated clock in the mask
+    };
+
+    struct Change {
+        const PowerSetting* setting;
+        DWORD value;
+    };
+
+    FrequencyPinning(const Request& request, const Target& target,
+        std::unique_ptr<PowerSettingStore> store,
+        const std::wstring& journalPath);
+    ~FrequencyPinning();
+
+    static Request FromOptions(const CommandLineOptions& options);
+    static Target DescribeMask(DWORD_PTR mask);
+    static std::vector<Change> PlanChanges(const Request& request,
+        const Target& target);
+    // This run's journal next to the launcher; purpose tells apart the
+    // journals of one run
+    static std::wstring GetDefaultJournalPath(
+        const std::wstring& purpose = L"freq");
+    // Puts back the values journaled by an interrupted run; true if a
+    // journal was found and replayed
+    static bool RecoverJournal(const std::wstring& journalPath,
+        PowerSettingStore& store);
+    // Same for the plan named in the journal; a journal that cannot be
+    // parsed is deleted instead
+    static bool RecoverJournal(const std::wstring& journalPath);
+    // Replays every journal next to the launcher whose run has ended;
+    // returns how many were restored
+    static int RecoverJournals();
+    // False once the process that wrote the journal has exited (or its
+    // process id belongs to a newer process)
+    static bool IsJournalOwnerAlive(const std::wstring& journalPath);
+
+    void Pin();
+    void Restore();
+
+private:
+    struct Saved {
+        const PowerSetting* setting;
+        DWORD ac;
+        DWORD dc;
+    };
+
+    void WriteJournal() const;
+
+    Request m_request;
+    Target m_target;
+    std::unique_ptr<PowerSettingStore> m_store;
+    std::wstring m_journalPath;
+    std::vector<Saved> m_saved;
+};
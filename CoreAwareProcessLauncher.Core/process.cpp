@@ -1,7 +1,11 @@
 //process.cpp
 #include "pch.h"
 #include "process.h"
+#include "topology.h"
+#include "capl_topology.h"
 #include "utilities.h" 
+#include "trace.h"
+#include <algorithm>
 #include <format>
 
 using Utilities::ConvertToNarrowString;
@@ -11,12 +15,280 @@ bool ProcessManager::LaunchProcess(
     const std::wstring& path,
     const std::vector<std::wstring>& args,
     const std::wstring& workingDir,
-    DWORD_PTR affinityMask) {
+    DWORD_PTR affinityMask,
+    ProcessStats* stats,
+    const std::vector<ProcessMonitor*>& monitors,
+    const SchedulingSettings& scheduling) {
     
+    PROCESS_INFORMATION pi;
+    if (!CreateSuspended(path, args, workingDir, affinityMask, scheduling,
+        pi)) {
+        return false;
+    }
+
+    // Monitors attach while the child is still suspended
+    for (auto* monitor : monitors) {
+        monitor->OnStart(pi.hProcess, pi.dwProcessId, affinityMask);
+    }
+
+    // Resume the process
+    LARGE_INTEGER frequency, startCounter, endCounter;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&startCounter);
+    DWORD resumed;
+    {
+        PhaseTrace::Scope trace("ResumeThread");
+        resumed = ResumeThread(pi.hThread);
+    }
+    if (resumed == -1) {        // NEW: Error check for ResumeThread
+        LogWin32Error("ResumeThread failed");
+        TerminateProcess(pi.hProcess, 1);
+        for (auto* monitor : monitors) {
+            monitor->OnExit(pi.hProcess);
+        }
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        return false;
+    }
+    
+    // After process is launched and running, wait for it to complete
+    WaitWithMonitors(pi.hProcess, monitors);
+    QueryPerformanceCounter(&endCounter);
+    if (PhaseTrace::IsEnabled()) {
+        PhaseTrace::Record("Program running", startCounter.QuadPart,
+            endCounter.QuadPart);
+    }
+
+    for (auto* monitor : monitors) {
+        monitor->OnExit(pi.hProcess);
+    }
+
+    if (stats) {
+        stats->wallSeconds =
+            static_cast<double>(endCounter.QuadPart - startCounter.QuadPart) /
+            frequency.QuadPart;
+
+        FILETIME creationTime, exitTime, kernelTime, userTime;
+        if (GetProcessTimes(pi.hProcess, &creationTime, &exitTime,
+            &kernelTime, &userTime)) {
+            stats->kernelSeconds = FileTimeToSeconds(kernelTime);
+            stats->userSeconds = FileTimeToSeconds(userTime);
+        } else {
+            LogWin32Error("GetProcessTimes failed");
+        }
+        if (!GetExitCodeProcess(pi.hProcess, &stats->exitCode)) {
+            LogWin32Error("GetExitCodeProcess failed");
+        }
+    }
+
+    // Force console refresh
+    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    GetConsoleScreenBufferInfo(hConsole, &csbi);
+    SetConsoleCursorPosition(hConsole, csbi.dwCursorPosition);
+
+    // Clean up handles
+    CloseHandle(pi.hProcess);
+    CloseHandle(pi.hThread);
+
+    g_logger->Log(ApplicationLogger::Level::INFO, "Process launched successfully");
+    return true;
+}
+
+bool ProcessManager::StartProcess(
+    const std::wstring& path,
+    const std::vector<std::wstring>& args,
+    const std::wstring& workingDir,
+    DWORD_PTR affinityMask,
+    const SchedulingSettings& scheduling,
+    PROCESS_INFORMATION& info) {
+
+    if (!CreateSuspended(path, args, workingDir, affinityMask, scheduling,
+        info)) {
+        return false;
+    }
+    DWORD resumed;
+    {
+        PhaseTrace::Scope trace("ResumeThread");
+        resumed = ResumeThread(info.hThread);
+    }
+    if (resumed == -1) {
+        DWORD error = LogWin32Error("ResumeThread failed");
+        TerminateProcess(info.hProcess, 1);
+        CloseHandle(info.hProcess);
+        CloseHandle(info.hThread);
+        SetLastError(error);
+        return false;
+    }
+    return true;
+}
+
+bool ProcessManager::CreateSuspended(
+    const std::wstring& path,
+    const std::vector<std::wstring>& args,
+    const std::wstring& workingDir,
+    DWORD_PTR affinityMask,
+    const SchedulingSettings& scheduling,
+    PROCESS_INFORMATION& pi) {
+
+    PhaseTrace::Scope trace("Create suspended process");
     g_logger->Log(ApplicationLogger::Level::INFO, 
-        "Attempting to launch: " + ConvertToNarrowString(path));
+        "Attempting to launch: {}", path);
+
+    std::wstring fullPath = ResolveExecutablePath(path);
+
+    g_logger->Log(ApplicationLogger::Level::INFO, 
+        "Resolved path: {}", fullPath);
+    
+    g_logger->Log(ApplicationLogger::Level::INFO, 
+        "Launching process with affinity mask: 0x{:X}", affinityMask);
+    
+    std::wstring cmdLine = BuildCommandLine(fullPath, args);
+    g_logger->Log(ApplicationLogger::Level::DEBUG, 
+        "Command line: {}", cmdLine);    
+
+    // Both topology variables go into the child's environment block only;
+    // CAPL's own environment, and so later launches, stay unchanged
+    std::vector<std::pair<std::wstring, std::wstring>> variables;
+
+    // --export-topology: CAPL_TOPOLOGY for capl_runtime.h thread pools
+    if (scheduling.exportTopology) {
+        PhaseTrace::Scope trace("Export topology");
+        variables.emplace_back(TopologySnapshot::ENVIRONMENT_VARIABLE,
+            TopologySnapshot::Capture().FormatEnvironment());
+    }
+
+    // --share-topology: the child inherits a read-only blob handle and
+    // finds its value in CAPL_TOPOLOGY_FD
+    HANDLE topologyBlob = NULL;
+    if (scheduling.publishTopology) {
+        PhaseTrace::Scope publishTrace("Publish topology blob");
+        topologyBlob = TopologySnapshot::Capture().Publish(affinityMask);
+        if (!topologyBlob) {
+            return false;
+        }
+        variables.emplace_back(
+            Utilities::ConvertToWideString(CAPL_TOPOLOGY_VARIABLE),
+            std::to_wstring(reinterpret_cast<uintptr_t>(topologyBlob)));
+    }
+    std::wstring environment;
+    if (!variables.empty()) {
+        environment = BuildEnvironment(variables);
+    }
+
+    // With a topology blob the child inherits only the handles listed
+    // here: its blob and CAPL's standard handles when they are inheritable
+    // (redirected output). Launches running side by side, like daemon
+    // requests, never receive each other's blobs. Without a blob the child
+    // inherits every inheritable handle, as it always has
+    STARTUPINFOEXW si = {};
+    si.StartupInfo.cb = sizeof(STARTUPINFOEXW);
+    std::vector<BYTE> attributes;
+    bool listed = false;
+    if (topologyBlob) {
+        SetHandleInformation(topologyBlob, HANDLE_FLAG_INHERIT,
+            HANDLE_FLAG_INHERIT);
+        std::vector<HANDLE> inherited = { topologyBlob };
+        for (DWORD stdHandle : { STD_INPUT_HANDLE, STD_OUTPUT_HANDLE,
+            STD_ERROR_HANDLE }) {
+            HANDLE handle = GetStdHandle(stdHandle);
+            DWORD flags = 0;
+            if (handle && handle != INVALID_HANDLE_VALUE &&
+                GetHandleInformation(handle, &flags) &&
+                (flags & HANDLE_FLAG_INHERIT) &&
+                std::find(inherited.begin(), inherited.end(), handle) ==
+                    inherited.end()) {
+                inherited.push_back(handle);  // Listed once, even if shared
+            }
+        }
+
+        SIZE_T size = 0;
+        InitializeProcThreadAttributeList(NULL, 1, 0, &size);
+        attributes.resize(size);
+        si.lpAttributeList =
+            reinterpret_cast<LPPROC_THREAD_ATTRIBUTE_LIST>(attributes.data());
+        if (!InitializeProcThreadAttributeList(si.lpAttributeList, 1, 0,
+            &size)) {
+            DWORD error = LogWin32Error("InitializeProcThreadAttributeList failed");
+            CloseHandle(topologyBlob);
+            SetLastError(error);
+            return false;
+        }
+        listed = UpdateProcThreadAttribute(si.lpAttributeList, 0,
+            PROC_THREAD_ATTRIBUTE_HANDLE_LIST, inherited.data(),
+            inherited.size() * sizeof(HANDLE), NULL, NULL) != FALSE;
+        if (!listed) {
+            DWORD error = LogWin32Error("UpdateProcThreadAttribute failed");
+            DeleteProcThreadAttributeList(si.lpAttributeList);
+            CloseHandle(topologyBlob);
+            SetLastError(error);
+            return false;
+        }
+    }
 
-    // Resolve full path
+    // Create process suspended
+    BOOL created;
+    {
+        PhaseTrace::Scope createTrace("CreateProcessW");
+        created = CreateProcessW(
+            NULL,                // Application name (NULL when using command line)
+            cmdLine.data(),      // Command line
+            NULL,               // Process attributes
+            NULL,               // Thread attributes
+            TRUE,               // Inherit handles (only the listed ones with a blob)
+            CREATE_SUSPENDED |  // Creation flags
+                (listed ? EXTENDED_STARTUPINFO_PRESENT : 0) |
+                (environment.empty() ? 0 : CREATE_UNICODE_ENVIRONMENT),
+            environment.empty() ? NULL : environment.data(), // Environment
+            workingDir.empty() ? NULL : workingDir.c_str(), // Working directory
+            &si.StartupInfo,    // Startup info
+            &pi                 // Process information
+        );
+    }
+    DWORD createError = created ? ERROR_SUCCESS : GetLastError();
+    if (listed) {
+        DeleteProcThreadAttributeList(si.lpAttributeList);
+    }
+    if (topologyBlob) {
+        CloseHandle(topologyBlob);  // The child holds its own copy
+    }
+    if (!created) {
+        SetLastError(createError);
+        LogWin32Error("CreateProcess failed");
+        return false;
+    }
+    
+    // Set affinity; soft affinity only states a preference through the
+    // default CPU sets, which the scheduler may override under load
+    PhaseTrace::Scope affinityTrace("Affinity and scheduling");
+    // The child never runs if any step fails; GetLastError() keeps the
+    // error of that step for the caller
+    auto abandon = [&pi](DWORD error) {
+        TerminateProcess(pi.hProcess, 1);
+        CloseHandle(pi.hProcess);
+        CloseHandle(pi.hThread);
+        SetLastError(error);
+        return false;
+    };
+    if (scheduling.softAffinity) {
+        if (!ApplyCpuSets(pi.hProcess, affinityMask)) {
+            return abandon(GetLastError());
+        }
+    } else if (!SetProcessAffinityMask(pi.hProcess, affinityMask)) {
+        return abandon(LogWin32Error("SetProcessAffinityMask failed"));
+    }
+
+    // Priorities and QoS, like affinity, are in place before the first
+    // instruction of the child runs
+    if (!ApplyScheduling(pi.hProcess, pi.hThread, scheduling)) {
+        return abandon(GetLastError());
+    }
+    
+    return true;
+}
+
+std::wstring ProcessManager::ResolveExecutablePath(const std::wstring& path) {
+    PhaseTrace::Scope trace("SearchPathW");
     WCHAR fullPath[MAX_PATH];
     DWORD searchResult = SearchPathW(
         NULL,           // Search in default paths
@@ -45,9 +317,10 @@ bool ProcessManager::LaunchProcess(
 
         // Log the PATH for debugging
         WCHAR pathEnv[32768];  // Maximum environment variable size
-        if (GetEnvironmentVariableW(L"PATH", pathEnv, 32768)) {
+        if (g_logger->IsEnabled() &&
+            GetEnvironmentVariableW(L"PATH", pathEnv, 32768)) {
             g_logger->Log(ApplicationLogger::Level::DEBUG,
-                "Search PATH: " + ConvertToNarrowString(pathEnv));
+                "Search PATH: {}", std::wstring_view(pathEnv));
         }
 
         g_logger->Log(ApplicationLogger::Level::ERR, errorMsg);
@@ -55,70 +328,7 @@ bool ProcessManager::LaunchProcess(
 		throw std::runtime_error(errorMsg);
     }    
 
-    g_logger->Log(ApplicationLogger::Level::INFO, 
-        "Resolved path: " + ConvertToNarrowString(fullPath));
-    
-    STARTUPINFOW si = { sizeof(STARTUPINFOW) };
-    PROCESS_INFORMATION pi;
-    
-    g_logger->Log(ApplicationLogger::Level::INFO, 
-        std::string("Launching process with affinity mask: 0x") + 
-        std::format("{:X}", affinityMask));
-    
-    std::wstring cmdLine = BuildCommandLine(fullPath, args);
-    g_logger->Log(ApplicationLogger::Level::DEBUG, 
-        std::string("Command line: ") + ConvertToNarrowString(cmdLine));    
-
-    // Create process suspended
-    if (!CreateProcessW(
-        NULL,                // Application name (NULL when using command line)
-        cmdLine.data(),      // Command line
-        NULL,               // Process attributes
-        NULL,               // Thread attributes
-        TRUE,              // Inherit handles
-        CREATE_SUSPENDED,   // Creation flags
-        NULL,               // Environment
-        workingDir.empty() ? NULL : workingDir.c_str(), // Working directory
-        &si,                // Startup info
-        &pi                 // Process information
-    )) {
-        LogWin32Error("CreateProcess failed");
-        return false;
-    }
-    
-    // Set affinity
-    if (!SetProcessAffinityMask(pi.hProcess, affinityMask)) {
-        LogWin32Error("SetProcessAffinityMask failed");
-        TerminateProcess(pi.hProcess, 1);
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
-        return false;
-    }
-    
-    // Resume the process
-    if (ResumeThread(pi.hThread) == -1) {        // NEW: Error check for ResumeThread
-        LogWin32Error("ResumeThread failed");
-        TerminateProcess(pi.hProcess, 1);
-        CloseHandle(pi.hProcess);
-        CloseHandle(pi.hThread);
-        return false;
-    }
-    
-    // After process is launched and running, wait for it to complete
-    WaitForSingleObject(pi.hProcess, INFINITE);
-
-    // Force console refresh
-    HANDLE hConsole = GetStdHandle(STD_OUTPUT_HANDLE);
-    CONSOLE_SCREEN_BUFFER_INFO csbi;
-    GetConsoleScreenBufferInfo(hConsole, &csbi);
-    SetConsoleCursorPosition(hConsole, csbi.dwCursorPosition);
-
-    // Clean up handles
-    CloseHandle(pi.hProcess);
-    CloseHandle(pi.hThread);
-
-    g_logger->Log(ApplicationLogger::Level::INFO, "Process launched successfully");
-    return true;
+    return fullPath;
 }
 
 std::wstring ProcessManager::BuildCommandLine(
@@ -144,9 +354,210 @@ std::wstring ProcessManager::BuildCommandLine(
     return cmdLine;
 }
 
-void ProcessManager::LogWin32Error(const std::string& context) {
+void ProcessManager::WaitWithMonitors(HANDLE process,
+    const std::vector<ProcessMonitor*>& monitors) {
+    if (monitors.empty()) {
+        WaitForSingleObject(process, INFINITE);
+        return;
+    }
+
+    // Each monitor keeps its own schedule; sleep until the earliest is due
+    std::vector<ULONGLONG> due;
+    ULONGLONG now = GetTickCount64();
+    for (auto* monitor : monitors) {
+        due.push_back(now + monitor->GetIntervalMs());
+    }
+
+    while (true) {
+        ULONGLONG next = *std::min_element(due.begin(), due.end());
+        now = GetTickCount64();
+        DWORD timeout = next > now ? static_cast<DWORD>(next - now) : 0;
+        if (WaitForSingleObject(process, timeout) != WAIT_TIMEOUT) {
+            break;
+        }
+
+        now = GetTickCount64();
+        for (size_t i = 0; i < monitors.size(); i++) {
+            if (now >= due[i]) {
+                monitors[i]->OnTick(process);
+                due[i] = now + monitors[i]->GetIntervalMs();
+            }
+        }
+    }
+}
+
+bool ProcessManager::ApplyScheduling(HANDLE process, HANDLE thread,
+    const SchedulingSettings& scheduling) {
+
+    if (scheduling.priorityClass != 0) {
+        if (!SetPriorityClass(process, scheduling.priorityClass)) {
+            LogWin32Error("SetPriorityClass failed");
+            return false;
+        }
+        // Without SeIncreaseBasePriorityPrivilege realtime becomes high
+        DWORD applied = GetPriorityClass(process);
+        if (applied != scheduling.priorityClass) {
+            g_logger->Log(ApplicationLogger::Level::WARNING,
+                "Requested priority class 0x{:X}, got 0x{:X}",
+                scheduling.priorityClass, applied);
+        }
+    }
+
+    if (scheduling.setThreadPriority &&
+        !SetThreadPriority(thread, scheduling.threadPriority)) {
+        LogWin32Error("SetThreadPriority failed");
+        return false;
+    }
+
+    if (scheduling.ioPriority >= 0) {
+        using NtSetInformationProcessFn =
+            LONG(WINAPI*)(HANDLE, INT, PVOID, ULONG);
+        auto ntSetInformationProcess =
+            reinterpret_cast<NtSetInformationProcessFn>(GetProcAddress(
+                GetModuleHandleW(L"ntdll.dll"), "NtSetInformationProcess"));
+        const INT ProcessIoPriority = 33;
+        ULONG hint = static_cast<ULONG>(scheduling.ioPriority);
+        LONG status = ntSetInformationProcess
+            ? ntSetInformationProcess(process, ProcessIoPriority, &hint,
+                sizeof(hint))
+            : -1;
+        if (status < 0) {
+            g_logger->Log(ApplicationLogger::Level::ERR,
+                "Setting the I/O priority failed: NTSTATUS 0x{:X}",
+                static_cast<ULONG>(status));
+            SetLastError(ERROR_NOT_SUPPORTED);
+            return false;
+        }
+    }
+
+    // EcoQoS sets the throttling bit, HighQoS takes control of it and
+    // clears it so the scheduler treats the child as performance-critical
+    if (scheduling.ecoQos || scheduling.highQos) {
+        PROCESS_POWER_THROTTLING_STATE throttling = {};
+        throttling.Version = PROCESS_POWER_THROTTLING_CURRENT_VERSION;
+        throttling.ControlMask = PROCESS_POWER_THROTTLING_EXECUTION_SPEED;
+        throttling.StateMask = scheduling.ecoQos
+            ? PROCESS_POWER_THROTTLING_EXECUTION_SPEED : 0;
+        if (!SetProcessInformation(process, ProcessPowerThrottling,
+            &throttling, sizeof(throttling))) {
+            LogWin32Error(scheduling.ecoQos ? "Enabling EcoQoS failed"
+                                            : "Enabling HighQoS failed");
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool ProcessManager::ApplyCpuSets(HANDLE process, DWORD_PTR mask) {
+    ULONG length = 0;
+    GetSystemCpuSetInformation(NULL, 0, &length, GetCurrentProcess(), 0);
+    std::vector<BYTE> buffer(length);
+    if (!GetSystemCpuSetInformation(
+        reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(buffer.data()),
+        length, &length, GetCurrentProcess(), 0)) {
+        LogWin32Error("GetSystemCpuSetInformation failed");
+        return false;
+    }
+
+    // Affinity masks cover processor group 0, like the rest of CAPL
+    std::vector<ULONG> cpuSetIds;
+    for (ULONG offset = 0; offset < length;) {
+        auto info = reinterpret_cast<PSYSTEM_CPU_SET_INFORMATION>(
+            buffer.data() + offset);
+        if (info->Type == CpuSetInformation && info->CpuSet.Group == 0 &&
+            info->CpuSet.LogicalProcessorIndex < sizeof(DWORD_PTR) * 8 &&
+            (mask & (DWORD_PTR(1) << info->CpuSet.LogicalProcessorIndex))) {
+            cpuSetIds.push_back(info->CpuSet.Id);
+        }
+        offset += info->Size;
+    }
+
+    // An empty list clears the default sets and the child would run
+    // anywhere, which is no hint at all
+    if (cpuSetIds.empty()) {
+        g_logger->Log(ApplicationLogger::Level::ERR,
+            "No CPU set matches the mask 0x{:X}", mask);
+        SetLastError(ERROR_INVALID_PARAMETER);
+        return false;
+    }
+
+    if (!SetProcessDefaultCpuSets(process, cpuSetIds.data(),
+        static_cast<ULONG>(cpuSetIds.size()))) {
+        LogWin32Error("SetProcessDefaultCpuSets failed");
+        return false;
+    }
+    g_logger->Log(ApplicationLogger::Level::INFO,
+        "Default CPU sets: {} of the mask 0x{:X}", cpuSetIds.size(), mask);
+    return true;
+}
+
+std::wstring ProcessManager::BuildEnvironment(
+    const std::vector<std::pair<std::wstring, std::wstring>>& variables) {
+    std::wstring environment;
+    LPWCH strings = GetEnvironmentStringsW();
+    for (LPWCH entry = strings; entry && *entry; entry += wcslen(entry) + 1) {
+        bool replaced = false;
+        for (const auto& [name, value] : variables) {
+            std::wstring prefix = name + L"=";
+            if (_wcsnicmp(entry, prefix.c_str(), prefix.size()) == 0) {
+                replaced = true;
+                break;
+            }
+        }
+        if (!replaced) {
+            environment.append(entry);
+            environment.push_back(L'\0');
+        }
+    }
+    if (strings) {
+        FreeEnvironmentStringsW(strings);
+    }
+    for (const auto& [name, value] : variables) {
+        environment += name + L"=" + value;
+        environment.push_back(L'\0');
+    }
+    environment.push_back(L'\0');
+    return environment;
+}
+
+double ProcessManager::FileTimeToSeconds(const FILETIME& fileTime) {
+    ULARGE_INTEGER ticks;
+    ticks.LowPart = fileTime.dwLowDateTime;
+    ticks.HighPart = fileTime.dwHighDateTime;
+    return static_cast<double>(ticks.QuadPart) / 1e7;  // 100ns units
+}
+
+bool ProcessManager::QueryProcessList(std::vector<BYTE>& buffer) {
+    using NtQuerySystemInformationFn = LONG(WINAPI*)(INT, PVOID, ULONG, PULONG);
+    static auto ntQuerySystemInformation =
+        reinterpret_cast<NtQuerySystemInformationFn>(GetProcAddress(
+            GetModuleHandleW(L"ntdll.dll"), "NtQuerySystemInformation"));
+    if (!ntQuerySystemInformation) {
+        return false;
+    }
+
+    const INT SystemProcessInformation = 5;
+    const LONG STATUS_INFO_LENGTH_MISMATCH = static_cast<LONG>(0xC0000004);
+    // Processes may start between the calls, so retry a few times
+    for (int attempt = 0; attempt < 4; attempt++) {
+        ULONG needed = 0;
+        LONG status = ntQuerySystemInformation(SystemProcessInformation,
+            buffer.data(), static_cast<ULONG>(buffer.size()), &needed);
+        if (status != STATUS_INFO_LENGTH_MISMATCH) {
+            return status >= 0;
+        }
+        buffer.resize(needed + 64 * 1024);
+    }
+    return false;
+}
+
+DWORD ProcessManager::LogWin32Error(const char* context) {
     DWORD error = GetLastError();
-    LPVOID msgBuf;
+    if (!g_logger->IsEnabled()) {
+        return error;  // Skip the message lookup nobody reads
+    }
+    LPSTR msgBuf = NULL;
     
     FormatMessageA(
         FORMAT_MESSAGE_ALLOCATE_BUFFER | 
@@ -158,8 +569,9 @@ void ProcessManager::LogWin32Error(const std::string& context) {
         (LPSTR)&msgBuf,
         0, NULL);
     
-    std::string errorMsg = context + ": " + (char*)msgBuf;
+    g_logger->Log(ApplicationLogger::Level::ERR, "{}: {}", context,
+        msgBuf ? msgBuf : "");
     LocalFree(msgBuf);
-    
-    g_logger->Log(ApplicationLogger::Level::ERR, errorMsg);
+    SetLastError(error);  // Callers report it after logging
+    return error;
 }
@@ -2,19 +2,89 @@
 #pragma once
 #include <windows.h>
 #include <string>
+#include <utility>
 #include <vector>
 
+// Timing and exit status of one finished child process
+struct ProcessStats {
+    DWORD exitCode = 0;
+    double wallSeconds = 0.0;   // From resume until the process exited
+    double userSeconds = 0.0;
+    double kernelSeconds = 0.0;
+};
+
+// Priority and QoS applied to a child before it starts running
+struct SchedulingSettings {
+    DWORD priorityClass = 0;      // 0 = inherit from CAPL
+    bool setThreadPriority = false;
+    int threadPriority = THREAD_PRIORITY_NORMAL;  // Primary thread
+    int ioPriority = -1;          // IO_PRIORITY_HINT, -1 = inherit
+    bool ecoQos = false;          // Power throttling (efficiency mode)
+    bool highQos = false;         // Power throttling explicitly off
+    bool softAffinity = false;    // Mask becomes default CPU sets instead
+    bool publishTopology = false; // Topology blob named by CAPL_TOPOLOGY_FD
+    bool exportTopology = false;  // CAPL_TOPOLOGY for capl_runtime.h pools
+};
+
+// Observes a running child; LaunchProcess calls it while waiting
+class ProcessMonitor {
+public:
+    virtual ~ProcessMonitor() = default;
+    virtual DWORD GetIntervalMs() const = 0;
+    virtual void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) {}
+    virtual void OnTick(HANDLE process) = 0;
+    virtual void OnExit(HANDLE process) {}
+};
+
 class ProcessManager {
 public:
     static bool LaunchProcess(
         const std::wstring& path,
         const std::vector<std::wstring>& args,
         const std::wstring& workingDir,
-        DWORD_PTR affinityMask);
+        DWORD_PTR affinityMask,
+        ProcessStats* stats = nullptr,
+        const std::vector<ProcessMonitor*>& monitors = {},
+        const SchedulingSettings& scheduling = {});
+    // Starts the child with the mask and scheduling in place and returns
+    // at once; the caller owns (and closes) both handles in info. On
+    // failure GetLastError() is the error of the step that failed
+    static bool StartProcess(
+        const std::wstring& path,
+        const std::vector<std::wstring>& args,
+        const std::wstring& workingDir,
+        DWORD_PTR affinityMask,
+        const SchedulingSettings& scheduling,
+        PROCESS_INFORMATION& info);
+    // Finds the executable the same way LaunchProcess does (throws if missing)
+    static std::wstring ResolveExecutablePath(const std::wstring& path);
+    // Kernel/user time of GetProcessTimes in seconds
+    static double FileTimeToSeconds(const FILETIME& fileTime);
+    // Fills buffer with the SYSTEM_PROCESS_INFORMATION list of every
+    // process; the buffer only grows when the list no longer fits
+    static bool QueryProcessList(std::vector<BYTE>& buffer);
 
 private:
-    static void LogWin32Error(const std::string& context);
+    static bool CreateSuspended(
+        const std::wstring& path,
+        const std::vector<std::wstring>& args,
+        const std::wstring& workingDir,
+        DWORD_PTR affinityMask,
+        const SchedulingSettings& scheduling,
+        PROCESS_INFORMATION& pi);
+    // Logs GetLastError() with context and returns it; the last error is
+    // left unchanged
+    static DWORD LogWin32Error(const char* context);
     static std::wstring BuildCommandLine(
         const std::wstring& path,
         const std::vector<std::wstring>& args);
-};
\ No newline at end of file
+    static bool ApplyScheduling(HANDLE process, HANDLE thread,
+        const SchedulingSettings& scheduling);
+    static bool ApplyCpuSets(HANDLE process, DWORD_PTR mask);
+    // This process's environment with each name=value added (or replaced)
+    static std::wstring BuildEnvironment(
+        const std::vector<std::pair<std::wstring, std::wstring>>& variables);
+    static void WaitWithMonitors(HANDLE process,
+        const std::vector<ProcessMonitor*>& monitors);
+};
@@ -0,0 +1,103 @@
+// profiles.cpp
+#include "pch.h"
+#include "profiles.h"
+#include "utilities.h"
+#include <algorithm>
+#include <cwctype>
+#include <format>
+
+using Utilities::ConvertToNarrowString;
+
+const std::wstring PROFILE_FILE_NAME = L"capl_profiles.ini";
+
+std::wstring ProfileStore::GetDefaultPath() {
+	// Keep the database next to the launcher so every working directory
+	// sees the same profiles
+	WCHAR modulePath[MAX_PATH];
+	DWORD length = GetModuleFileNameW(NULL, modulePath, MAX_PATH);
+	if (length == 0 || length == MAX_PATH) {
+		return PROFILE_FILE_NAME;
+	}
+
+	std::wstring directory(modulePath, length);
+	size_t separator = directory.find_last_of(L"\\/");
+	if (separator == std::wstring::npos) {
+		return PROFILE_FILE_NAME;
+	}
+	return directory.substr(0, separator + 1) + PROFILE_FILE_NAME;
+}
+
+std::optional<ProfileStore::Profile> ProfileStore::Load(
+	const std::wstring& databasePath,
+	const std::wstring& executablePath) {
+
+	std::wstring section = GetSectionName(executablePath);
+	WCHAR value[256] = L"";
+
+	// GetPrivateProfileString needs a full path or it looks in %WINDIR%
+	WCHAR fullPath[MAX_PATH];
+	if (!GetFullPathNameW(databasePath.c_str(), MAX_PATH, fullPath, NULL)) {
+		return std::nullopt;
+	}
+
+	GetPrivateProfileStringW(section.c_str(), L"Mask", L"", value,
+		static_cast<DWORD>(std::size(value)), fullPath);
+	if (value[0] == L'\0') {
+		return std::nullopt;
+	}
+
+	Profile profile;
+	try {
+		profile.mask = static_cast<DWORD_PTR>(std::stoull(value, nullptr, 16));
+	} catch (...) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Ignoring malformed profile mask for {}", executablePath);
+		return std::nullopt;
+	}
+
+	GetPrivateProfileStringW(section.c_str(), L"Label", L"", value,
+		static_cast<DWORD>(std::size(value)), fullPath);
+	profile.label = value;
+
+	GetPrivateProfileStringW(section.c_str(), L"WallSeconds", L"0", value,
+		static_cast<DWORD>(std::size(value)), fullPath);
+	profile.wallSeconds = _wtof(value);
+
+	return profile;
+}
+
+void ProfileStore::Save(
+	const std::wstring& databasePath,
+	const std::wstring& executablePath,
+	const Profile& profile) {
+
+	std::wstring section = GetSectionName(executablePath);
+	WCHAR fullPath[MAX_PATH];
+	if (!GetFullPathNameW(databasePath.c_str(), MAX_PATH, fullPath, NULL)) {
+		throw std::runtime_error("Invalid profile database path: " +
+			ConvertToNarrowString(databasePath));
+	}
+
+	std::wstring mask = std::format(L"0x{:X}", profile.mask);
+	std::wstring wallSeconds = std::format(L"{:.6f}", profile.wallSeconds);
+	if (!WritePrivateProfileStringW(section.c_str(), L"Mask",
+			mask.c_str(), fullPath) ||
+		!WritePrivateProfileStringW(section.c_str(), L"Label",
+			profile.label.c_str(), fullPath) ||
+		!WritePrivateProfileStringW(section.c_str(), L"WallSeconds",
+			wallSeconds.c_str(), fullPath)) {
+		throw std::runtime_error("Cannot write profile database: " +
+			ConvertToNarrowString(fullPath));
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO, "Saved profile {} for {}",
+		mask, executablePath);
+}
+
+std::wstring ProfileStore::GetSectionName(const std::wstring& executablePath) {
+	// Paths are case-insensitive on Windows
+	std::wstring section = executablePath;
+	std::transform(section.begin(), section.end(), section.begin(),
+		[](wchar_t c) { return static_cast<wchar_t>(std::towlower(c)); });
+	return section;
+}
@@ -0,0 +1,27 @@
+// profiles.h
+#pragma once
+#include <windows.h>
+#include <optional>
+#include <string>
+
+// Per-executable affinity profiles saved by --tune (INI file)
+class ProfileStore {
+public:
+    struct Profile {
+        DWORD_PTR mask = 0;
+        std::wstring label;       // Candidate that won, e.g. "p-nosmt"
+        double wallSeconds = 0.0; // Median wall time of the winner
+    };
+
+    static std::wstring GetDefaultPath();
+    static std::optional<Profile> Load(
+        const std::wstring& databasePath,
+        const std::wstring& executablePath);
+    static void Save(
+        const std::wstring& databasePath,
+        const std::wstring& executablePath,
+        const Profile& profile);
+
+private:
+    static std::wstring GetSectionName(const std::wstring& executablePath);
+};
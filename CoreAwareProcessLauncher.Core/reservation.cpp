@@ -0,0 +1,361 @@
+// reservation.cpp
+#include "pch.h"
+#include "reservation.h"
+#include "cpu.h"
+#include "utilities.h"
+#include <format>
+#include <random>
+
+using Utilities::ConvertToNarrowString;
+
+const wchar_t TABLE_NAME[] = L"Local\\CoreAwareProcessLauncher.Reservations";
+const LONG TABLE_MAGIC = 0x4C504143;  // "CAPL"
+const int MAX_ATTEMPTS = 100;
+const LONG64 FLAG_EXCLUSIVE = 1;
+
+// Every field is only read and written with interlocked operations. A slot
+// belongs to whoever moved its ticket away from zero; the other fields are
+// valid once committed equals that ticket.
+struct CoreReservation::Slot {
+	volatile LONG64 ticket;          // (sequence << 32) | launcher pid
+	volatile LONG64 committed;
+	volatile LONG64 launcherCreated; // FILETIME of the launcher
+	volatile LONG64 mask;
+	volatile LONG64 flags;
+	volatile LONG64 childPid;
+	volatile LONG64 childCreated;
+	LONG64 reserved;
+};
+
+struct CoreReservation::Table {
+	volatile LONG magic;
+	volatile LONG sequence;
+	LONG64 reserved[7];
+	Slot slots[SLOT_COUNT];
+};
+
+class CoreReservation::Mapping {
+public:
+	Mapping(HANDLE handle, Table* table) : m_handle(handle), m_table(table) {}
+	~Mapping() {
+		UnmapViewOfFile(m_table);
+		CloseHandle(m_handle);
+	}
+	Table& Get() { return *m_table; }
+	HANDLE GetHandle() const { return m_handle; }
+
+private:
+	HANDLE m_handle;
+	Table* m_table;
+};
+
+static LONG64 ReadField(volatile LONG64& field) {
+	return InterlockedCompareExchange64(&field, 0, 0);
+}
+
+CoreReservation::CoreReservation(std::shared_ptr<Mapping> mapping, LONG slot,
+	LONG64 ticket, DWORD_PTR mask)
+	: m_mapping(std::move(mapping)), m_slot(slot), m_ticket(ticket),
+	m_mask(mask) {}
+
+CoreReservation::~CoreReservation() {
+	Release();
+}
+
+std::unique_ptr<CoreReservation> CoreReservation::FromOptions(
+	DWORD_PTR coreMask, const CommandLineOptions& options) {
+	return Acquire(coreMask, options.freeCoreCount, options.exclusive);
+}
+
+std::unique_ptr<CoreReservation> CoreReservation::Acquire(
+	DWORD_PTR candidates, int count, bool exclusive) {
+
+	bool mustBeFree = exclusive || count > 0;
+	auto mapping = OpenTable();
+	if (!mapping) {
+		if (mustBeFree) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"The core reservation table is not available"));
+		}
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Core reservation table not available; launch not registered");
+		return nullptr;
+	}
+	Table& table = mapping->Get();
+
+	// Reclaim dead holders first so their slots can be reused
+	DWORD holderPid = 0;
+	CollectTaken(table, -1, 0, holderPid);
+
+	DWORD pid = GetCurrentProcessId();
+	LONG64 ticket = (static_cast<LONG64>(
+		static_cast<ULONG>(InterlockedIncrement(&table.sequence))) << 32) | pid;
+	LONG index = -1;
+	for (LONG i = 0; i < SLOT_COUNT && index < 0; i++) {
+		if (InterlockedCompareExchange64(&table.slots[i].ticket, ticket, 0) == 0) {
+			index = i;
+		}
+	}
+	if (index < 0) {
+		throw std::runtime_error(ConvertToNarrowString(std::format(
+			L"All {} core reservation slots are in use", SLOT_COUNT)));
+	}
+
+	Slot& slot = table.slots[index];
+	InterlockedExchange64(&slot.mask, 0);
+	InterlockedExchange64(&slot.flags, mustBeFree ? FLAG_EXCLUSIVE : 0);
+	InterlockedExchange64(&slot.childPid, 0);
+	InterlockedExchange64(&slot.childCreated, 0);
+	InterlockedExchange64(&slot.launcherCreated,
+		GetCreationTime(GetCurrentProcess()));
+	InterlockedExchange64(&slot.committed, ticket);
+
+	std::unique_ptr<CoreReservation> reservation(
+		new CoreReservation(mapping, index, ticket, 0));
+	auto physicalCores = CpuInfo::GetPhysicalCoreMasks();
+	std::mt19937 random(pid ^ static_cast<ULONG>(GetTickCount64()));
+
+	for (int attempt = 0; attempt < MAX_ATTEMPTS; attempt++) {
+		// Plain launches only need to know about exclusive holders
+		DWORD_PTR taken = CollectTaken(table, index,
+			mustBeFree ? 0 : FLAG_EXCLUSIVE, holderPid);
+
+		DWORD_PTR wanted = candidates;
+		if (count > 0) {
+			wanted = PickFreeCores(candidates, taken, count, physicalCores);
+			if (CpuInfo::CountBits(wanted) < count) {
+				throw std::runtime_error(ConvertToNarrowString(std::format(
+					L"Only {} of the requested {} cores in 0x{:X} are free",
+					CpuInfo::CountBits(candidates & ~taken), count,
+					candidates)));
+			}
+		} else if (exclusive && (wanted & taken) != 0) {
+			throw std::runtime_error(ConvertToNarrowString(std::format(
+				L"Cores 0x{:X} are reserved by the launch in process {}",
+				wanted & taken, holderPid)));
+		} else if (!mustBeFree) {
+			// Plain launches run on what the exclusive holders left
+			wanted = candidates & ~taken;
+			if (wanted == 0) {
+				throw std::runtime_error(ConvertToNarrowString(std::format(
+					L"Every selected core (0x{:X}) is reserved exclusively "
+					L"by the launch in process {}", candidates, holderPid)));
+			}
+		}
+
+		InterlockedExchange64(&slot.mask, static_cast<LONG64>(wanted));
+		reservation->m_mask = wanted;
+
+		// An exclusive launch publishing at the same time re-reads the
+		// table after this and backs off
+		if (!mustBeFree) {
+			if ((candidates & taken) != 0) {
+				g_logger->Log(ApplicationLogger::Level::INFO,
+					"Left out cores 0x{:X} reserved exclusively by process {}",
+					candidates & taken, holderPid);
+			}
+			return reservation;
+		}
+
+		// A launch that published at the same time is visible now; if it
+		// overlaps, both step back and retry after a random delay
+		if ((CollectTaken(table, index, 0, holderPid) & wanted) == 0) {
+			g_logger->Log(ApplicationLogger::Level::INFO,
+				"Reserved cores 0x{:X} (slot {})", wanted, index);
+			return reservation;
+		}
+		InterlockedExchange64(&slot.mask, 0);
+		reservation->m_mask = 0;
+		Sleep(std::uniform_int_distribution<DWORD>(1, 2 + attempt)(random));
+	}
+
+	throw std::runtime_error(ConvertToNarrowString(
+		L"Could not reserve cores: too many launches competing for them"));
+}
+
+std::vector<CoreReservation::Holder> CoreReservation::ListHolders() {
+	std::vector<Holder> holders;
+	auto mapping = OpenTable();
+	if (!mapping) {
+		return holders;
+	}
+
+	Table& table = mapping->Get();
+	DWORD holderPid = 0;
+	CollectTaken(table, -1, 0, holderPid);
+	for (Slot& slot : table.slots) {
+		LONG64 ticket = ReadField(slot.ticket);
+		if (ticket == 0 || ReadField(slot.committed) != ticket) {
+			continue;
+		}
+		Holder holder;
+		holder.launcherPid = static_cast<DWORD>(ticket);
+		holder.childPid = static_cast<DWORD>(ReadField(slot.childPid));
+		holder.mask = static_cast<DWORD_PTR>(ReadField(slot.mask));
+		holder.exclusive = (ReadField(slot.flags) & FLAG_EXCLUSIVE) != 0;
+		if (holder.mask != 0) {
+			holders.push_back(holder);
+		}
+	}
+	return holders;
+}
+
+DWORD_PTR CoreReservation::PickFreeCores(DWORD_PTR candidates,
+	DWORD_PTR taken, int count, const std::vector<DWORD_PTR>& physicalCores) {
+
+	DWORD_PTR available = candidates & ~taken;
+	DWORD_PTR picked = 0;
+	// Physical cores nobody else runs on
+	for (DWORD_PTR core : physicalCores) {
+		if (CpuInfo::CountBits(picked) >= count) {
+			break;
+		}
+		DWORD_PTR threads = core & available;
+		if (threads != 0 && (core & taken) == 0) {
+			picked |= threads & (~threads + 1);
+		}
+	}
+	// Then any free thread, siblings of the cores above included
+	DWORD_PTR rest = available & ~picked;
+	while (rest != 0 && CpuInfo::CountBits(picked) < count) {
+		picked |= rest & (~rest + 1);
+		rest &= rest - 1;
+	}
+	return picked;
+}
+
+DWORD_PTR CoreReservation::GetMask() const {
+	return m_mask;
+}
+
+void CoreReservation::Release() {
+	if (!m_mapping) {
+		return;
+	}
+	Slot& slot = m_mapping->Get().slots[m_slot];
+	InterlockedExchange64(&slot.mask, 0);
+	InterlockedCompareExchange64(&slot.ticket, 0, m_ticket);
+	m_mapping.reset();
+}
+
+DWORD CoreReservation::GetIntervalMs() const {
+	return INFINITE;
+}
+
+void CoreReservation::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+	if (!m_mapping) {
+		return;
+	}
+	Slot& slot = m_mapping->Get().slots[m_slot];
+	InterlockedExchange64(&slot.childCreated, GetCreationTime(process));
+	InterlockedExchange64(&slot.childPid, processId);
+
+	// The child keeps the cores even if this launcher is killed. The table
+	// is a named section that goes away with its last handle, so the child
+	// gets one of its own; Windows closes it when the child exits
+	HANDLE childHandle = NULL;
+	if (!DuplicateHandle(GetCurrentProcess(), m_mapping->GetHandle(), process,
+		&childHandle, 0, FALSE, DUPLICATE_SAME_ACCESS)) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Could not hand the reservation table to process {}: error {}; "
+			"the cores are released if this launcher exits first", processId,
+			GetLastError());
+	}
+}
+
+void CoreReservation::OnTick(HANDLE process) {}
+
+std::shared_ptr<CoreReservation::Mapping> CoreReservation::OpenTable() {
+	// Pagefile-backed sections start zeroed, which is a valid empty table
+	HANDLE handle = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+		PAGE_READWRITE, 0, sizeof(Table), TABLE_NAME);
+	if (!handle) {
+		return nullptr;
+	}
+	auto table = static_cast<Table*>(MapViewOfFile(handle,
+		FILE_MAP_ALL_ACCESS, 0, 0, sizeof(Table)));
+	if (!table) {
+		CloseHandle(handle);
+		return nullptr;
+	}
+	auto mapping = std::make_shared<Mapping>(handle, table);
+
+	LONG magic = InterlockedCompareExchange(&table->magic, TABLE_MAGIC, 0);
+	if (magic != 0 && magic != TABLE_MAGIC) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"The core reservation table belongs to an incompatible version"));
+	}
+	return mapping;
+}
+
+bool CoreReservation::IsAlive(DWORD pid, LONG64 creationTime) {
+	if (pid == 0) {
+		return false;
+	}
+	HANDLE process = OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid);
+	if (!process) {
+		// Another user's elevated process: assume it is still there
+		return GetLastError() == ERROR_ACCESS_DENIED;
+	}
+	DWORD exitCode = 0;
+	bool alive = GetExitCodeProcess(process, &exitCode) &&
+		exitCode == STILL_ACTIVE;
+	// A different creation time means the pid was reused
+	if (alive && creationTime != 0) {
+		alive = GetCreationTime(process) == creationTime;
+	}
+	CloseHandle(process);
+	return alive;
+}
+
+LONG64 CoreReservation::GetCreationTime(HANDLE process) {
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(process, &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	return static_cast<LONG64>(
+		(static_cast<ULONGLONG>(creation.dwHighDateTime) << 32) |
+		creation.dwLowDateTime);
+}
+
+bool CoreReservation::IsSlotLive(Slot& slot, LONG64 ticket) {
+	DWORD launcherPid = static_cast<DWORD>(ticket);
+	if (ReadField(slot.committed) != ticket) {
+		// Still being filled in: only the pid is known yet
+		return IsAlive(launcherPid, 0);
+	}
+	if (IsAlive(launcherPid, ReadField(slot.launcherCreated))) {
+		return true;
+	}
+	DWORD childPid = static_cast<DWORD>(ReadField(slot.childPid));
+	return childPid != 0 && IsAlive(childPid, ReadField(slot.childCreated));
+}
+
+DWORD_PTR CoreReservation::CollectTaken(Table& table, LONG skip,
+	LONG64 requiredFlags, DWORD& holderPid) {
+
+	DWORD_PTR taken = 0;
+	for (LONG i = 0; i < SLOT_COUNT; i++) {
+		Slot& slot = table.slots[i];
+		LONG64 ticket = ReadField(slot.ticket);
+		if (i == skip || ticket == 0) {
+			continue;
+		}
+		if (!IsSlotLive(slot, ticket)) {
+			// Only frees the slot if nobody reclaimed it in the meantime
+			InterlockedCompareExchange64(&slot.ticket, 0, ticket);
+			continue;
+		}
+		if (ReadField(slot.committed) != ticket ||
+			(requiredFlags && !(ReadField(slot.flags) & requiredFlags))) {
+			continue;
+		}
+		DWORD_PTR mask = static_cast<DWORD_PTR>(ReadField(slot.mask));
+		if (mask != 0) {
+			taken |= mask;
+			holderPid = static_cast<DWORD>(ticket);
+		}
+	}
+	return taken;
+}
@@ -0,0 +1,76 @@
+// reservation.h
+#pragma once
+#include <windows.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "process.h"
+
+// Cores held by every live CAPL launch in this session, kept in a named
+// shared-memory table so separate invocations can stay off each other's
+// cores (--exclusive, --mode <class>:free:<n>)
+//
+// Every slot is claimed and released with interlocked operations only:
+// a launch publishes its mask and then re-reads the other slots, so of two
+// racing launches at least one sees the other and backs off. Slots whose
+// launcher and child are both gone are reclaimed by the next launch.
+class CoreReservation : public ProcessMonitor {
+public:
+    static const LONG SLOT_COUNT = 512;
+
+    struct Holder {
+        DWORD launcherPid;
+        DWORD childPid;      // 0 until the child has started
+        DWORD_PTR mask;
+        bool exclusive;
+    };
+
+    ~CoreReservation();
+
+    // Registers the launch. With exclusive or count > 0 the cores must not
+    // be held by another launch; count picks that many free cores out of
+    // candidates, otherwise the whole mask is taken. A plain launch takes
+    // the candidates no exclusive launch holds and fails if none are left
+    static std::unique_ptr<CoreReservation> Acquire(DWORD_PTR candidates,
+        int count, bool exclusive);
+    static std::unique_ptr<CoreReservation> FromOptions(DWORD_PTR coreMask,
+        const CommandLineOptions& options);
+    // Live holders, after reclaiming the slots of dead ones
+    static std::vector<Holder> ListHolders();
+
+    // Free cores for a launch of count threads: whole idle physical cores
+    // first so the new job shares no SMT core, then single free threads
+    static DWORD_PTR PickFreeCores(DWORD_PTR candidates, DWORD_PTR taken,
+        int count, const std::vector<DWORD_PTR>& physicalCores);
+
+    DWORD_PTR GetMask() const;
+    void Release();
+
+    DWORD GetIntervalMs() const override;
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+
+private:
+    struct Slot;
+    struct Table;
+    class Mapping;
+
+    CoreReservation(std::shared_ptr<Mapping> mapping, LONG slot,
+        LONG64 ticket, DWORD_PTR mask);
+
+    static std::shared_ptr<Mapping> OpenTable();
+    static bool IsAlive(DWORD pid, LONG64 creationTime);
+    static LONG64 GetCreationTime(HANDLE process);
+    static bool IsSlotLive(Slot& slot, LONG64 ticket);
+    // Clears dead holders and returns the cores of the live ones (other than
+    // slot skip) whose flags include requiredFlags
+    static DWORD_PTR CollectTaken(Table& table, LONG skip,
+        LONG64 requiredFlags, DWORD& holderPid);
+
+    std::shared_ptr<Mapping> m_mapping;
+    LONG m_slot;
+    LONG64 m_ticket;
+    DWORD_PTR m_mask;
+};
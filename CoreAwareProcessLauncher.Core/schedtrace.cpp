@@ -0,0 +1,505 @@
+// schedtrace.cpp
+#include "pch.h"
+#include "schedtrace.h"
+#include "cpu.h"
+#include "utilities.h"
+#include <evntcons.h>
+#include <tlhelp32.h>
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+#include <unordered_map>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+// Classic provider of the kernel thread events (CSwitch, ReadyThread,
+// thread start and end)
+const GUID THREAD_EVENTS = { 0x3d6fa8d1, 0xfe05, 0x11d0,
+	{ 0x9d, 0xda, 0x00, 0xc0, 0x4f, 0xd7, 0xba, 0x7c } };
+const GUID SESSION_GUID = { 0x6a3b0c52, 0x41d7, 0x4e8f,
+	{ 0xb2, 0x19, 0x5c, 0x7e, 0x0a, 0x93, 0xd4, 0x61 } };
+
+const UCHAR OPCODE_THREAD_START = 1;
+const UCHAR OPCODE_THREAD_END = 2;
+const UCHAR OPCODE_THREAD_RUNDOWN = 3;
+const UCHAR OPCODE_CSWITCH = 36;
+const UCHAR OPCODE_READY_THREAD = 50;
+
+const char TRACE_MAGIC[8] = { 'C', 'A', 'P', 'L', 'S', 'C', 'H', 'D' };
+
+// Owned by the recorder that runs the session; a session that exists while
+// nobody owns this is stale
+const wchar_t OWNER_MUTEX[] = L"Global\\CAPL Scheduling Trace";
+
+uint32_t ReadUInt32(const BYTE* data, size_t offset) {
+	uint32_t value;
+	memcpy(&value, data + offset, sizeof(value));
+	return value;
+}
+
+} // namespace
+
+SchedTrace SchedTrace::Read(const std::wstring& path) {
+	std::ifstream in(path, std::ios::in | std::ios::binary);
+	if (!in.is_open()) {
+		throw std::runtime_error("Cannot read scheduling trace: " +
+			ConvertToNarrowString(path));
+	}
+
+	SchedTrace trace;
+	in.read(reinterpret_cast<char*>(&trace.header), sizeof(trace.header));
+	if (!in || memcmp(trace.header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC)) != 0 ||
+		trace.header.version != VERSION || trace.header.frequency <= 0) {
+		throw std::runtime_error(ConvertToNarrowString(path) +
+			" is not a --sched-trace file");
+	}
+	trace.records.resize(trace.header.recordCount);
+	in.read(reinterpret_cast<char*>(trace.records.data()),
+		trace.records.size() * sizeof(SchedRecord));
+	if (!in) {
+		throw std::runtime_error("Scheduling trace is truncated: " +
+			ConvertToNarrowString(path));
+	}
+	return trace;
+}
+
+void SchedTrace::Write(const std::wstring& path) const {
+	std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!out.is_open()) {
+		throw std::runtime_error("Cannot write scheduling trace: " +
+			ConvertToNarrowString(path));
+	}
+	SchedTraceHeader written = header;
+	written.recordCount = static_cast<uint32_t>(records.size());
+	out.write(reinterpret_cast<const char*>(&written), sizeof(written));
+	out.write(reinterpret_cast<const char*>(records.data()),
+		records.size() * sizeof(SchedRecord));
+	out.close();
+	if (out.fail()) {
+		throw std::runtime_error("Cannot write scheduling trace: " +
+			ConvertToNarrowString(path));
+	}
+}
+
+SchedTraceRecorder::SchedTraceRecorder() {
+	m_owner = CreateMutexW(NULL, FALSE, OWNER_MUTEX);
+	if (!m_owner && GetLastError() == ERROR_ACCESS_DENIED) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"--sched-trace needs administrator rights (kernel context "
+			L"switch events)"));
+	}
+	if (!m_owner) {
+		throw std::runtime_error(std::format(
+			"Cannot create the scheduling trace lock: error {}",
+			GetLastError()));
+	}
+	DWORD wait = WaitForSingleObject(m_owner, 0);
+	if (wait != WAIT_OBJECT_0 && wait != WAIT_ABANDONED) {
+		CloseHandle(m_owner);
+		m_owner = NULL;
+		throw std::runtime_error(ConvertToNarrowString(
+			L"Another launcher is recording a --sched-trace; only one can "
+			L"run at a time"));
+	}
+	// Nobody owned the name, so a session under it was left behind by a
+	// launcher that was killed and still holds kernel buffers
+	if (StopNamedSession() == ERROR_SUCCESS) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Stopped a stale scheduling trace session");
+	}
+
+	m_sessionName = SESSION_NAME;
+	m_properties.assign(sizeof(EVENT_TRACE_PROPERTIES) +
+		(m_sessionName.size() + 1) * sizeof(wchar_t), 0);
+	auto properties = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(
+		m_properties.data());
+	properties->Wnode.BufferSize = static_cast<ULONG>(m_properties.size());
+	properties->Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+	properties->Wnode.ClientContext = 1;  // QueryPerformanceCounter time
+	properties->Wnode.Guid = SESSION_GUID;
+	properties->LogFileMode = EVENT_TRACE_REAL_TIME_MODE |
+		EVENT_TRACE_SYSTEM_LOGGER_MODE;
+	properties->EnableFlags = EVENT_TRACE_FLAG_CSWITCH |
+		EVENT_TRACE_FLAG_DISPATCHER | EVENT_TRACE_FLAG_THREAD;
+	properties->BufferSize = 256;  // KB; context switches come in bursts
+	properties->MinimumBuffers = 32;
+	properties->MaximumBuffers = 128;
+	properties->FlushTimer = 1;
+	properties->LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+
+	ULONG status = StartTraceW(&m_session, m_sessionName.c_str(), properties);
+	if (status != ERROR_SUCCESS) {
+		ReleaseOwnership();
+	}
+	if (status == ERROR_ACCESS_DENIED) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"--sched-trace needs administrator rights (kernel context "
+			L"switch events)"));
+	}
+	if (status != ERROR_SUCCESS) {
+		throw std::runtime_error(std::format(
+			"Cannot start the scheduling trace session: error {}", status));
+	}
+	// Ctrl+C and closing the console end CAPL without unwinding; the
+	// kernel session would outlive it
+	SetConsoleCtrlHandler(&SchedTraceRecorder::OnConsoleControl, TRUE);
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Scheduling trace session started");
+}
+
+SchedTraceRecorder::~SchedTraceRecorder() {
+	StopSession();
+	ReleaseOwnership();
+}
+
+void SchedTraceRecorder::ReleaseOwnership() {
+	if (m_owner) {
+		ReleaseMutex(m_owner);
+		CloseHandle(m_owner);
+		m_owner = NULL;
+	}
+}
+
+ULONG SchedTraceRecorder::StopNamedSession() {
+	struct {
+		EVENT_TRACE_PROPERTIES properties;
+		wchar_t name[64];
+	} buffer = {};
+	buffer.properties.Wnode.BufferSize = sizeof(buffer);
+	buffer.properties.LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+	return ControlTraceW(0, SESSION_NAME, &buffer.properties,
+		EVENT_TRACE_CONTROL_STOP);
+}
+
+BOOL WINAPI SchedTraceRecorder::OnConsoleControl(DWORD controlType) {
+	StopNamedSession();
+	return FALSE;  // The default handler still ends the process
+}
+
+DWORD SchedTraceRecorder::GetIntervalMs() const {
+	return INFINITE;  // Events arrive on the consumer thread
+}
+
+void SchedTraceRecorder::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+	m_trace = {};
+	memcpy(m_trace.header.magic, TRACE_MAGIC, sizeof(TRACE_MAGIC));
+	m_trace.header.version = SchedTrace::VERSION;
+	m_trace.header.processId = processId;
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	m_trace.header.frequency = frequency.QuadPart;
+	m_trace.header.launchMask = affinityMask;
+	auto masks = CpuInfo::GetCoreTypeMasks();
+	m_trace.header.pCoreMask = masks.pCoreMask;
+	m_trace.header.eCoreMask = masks.eCoreMask;
+	m_trace.header.lpECoreMask = masks.lpECoreMask;
+
+	// The suspended main thread started before the consumer
+	m_threads.clear();
+	HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+	if (snapshot != INVALID_HANDLE_VALUE) {
+		THREADENTRY32 entry = { sizeof(entry) };
+		for (BOOL more = Thread32First(snapshot, &entry); more;
+			more = Thread32Next(snapshot, &entry)) {
+			if (entry.th32OwnerProcessID == processId) {
+				m_threads.insert(entry.th32ThreadID);
+			}
+		}
+		CloseHandle(snapshot);
+	}
+
+	EVENT_TRACE_LOGFILEW logFile = {};
+	logFile.LoggerName = m_sessionName.data();
+	logFile.ProcessTraceMode = PROCESS_TRACE_MODE_REAL_TIME |
+		PROCESS_TRACE_MODE_EVENT_RECORD | PROCESS_TRACE_MODE_RAW_TIMESTAMP;
+	logFile.EventRecordCallback = &SchedTraceRecorder::OnEvent;
+	logFile.Context = this;
+	m_consumer = OpenTraceW(&logFile);
+	if (m_consumer == INVALID_PROCESSTRACE_HANDLE) {
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Cannot open the scheduling trace session: error {}",
+			GetLastError());
+		return;
+	}
+	m_consumerThread = std::thread([this]() {
+		ProcessTrace(&m_consumer, 1, NULL, NULL);
+	});
+}
+
+void SchedTraceRecorder::OnTick(HANDLE process) {
+}
+
+void SchedTraceRecorder::OnExit(HANDLE process) {
+	StopSession();
+
+	// Events come from per-processor buffers; order them by time, keeping
+	// a switch-out ahead of the switch-in of the same event
+	std::stable_sort(m_trace.records.begin(), m_trace.records.end(),
+		[](const SchedRecord& a, const SchedRecord& b) {
+			return a.time < b.time;
+		});
+	m_trace.header.recordCount = static_cast<uint32_t>(m_trace.records.size());
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Scheduling trace: {} records, {} events lost",
+		m_trace.records.size(), m_trace.header.lostEvents);
+}
+
+const SchedTrace& SchedTraceRecorder::GetTrace() const {
+	return m_trace;
+}
+
+void SchedTraceRecorder::StopSession() {
+	if (m_session != 0) {
+		SetConsoleCtrlHandler(&SchedTraceRecorder::OnConsoleControl, FALSE);
+		auto properties = reinterpret_cast<EVENT_TRACE_PROPERTIES*>(
+			m_properties.data());
+		if (ControlTraceW(m_session, NULL, properties,
+			EVENT_TRACE_CONTROL_STOP) == ERROR_SUCCESS) {
+			m_trace.header.lostEvents = properties->EventsLost +
+				properties->RealTimeBuffersLost;
+		}
+		m_session = 0;
+	}
+	// ProcessTrace returns once the stopped session is drained
+	if (m_consumerThread.joinable()) {
+		m_consumerThread.join();
+	}
+	if (m_consumer != INVALID_PROCESSTRACE_HANDLE) {
+		CloseTrace(m_consumer);
+		m_consumer = INVALID_PROCESSTRACE_HANDLE;
+	}
+}
+
+void WINAPI SchedTraceRecorder::OnEvent(PEVENT_RECORD event) {
+	static_cast<SchedTraceRecorder*>(event->UserContext)->HandleEvent(event);
+}
+
+void SchedTraceRecorder::HandleEvent(PEVENT_RECORD event) {
+	if (!IsEqualGUID(event->EventHeader.ProviderId, THREAD_EVENTS) ||
+		event->UserDataLength < 8) {
+		return;
+	}
+	auto data = static_cast<const BYTE*>(event->UserData);
+	SchedRecord record = {};
+	record.time = event->EventHeader.TimeStamp.QuadPart;
+	record.processor = event->BufferContext.ProcessorIndex;
+
+	switch (event->EventHeader.EventDescriptor.Opcode) {
+	case OPCODE_CSWITCH: {
+		// NewThreadId, OldThreadId, ...
+		DWORD newThread = ReadUInt32(data, 0);
+		DWORD oldThread = ReadUInt32(data, 4);
+		if (m_threads.count(oldThread)) {
+			record.threadId = oldThread;
+			record.type = SchedRecord::SWITCH_OUT;
+			m_trace.records.push_back(record);
+		}
+		if (m_threads.count(newThread)) {
+			record.threadId = newThread;
+			record.type = SchedRecord::SWITCH_IN;
+			m_trace.records.push_back(record);
+		}
+		break;
+	}
+	case OPCODE_READY_THREAD:
+		record.threadId = ReadUInt32(data, 0);
+		if (m_threads.count(record.threadId)) {
+			record.type = SchedRecord::READY;
+			m_trace.records.push_back(record);
+		}
+		break;
+	case OPCODE_THREAD_START:
+	case OPCODE_THREAD_RUNDOWN:
+		// ProcessId, TThreadId, ...
+		if (ReadUInt32(data, 0) == m_trace.header.processId) {
+			record.threadId = ReadUInt32(data, 4);
+			m_threads.insert(record.threadId);
+			record.type = SchedRecord::THREAD_START;
+			m_trace.records.push_back(record);
+		}
+		break;
+	case OPCODE_THREAD_END:
+		record.threadId = ReadUInt32(data, 4);
+		if (m_threads.erase(record.threadId)) {
+			record.type = SchedRecord::THREAD_END;
+			m_trace.records.push_back(record);
+		}
+		break;
+	}
+}
+
+SchedAnalysis SchedTraceAnalyzer::Analyze(const SchedTrace& trace) {
+	const auto& header = trace.header;
+	SchedAnalysis analysis;
+	analysis.processId = header.processId;
+	analysis.launchMask = static_cast<DWORD_PTR>(header.launchMask);
+	analysis.isHybrid = header.pCoreMask != 0;
+	analysis.lostEvents = header.lostEvents;
+	if (trace.records.empty()) {
+		return analysis;
+	}
+	double secondsPerTick = 1.0 / header.frequency;
+	analysis.seconds = (trace.records.back().time -
+		trace.records.front().time) * secondsPerTick;
+
+	struct ThreadState {
+		size_t index;
+		bool running = false;
+		int processor = -1;
+		int lastProcessor = -1;
+		int64_t runStart = 0;
+		bool ready = false;
+		int64_t readyTime = 0;
+	};
+	std::unordered_map<uint32_t, ThreadState> states;
+	auto stateOf = [&](uint32_t threadId) -> ThreadState& {
+		auto found = states.find(threadId);
+		if (found == states.end()) {
+			found = states.emplace(threadId,
+				ThreadState{ analysis.threads.size() }).first;
+			analysis.threads.push_back({});
+			analysis.threads.back().threadId = threadId;
+		}
+		return found->second;
+	};
+	auto classOf = [&](int processor) {
+		uint64_t bit = processor < 64 ? uint64_t(1) << processor : 0;
+		return (header.pCoreMask & bit) ? 0 : (header.eCoreMask & bit) ? 1
+			: (header.lpECoreMask & bit) ? 2 : 3;
+	};
+	auto endRun = [&](ThreadState& state, int64_t time) {
+		auto& stats = analysis.threads[state.index];
+		double seconds = (time - state.runStart) * secondsPerTick;
+		stats.runSeconds += seconds;
+		stats.processorSeconds[state.processor] += seconds;
+		stats.classSeconds[classOf(state.processor)] += seconds;
+		if (state.processor >= 64 ||
+			!(header.launchMask & (uint64_t(1) << state.processor))) {
+			stats.outsideMaskSeconds += seconds;
+		}
+		state.running = false;
+	};
+
+	for (const auto& record : trace.records) {
+		ThreadState& state = stateOf(record.threadId);
+		auto& stats = analysis.threads[state.index];
+		switch (record.type) {
+		case SchedRecord::SWITCH_IN:
+			if (state.running) {
+				endRun(state, record.time);  // The switch-out was lost
+			}
+			stats.switches++;
+			if (state.lastProcessor >= 0 &&
+				state.lastProcessor != record.processor) {
+				stats.migrations++;
+			}
+			if (state.ready) {
+				stats.waitSeconds += (record.time - state.readyTime) *
+					secondsPerTick;
+				stats.waits++;
+				state.ready = false;
+			}
+			state.running = true;
+			state.runStart = record.time;
+			state.processor = state.lastProcessor = record.processor;
+			break;
+		case SchedRecord::SWITCH_OUT:
+		case SchedRecord::THREAD_END:
+			if (state.running) {
+				endRun(state, record.time);
+			}
+			break;
+		case SchedRecord::READY:
+			if (!state.running) {
+				state.ready = true;
+				state.readyTime = record.time;
+			}
+			break;
+		}
+	}
+	for (auto& [threadId, state] : states) {
+		if (state.running) {
+			endRun(state, trace.records.back().time);
+		}
+	}
+
+	auto& total = analysis.total;
+	for (const auto& stats : analysis.threads) {
+		total.runSeconds += stats.runSeconds;
+		total.waitSeconds += stats.waitSeconds;
+		total.switches += stats.switches;
+		total.migrations += stats.migrations;
+		total.waits += stats.waits;
+		total.outsideMaskSeconds += stats.outsideMaskSeconds;
+		for (int i = 0; i < 4; i++) {
+			total.classSeconds[i] += stats.classSeconds[i];
+		}
+		for (const auto& [processor, seconds] : stats.processorSeconds) {
+			total.processorSeconds[processor] += seconds;
+		}
+	}
+	return analysis;
+}
+
+std::wstring SchedTraceAnalyzer::FormatReport(const SchedAnalysis& analysis) {
+	auto share = [](double part, double whole) {
+		return whole > 0.0 ? part / whole * 100.0 : 0.0;
+	};
+	auto classes = [&](const ThreadSchedStats& stats) {
+		return std::format(L"{:.0f}/{:.0f}/{:.0f}",
+			share(stats.classSeconds[0], stats.runSeconds),
+			share(stats.classSeconds[1], stats.runSeconds),
+			share(stats.classSeconds[2], stats.runSeconds));
+	};
+	const auto& total = analysis.total;
+
+	std::wstringstream ss;
+	ss << L"\nScheduling Trace Analysis:\n";
+	ss << std::format(L"  Process:            {}, {:.3f}s traced, {} thread(s)\n",
+		analysis.processId, analysis.seconds, analysis.threads.size());
+	ss << std::format(L"  Launch mask:        0x{:X}\n", analysis.launchMask);
+	ss << std::format(L"  On-CPU time:        {:.3f}s, {:.1f}% outside the "
+		L"launch mask\n", total.runSeconds,
+		share(total.outsideMaskSeconds, total.runSeconds));
+	ss << std::format(L"  Context switches:   {}, {} migration(s)\n",
+		total.switches, total.migrations);
+	ss << std::format(L"  Run-queue wait:     {:.2f} ms total, {:.1f} us mean\n",
+		total.waitSeconds * 1e3,
+		total.waits > 0 ? total.waitSeconds * 1e6 / total.waits : 0.0);
+	if (analysis.isHybrid) {
+		ss << std::format(L"  Core classes:       P {:.1f}%, E {:.1f}%, "
+			L"LP E {:.1f}%\n", share(total.classSeconds[0], total.runSeconds),
+			share(total.classSeconds[1], total.runSeconds),
+			share(total.classSeconds[2], total.runSeconds));
+	}
+	if (analysis.lostEvents > 0) {
+		ss << std::format(L"  Warning:            {} event(s) lost; figures "
+			L"are incomplete\n", analysis.lostEvents);
+	}
+
+	ss << L"\n  Processor residency (share of on-CPU time):\n";
+	for (const auto& [processor, seconds] : total.processorSeconds) {
+		bool inMask = processor < 64 &&
+			(analysis.launchMask & (DWORD_PTR(1) << processor));
+		ss << std::format(L"    {:>3}{}: {:>8.1f} ms {:>5.1f}%\n", processor,
+			inMask ? L" " : L"!", seconds * 1e3,
+			share(seconds, total.runSeconds));
+	}
+	ss << L"    (! = outside the launch mask)\n";
+
+	ss << std::format(L"\n  {:>8} {:>10} {:>9} {:>10} {:>10} {:>12} {:>8}\n",
+		L"Thread", L"Run (ms)", L"Switches", L"Migrations", L"Wait (ms)",
+		analysis.isHybrid ? L"P/E/LP (%)" : L"", L"Outside");
+	for (const auto& stats : analysis.threads) {
+		ss << std::format(L"  {:>8} {:>10.1f} {:>9} {:>10} {:>10.2f} {:>12} "
+			L"{:>7.1f}%\n", stats.threadId, stats.runSeconds * 1e3,
+			stats.switches, stats.migrations, stats.waitSeconds * 1e3,
+			analysis.isHybrid ? classes(stats) : L"",
+			share(stats.outsideMaskSeconds, stats.runSeconds));
+	}
+	return ss.str();
+}
@@ -0,0 +1,124 @@
+// schedtrace.h
+#pragma once
+#include <windows.h>
+#include <evntrace.h>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include "options.h"
+#include "process.h"
+
+// --sched-trace file: a header followed by fixed-size records. Times are
+// QueryPerformanceCounter ticks; processors are group 0 processor numbers
+struct SchedTraceHeader {
+    char magic[8];           // "CAPLSCHD"
+    uint32_t version;
+    uint32_t recordCount;
+    uint32_t processId;
+    uint32_t lostEvents;     // Dropped by ETW; the trace has gaps if not 0
+    int64_t frequency;       // Ticks per second
+    uint64_t launchMask;
+    uint64_t pCoreMask;      // Core classes of the machine that recorded
+    uint64_t eCoreMask;
+    uint64_t lpECoreMask;
+};
+
+struct SchedRecord {
+    enum Type : uint8_t {
+        SWITCH_IN,           // The thread started running on processor
+        SWITCH_OUT,          // The thread left processor
+        READY,               // The thread became ready to run
+        THREAD_START,
+        THREAD_END
+    };
+    int64_t time;
+    uint32_t threadId;
+    uint16_t processor;
+    uint8_t type;
+    uint8_t reserved;
+};
+
+struct SchedTrace {
+    SchedTraceHeader header = {};
+    std::vector<SchedRecord> records;
+
+    static constexpr uint32_t VERSION = 1;
+    static SchedTrace Read(const std::wstring& path);
+    void Write(const std::wstring& path) const;
+};
+
+// Records the context switches, ready events and thread starts of the
+// launched program (--sched-trace) from a real-time ETW session with the
+// kernel CSwitch, dispatcher and thread events. Needs administrator rights
+class SchedTraceRecorder : public ProcessMonitor {
+public:
+    // One recording runs at a time under this name. A session left behind
+    // by a launcher that was killed is stopped before a new one starts;
+    // one that another running launcher owns makes the constructor throw
+    static constexpr const wchar_t* SESSION_NAME = L"CAPL Scheduling Trace";
+
+    SchedTraceRecorder();
+    ~SchedTraceRecorder();
+
+    DWORD GetIntervalMs() const override;
+    // Starts the session while the program is still suspended
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+    void OnExit(HANDLE process) override;
+
+    const SchedTrace& GetTrace() const;
+
+private:
+    static void WINAPI OnEvent(PEVENT_RECORD event);
+    void HandleEvent(PEVENT_RECORD event);
+    void StopSession();
+    void ReleaseOwnership();
+    // Stops whatever session runs under SESSION_NAME; also used on Ctrl+C
+    static ULONG StopNamedSession();
+    static BOOL WINAPI OnConsoleControl(DWORD controlType);
+
+    HANDLE m_owner = NULL;           // Held while this recorder runs
+    std::wstring m_sessionName;
+    std::vector<BYTE> m_properties;  // EVENT_TRACE_PROPERTIES and the name
+    TRACEHANDLE m_session = 0;
+    TRACEHANDLE m_consumer = INVALID_PROCESSTRACE_HANDLE;
+    std::thread m_consumerThread;
+    // Only touched by the consumer thread once it runs
+    std::unordered_set<DWORD> m_threads;
+    SchedTrace m_trace;
+};
+
+struct ThreadSchedStats {
+    DWORD threadId = 0;
+    double runSeconds = 0.0;
+    double waitSeconds = 0.0;        // Ready, but not yet running
+    int switches = 0;
+    int migrations = 0;              // Resumed on another processor
+    int waits = 0;
+    std::map<int, double> processorSeconds;
+    double classSeconds[4] = {};     // P, E, LP, other (non-hybrid)
+    double outsideMaskSeconds = 0.0;
+};
+
+struct SchedAnalysis {
+    DWORD processId = 0;
+    DWORD_PTR launchMask = 0;
+    bool isHybrid = false;
+    double seconds = 0.0;
+    uint32_t lostEvents = 0;
+    std::vector<ThreadSchedStats> threads;  // In order of first appearance
+    ThreadSchedStats total;
+};
+
+// caplcli analyze <file>: residency per processor and core class,
+// migrations and run-queue waits per thread
+class SchedTraceAnalyzer {
+public:
+    static SchedAnalysis Analyze(const SchedTrace& trace);
+    static std::wstring FormatReport(const SchedAnalysis& analysis);
+};
@@ -0,0 +1,99 @@
+// scheduling.cpp
+#include "pch.h"
+#include "scheduling.h"
+#include "latency.h"
+#include "utilities.h"
+
+SchedulingSettings SchedulingResolver::Resolve(
+	const CommandLineOptions& options) {
+
+	if (options.latencyCritical) {
+		SchedulingSettings settings = LatencyProfile::GetSchedulingSettings();
+		settings.ioPriority = options.ioPriority;
+		settings.publishTopology = options.shareTopology;
+		settings.exportTopology = options.exportTopology;
+		return settings;
+	}
+
+	SchedulingSettings settings;
+	settings.priorityClass = options.priorityClass;
+	settings.ioPriority = options.ioPriority;
+	settings.ecoQos = options.ecoQos;
+	settings.softAffinity = options.softAffinity;
+	settings.publishTopology = options.shareTopology;
+	settings.exportTopology = options.exportTopology;
+
+	// Windows has no utilization clamps; the hybrid scheduler steers by
+	// QoS instead, so a low ceiling becomes EcoQoS (prefer E-cores) and a
+	// high floor becomes HighQoS (prefer P-cores). Neither locks the child
+	if (options.uclampMax >= 0 && options.uclampMax < UCLAMP_E_CORE_CAPACITY) {
+		settings.ecoQos = true;
+	}
+	if (options.uclampMin >= UCLAMP_E_CORE_CAPACITY) {
+		settings.highQos = true;
+	}
+
+	if (options.niceSet) {
+		settings.priorityClass = NiceToPriorityClass(options.niceValue);
+	}
+
+	switch (options.schedPolicy) {
+	case CommandLineOptions::SchedPolicy::OTHER:
+		settings.priorityClass = NORMAL_PRIORITY_CLASS;
+		break;
+
+	case CommandLineOptions::SchedPolicy::BATCH:
+		settings.priorityClass = BELOW_NORMAL_PRIORITY_CLASS;
+		break;
+
+	case CommandLineOptions::SchedPolicy::IDLE:
+		settings.priorityClass = IDLE_PRIORITY_CLASS;
+		break;
+
+	// Windows round-robins threads of equal priority, so FIFO and RR
+	// both become a realtime-class primary thread
+	case CommandLineOptions::SchedPolicy::FIFO:
+	case CommandLineOptions::SchedPolicy::RR:
+		settings.priorityClass = REALTIME_PRIORITY_CLASS;
+		settings.setThreadPriority = true;
+		settings.threadPriority =
+			RealtimeToThreadPriority(options.schedPriority);
+		break;
+
+	default:
+		break;
+	}
+
+	return settings;
+}
+
+DWORD SchedulingResolver::NiceToPriorityClass(int nice) {
+	if (nice <= -15) {
+		return HIGH_PRIORITY_CLASS;
+	} else if (nice <= -5) {
+		return ABOVE_NORMAL_PRIORITY_CLASS;
+	} else if (nice < 5) {
+		return NORMAL_PRIORITY_CLASS;
+	} else if (nice < 15) {
+		return BELOW_NORMAL_PRIORITY_CLASS;
+	}
+	return IDLE_PRIORITY_CLASS;
+}
+
+int SchedulingResolver::RealtimeToThreadPriority(int priority) {
+	// Realtime-class threads accept -7..6 (levels 16..31 without the
+	// idle and time-critical saturation values)
+	return -7 + (priority - 1) * 13 / 98;
+}
+
+std::wstring SchedulingResolver::GetPriorityClassName(DWORD priorityClass) {
+	switch (priorityClass) {
+	case IDLE_PRIORITY_CLASS:         return L"idle";
+	case BELOW_NORMAL_PRIORITY_CLASS: return L"below-normal";
+	case NORMAL_PRIORITY_CLASS:       return L"normal";
+	case ABOVE_NORMAL_PRIORITY_CLASS: return L"above-normal";
+	case HIGH_PRIORITY_CLASS:         return L"high";
+	case REALTIME_PRIORITY_CLASS:     return L"realtime";
+	default:                          return L"inherited";
+	}
+}
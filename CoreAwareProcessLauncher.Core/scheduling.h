@@ -0,0 +1,23 @@
+// scheduling.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include "options.h"
+#include "process.h"
+
+// Turns --sched, --nice, --priority, --ioprio, --ecoqos, --uclamp-min/max
+// and --soft into the settings LaunchProcess applies before the child runs
+class SchedulingResolver {
+public:
+    // Utilization clamps use the Linux scale, where 1024 is a fully busy
+    // big core; below this a task fits on an E-core
+    static constexpr int UCLAMP_E_CORE_CAPACITY = 512;
+
+    static SchedulingSettings Resolve(const CommandLineOptions& options);
+    // Maps a Unix nice value (-20..19) onto the closest priority class
+    static DWORD NiceToPriorityClass(int nice);
+    // Maps a SCHED_FIFO/SCHED_RR priority (1..99) onto a realtime-class
+    // thread priority (-7..6)
+    static int RealtimeToThreadPriority(int priority);
+    static std::wstring GetPriorityClassName(DWORD priorityClass);
+};
@@ -0,0 +1,237 @@
+// sweep.cpp
+#include "pch.h"
+#include "sweep.h"
+#include "affinity.h"
+#include "benchmark.h"
+#include "cpu.h"
+#include "process.h"
+#include "scheduling.h"
+#include "utilities.h"
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <sstream>
+
+using Utilities::ConvertToNarrowString;
+
+std::vector<ScalabilitySweep::StepResult> ScalabilitySweep::Run(
+	const CommandLineOptions& options) {
+
+	auto classes = AffinityTuner::DetectCoreClasses();
+	std::vector<std::pair<std::wstring, DWORD_PTR>> sweepClasses;
+	if (classes.pCores != 0) {
+		sweepClasses.push_back({ L"P", classes.pCores });
+		sweepClasses.push_back({ L"E", classes.eCores });
+		sweepClasses.push_back({ L"LP", classes.lpECores });
+	} else {
+		sweepClasses.push_back({ L"all", classes.allCores });
+	}
+
+	int runsPerStep = options.repeatCount > 0 ? options.repeatCount : 1;
+	SchedulingSettings scheduling = SchedulingResolver::Resolve(options);
+	bool cacheWarningShown = false;
+	auto launch = [&options, &scheduling, &cacheWarningShown](DWORD_PTR mask) {
+		// Every run of every step starts cold, as with --repeat
+		if (options.dropCache && !Benchmark::DropFileCache() &&
+			!cacheWarningShown) {
+			cacheWarningShown = true;
+			g_logger->Log(ApplicationLogger::Level::WARNING,
+				"Could not purge the file cache; run as administrator");
+			if (g_messageHandler) {
+				g_messageHandler->ShowInfo(
+					L"Warning: could not purge the file cache "
+					L"(requires administrator rights)");
+			}
+		}
+
+		ProcessStats stats;
+		if (!ProcessManager::LaunchProcess(
+			options.targetPath,
+			options.targetArgs,
+			options.targetWorkingDir,
+			mask,
+			&stats,
+			{},
+			scheduling)) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"Failed to launch process"));
+		}
+		return stats.wallSeconds;
+	};
+
+	std::vector<StepResult> results;
+	for (const auto& [className, classMask] : sweepClasses) {
+		if (classMask == 0) {
+			continue;
+		}
+
+		std::vector<StepResult> classSteps;
+		for (DWORD_PTR mask : BuildSteps(classMask, classes.physicalCores,
+			classes.l2Domains)) {
+			for (int i = 0; i < options.warmupCount; i++) {
+				launch(mask);
+			}
+
+			std::vector<double> samples;
+			for (int i = 0; i < runsPerStep; i++) {
+				samples.push_back(launch(mask));
+			}
+
+			StepResult step;
+			step.className = className;
+			step.threads = CpuInfo::CountBits(mask);
+			step.mask = mask;
+			step.wallSeconds = Benchmark::ComputeStatistics(samples).median;
+			classSteps.push_back(step);
+
+			g_logger->Log(ApplicationLogger::Level::INFO,
+				"Sweep {} x{} (0x{:X}): {:.6f}s", className, step.threads,
+				mask, step.wallSeconds);
+		}
+
+		ComputeScaling(classSteps);
+		results.insert(results.end(), classSteps.begin(), classSteps.end());
+	}
+
+	return results;
+}
+
+// Orders the cores of a class so every step adds the one that shares the
+// least with the cores already chosen: a new physical core in the least
+// occupied L2 domain first, SMT siblings only once every core is in use
+std::vector<DWORD_PTR> ScalabilitySweep::BuildSteps(
+	DWORD_PTR classMask,
+	const std::vector<DWORD_PTR>& physicalCores,
+	const std::vector<DWORD_PTR>& cacheDomains) {
+
+	std::vector<DWORD_PTR> cores;
+	for (DWORD_PTR core : physicalCores) {
+		if (core & classMask) {
+			cores.push_back(core & classMask);
+		}
+	}
+
+	auto domainOf = [&cacheDomains](DWORD_PTR core) -> int {
+		for (size_t i = 0; i < cacheDomains.size(); i++) {
+			if (cacheDomains[i] & core) {
+				return static_cast<int>(i);
+			}
+		}
+		return -1;
+	};
+
+	std::vector<int> domainLoad(cacheDomains.size(), 0);
+	std::vector<DWORD_PTR> primaryOrder;
+	std::vector<bool> used(cores.size(), false);
+	for (size_t picked = 0; picked < cores.size(); picked++) {
+		size_t best = cores.size();
+		int bestLoad = 0;
+		for (size_t i = 0; i < cores.size(); i++) {
+			if (used[i]) {
+				continue;
+			}
+			int domain = domainOf(cores[i]);
+			int load = domain >= 0 ? domainLoad[domain] : 0;
+			if (best == cores.size() || load < bestLoad) {
+				best = i;
+				bestLoad = load;
+			}
+		}
+		used[best] = true;
+		primaryOrder.push_back(cores[best]);
+		int domain = domainOf(cores[best]);
+		if (domain >= 0) {
+			domainLoad[domain]++;
+		}
+	}
+
+	std::vector<DWORD_PTR> steps;
+	DWORD_PTR mask = 0;
+	// First pass: one thread per physical core
+	for (DWORD_PTR core : primaryOrder) {
+		mask |= core & (~core + 1);
+		steps.push_back(mask);
+	}
+	// Second pass: the remaining SMT siblings in the same order
+	for (DWORD_PTR core : primaryOrder) {
+		DWORD_PTR siblings = core & ~(core & (~core + 1));
+		while (siblings) {
+			mask |= siblings & (~siblings + 1);
+			siblings &= siblings - 1;
+			steps.push_back(mask);
+		}
+	}
+
+	return steps;
+}
+
+void ScalabilitySweep::ComputeScaling(std::vector<StepResult>& classSteps) {
+	if (classSteps.empty()) {
+		return;
+	}
+	double baseline = classSteps.front().wallSeconds *
+		classSteps.front().threads;
+	for (auto& step : classSteps) {
+		if (step.wallSeconds <= 0.0) {
+			continue;
+		}
+		step.throughput = 1.0 / step.wallSeconds;
+		step.speedup = baseline / step.wallSeconds;
+		step.efficiency = step.speedup / step.threads;
+	}
+}
+
+std::wstring ScalabilitySweep::FormatReport(
+	const std::vector<StepResult>& steps) {
+
+	std::wstringstream ss;
+	ss << L"\nScalability Sweep Results:\n";
+	ss << std::format(L"  {:<6} {:>7} {:>18} {:>12} {:>12} {:>9} {:>10}\n",
+		L"class", L"threads", L"mask", L"wall (s)", L"runs/s", L"speedup",
+		L"efficiency");
+	for (const auto& step : steps) {
+		ss << std::format(
+			L"  {:<6} {:>7} {:>18} {:>12.4f} {:>12.4f} {:>9.2f} {:>9.1f}%\n",
+			step.className, step.threads, std::format(L"0x{:X}", step.mask),
+			step.wallSeconds, step.throughput, step.speedup,
+			step.efficiency * 100.0);
+	}
+	return ss.str();
+}
+
+void ScalabilitySweep::WriteResults(
+	const std::wstring& path,
+	const std::vector<StepResult>& steps) {
+
+	std::ofstream out(path, std::ios::out | std::ios::trunc);
+	if (!out.is_open()) {
+		throw std::runtime_error("Cannot write results file: " +
+			ConvertToNarrowString(path));
+	}
+
+	if (path.ends_with(L".json")) {
+		out << "{\n  \"steps\": [\n";
+		for (size_t i = 0; i < steps.size(); i++) {
+			const auto& step = steps[i];
+			out << std::format("    {{\"class\": \"{}\", \"threads\": {}, "
+				"\"mask\": \"0x{:X}\", \"wallSeconds\": {:.6f}, "
+				"\"throughput\": {:.6f}, \"speedup\": {:.4f}, "
+				"\"efficiency\": {:.4f}}}{}\n",
+				ConvertToNarrowString(step.className), step.threads, step.mask,
+				step.wallSeconds, step.throughput, step.speedup,
+				step.efficiency, i + 1 < steps.size() ? "," : "");
+		}
+		out << "  ]\n}\n";
+	} else {
+		out << "class,threads,mask,wall_seconds,throughput,speedup,efficiency\n";
+		for (const auto& step : steps) {
+			out << std::format("{},{},0x{:X},{:.6f},{:.6f},{:.4f},{:.4f}\n",
+				ConvertToNarrowString(step.className), step.threads, step.mask,
+				step.wallSeconds, step.throughput, step.speedup,
+				step.efficiency);
+		}
+	}
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Sweep results written to {}", path);
+}
@@ -0,0 +1,32 @@
+// sweep.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "options.h"
+#include "tuner.h"
+
+// Measures how a program scales on growing subsets of each core class
+class ScalabilitySweep {
+public:
+    struct StepResult {
+        std::wstring className;
+        int threads = 0;
+        DWORD_PTR mask = 0;
+        double wallSeconds = 0.0;  // Median over the runs of this step
+        double throughput = 0.0;   // Runs per second
+        double speedup = 0.0;      // Relative to one thread of the class
+        double efficiency = 0.0;   // Speedup per thread
+    };
+
+    static std::vector<StepResult> Run(const CommandLineOptions& options);
+    static std::vector<DWORD_PTR> BuildSteps(
+        DWORD_PTR classMask,
+        const std::vector<DWORD_PTR>& physicalCores,
+        const std::vector<DWORD_PTR>& cacheDomains);
+    static void ComputeScaling(std::vector<StepResult>& classSteps);
+    static std::wstring FormatReport(const std::vector<StepResult>& steps);
+    static void WriteResults(
+        const std::wstring& path,
+        const std::vector<StepResult>& steps);
+};
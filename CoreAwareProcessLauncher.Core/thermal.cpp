@@ -0,0 +1,264 @@
+// thermal.cpp
+#include "pch.h"
+#include "thermal.h"
+#include "cpu.h"
+#include "utilities.h"
+#include <algorithm>
+#include <format>
+#include <sstream>
+
+#pragma comment(lib, "pdh.lib")
+
+using Utilities::ConvertToNarrowString;
+
+const double KELVIN_OFFSET = 273.15;
+
+ThermalSensors::ThermalSensors(std::unique_ptr<EnergyMeter> meter)
+	: m_meter(std::move(meter)) {
+	// Thermal zone counters are readable without elevation
+	if (PdhOpenQueryW(NULL, 0, &m_query) == ERROR_SUCCESS) {
+		if (PdhAddEnglishCounterW(m_query,
+			L"\\Thermal Zone Information(*)\\Temperature", 0,
+			&m_temperatureCounter) != ERROR_SUCCESS) {
+			m_temperatureCounter = NULL;
+			g_logger->Log(ApplicationLogger::Level::WARNING,
+				"Thermal zone counters are not available");
+		}
+		PdhCollectQueryData(m_query);
+	} else {
+		m_query = NULL;
+	}
+
+	if (m_meter) {
+		m_lastEnergy = m_meter->Read();
+		m_lastEnergyTick = GetTickCount64();
+	}
+}
+
+ThermalSensors::~ThermalSensors() {
+	if (m_query) {
+		PdhCloseQuery(m_query);
+	}
+}
+
+ThermalSample ThermalSensors::Sample(DWORD_PTR pCoreMask) {
+	ThermalSample sample;
+	sample.hasTemperature = ReadTemperature(sample.maxZoneCelsius);
+	sample.hasPower = ReadPower(sample.packageWatts);
+	sample.hasFrequency = ReadFrequencyLimit(pCoreMask, sample.pCoreLimitRatio);
+	return sample;
+}
+
+bool ThermalSensors::ReadTemperature(double& celsius) {
+	if (!m_query || !m_temperatureCounter ||
+		PdhCollectQueryData(m_query) != ERROR_SUCCESS) {
+		return false;
+	}
+
+	DWORD bufferSize = static_cast<DWORD>(m_temperatureBuffer.size());
+	DWORD itemCount = 0;
+	auto items = reinterpret_cast<PPDH_FMT_COUNTERVALUE_ITEM_W>(
+		m_temperatureBuffer.data());
+	PDH_STATUS status = PdhGetFormattedCounterArrayW(m_temperatureCounter,
+		PDH_FMT_DOUBLE, &bufferSize, &itemCount, items);
+	if (status == PDH_MORE_DATA) {
+		m_temperatureBuffer.resize(bufferSize);
+		items = reinterpret_cast<PPDH_FMT_COUNTERVALUE_ITEM_W>(
+			m_temperatureBuffer.data());
+		status = PdhGetFormattedCounterArrayW(m_temperatureCounter,
+			PDH_FMT_DOUBLE, &bufferSize, &itemCount, items);
+	}
+	if (status != ERROR_SUCCESS || itemCount == 0) {
+		return false;
+	}
+
+	double hottest = 0.0;
+	for (DWORD i = 0; i < itemCount; i++) {
+		hottest = (std::max)(hottest, items[i].FmtValue.doubleValue);
+	}
+	celsius = hottest - KELVIN_OFFSET;
+	return true;
+}
+
+bool ThermalSensors::ReadPower(double& watts) {
+	if (!m_meter) {
+		return false;
+	}
+
+	auto energy = m_meter->Read();
+	ULONGLONG tick = GetTickCount64();
+	double seconds = (tick - m_lastEnergyTick) / 1000.0;
+	bool valid = seconds > 0.0;
+	if (valid) {
+		watts = EnergyProfiler::BuildReport(m_lastEnergy, energy, seconds)
+			.averageWatts;
+	}
+	m_lastEnergy = std::move(energy);
+	m_lastEnergyTick = tick;
+	return valid;
+}
+
+bool ThermalSensors::ReadFrequencyLimit(DWORD_PTR mask, double& ratio) {
+	double limit = 0.0, maximum = 0.0;
+	for (const auto& processor : CpuInfo::GetProcessorFrequencies()) {
+		if (mask & (1ULL << processor.number)) {
+			limit += (std::min)(processor.mhzLimit, processor.maxMhz);
+			maximum += processor.maxMhz;
+		}
+	}
+	if (maximum == 0.0) {
+		return false;
+	}
+	ratio = limit / maximum;
+	return true;
+}
+
+ThermalPolicy::ThermalPolicy(const Settings& settings, DWORD_PTR pCoreMask,
+	DWORD_PTR eCoreMask, std::unique_ptr<ThermalSensors> sensors)
+	: m_settings(settings), m_pCoreMask(pCoreMask), m_eCoreMask(eCoreMask),
+	  m_sensors(std::move(sensors)) {}
+
+std::unique_ptr<ThermalPolicy> ThermalPolicy::Create(
+	const CommandLineOptions& options) {
+
+	if (!CpuInfo::GetCapabilities().isHybrid) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"--thermal-policy requires a hybrid CPU with P-cores and E-cores"));
+	}
+
+	Settings settings;
+	settings.action =
+		options.thermalAction == CommandLineOptions::ThermalAction::SHIFT
+		? Action::SHIFT : Action::WIDEN;
+	settings.powerBudgetWatts = options.powerBudgetWatts;
+	settings.temperatureLimitCelsius = options.temperatureLimitCelsius;
+	settings.intervalMs = static_cast<DWORD>(options.pollIntervalMs);
+
+	// Package power is only needed for a budget; without one the policy
+	// still reacts to temperature and frequency limits
+	std::unique_ptr<EnergyMeter> meter;
+	if (settings.powerBudgetWatts > 0.0) {
+		meter = EmiEnergyMeter::Open();
+	}
+
+	return std::make_unique<ThermalPolicy>(settings, CpuInfo::GetPCoreMask(),
+		CpuInfo::GetECoreMask() | CpuInfo::GetLpECoreMask(),
+		std::make_unique<ThermalSensors>(std::move(meter)));
+}
+
+DWORD ThermalPolicy::GetIntervalMs() const {
+	return m_settings.intervalMs;
+}
+
+void ThermalPolicy::OnStart(HANDLE process, DWORD processId,
+	DWORD_PTR affinityMask) {
+	m_originalMask = affinityMask;
+	if ((affinityMask & m_pCoreMask) == 0) {
+		g_logger->Log(ApplicationLogger::Level::WARNING,
+			"Thermal policy inactive: the mask contains no P-cores");
+	}
+}
+
+void ThermalPolicy::OnTick(HANDLE process) {
+	if (!m_sensors || (m_originalMask & m_pCoreMask) == 0) {
+		return;
+	}
+
+	std::wstring reason;
+	if (!Evaluate(m_sensors->Sample(m_originalMask & m_pCoreMask), reason)) {
+		return;
+	}
+
+	DWORD_PTR mask = GetTargetMask();
+	if (!SetProcessAffinityMask(process, mask)) {
+		DWORD error = GetLastError();
+		// The program still runs on the old mask; retry on a later tick
+		m_degraded = !m_degraded;
+		m_healthySamples = 0;
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Thermal policy could not apply mask 0x{:X} ({}): error {}", mask,
+			reason, error);
+		return;
+	}
+
+	Transition transition;
+	GetLocalTime(&transition.time);
+	transition.degraded = m_degraded;
+	transition.mask = mask;
+	transition.reason = reason;
+	m_transitions.push_back(transition);
+
+	g_logger->Log(ApplicationLogger::Level::INFO,
+		"Thermal policy: {}, mask 0x{:X}", reason, mask);
+}
+
+bool ThermalPolicy::Evaluate(const ThermalSample& sample,
+	std::wstring& reason) {
+
+	std::wstring cause;
+	if (m_settings.powerBudgetWatts > 0.0 && sample.hasPower &&
+		sample.packageWatts > m_settings.powerBudgetWatts) {
+		cause = std::format(L"package power {:.1f} W over budget {:.1f} W",
+			sample.packageWatts, m_settings.powerBudgetWatts);
+	} else if (m_settings.temperatureLimitCelsius > 0.0 &&
+		sample.hasTemperature &&
+		sample.maxZoneCelsius >= m_settings.temperatureLimitCelsius) {
+		cause = std::format(L"thermal zone at {:.1f} C", sample.maxZoneCelsius);
+	} else if (sample.hasFrequency &&
+		sample.pCoreLimitRatio < m_settings.throttleRatio) {
+		cause = std::format(L"P-cores limited to {:.0f}% of max frequency",
+			sample.pCoreLimitRatio * 100.0);
+	}
+
+	if (!cause.empty()) {
+		m_healthySamples = 0;
+		if (!m_degraded) {
+			m_degraded = true;
+			reason = cause;
+			return true;
+		}
+		return false;
+	}
+
+	if (m_degraded && ++m_healthySamples >= m_settings.recoverySamples) {
+		m_degraded = false;
+		m_healthySamples = 0;
+		reason = L"P-cores recovered";
+		return true;
+	}
+	return false;
+}
+
+bool ThermalPolicy::IsDegraded() const {
+	return m_degraded;
+}
+
+DWORD_PTR ThermalPolicy::GetTargetMask() const {
+	if (!m_degraded) {
+		return m_originalMask;
+	}
+	if (m_settings.action == Action::WIDEN) {
+		return m_originalMask | m_eCoreMask;
+	}
+	return (m_originalMask & ~m_pCoreMask) | m_eCoreMask;
+}
+
+const std::vector<ThermalPolicy::Transition>&
+ThermalPolicy::GetTransitions() const {
+	return m_transitions;
+}
+
+std::wstring ThermalPolicy::FormatTransitions() const {
+	std::wstringstream ss;
+	ss << L"\nThermal Policy Transitions:\n";
+	if (m_transitions.empty()) {
+		ss << L"  none\n";
+	}
+	for (const auto& t : m_transitions) {
+		ss << std::format(L"  {:04}-{:02}-{:02} {:02}:{:02}:{:02}.{:03}  {:<8} "
+			L"0x{:X}  {}\n", t.time.wYear, t.time.wMonth, t.time.wDay,
+			t.time.wHour, t.time.wMinute, t.time.wSecond, t.time.wMilliseconds,
+			t.degraded ? L"degrade" : L"restore", t.mask, t.reason);
+	}
+	return ss.str();
+}
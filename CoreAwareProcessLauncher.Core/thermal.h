@@ -0,0 +1,96 @@
+// thermal.h
+#pragma once
+#include <windows.h>
+#include <pdh.h>
+#include <memory>
+#include <string>
+#include <vector>
+#include "energy.h"
+#include "options.h"
+#include "process.h"
+
+// One reading of the platform's thermal and power state
+struct ThermalSample {
+    bool hasTemperature = false;
+    double maxZoneCelsius = 0.0;     // Hottest ACPI thermal zone
+    bool hasPower = false;
+    double packageWatts = 0.0;       // Since the previous sample
+    bool hasFrequency = false;
+    double pCoreLimitRatio = 1.0;    // Firmware frequency limit / max MHz
+};
+
+// Reads thermal zones, RAPL package power and per-core frequency limits
+class ThermalSensors {
+public:
+    explicit ThermalSensors(std::unique_ptr<EnergyMeter> meter);
+    ~ThermalSensors();
+
+    ThermalSample Sample(DWORD_PTR pCoreMask);
+
+private:
+    bool ReadTemperature(double& celsius);
+    bool ReadPower(double& watts);
+    bool ReadFrequencyLimit(DWORD_PTR mask, double& ratio);
+
+    PDH_HQUERY m_query = NULL;
+    PDH_HCOUNTER m_temperatureCounter = NULL;
+    std::vector<BYTE> m_temperatureBuffer;
+    std::unique_ptr<EnergyMeter> m_meter;
+    std::vector<EnergyCounter> m_lastEnergy;
+    ULONGLONG m_lastEnergyTick = 0;
+};
+
+// Moves a P-core-pinned child onto E-cores while the P-cores are throttled,
+// too hot or over the power budget, and restores it afterwards
+class ThermalPolicy : public ProcessMonitor {
+public:
+    enum class Action {
+        WIDEN,  // Add the E-cores to the mask
+        SHIFT,  // Replace the P-cores with the E-cores
+    };
+
+    struct Settings {
+        Action action = Action::WIDEN;
+        double powerBudgetWatts = 0.0;        // 0 = no budget
+        double temperatureLimitCelsius = 0.0; // 0 = no limit
+        double throttleRatio = 0.85;          // Below this the P-cores throttle
+        DWORD intervalMs = 1000;
+        int recoverySamples = 3;              // Healthy samples before restoring
+    };
+
+    struct Transition {
+        SYSTEMTIME time;
+        bool degraded;
+        DWORD_PTR mask;
+        std::wstring reason;
+    };
+
+    ThermalPolicy(const Settings& settings, DWORD_PTR pCoreMask,
+        DWORD_PTR eCoreMask, std::unique_ptr<ThermalSensors> sensors);
+
+    // Builds the policy requested by --thermal-policy with live sensors
+    static std::unique_ptr<ThermalPolicy> Create(
+        const CommandLineOptions& options);
+
+    DWORD GetIntervalMs() const override;
+    void OnStart(HANDLE process, DWORD processId,
+        DWORD_PTR affinityMask) override;
+    void OnTick(HANDLE process) override;
+
+    // Runs one sample through the state machine; true when the state changed
+    bool Evaluate(const ThermalSample& sample, std::wstring& reason);
+    bool IsDegraded() const;
+    DWORD_PTR GetTargetMask() const;
+    const std::vector<Transition>& GetTransitions() const;
+    std::wstring FormatTransitions() const;
+
+private:
+    Settings m_settings;
+    DWORD_PTR m_pCoreMask;
+    DWORD_PTR m_eCoreMask;
+    DWORD_PTR m_originalMask = 0;
+    std::unique_ptr<ThermalSensors> m_sensors;
+    bool m_degraded = false;
+    int m_healthySamples = 0;
+    std::vector<Transition> m_transitions;
+};
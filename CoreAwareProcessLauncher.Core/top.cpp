@@ -0,0 +1,324 @@
+// top.cpp
+#include "pch.h"
+#include "top.h"
+#include "process.h"
+#include "reservation.h"
+#include "utilities.h"
+#include <winternl.h>
+#include <algorithm>
+#include <format>
+#include <iterator>
+#include <stdexcept>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+const int BAR_WIDTH = 20;
+const int MAX_LISTED_PIDS = 3;
+const ULONG THREAD_STATE_RUNNING = 2;  // KTHREAD_STATE Running
+
+const wchar_t* LoadColor(double busy) {
+	if (busy >= 0.85) {
+		return L"\x1b[31m";
+	}
+	return busy >= 0.5 ? L"\x1b[33m" : L"\x1b[32m";
+}
+
+void WriteText(HANDLE output, const std::wstring& text) {
+	DWORD written = 0;
+	WriteConsoleW(output, text.data(), static_cast<DWORD>(text.size()),
+		&written, NULL);
+}
+
+} // namespace
+
+TopView::TopView(DWORD refreshMs)
+	: m_refreshMs(refreshMs),
+	m_stopEvent(CreateEventW(NULL, TRUE, FALSE, NULL)) {
+	m_layout = BuildLayout(CpuInfo::GetCoreTypeMasks(),
+		CpuInfo::GetAllowedMask(), CpuInfo::GetCacheDomainMasks(2));
+}
+
+TopView::~TopView() {
+	CloseHandle(m_stopEvent);
+}
+
+std::vector<TopView::Group> TopView::BuildLayout(
+	const CpuInfo::CoreTypeMasks& masks, DWORD_PTR allowed,
+	const std::vector<DWORD_PTR>& l2Clusters) {
+
+	std::vector<std::pair<std::wstring, DWORD_PTR>> classes;
+	DWORD_PTR hybrid = masks.pCoreMask | masks.eCoreMask | masks.lpECoreMask;
+	if (hybrid == 0) {
+		classes.push_back({ L"Cores", allowed });
+	} else {
+		classes.push_back({ L"P-cores", masks.pCoreMask & allowed });
+		classes.push_back({ L"E-cores", masks.eCoreMask & allowed });
+		classes.push_back({ L"LP E-cores", masks.lpECoreMask & allowed });
+		classes.push_back({ L"Other", allowed & ~hybrid });
+	}
+
+	std::vector<Group> layout;
+	for (const auto& [name, classMask] : classes) {
+		if (classMask == 0) {
+			continue;
+		}
+		Group group{ name, {} };
+		DWORD_PTR covered = 0;
+		for (DWORD_PTR cluster : l2Clusters) {
+			if (cluster & classMask) {
+				group.clusters.push_back(cluster & classMask);
+				covered |= cluster & classMask;
+			}
+		}
+		// Processors whose L2 was not reported form one last row block
+		if (classMask & ~covered) {
+			group.clusters.push_back(classMask & ~covered);
+		}
+		layout.push_back(std::move(group));
+	}
+	return layout;
+}
+
+void TopView::FormatFrame(const std::vector<Group>& layout,
+	const std::vector<double>& busy,
+	const std::vector<CpuInfo::ProcessorFrequency>& frequencies,
+	const std::vector<Program>& programs, DWORD refreshMs,
+	std::wstring& out) {
+
+	auto to = std::back_inserter(out);
+	int processors = 0;
+	for (const auto& group : layout) {
+		for (DWORD_PTR cluster : group.clusters) {
+			processors += CpuInfo::CountBits(cluster);
+		}
+	}
+	std::format_to(to, L"\x1b[1mCAPL top\x1b[0m - {} processors, every {} ms "
+		L"(q to quit)\x1b[K\n\x1b[K\n", processors, refreshMs);
+
+	for (const auto& group : layout) {
+		double sum = 0.0;
+		int count = 0;
+		for (DWORD_PTR cluster : group.clusters) {
+			for (size_t i = 0; i < busy.size() && i < sizeof(DWORD_PTR) * 8; i++) {
+				if (cluster & (DWORD_PTR(1) << i)) {
+					sum += busy[i];
+					count++;
+				}
+			}
+		}
+		std::format_to(to, L"\x1b[1m{}\x1b[0m  {:5.1f}% busy\x1b[K\n", group.name,
+			count > 0 ? sum * 100.0 / count : 0.0);
+
+		for (DWORD_PTR cluster : group.clusters) {
+			bool first = true;
+			for (int i = 0; i < static_cast<int>(sizeof(DWORD_PTR) * 8); i++) {
+				if (!(cluster & (DWORD_PTR(1) << i))) {
+					continue;
+				}
+				double load = i < static_cast<int>(busy.size()) ? busy[i] : 0.0;
+				int filled = static_cast<int>(load * BAR_WIDTH + 0.5);
+				filled = (std::clamp)(filled, 0, BAR_WIDTH);
+				std::wstring label = first ? std::format(L"L2 0x{:X}", cluster) : L"";
+				first = false;
+				std::format_to(to, L"  {:<14} cpu {:>2} [{}{}\x1b[0m{}] {:5.1f}%",
+					label, i, LoadColor(load), std::wstring(filled, L'#'),
+					std::wstring(BAR_WIDTH - filled, L' '), load * 100.0);
+
+				auto frequency = std::find_if(frequencies.begin(),
+					frequencies.end(), [i](const CpuInfo::ProcessorFrequency& f) {
+						return f.number == static_cast<ULONG>(i);
+					});
+				if (frequency != frequencies.end()) {
+					std::format_to(to, L"  {:>4}/{:>4} MHz", frequency->currentMhz,
+						frequency->maxMhz);
+					if (frequency->mhzLimit < frequency->maxMhz * 0.85) {
+						std::format_to(to, L" \x1b[31mlimited\x1b[0m");
+					}
+				}
+
+				int listed = 0, more = 0;
+				for (const auto& program : programs) {
+					if (!(program.mask & (DWORD_PTR(1) << i))) {
+						continue;
+					}
+					if (listed < MAX_LISTED_PIDS) {
+						std::format_to(to, L"{}{}", listed == 0 ? L"  pid " : L",",
+							program.processId);
+						listed++;
+					} else {
+						more++;
+					}
+				}
+				if (more > 0) {
+					std::format_to(to, L" +{}", more);
+				}
+				std::format_to(to, L"\x1b[K\n");
+			}
+		}
+		std::format_to(to, L"\x1b[K\n");
+	}
+
+	if (programs.empty()) {
+		std::format_to(to, L"No programs launched by CAPL are running\x1b[K\n");
+		return;
+	}
+	std::format_to(to, L"\x1b[1m{:>7}  {:>7}  {:>7}  {:<18}  {}\x1b[0m\x1b[K\n",
+		L"PID", L"Threads", L"Running", L"Mask", L"Program");
+	for (const auto& program : programs) {
+		std::format_to(to, L"{:>7}  {:>7}  {:>7}  0x{:<16X}  {}\x1b[K\n",
+			program.processId, program.threads, program.runningThreads,
+			program.mask, program.name);
+	}
+}
+
+void TopView::Run() {
+	HANDLE output = GetStdHandle(STD_OUTPUT_HANDLE);
+	DWORD outputMode = 0;
+	if (!GetConsoleMode(output, &outputMode)) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"top needs a console window"));
+	}
+	SetConsoleMode(output, outputMode | ENABLE_VIRTUAL_TERMINAL_PROCESSING);
+
+	// Raw key events, so Ctrl+C reaches the loop and the screen is restored
+	HANDLE input = GetStdHandle(STD_INPUT_HANDLE);
+	DWORD inputMode = 0;
+	bool rawInput = GetConsoleMode(input, &inputMode) != FALSE;
+	if (rawInput) {
+		m_input = input;
+		SetConsoleMode(input, inputMode & ~(ENABLE_PROCESSED_INPUT |
+			ENABLE_LINE_INPUT | ENABLE_ECHO_INPUT));
+	}
+
+	auto restore = [&]() {
+		WriteText(output, L"\x1b[?25h\x1b[?1049l");
+		SetConsoleMode(output, outputMode);
+		if (rawInput) {
+			SetConsoleMode(input, inputMode);
+		}
+	};
+
+	// Alternate screen buffer with the cursor hidden
+	WriteText(output, L"\x1b[?1049h\x1b[?25l");
+	try {
+		CpuLoadSampler::ReadTimes(m_lastTimes, m_loadBuffer);
+		// The first frame comes quickly; later ones at the refresh rate
+		DWORD timeout = (std::min)(m_refreshMs, DWORD(200));
+		while (WaitForRefresh(timeout)) {
+			Refresh();
+			Draw(output);
+			timeout = m_refreshMs;
+		}
+	} catch (...) {
+		restore();
+		throw;
+	}
+	restore();
+}
+
+void TopView::Stop() {
+	SetEvent(m_stopEvent);
+}
+
+bool TopView::WaitForRefresh(DWORD timeoutMs) {
+	ULONGLONG deadline = GetTickCount64() + timeoutMs;
+	while (true) {
+		ULONGLONG now = GetTickCount64();
+		if (now >= deadline) {
+			return true;
+		}
+		HANDLE handles[] = { m_stopEvent, m_input };
+		DWORD result = WaitForMultipleObjects(m_input ? 2 : 1, handles, FALSE,
+			static_cast<DWORD>(deadline - now));
+		if (result == WAIT_OBJECT_0) {
+			return false;
+		}
+		if (result != WAIT_OBJECT_0 + 1) {
+			return true;
+		}
+
+		INPUT_RECORD records[16];
+		DWORD read = 0;
+		if (!ReadConsoleInputW(m_input, records, 16, &read)) {
+			m_input = NULL;  // Stop waiting on input that cannot be read
+			continue;
+		}
+		for (DWORD i = 0; i < read; i++) {
+			if (records[i].EventType != KEY_EVENT ||
+				!records[i].Event.KeyEvent.bKeyDown) {
+				continue;
+			}
+			WCHAR key = records[i].Event.KeyEvent.uChar.UnicodeChar;
+			if (key == L'q' || key == L'Q' || key == 0x1B || key == 0x03) {
+				return false;
+			}
+		}
+	}
+}
+
+void TopView::Refresh() {
+	CpuLoadSampler::ReadTimes(m_times, m_loadBuffer);
+	m_busy.assign(m_times.size(), 0.0);
+	for (size_t i = 0; i < m_times.size() && i < m_lastTimes.size(); i++) {
+		ULONGLONG total = m_times[i].total - m_lastTimes[i].total;
+		ULONGLONG idle = m_times[i].idle - m_lastTimes[i].idle;
+		if (total > 0) {
+			m_busy[i] = static_cast<double>(total - (std::min)(idle, total)) /
+				total;
+		}
+	}
+	m_lastTimes.swap(m_times);
+
+	CpuInfo::GetProcessorFrequencies(m_frequencies, m_frequencyBuffer);
+	ReadPrograms();
+}
+
+void TopView::ReadPrograms() {
+	m_programs.clear();
+	for (const auto& holder : CoreReservation::ListHolders()) {
+		if (holder.childPid != 0) {
+			m_programs.push_back({ holder.childPid, L"", holder.mask, 0, 0 });
+		}
+	}
+	if (m_programs.empty() || !ProcessManager::QueryProcessList(m_processBuffer)) {
+		return;
+	}
+
+	// One snapshot of every process gives the names, threads and states
+	for (size_t offset = 0;;) {
+		auto entry = reinterpret_cast<const SYSTEM_PROCESS_INFORMATION*>(
+			m_processBuffer.data() + offset);
+		DWORD processId = static_cast<DWORD>(
+			reinterpret_cast<ULONG_PTR>(entry->UniqueProcessId));
+		for (auto& program : m_programs) {
+			if (program.processId != processId) {
+				continue;
+			}
+			program.name.assign(entry->ImageName.Buffer,
+				entry->ImageName.Length / sizeof(WCHAR));
+			program.threads = entry->NumberOfThreads;
+			auto threads = reinterpret_cast<const SYSTEM_THREAD_INFORMATION*>(
+				entry + 1);
+			for (ULONG t = 0; t < entry->NumberOfThreads; t++) {
+				if (threads[t].ThreadState == THREAD_STATE_RUNNING) {
+					program.runningThreads++;
+				}
+			}
+		}
+		if (entry->NextEntryOffset == 0) {
+			break;
+		}
+		offset += entry->NextEntryOffset;
+	}
+}
+
+void TopView::Draw(HANDLE output) {
+	m_frame.clear();
+	m_frame += L"\x1b[H";
+	FormatFrame(m_layout, m_busy, m_frequencies, m_programs, m_refreshMs,
+		m_frame);
+	m_frame += L"\x1b[J";
+	WriteText(output, m_frame);
+}
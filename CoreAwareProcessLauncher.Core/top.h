@@ -0,0 +1,67 @@
+// top.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "cpu.h"
+#include "cpuload.h"
+
+// Live per-processor view (caplcli top): load, clock and the CAPL launches
+// allowed on every processor, grouped by core class and L2 cluster and
+// redrawn in place with ANSI escapes. The topology is read once; every
+// refresh reuses the buffers of the previous one
+class TopView {
+public:
+    struct Group {
+        std::wstring name;                // "P-cores", "E-cores", ...
+        std::vector<DWORD_PTR> clusters;  // L2 instances within the class
+    };
+
+    // A program started by caplcli, caplgui or the daemon
+    struct Program {
+        DWORD processId;
+        std::wstring name;
+        DWORD_PTR mask;
+        DWORD threads;
+        DWORD runningThreads;             // On a processor right now
+    };
+
+    explicit TopView(DWORD refreshMs);
+    ~TopView();
+
+    // Redraws until q, Esc or Ctrl+C is pressed or Stop() is called
+    void Run();
+    void Stop();
+
+    // Core classes in allowed (one "Cores" group on non-hybrid CPUs), each
+    // split into the clusters that share an L2 cache
+    static std::vector<Group> BuildLayout(const CpuInfo::CoreTypeMasks& masks,
+        DWORD_PTR allowed, const std::vector<DWORD_PTR>& l2Clusters);
+    // Appends one screen; every line ends by clearing the rest of the row
+    static void FormatFrame(const std::vector<Group>& layout,
+        const std::vector<double>& busy,
+        const std::vector<CpuInfo::ProcessorFrequency>& frequencies,
+        const std::vector<Program>& programs, DWORD refreshMs,
+        std::wstring& out);
+
+private:
+    bool WaitForRefresh(DWORD timeoutMs);
+    void Refresh();
+    void ReadPrograms();
+    void Draw(HANDLE output);
+
+    DWORD m_refreshMs;
+    HANDLE m_stopEvent;
+    HANDLE m_input = NULL;
+    std::vector<Group> m_layout;
+
+    std::vector<CpuLoadSampler::Times> m_lastTimes;
+    std::vector<CpuLoadSampler::Times> m_times;
+    std::vector<BYTE> m_loadBuffer;
+    std::vector<double> m_busy;
+    std::vector<CpuInfo::ProcessorFrequency> m_frequencies;
+    std::vector<BYTE> m_frequencyBuffer;
+    std::vector<BYTE> m_processBuffer;
+    std::vector<Program> m_programs;
+    std::wstring m_frame;
+};
@@ -0,0 +1,490 @@
+// topology.cpp
+#include "pch.h"
+#include "topology.h"
+#include "cpu.h"
+#include "utilities.h"
+#include "capl_topology.h"
+#include "trace.h"
+#include <format>
+#include <iterator>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+// Newer than some SDKs that still build CAPL
+const int RELATION_PROCESSOR_DIE = 5;
+const int RELATION_PROCESSOR_MODULE = 7;
+
+DWORD_PTR GroupZeroMask(const PROCESSOR_RELATIONSHIP& relation) {
+	for (WORD i = 0; i < relation.GroupCount; i++) {
+		if (relation.GroupMask[i].Group == 0) {
+			return relation.GroupMask[i].Mask;
+		}
+	}
+	return 0;
+}
+
+// Fills the relationship lists and the processors' indices into them
+void ReadRelations(TopologySnapshot& topology) {
+	PhaseTrace::Scope trace("Processor relationships");
+	DWORD length = 0;
+	GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+	if (GetLastError() != ERROR_INSUFFICIENT_BUFFER) {
+		return;
+	}
+	std::vector<BYTE> buffer(length);
+	if (!GetLogicalProcessorInformationEx(RelationAll,
+		reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+			buffer.data()), &length)) {
+		return;
+	}
+
+	using Processor = TopologySnapshot::Processor;
+	auto assign = [&topology](DWORD_PTR mask, int Processor::* field,
+		int value) {
+		for (auto& processor : topology.processors) {
+			if (mask & (DWORD_PTR(1) << processor.number)) {
+				processor.*field = value;
+			}
+		}
+	};
+	auto append = [&assign](std::vector<DWORD_PTR>& list, DWORD_PTR mask,
+		int Processor::* field) {
+		if (mask != 0) {
+			assign(mask, field, static_cast<int>(list.size()));
+			list.push_back(mask);
+		}
+	};
+
+	for (DWORD offset = 0; offset < length;) {
+		auto entry = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+			buffer.data() + offset);
+		offset += entry->Size;
+
+		switch (static_cast<int>(entry->Relationship)) {
+		case RelationProcessorCore: {
+			DWORD_PTR mask = GroupZeroMask(entry->Processor);
+			append(topology.physicalCores, mask, &Processor::core);
+			for (auto& processor : topology.processors) {
+				DWORD_PTR bit = DWORD_PTR(1) << processor.number;
+				if (mask & bit) {
+					processor.smtSiblings = mask & ~bit;
+					processor.efficiencyClass = entry->Processor.EfficiencyClass;
+				}
+			}
+			break;
+		}
+		case RELATION_PROCESSOR_MODULE:
+			append(topology.modules, GroupZeroMask(entry->Processor),
+				&Processor::module);
+			break;
+		case RELATION_PROCESSOR_DIE:
+			append(topology.dies, GroupZeroMask(entry->Processor),
+				&Processor::die);
+			break;
+		case RelationProcessorPackage:
+			append(topology.packages, GroupZeroMask(entry->Processor),
+				&Processor::package);
+			break;
+		case RelationNumaNode:
+			if (entry->NumaNode.GroupMask.Group == 0) {
+				topology.numaNodes.push_back({ entry->NumaNode.NodeNumber,
+					entry->NumaNode.GroupMask.Mask });
+				assign(entry->NumaNode.GroupMask.Mask, &Processor::numaNode,
+					static_cast<int>(entry->NumaNode.NodeNumber));
+			}
+			break;
+		case RelationCache: {
+			const CACHE_RELATIONSHIP& cache = entry->Cache;
+			if (cache.GroupMask.Group != 0) {
+				break;
+			}
+			topology.caches.push_back({ cache.Level, cache.Type,
+				cache.CacheSize, cache.LineSize, cache.Associativity,
+				cache.GroupMask.Mask });
+			// Instruction caches would duplicate the data domains
+			if (cache.Type == CacheInstruction) {
+				break;
+			}
+			if (cache.Level == 2) {
+				append(topology.l2Domains, cache.GroupMask.Mask,
+					&Processor::l2Domain);
+			} else if (cache.Level == 3) {
+				append(topology.l3Domains, cache.GroupMask.Mask,
+					&Processor::l3Domain);
+			}
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	// Windows 10 has no module relationship; the cores sharing an L2 are
+	// the module there, so the L2 domains double as the module list
+	if (topology.modules.empty()) {
+		topology.modules = topology.l2Domains;
+		for (auto& processor : topology.processors) {
+			processor.module = processor.l2Domain;
+		}
+	}
+}
+
+const char* CoreTypeName(TopologySnapshot::CoreType type) {
+	switch (type) {
+	case TopologySnapshot::CoreType::PERFORMANCE:
+		return "p";
+	case TopologySnapshot::CoreType::EFFICIENCY:
+		return "e";
+	case TopologySnapshot::CoreType::LOW_POWER:
+		return "lp";
+	default:
+		return "uniform";
+	}
+}
+
+const char* CacheTypeName(PROCESSOR_CACHE_TYPE type) {
+	switch (type) {
+	case CacheInstruction:
+		return "instruction";
+	case CacheData:
+		return "data";
+	case CacheTrace:
+		return "trace";
+	default:
+		return "unified";
+	}
+}
+
+// Processor numbers of mask as a JSON array
+std::string ProcessorList(DWORD_PTR mask) {
+	std::string list = "[";
+	for (int i = 0; i < static_cast<int>(sizeof(DWORD_PTR) * 8); i++) {
+		if (mask & (DWORD_PTR(1) << i)) {
+			list += std::format("{}{}", list.size() > 1 ? ", " : "", i);
+		}
+	}
+	return list + "]";
+}
+
+std::string MaskLists(const std::vector<DWORD_PTR>& masks) {
+	std::string lists = "[";
+	for (size_t i = 0; i < masks.size(); i++) {
+		lists += (i > 0 ? ", " : "") + ProcessorList(masks[i]);
+	}
+	return lists + "]";
+}
+
+std::string IndexOrNull(int index) {
+	return index >= 0 ? std::to_string(index) : "null";
+}
+
+} // namespace
+
+TopologySnapshot TopologySnapshot::Capture(bool includeClocks) {
+	TopologySnapshot topology;
+	// Runs the core type sweep (cached after the first call)
+	auto caps = CpuInfo::GetCapabilities();
+	topology.brandString = caps.brandString;
+	topology.logicalProcessors = caps.totalCores;
+	topology.systemMask = CpuInfo::GetSystemMask();
+	topology.allowedMask = CpuInfo::GetAllowedMask();
+	topology.pCoreMask = caps.pCoreMask;
+	topology.eCoreMask = caps.eCoreMask;
+	topology.lpECoreMask = caps.lpECoreMask;
+	topology.isHybrid = caps.isHybrid;
+
+	for (int i = 0; i < static_cast<int>(sizeof(DWORD_PTR) * 8); i++) {
+		DWORD_PTR bit = DWORD_PTR(1) << i;
+		if (!(topology.systemMask & bit)) {
+			continue;
+		}
+		Processor processor;
+		processor.number = i;
+		processor.allowed = (topology.allowedMask & bit) != 0;
+		if (topology.pCoreMask & bit) {
+			processor.coreType = CoreType::PERFORMANCE;
+		} else if (topology.eCoreMask & bit) {
+			processor.coreType = CoreType::EFFICIENCY;
+		} else if (topology.lpECoreMask & bit) {
+			processor.coreType = CoreType::LOW_POWER;
+		}
+		topology.processors.push_back(processor);
+	}
+
+	ReadRelations(topology);
+
+	if (includeClocks) {
+		for (const auto& frequency : CpuInfo::GetProcessorFrequencies()) {
+			for (auto& processor : topology.processors) {
+				if (processor.number == static_cast<int>(frequency.number)) {
+					processor.maxMhz = frequency.maxMhz;
+					processor.currentMhz = frequency.currentMhz;
+					processor.mhzLimit = frequency.mhzLimit;
+				}
+			}
+		}
+	}
+	return topology;
+}
+
+std::string TopologySnapshot::FormatJson() const {
+	std::string json;
+	auto out = std::back_inserter(json);
+	std::format_to(out, "{{\n  \"brand\": \"{}\",\n  \"logical_processors\": {},\n"
+		"  \"hybrid\": {},\n  \"system_mask\": \"0x{:X}\",\n"
+		"  \"allowed_mask\": \"0x{:X}\",\n  \"allowed\": {},\n"
+		"  \"p_cores\": {},\n  \"e_cores\": {},\n  \"lp_e_cores\": {},\n",
+		Utilities::EscapeJson(ConvertToNarrowString(brandString)),
+		logicalProcessors, isHybrid, systemMask, allowedMask,
+		ProcessorList(allowedMask), ProcessorList(pCoreMask),
+		ProcessorList(eCoreMask), ProcessorList(lpECoreMask));
+
+	std::format_to(out, "  \"processors\": [");
+	for (size_t i = 0; i < processors.size(); i++) {
+		const Processor& processor = processors[i];
+		std::format_to(out, "{}\n    {{\"number\": {}, \"core_type\": \"{}\", "
+			"\"low_power\": {}, \"allowed\": {}, \"smt_siblings\": {}, "
+			"\"core\": {}, \"module\": {}, \"die\": {}, \"package\": {}, "
+			"\"numa_node\": {}, \"l2\": {}, \"l3\": {}, "
+			"\"efficiency_class\": {}, ",
+			i > 0 ? "," : "", processor.number,
+			CoreTypeName(processor.coreType),
+			processor.coreType == CoreType::LOW_POWER, processor.allowed,
+			ProcessorList(processor.smtSiblings), IndexOrNull(processor.core),
+			IndexOrNull(processor.module), IndexOrNull(processor.die),
+			IndexOrNull(processor.package), IndexOrNull(processor.numaNode),
+			IndexOrNull(processor.l2Domain), IndexOrNull(processor.l3Domain),
+			processor.efficiencyClass);
+		if (processor.maxMhz > 0) {
+			std::format_to(out, "\"max_mhz\": {}, \"current_mhz\": {}, "
+				"\"mhz_limit\": {}}}", processor.maxMhz, processor.currentMhz,
+				processor.mhzLimit);
+		} else {
+			std::format_to(out, "\"max_mhz\": null, \"current_mhz\": null, "
+				"\"mhz_limit\": null}}");
+		}
+	}
+
+	std::format_to(out, "\n  ],\n  \"caches\": [");
+	for (size_t i = 0; i < caches.size(); i++) {
+		const Cache& cache = caches[i];
+		std::format_to(out, "{}\n    {{\"level\": {}, \"type\": \"{}\", "
+			"\"size_bytes\": {}, \"line_size\": {}, \"associativity\": {}, "
+			"\"processors\": {}}}", i > 0 ? "," : "", cache.level,
+			CacheTypeName(cache.type), cache.sizeBytes, cache.lineSize,
+			cache.associativity, ProcessorList(cache.mask));
+	}
+
+	std::format_to(out, "\n  ],\n  \"numa_nodes\": [");
+	for (size_t i = 0; i < numaNodes.size(); i++) {
+		std::format_to(out, "{}\n    {{\"node\": {}, \"processors\": {}}}",
+			i > 0 ? "," : "", numaNodes[i].number,
+			ProcessorList(numaNodes[i].mask));
+	}
+
+	std::format_to(out, "\n  ],\n  \"cores\": {},\n  \"modules\": {},\n"
+		"  \"dies\": {},\n  \"packages\": {},\n  \"l2_domains\": {},\n"
+		"  \"l3_domains\": {}\n}}\n", MaskLists(physicalCores),
+		MaskLists(modules), MaskLists(dies), MaskLists(packages),
+		MaskLists(l2Domains), MaskLists(l3Domains));
+	return json;
+}
+
+std::wstring TopologySnapshot::FormatEnvironment() const {
+	auto join = [](const std::vector<DWORD_PTR>& masks) {
+		std::wstring list;
+		for (DWORD_PTR mask : masks) {
+			list += (list.empty() ? L"" : L",") + std::format(L"{:X}", mask);
+		}
+		return list;
+	};
+	return std::format(L"p={:X};e={:X};lp={:X};core={};l2={};l3={}",
+		pCoreMask, eCoreMask, lpECoreMask, join(physicalCores),
+		join(l2Domains), join(l3Domains));
+}
+
+HANDLE TopologySnapshot::Publish(DWORD_PTR launchMask) const {
+	const std::vector<DWORD_PTR>* lists[] = {
+		&physicalCores, &l2Domains, &l3Domains };
+	size_t maskCount = 0;
+	for (const auto* list : lists) {
+		maskCount += list->size();
+	}
+	DWORD size = static_cast<DWORD>(sizeof(capl_topology_blob) +
+		maskCount * sizeof(uint64_t));
+
+	HANDLE writable = CreateFileMappingW(INVALID_HANDLE_VALUE, NULL,
+		PAGE_READWRITE, 0, size, NULL);
+	if (!writable) {
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Cannot create the topology blob: error {}", GetLastError());
+		return NULL;
+	}
+	auto blob = static_cast<capl_topology_blob*>(
+		MapViewOfFile(writable, FILE_MAP_WRITE, 0, 0, size));
+	if (!blob) {
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Cannot map the topology blob: error {}", GetLastError());
+		CloseHandle(writable);
+		return NULL;
+	}
+
+	blob->magic = CAPL_TOPOLOGY_MAGIC;
+	blob->version = CAPL_TOPOLOGY_VERSION;
+	blob->header_size = sizeof(capl_topology_blob);
+	blob->total_size = size;
+	blob->is_hybrid = isHybrid ? 1 : 0;
+	blob->launch_mask = launchMask;
+	blob->allowed_mask = allowedMask;
+	blob->p_cores = pCoreMask;
+	blob->e_cores = eCoreMask;
+	blob->lp_e_cores = lpECoreMask;
+	blob->core_count = static_cast<uint32_t>(physicalCores.size());
+	blob->l2_count = static_cast<uint32_t>(l2Domains.size());
+	blob->l3_count = static_cast<uint32_t>(l3Domains.size());
+	auto masks = reinterpret_cast<uint64_t*>(blob + 1);
+	for (const auto* list : lists) {
+		for (DWORD_PTR mask : *list) {
+			*masks++ = mask;
+		}
+	}
+	UnmapViewOfFile(blob);
+
+	// The child's copy can map the blob but never write to it. It is not
+	// inheritable; the launch lists it for its own child only
+	HANDLE readOnly = NULL;
+	if (!DuplicateHandle(GetCurrentProcess(), writable, GetCurrentProcess(),
+		&readOnly, SECTION_QUERY | SECTION_MAP_READ, FALSE, 0)) {
+		g_logger->Log(ApplicationLogger::Level::ERR,
+			"Cannot share the topology blob: error {}", GetLastError());
+		readOnly = NULL;
+	}
+	CloseHandle(writable);
+	return readOnly;
+}
+
+DWORD_PTR CpuSetSpec::Evaluate(std::string_view spec,
+	const TopologySnapshot& topology) {
+
+	std::string_view body = spec;
+	bool invert = !body.empty() && body.front() == '~';
+	if (invert) {
+		body.remove_prefix(1);
+	}
+
+	int domain = -1;
+	size_t at = body.find('@');
+	if (at != std::string_view::npos) {
+		std::string_view domainText = body.substr(at + 1);
+		if (!ParseNumber(domainText, domain) || !domainText.empty()) {
+			throw std::runtime_error(std::format(
+				"Invalid L3 domain in core specification '{}'", spec));
+		}
+		body = body.substr(0, at);
+	}
+
+	if (body.empty()) {
+		throw std::runtime_error(std::format(
+			"Empty core specification '{}'", spec));
+	}
+
+	DWORD_PTR mask = body.front() >= '0' && body.front() <= '9'
+		? EvaluateList(body) : EvaluateMode(body, topology);
+	if (invert) {
+		mask = topology.allowedMask & ~mask;
+	}
+	if (domain >= 0) {
+		if (domain >= static_cast<int>(topology.l3Domains.size())) {
+			throw std::runtime_error(std::format(
+				"L3 domain {} does not exist; this CPU has {} L3 domain(s)",
+				domain, topology.l3Domains.size()));
+		}
+		mask &= topology.l3Domains[domain];
+	}
+
+	mask &= topology.allowedMask;
+	if (mask == 0) {
+		throw std::runtime_error(std::format(
+			"Core specification '{}' selects no allowed processor", spec));
+	}
+	return mask;
+}
+
+DWORD_PTR CpuSetSpec::EvaluateMode(std::string_view mode,
+	const TopologySnapshot& topology) {
+
+	if (mode == "all") {
+		return topology.allowedMask;
+	}
+
+	DWORD_PTR mask;
+	if (mode == "p") {
+		mask = topology.pCoreMask;
+	} else if (mode == "e") {
+		mask = topology.eCoreMask;
+	} else if (mode == "lp") {
+		mask = topology.lpECoreMask;
+	} else if (mode == "alle") {
+		mask = topology.eCoreMask | topology.lpECoreMask;
+	} else {
+		throw std::runtime_error(std::format(
+			"Invalid mode '{}'. Use: p, e, lp, alle, all or a core list",
+			mode));
+	}
+
+	if (!topology.isHybrid) {
+		throw std::runtime_error(std::format(
+			"Mode '{}' needs a hybrid CPU", mode));
+	}
+	return mask;
+}
+
+DWORD_PTR CpuSetSpec::EvaluateList(std::string_view list) {
+	const int maxCore = static_cast<int>(sizeof(DWORD_PTR) * 8) - 1;
+	DWORD_PTR mask = 0;
+	std::string_view rest = list;
+	while (true) {
+		int first = 0;
+		if (!ParseNumber(rest, first)) {
+			break;
+		}
+		int last = first;
+		if (!rest.empty() && rest.front() == '-') {
+			rest.remove_prefix(1);
+			if (!ParseNumber(rest, last)) {
+				break;
+			}
+		}
+		if (first > last || last > maxCore) {
+			throw std::runtime_error(std::format(
+				"Invalid core range in '{}'; cores are 0-{}", list, maxCore));
+		}
+		for (int core = first; core <= last; core++) {
+			mask |= DWORD_PTR(1) << core;
+		}
+
+		if (rest.empty()) {
+			return mask;
+		}
+		if (rest.front() != ',') {
+			break;
+		}
+		rest.remove_prefix(1);
+	}
+	throw std::runtime_error(std::format("Invalid core list '{}'", list));
+}
+
+// Consumes the leading decimal digits of text
+bool CpuSetSpec::ParseNumber(std::string_view& text, int& value) {
+	size_t digits = 0;
+	value = 0;
+	while (digits < text.size() && text[digits] >= '0' &&
+		text[digits] <= '9' && digits < 4) {
+		value = value * 10 + (text[digits] - '0');
+		digits++;
+	}
+	text.remove_prefix(digits);
+	return digits > 0;
+}
@@ -0,0 +1,104 @@
+// topology.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Everything placement decisions need from the CPU, probed once. A snapshot
+// is never modified after Capture(), so any number of threads may read it
+struct TopologySnapshot {
+    enum class CoreType { UNIFORM, PERFORMANCE, EFFICIENCY, LOW_POWER };
+
+    // One instance of a cache, any level and type
+    struct Cache {
+        BYTE level;
+        PROCESSOR_CACHE_TYPE type;
+        DWORD sizeBytes;
+        WORD lineSize;
+        BYTE associativity;      // 0xFF = fully associative
+        DWORD_PTR mask;
+    };
+
+    struct NumaNode {
+        DWORD number;
+        DWORD_PTR mask;
+    };
+
+    // One logical processor of group 0. Indices refer to the lists below
+    // and are -1 when Windows does not report the relationship
+    struct Processor {
+        int number = 0;
+        CoreType coreType = CoreType::UNIFORM;
+        bool allowed = false;
+        DWORD_PTR smtSiblings = 0;   // Other threads of the same core
+        int core = -1;
+        int module = -1;             // The L2 cluster before Windows 11
+        int die = -1;
+        int package = -1;
+        int numaNode = -1;           // Node number
+        int l2Domain = -1;
+        int l3Domain = -1;
+        BYTE efficiencyClass = 0;    // Relative capacity, higher is faster
+        ULONG maxMhz = 0;            // Clocks only with Capture(true)
+        ULONG currentMhz = 0;
+        ULONG mhzLimit = 0;
+    };
+
+    std::wstring brandString;
+    int logicalProcessors = 0;
+    bool isHybrid = false;
+    DWORD_PTR systemMask = 0;
+    DWORD_PTR allowedMask = 0;   // See CpuInfo::GetAllowedMask
+    DWORD_PTR pCoreMask = 0;
+    DWORD_PTR eCoreMask = 0;
+    DWORD_PTR lpECoreMask = 0;
+    std::vector<DWORD_PTR> physicalCores;
+    std::vector<DWORD_PTR> l2Domains;
+    std::vector<DWORD_PTR> l3Domains;
+    std::vector<DWORD_PTR> modules;
+    std::vector<DWORD_PTR> dies;
+    std::vector<DWORD_PTR> packages;
+    std::vector<NumaNode> numaNodes;
+    std::vector<Cache> caches;
+    std::vector<Processor> processors;
+
+    // Reads every processor relationship in one pass; the clocks need an
+    // extra power query, so launches leave them out
+    static TopologySnapshot Capture(bool includeClocks = false);
+
+    // --query --format json
+    std::string FormatJson() const;
+
+    // Launched programs find the snapshot in this variable (read by
+    // capl_runtime.h) as "p=<mask>;e=...;lp=...;core=<mask>,...;l2=...;l3=..."
+    static constexpr const wchar_t* ENVIRONMENT_VARIABLE = L"CAPL_TOPOLOGY";
+    std::wstring FormatEnvironment() const;
+
+    // Writes the snapshot and the launch mask into a capl_topology.h blob
+    // and returns a handle that can only map it for reading (NULL on
+    // failure). The handle is not inheritable; the launch passes it to one
+    // child in a handle list and closes it once the child has started
+    HANDLE Publish(DWORD_PTR launchMask) const;
+};
+
+// Turns a core specification into a mask of allowed processors:
+//
+//   [~]<mode|list>[@<L3 domain>]
+//
+// where mode is p, e, lp, alle or all and list is core numbers and ranges
+// such as 0,2,4-7. A leading ~ inverts the selection within the allowed
+// set and @n keeps the part inside L3 instance n (like --llc-domain).
+// Evaluation only reads the snapshot and does not allocate unless the
+// specification is rejected
+class CpuSetSpec {
+public:
+    static DWORD_PTR Evaluate(std::string_view spec,
+        const TopologySnapshot& topology);
+
+private:
+    static DWORD_PTR EvaluateMode(std::string_view mode,
+        const TopologySnapshot& topology);
+    static DWORD_PTR EvaluateList(std::string_view list);
+    static bool ParseNumber(std::string_view& text, int& value);
+};
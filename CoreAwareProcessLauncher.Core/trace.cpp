@@ -0,0 +1,116 @@
+// trace.cpp
+#include "pch.h"
+#include "trace.h"
+#include "utilities.h"
+#include <algorithm>
+#include <array>
+#include <format>
+#include <fstream>
+#include <iostream>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+struct TraceEvent {
+	const char* name;
+	LONGLONG start;
+	LONGLONG end;
+	DWORD threadId;
+};
+
+// Slots are claimed with one atomic increment; nothing is allocated while
+// recording
+std::array<TraceEvent, PhaseTrace::MAX_EVENTS> g_events;
+std::atomic<size_t> g_eventCount{ 0 };
+
+} // namespace
+
+void PhaseTrace::Start() {
+	s_enabled.store(true, std::memory_order_relaxed);
+}
+
+void PhaseTrace::Stop() {
+	s_enabled.store(false, std::memory_order_relaxed);
+}
+
+LONGLONG PhaseTrace::Now() {
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return counter.QuadPart;
+}
+
+void PhaseTrace::Record(const char* name, LONGLONG start, LONGLONG end) {
+	size_t index = g_eventCount.fetch_add(1, std::memory_order_relaxed);
+	if (index < MAX_EVENTS) {
+		g_events[index] = { name, start, end, GetCurrentThreadId() };
+	}
+}
+
+size_t PhaseTrace::GetDroppedCount() {
+	size_t count = g_eventCount.load();
+	return count > MAX_EVENTS ? count - MAX_EVENTS : 0;
+}
+
+void PhaseTrace::Clear() {
+	g_eventCount.store(0);
+}
+
+std::string PhaseTrace::Format() {
+	size_t count = (std::min)(g_eventCount.load(), MAX_EVENTS);
+	LARGE_INTEGER frequency;
+	QueryPerformanceFrequency(&frequency);
+	double toMicroseconds = 1e6 / frequency.QuadPart;
+
+	LONGLONG origin = count > 0 ? g_events[0].start : 0;
+	for (size_t i = 1; i < count; i++) {
+		origin = (std::min)(origin, g_events[i].start);
+	}
+
+	DWORD processId = GetCurrentProcessId();
+	std::string json = "{\"traceEvents\": [\n";
+	json += std::format("  {{\"name\": \"process_name\", \"ph\": \"M\", "
+		"\"pid\": {}, \"args\": {{\"name\": \"capl\"}}}}", processId);
+	for (size_t i = 0; i < count; i++) {
+		const auto& event = g_events[i];
+		json += std::format(",\n  {{\"name\": \"{}\", \"cat\": \"capl\", "
+			"\"ph\": \"X\", \"ts\": {:.3f}, \"dur\": {:.3f}, \"pid\": {}, "
+			"\"tid\": {}}}", Utilities::EscapeJson(event.name),
+			(event.start - origin) * toMicroseconds,
+			(event.end - event.start) * toMicroseconds, processId,
+			event.threadId);
+	}
+	json += std::format("\n], \"displayTimeUnit\": \"ms\", "
+		"\"otherData\": {{\"droppedEvents\": {}}}}}\n", GetDroppedCount());
+	return json;
+}
+
+void PhaseTrace::Write(const std::wstring& path) {
+	std::ofstream out(path, std::ios::out | std::ios::trunc | std::ios::binary);
+	if (!out.is_open()) {
+		throw std::runtime_error("Cannot write trace file: " +
+			ConvertToNarrowString(path));
+	}
+	out << Format();
+	out.close();
+	if (out.fail()) {
+		throw std::runtime_error("Cannot write trace file: " +
+			ConvertToNarrowString(path));
+	}
+}
+
+PhaseTrace::Session::Session(const std::wstring& path) : m_path(path) {
+	Start();
+}
+
+PhaseTrace::Session::~Session() {
+	Stop();
+	try {
+		Write(m_path);
+	}
+	catch (const std::exception& e) {
+		// Logging is usually off when --trace is used; say it on stderr too
+		std::cerr << "Error: " << e.what() << std::endl;
+		g_logger->Log(ApplicationLogger::Level::ERR, e.what());
+	}
+}
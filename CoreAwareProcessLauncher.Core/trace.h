@@ -0,0 +1,68 @@
+// trace.h
+#pragma once
+#include <windows.h>
+#include <atomic>
+#include <string>
+
+// Phase timing of the launch path (--trace). Scopes in the parser, the CPU
+// probes and the process code record QueryPerformanceCounter intervals into
+// a fixed in-memory buffer; the Session writes them as Chrome trace-event
+// JSON (chrome://tracing, ui.perfetto.dev) when it ends. Until tracing is
+// started a scope costs one relaxed load and records nothing
+class PhaseTrace {
+public:
+    class Scope {
+    public:
+        // name must outlive the trace; pass a string literal
+        explicit Scope(const char* name)
+            : m_name(name), m_start(IsEnabled() ? Now() : 0) {}
+        ~Scope() {
+            if (m_start != 0) {
+                Record(m_name, m_start, Now());
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        const char* m_name;
+        LONGLONG m_start;
+    };
+
+    // Starts tracing and writes the trace file when it goes out of scope,
+    // also when the launch failed with an exception; a failed write is
+    // reported on stderr and in the log
+    class Session {
+    public:
+        explicit Session(const std::wstring& path);
+        ~Session();
+        Session(const Session&) = delete;
+        Session& operator=(const Session&) = delete;
+
+    private:
+        std::wstring m_path;
+    };
+
+    static bool IsEnabled() {
+        return s_enabled.load(std::memory_order_relaxed);
+    }
+    static void Start();
+    static void Stop();
+    static LONGLONG Now();
+
+    // For phases that began before tracing was started (argument parsing)
+    static void Record(const char* name, LONGLONG start, LONGLONG end);
+
+    // Chrome trace-event JSON of everything recorded so far; timestamps
+    // are microseconds from the first recorded phase
+    static std::string Format();
+    static void Write(const std::wstring& path);
+    static void Clear();
+
+    // Phases past the buffer are counted, not recorded
+    static constexpr size_t MAX_EVENTS = 4096;
+    static size_t GetDroppedCount();
+
+private:
+    static inline std::atomic<bool> s_enabled{ false };
+};
@@ -0,0 +1,212 @@
+// tuner.cpp
+#include "pch.h"
+#include "tuner.h"
+#include "affinity.h"
+#include "benchmark.h"
+#include "cpu.h"
+#include "process.h"
+#include "scheduling.h"
+#include "utilities.h"
+#include <algorithm>
+#include <format>
+#include <sstream>
+
+using Utilities::ConvertToNarrowString;
+
+// A candidate this much slower than the best median is dropped early
+const double FIRST_ROUND_PRUNE_FACTOR = 1.5;
+const double PRUNE_FACTOR = 1.2;
+
+double AffinityTuner::Candidate::Median() const {
+	std::vector<double> sorted = wallSeconds;
+	std::sort(sorted.begin(), sorted.end());
+	return Benchmark::Percentile(sorted, 50.0);
+}
+
+AffinityTuner::CoreClasses AffinityTuner::DetectCoreClasses() {
+	CoreClasses classes;
+	auto caps = CpuInfo::GetCapabilities();
+	if (caps.isHybrid) {
+		classes.pCores = caps.pCoreMask;
+		classes.eCores = caps.eCoreMask;
+		classes.lpECores = caps.lpECoreMask;
+	}
+	classes.allCores = AffinityResolver::GetAllCoresMask();
+	classes.physicalCores = CpuInfo::GetPhysicalCoreMasks();
+	classes.l2Domains = CpuInfo::GetCacheDomainMasks(2);
+	return classes;
+}
+
+std::vector<AffinityTuner::Candidate> AffinityTuner::GenerateCandidates(
+	const CoreClasses& classes) {
+
+	std::vector<Candidate> candidates;
+	auto add = [&candidates](const std::wstring& label, DWORD_PTR mask) {
+		if (mask == 0) {
+			return;
+		}
+		for (const auto& existing : candidates) {
+			if (existing.mask == mask) {
+				return;
+			}
+		}
+		Candidate candidate;
+		candidate.label = label;
+		candidate.mask = mask;
+		candidates.push_back(candidate);
+	};
+	auto noSmt = [&classes](DWORD_PTR mask) {
+		return CpuInfo::RemoveSmtSiblings(mask, classes.physicalCores);
+	};
+
+	// Core classes with and without SMT siblings
+	add(L"all", classes.allCores);
+	add(L"all-nosmt", noSmt(classes.allCores));
+	if (classes.pCores != 0) {
+		DWORD_PTR eCores = classes.eCores | classes.lpECores;
+		add(L"p", classes.pCores);
+		add(L"p-nosmt", noSmt(classes.pCores));
+		add(L"p+e", classes.pCores | classes.eCores);
+		add(L"p-nosmt+e", noSmt(classes.pCores) | classes.eCores);
+		add(L"e", classes.eCores);
+		add(L"alle", eCores);
+		add(L"lp", classes.lpECores);
+	}
+
+	// Thread counts: half and a quarter of the fastest physical cores
+	DWORD_PTR fastest = classes.pCores != 0 ? classes.pCores : classes.allCores;
+	int physical = 0;
+	for (DWORD_PTR core : classes.physicalCores) {
+		if (core & fastest) {
+			physical++;
+		}
+	}
+	for (int divisor : { 2, 4 }) {
+		int count = physical / divisor;
+		if (count > 0) {
+			add(std::format(L"{}-cores", count),
+				TakePhysicalCores(fastest, count, classes.physicalCores));
+		}
+	}
+
+	return candidates;
+}
+
+AffinityTuner::Candidate AffinityTuner::Tune(
+	const CommandLineOptions& options,
+	std::vector<Candidate>& candidates) {
+
+	if (candidates.empty()) {
+		throw std::runtime_error(ConvertToNarrowString(
+			L"No affinity candidates could be generated"));
+	}
+
+	SchedulingSettings scheduling = SchedulingResolver::Resolve(options);
+	auto launch = [&options, &scheduling](DWORD_PTR mask) {
+		ProcessStats stats;
+		if (!ProcessManager::LaunchProcess(
+			options.targetPath,
+			options.targetArgs,
+			options.targetWorkingDir,
+			mask,
+			&stats,
+			{},
+			scheduling)) {
+			throw std::runtime_error(ConvertToNarrowString(
+				L"Failed to launch process"));
+		}
+		return stats.wallSeconds;
+	};
+
+	// One unmeasured run so the first candidate does not pay for cold caches
+	launch(candidates.front().mask);
+
+	for (int round = 0; round < options.tuneRuns; round++) {
+		for (auto& candidate : candidates) {
+			if (candidate.pruned) {
+				continue;
+			}
+			double seconds = launch(candidate.mask);
+			candidate.wallSeconds.push_back(seconds);
+			g_logger->Log(ApplicationLogger::Level::INFO,
+				"Tune round {} {} (0x{:X}): {:.6f}s", round + 1,
+				candidate.label, candidate.mask, seconds);
+		}
+		PruneLosers(candidates,
+			round == 0 ? FIRST_ROUND_PRUNE_FACTOR : PRUNE_FACTOR);
+	}
+
+	const Candidate* winner = nullptr;
+	for (const auto& candidate : candidates) {
+		if (!candidate.pruned &&
+			(!winner || candidate.Median() < winner->Median())) {
+			winner = &candidate;
+		}
+	}
+	return *winner;
+}
+
+void AffinityTuner::PruneLosers(std::vector<Candidate>& candidates,
+	double factor) {
+
+	double best = 0.0;
+	bool found = false;
+	for (const auto& candidate : candidates) {
+		if (!candidate.pruned && !candidate.wallSeconds.empty()) {
+			double median = candidate.Median();
+			if (!found || median < best) {
+				best = median;
+				found = true;
+			}
+		}
+	}
+	if (!found) {
+		return;
+	}
+
+	for (auto& candidate : candidates) {
+		if (!candidate.pruned && !candidate.wallSeconds.empty() &&
+			candidate.Median() > best * factor) {
+			candidate.pruned = true;
+			g_logger->Log(ApplicationLogger::Level::INFO,
+				"Pruned candidate {}", candidate.label);
+		}
+	}
+}
+
+std::wstring AffinityTuner::FormatReport(
+	const std::vector<Candidate>& candidates,
+	const Candidate& winner) {
+
+	std::wstringstream ss;
+	ss << L"\nAffinity Tuning Results:\n";
+	ss << std::format(L"  {:<12} {:>18} {:>6} {:>12}  {}\n",
+		L"candidate", L"mask", L"runs", L"median (s)", L"status");
+	for (const auto& candidate : candidates) {
+		ss << std::format(L"  {:<12} {:>18} {:>6} {:>12.4f}  {}\n",
+			candidate.label, std::format(L"0x{:X}", candidate.mask),
+			candidate.wallSeconds.size(), candidate.Median(),
+			candidate.mask == winner.mask ? L"winner"
+			: candidate.pruned ? L"pruned" : L"");
+	}
+	ss << std::format(L"\nFastest placement: {} (mask 0x{:X})\n",
+		winner.label, winner.mask);
+	return ss.str();
+}
+
+DWORD_PTR AffinityTuner::TakePhysicalCores(DWORD_PTR mask, int count,
+	const std::vector<DWORD_PTR>& physicalCores) {
+
+	DWORD_PTR result = 0;
+	for (DWORD_PTR core : physicalCores) {
+		if (count == 0) {
+			break;
+		}
+		DWORD_PTR threads = core & mask;
+		if (threads != 0) {
+			result |= threads & (~threads + 1);  // One thread per core
+			count--;
+		}
+	}
+	return result;
+}
@@ -0,0 +1,42 @@
+// tuner.h
+#pragma once
+#include <windows.h>
+#include <string>
+#include <vector>
+#include "options.h"
+
+// Searches candidate affinity masks for the fastest placement of a program
+class AffinityTuner {
+public:
+    struct Candidate {
+        std::wstring label;
+        DWORD_PTR mask = 0;
+        std::vector<double> wallSeconds;
+        bool pruned = false;
+
+        double Median() const;
+    };
+
+    struct CoreClasses {
+        DWORD_PTR pCores = 0;
+        DWORD_PTR eCores = 0;
+        DWORD_PTR lpECores = 0;
+        DWORD_PTR allCores = 0;
+        std::vector<DWORD_PTR> physicalCores;  // SMT sibling groups
+        std::vector<DWORD_PTR> l2Domains;      // Cores sharing an L2 cache
+    };
+
+    static CoreClasses DetectCoreClasses();
+    static std::vector<Candidate> GenerateCandidates(const CoreClasses& classes);
+    static Candidate Tune(
+        const CommandLineOptions& options,
+        std::vector<Candidate>& candidates);
+    static void PruneLosers(std::vector<Candidate>& candidates, double factor);
+    static std::wstring FormatReport(
+        const std::vector<Candidate>& candidates,
+        const Candidate& winner);
+
+private:
+    static DWORD_PTR TakePhysicalCores(DWORD_PTR mask, int count,
+        const std::vector<DWORD_PTR>& physicalCores);
+};
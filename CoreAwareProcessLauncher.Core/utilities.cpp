@@ -1,6 +1,11 @@
 // utilities.cpp
 #include "pch.h"
 #include "utilities.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <exception>
 #include <iostream>
 
 namespace Utilities {
@@ -46,6 +51,39 @@ namespace Utilities {
         return (attrs != INVALID_FILE_ATTRIBUTES) &&
                (attrs & FILE_ATTRIBUTE_DIRECTORY);
     }
+
+    std::string EscapeJson(const std::string &text) {
+        std::string escaped;
+        escaped.reserve(text.length());
+        for (char c : text) {
+            switch (c) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\t':
+                escaped += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+            }
+        }
+        return escaped;
+    }
 } // namespace Utilities
 
 // Logger
@@ -53,49 +91,246 @@ std::unique_ptr<ApplicationLogger> g_logger;
 
 ApplicationLogger::ApplicationLogger(bool enabled, const std::wstring &logPath)
     : m_enabled(enabled), m_logPath(logPath) {
-    if (m_enabled && !logPath.empty()) {
+    if (!m_enabled)
+        return;
+
+    if (!logPath.empty()) {
         m_logFile.open(logPath, std::ios::out | std::ios::app);
     }
+    m_slots = std::make_unique<Slot[]>(SLOT_COUNT);
+    for (size_t i = 0; i < SLOT_COUNT; i++) {
+        m_slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    m_flusher = std::thread(&ApplicationLogger::RunFlusher, this);
 }
 
 ApplicationLogger::~ApplicationLogger() {
+    if (m_flusher.joinable()) {
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+            m_stopping = true;
+        }
+        m_wake.notify_one();
+        m_flusher.join();
+    }
     if (m_logFile.is_open()) {
         m_logFile.close();
     }
 }
 
-void ApplicationLogger::Log(Level level, const std::string &message) {
+void ApplicationLogger::Log(Level level, std::string_view message) {
     if (!m_enabled)
         return;
 
-    std::string levelStr;
-    switch (level) {
-    case Level::INFO:
-        levelStr = "INFO";
-        break;
-    case Level::WARNING:
-        levelStr = "WARNING";
-        break;
-    case Level::ERR:
-        levelStr = "ERROR";
-        break;
-    case Level::DEBUG:
-        levelStr = "DEBUG";
-        break;
-    }
-
-    std::time_t now = std::time(nullptr);
-    char timestamp[26];
-    ctime_s(timestamp, sizeof(timestamp), &now);
-    timestamp[24] = '\0'; // Remove newline
-
-    std::string logMessage =
-        std::string(timestamp) + " [" + levelStr + "] " + message;
+    size_t position;
+    Slot *slot = Claim(position);
+    if (!slot)
+        return;
+    StoreText(slot, message);
+    Commit(slot, position, level);
+}
 
-    if (m_logFile.is_open()) {
-        m_logFile << logMessage << std::endl;
+// Reserves the next free slot; returns nullptr (and counts the record as
+// dropped) when the flusher has fallen a whole ring behind
+ApplicationLogger::Slot *ApplicationLogger::Claim(size_t &position) {
+    position = m_enqueue.load(std::memory_order_relaxed);
+    while (true) {
+        Slot *slot = &m_slots[position & (SLOT_COUNT - 1)];
+        size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        auto lag = static_cast<std::ptrdiff_t>(sequence - position);
+        if (lag == 0) {
+            if (m_enqueue.compare_exchange_weak(position, position + 1,
+                                                std::memory_order_relaxed)) {
+                return slot;
+            }
+        } else if (lag < 0) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        } else {
+            position = m_enqueue.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+// Text longer than a slot keeps its start and ends with a marker that
+// gives the full length, so a cut message is never mistaken for a whole one
+void ApplicationLogger::StoreText(Slot *slot, std::string_view text) {
+    size_t size = text.size();
+    if (size <= PAYLOAD_SIZE) {
+        memcpy(slot->payload, text.data(), size);
+    } else {
+        char marker[48];
+        int length = snprintf(marker, sizeof(marker),
+                              "... [truncated, %zu bytes]", text.size());
+        size_t kept = PAYLOAD_SIZE - static_cast<size_t>(length);
+        memcpy(slot->payload, text.data(), kept);
+        memcpy(slot->payload + kept, marker, length);
+        size = PAYLOAD_SIZE;
+    }
+    slot->size = static_cast<uint16_t>(size);
+    slot->formatter = nullptr;
+}
+
+void ApplicationLogger::Commit(Slot *slot, size_t position, Level level) {
+    slot->time = std::chrono::system_clock::now().time_since_epoch().count();
+    slot->level = level;
+    slot->sequence.store(position + 1, std::memory_order_release);
+
+    // The flusher polls anyway; only wake it early when it matters
+    size_t pending = position - m_dequeue.load(std::memory_order_relaxed);
+    if (level == Level::ERR || pending == SLOT_COUNT / 2) {
+        m_wake.notify_one();
+    }
+}
+
+void ApplicationLogger::RunFlusher() {
+    std::string batch;
+    batch.reserve(64 * 1024);
+    uint64_t reported = 0;
+    while (true) {
+        bool stopping;
+        {
+            std::unique_lock<std::mutex> guard(m_wakeLock);
+            m_wake.wait_for(guard, std::chrono::milliseconds(100),
+                            [this] { return m_stopping.load(); });
+            stopping = m_stopping;
+        }
+
+        // Once stopping is seen, producers are done: drain everything
+        size_t count;
+        do {
+            batch.clear();
+            count = Drain(batch);
+
+            uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+            if (dropped > reported) {
+                batch += std::format("[WARNING] Logger dropped {} message(s)\n",
+                                     dropped - reported);
+                reported = dropped;
+            }
+            if (!batch.empty() && m_logFile.is_open()) {
+                m_logFile.write(batch.data(),
+                                static_cast<std::streamsize>(batch.size()));
+                m_logFile.flush();
+            }
+            m_written.fetch_add(count, std::memory_order_release);
+        } while (count > 0);
+
+        if (stopping)
+            return;
     }
 }
 
+// Formats up to one ring of committed records into batch and frees their
+// slots; returns the number of records taken
+size_t ApplicationLogger::Drain(std::string &batch) {
+    size_t position = m_dequeue.load(std::memory_order_relaxed);
+    size_t count = 0;
+    while (count < SLOT_COUNT) {
+        Slot &slot = m_slots[position & (SLOT_COUNT - 1)];
+        if (slot.sequence.load(std::memory_order_acquire) != position + 1)
+            break;
+
+        using std::chrono::system_clock;
+        std::time_t now = system_clock::to_time_t(
+            system_clock::time_point(system_clock::duration(slot.time)));
+        char timestamp[26];
+        ctime_s(timestamp, sizeof(timestamp), &now);
+        timestamp[24] = '\0'; // Remove newline
+
+        const char *levelStr = "INFO";
+        switch (slot.level) {
+        case Level::INFO:
+            levelStr = "INFO";
+            break;
+        case Level::WARNING:
+            levelStr = "WARNING";
+            break;
+        case Level::ERR:
+            levelStr = "ERROR";
+            break;
+        case Level::DEBUG:
+            levelStr = "DEBUG";
+            break;
+        }
+
+        batch += timestamp;
+        batch += " [";
+        batch += levelStr;
+        batch += "] ";
+        if (slot.formatter) {
+            try {
+                slot.formatter(slot.format, slot.payload, batch);
+            } catch (const std::exception &e) {
+                batch += std::format("<format error: {}>", e.what());
+            }
+        } else {
+            batch.append(slot.payload, slot.size);
+        }
+        batch += '\n';
+
+        slot.sequence.store(position + SLOT_COUNT, std::memory_order_release);
+        position++;
+        count++;
+    }
+    m_dequeue.store(position, std::memory_order_relaxed);
+    return count;
+}
+
+void ApplicationLogger::Flush() {
+    if (!m_flusher.joinable())
+        return;
+
+    size_t target = m_enqueue.load(std::memory_order_acquire);
+    while (m_written.load(std::memory_order_acquire) < target) {
+        m_wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+bool ApplicationLogger::Flush(std::chrono::milliseconds timeout) {
+    if (!m_flusher.joinable())
+        return true;
+
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    size_t target = m_enqueue.load(std::memory_order_acquire);
+    while (m_written.load(std::memory_order_acquire) < target) {
+        if (std::chrono::steady_clock::now() >= deadline)
+            return false;
+        m_wake.notify_one();
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+namespace {
+std::terminate_handler g_previousTerminate = nullptr;
+LPTOP_LEVEL_EXCEPTION_FILTER g_previousFilter = nullptr;
+
+void FlushBeforeExit() {
+    if (g_logger) {
+        g_logger->Flush(std::chrono::milliseconds(500));
+    }
+}
+} // namespace
+
+void ApplicationLogger::FlushOnFailure() {
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        g_previousTerminate = std::set_terminate([]() {
+            FlushBeforeExit();
+            if (g_previousTerminate)
+                g_previousTerminate();
+            std::abort();
+        });
+        g_previousFilter = SetUnhandledExceptionFilter(
+            [](EXCEPTION_POINTERS *exception) -> LONG {
+                FlushBeforeExit();
+                return g_previousFilter ? g_previousFilter(exception)
+                                        : EXCEPTION_CONTINUE_SEARCH;
+            });
+    });
+}
+
 // MessageHandler global instance
 std::unique_ptr<MessageHandler> g_messageHandler;
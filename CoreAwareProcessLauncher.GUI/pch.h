@@ -23,3 +23,20 @@ processorArchitecture='*' publicKeyToken='6595b64144ccf1df' language='*'\"")
 #include "utilities.h"
 #include "cpu.h"
 #include "process.h"
+#include "affinity.h"
+#include "benchmark.h"
+#include "profiles.h"
+#include "tuner.h"
+#include "sweep.h"
+#include "energy.h"
+#include "thermal.h"
+#include "scheduling.h"
+#include "latency.h"
+#include "powerplan.h"
+#include "monitor.h"
+#include "reservation.h"
+#include "daemon.h"
+#include "topology.h"
+#include "trace.h"
+#include "schedtrace.h"
+#include "metrics.h"
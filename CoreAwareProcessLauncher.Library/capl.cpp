@@ -0,0 +1,184 @@
+// capl.cpp
+#include "pch.h"
+#include "capl.h"
+#include <algorithm>
+#include <mutex>
+
+using Utilities::ConvertToNarrowString;
+
+namespace {
+
+thread_local std::string t_lastError;
+
+// Probed on first use; never changes afterwards, so reads need no lock
+const TopologySnapshot& GetTopology() {
+	static std::once_flag once;
+	static TopologySnapshot topology;
+	std::call_once(once, []() {
+		if (!g_logger) {
+			g_logger = std::make_unique<ApplicationLogger>(false);
+		}
+		topology = TopologySnapshot::Capture();
+	});
+	return topology;
+}
+
+capl_status Fail(capl_status status, const std::string& message) {
+	t_lastError = message;
+	return status;
+}
+
+// error is read by the caller right after the failing call; anything in
+// between (logging, cleanup) may overwrite GetLastError()
+capl_status FailWin32(const char* context, DWORD error) {
+	return Fail(CAPL_E_SYSTEM, std::format("{}: error {}", context, error));
+}
+
+// DWORD_PTR is 32 bits wide in Win32 builds
+bool ToMask(capl_cpuset cpus, DWORD_PTR& mask) {
+	mask = static_cast<DWORD_PTR>(cpus);
+	return mask != 0 && static_cast<capl_cpuset>(mask) == cpus;
+}
+
+void CopyDomains(const std::vector<DWORD_PTR>& domains, capl_cpuset* out,
+	uint32_t& count) {
+	count = static_cast<uint32_t>(std::min<size_t>(domains.size(),
+		CAPL_MAX_DOMAINS));
+	for (uint32_t i = 0; i < count; i++) {
+		out[i] = domains[i];
+	}
+}
+
+} // namespace
+
+uint32_t capl_api_version(void) {
+	return CAPL_API_VERSION;
+}
+
+capl_status capl_get_topology(capl_topology* topology) {
+	if (!topology || topology->size != sizeof(capl_topology)) {
+		return Fail(CAPL_E_INVALID_ARGUMENT,
+			"topology must be set up with size = sizeof(capl_topology)");
+	}
+
+	// Nothing may throw across the C boundary
+	try {
+		const TopologySnapshot& snapshot = GetTopology();
+		*topology = {};
+		topology->size = sizeof(capl_topology);
+		topology->logical_processors = snapshot.logicalProcessors;
+		topology->physical_cores =
+			static_cast<uint32_t>(snapshot.physicalCores.size());
+		topology->is_hybrid = snapshot.isHybrid ? 1 : 0;
+		topology->system = snapshot.systemMask;
+		topology->allowed = snapshot.allowedMask;
+		topology->p_cores = snapshot.pCoreMask;
+		topology->e_cores = snapshot.eCoreMask;
+		topology->lp_e_cores = snapshot.lpECoreMask;
+		CopyDomains(snapshot.l2Domains, topology->l2_domains,
+			topology->l2_domain_count);
+		CopyDomains(snapshot.l3Domains, topology->l3_domains,
+			topology->l3_domain_count);
+
+		std::string brand = ConvertToNarrowString(snapshot.brandString);
+		brand.copy(topology->brand, sizeof(topology->brand) - 1);
+		return CAPL_OK;
+	}
+	catch (const std::exception& e) {
+		return Fail(CAPL_E_SYSTEM, e.what());
+	}
+}
+
+capl_status capl_evaluate(const char* spec, capl_cpuset* cpus) {
+	if (!spec || !cpus) {
+		return Fail(CAPL_E_INVALID_ARGUMENT, "spec and cpus must not be NULL");
+	}
+	try {
+		*cpus = CpuSetSpec::Evaluate(spec, GetTopology());
+		return CAPL_OK;
+	}
+	catch (const std::exception& e) {
+		return Fail(CAPL_E_INVALID_SPEC, e.what());
+	}
+}
+
+capl_status capl_spawn(const wchar_t* path, const wchar_t* const* args,
+	size_t arg_count, const wchar_t* working_dir, capl_cpuset cpus,
+	capl_process* process) {
+
+	DWORD_PTR mask;
+	if (!path || !process || (arg_count > 0 && !args) || !ToMask(cpus, mask)) {
+		return Fail(CAPL_E_INVALID_ARGUMENT,
+			"path, process and a non-empty group 0 mask are required");
+	}
+
+	try {
+		GetTopology();
+		std::vector<std::wstring> arguments(args, args + arg_count);
+		PROCESS_INFORMATION info = {};
+		if (!ProcessManager::StartProcess(path, arguments,
+			working_dir ? working_dir : L"", mask, {}, info)) {
+			// StartProcess leaves the error of the step that failed
+			return FailWin32("Starting the process failed", GetLastError());
+		}
+		process->process_id = info.dwProcessId;
+		process->thread_id = info.dwThreadId;
+		process->process_handle = info.hProcess;
+		process->thread_handle = info.hThread;
+		return CAPL_OK;
+	}
+	catch (const std::exception& e) {
+		return Fail(CAPL_E_SYSTEM, e.what());
+	}
+}
+
+void capl_close_process(capl_process* process) {
+	if (!process) {
+		return;
+	}
+	if (process->process_handle) {
+		CloseHandle(process->process_handle);
+	}
+	if (process->thread_handle) {
+		CloseHandle(process->thread_handle);
+	}
+	*process = {};
+}
+
+capl_status capl_set_process_affinity(uint32_t process_id, capl_cpuset cpus) {
+	DWORD_PTR mask;
+	if (!ToMask(cpus, mask)) {
+		return Fail(CAPL_E_INVALID_ARGUMENT, "cpus must be a non-empty group 0 mask");
+	}
+	HANDLE process = OpenProcess(PROCESS_SET_INFORMATION |
+		PROCESS_QUERY_LIMITED_INFORMATION, FALSE, process_id);
+	if (!process) {
+		return FailWin32("OpenProcess failed", GetLastError());
+	}
+	bool ok = SetProcessAffinityMask(process, mask) != FALSE;
+	capl_status status = ok ? CAPL_OK
+		: FailWin32("SetProcessAffinityMask failed", GetLastError());
+	CloseHandle(process);
+	return status;
+}
+
+capl_status capl_set_thread_affinity(uint32_t thread_id, capl_cpuset cpus) {
+	DWORD_PTR mask;
+	if (!ToMask(cpus, mask)) {
+		return Fail(CAPL_E_INVALID_ARGUMENT, "cpus must be a non-empty group 0 mask");
+	}
+	HANDLE thread = OpenThread(THREAD_SET_INFORMATION |
+		THREAD_QUERY_INFORMATION, FALSE, thread_id);
+	if (!thread) {
+		return FailWin32("OpenThread failed", GetLastError());
+	}
+	bool ok = SetThreadAffinityMask(thread, mask) != 0;
+	capl_status status = ok ? CAPL_OK
+		: FailWin32("SetThreadAffinityMask failed", GetLastError());
+	CloseHandle(thread);
+	return status;
+}
+
+const char* capl_last_error(void) {
+	return t_lastError.c_str();
+}
@@ -0,0 +1,97 @@
+/* capl.h - C interface of capl.dll
+ *
+ * Topology queries, core selection and affinity for programs that make
+ * their own placement decisions without starting caplcli.exe. Every
+ * function may be called from any thread. The topology is probed once,
+ * on the first call, and every later call reads that snapshot.
+ *
+ * Masks cover processor group 0: bit n is logical processor n.
+ */
+#ifndef CAPL_H
+#define CAPL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef CAPL_EXPORTS
+#define CAPL_API __declspec(dllexport)
+#else
+#define CAPL_API __declspec(dllimport)
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Bumped when a structure or signature below changes incompatibly */
+#define CAPL_API_VERSION 1
+
+#define CAPL_MAX_DOMAINS 64
+
+typedef enum capl_status {
+    CAPL_OK = 0,
+    CAPL_E_INVALID_ARGUMENT = 1, /* NULL pointer, bad size or zero mask */
+    CAPL_E_INVALID_SPEC = 2,     /* Core specification was rejected */
+    CAPL_E_SYSTEM = 3,           /* A Windows call failed */
+} capl_status;
+
+typedef uint64_t capl_cpuset;
+
+typedef struct capl_topology {
+    uint32_t size;               /* Set to sizeof(capl_topology) by the caller */
+    uint32_t logical_processors;
+    uint32_t physical_cores;
+    int32_t is_hybrid;
+    capl_cpuset system;          /* Every logical processor */
+    capl_cpuset allowed;         /* Processors this process (or job) may use */
+    capl_cpuset p_cores;
+    capl_cpuset e_cores;
+    capl_cpuset lp_e_cores;
+    uint32_t l2_domain_count;
+    uint32_t l3_domain_count;
+    capl_cpuset l2_domains[CAPL_MAX_DOMAINS];
+    capl_cpuset l3_domains[CAPL_MAX_DOMAINS];
+    char brand[64];              /* NUL-terminated CPU brand string */
+} capl_topology;
+
+typedef struct capl_process {
+    uint32_t process_id;
+    uint32_t thread_id;          /* Primary thread */
+    void* process_handle;        /* Close with capl_close_process */
+    void* thread_handle;
+} capl_process;
+
+CAPL_API uint32_t capl_api_version(void);
+
+/* Copies the topology snapshot */
+CAPL_API capl_status capl_get_topology(capl_topology* topology);
+
+/* Evaluates a core specification into a set of allowed processors:
+ *   [~]<mode|list>[@<L3 domain>]
+ * mode is p, e, lp, alle or all; list is core numbers and ranges such as
+ * "0,2,4-7". A leading ~ inverts the selection and @n keeps the part that
+ * shares L3 instance n. Does not allocate unless the spec is rejected. */
+CAPL_API capl_status capl_evaluate(const char* spec, capl_cpuset* cpus);
+
+/* Starts path (searched like caplcli does) with the given arguments,
+ * restricted to cpus from its first instruction. working_dir may be NULL */
+CAPL_API capl_status capl_spawn(const wchar_t* path,
+    const wchar_t* const* args, size_t arg_count,
+    const wchar_t* working_dir, capl_cpuset cpus, capl_process* process);
+
+CAPL_API void capl_close_process(capl_process* process);
+
+/* Restrict a running process or a single thread */
+CAPL_API capl_status capl_set_process_affinity(uint32_t process_id,
+    capl_cpuset cpus);
+CAPL_API capl_status capl_set_thread_affinity(uint32_t thread_id,
+    capl_cpuset cpus);
+
+/* Description of the last failure on the calling thread ("" if none) */
+CAPL_API const char* capl_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPL_H */
@@ -0,0 +1,498 @@
+// capl_runtime.h - header-only work-stealing thread pool for hybrid CPUs
+//
+// One worker is pinned to every logical processor the process may use.
+// ParallelFor hands each worker a share of the range weighted by its core
+// class, so E-cores and LP E-cores do not become the stragglers, and an
+// idle worker steals from the closest busy one first: its SMT sibling,
+// then the cores sharing its L2 cluster, then its L3, then the rest.
+//
+// The topology comes from the CAPL_TOPOLOGY variable that caplcli sets for
+// the programs it launches with --export-topology, or is detected here when
+// it is missing.
+#pragma once
+#include <windows.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cwchar>
+#include <deque>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace capl::runtime {
+
+enum class CoreClass { PERFORMANCE = 0, EFFICIENCY = 1, LOW_POWER = 2 };
+
+// A logical processor a worker can run on
+struct Processor {
+    int number = 0;          // Logical processor in group 0
+    CoreClass coreClass = CoreClass::PERFORMANCE;
+    int core = -1;           // Physical core index
+    int cluster = -1;        // L2 domain index
+    int llc = -1;            // L3 domain index
+};
+
+class Topology {
+public:
+    static constexpr const wchar_t* ENVIRONMENT_VARIABLE = L"CAPL_TOPOLOGY";
+
+    std::vector<Processor> processors;
+
+    // The topology CAPL passed in, else a detected one; either way limited
+    // to the processors this process may run on
+    static Topology Current() {
+        Topology topology;
+        std::wstring text(4096, L'\0');
+        DWORD length = GetEnvironmentVariableW(ENVIRONMENT_VARIABLE,
+            text.data(), static_cast<DWORD>(text.size()));
+        if (length == 0 || length >= text.size() ||
+            !Parse(text.substr(0, length), topology)) {
+            topology = Detect();
+        }
+
+        DWORD_PTR processMask = 0, systemMask = 0;
+        if (GetProcessAffinityMask(GetCurrentProcess(), &processMask,
+            &systemMask) && processMask != 0) {
+            std::erase_if(topology.processors,
+                [processMask](const Processor& processor) {
+                    return !(processMask & (DWORD_PTR(1) << processor.number));
+                });
+        }
+        if (topology.processors.empty()) {
+            topology.processors.push_back(Processor{});
+        }
+        return topology;
+    }
+
+    // "p=<mask>;e=<mask>;lp=<mask>;core=<mask>,...;l2=<mask>,...;l3=..."
+    // with hexadecimal masks, as written by caplcli
+    static bool Parse(const std::wstring& text, Topology& topology) {
+        DWORD_PTR p = 0, e = 0, lp = 0;
+        std::vector<DWORD_PTR> cores, l2, l3;
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find(L';', start);
+            if (end == std::wstring::npos) {
+                end = text.size();
+            }
+            std::wstring field = text.substr(start, end - start);
+            start = end + 1;
+
+            size_t equals = field.find(L'=');
+            if (equals == std::wstring::npos) {
+                return false;
+            }
+            std::wstring key = field.substr(0, equals);
+            std::vector<DWORD_PTR> masks;
+            if (!ParseMasks(field.substr(equals + 1), masks)) {
+                return false;
+            }
+            DWORD_PTR first = masks.empty() ? 0 : masks.front();
+            if (key == L"p") {
+                p = first;
+            } else if (key == L"e") {
+                e = first;
+            } else if (key == L"lp") {
+                lp = first;
+            } else if (key == L"core") {
+                cores = masks;
+            } else if (key == L"l2") {
+                l2 = masks;
+            } else if (key == L"l3") {
+                l3 = masks;
+            }
+        }
+        if (cores.empty()) {
+            return false;
+        }
+        topology = Build(p, e, lp, cores, l2, l3);
+        return true;
+    }
+
+    // Core classes from the Windows efficiency classes (highest is the
+    // P-core class), cores and caches from the logical processor table
+    static Topology Detect() {
+        std::vector<DWORD_PTR> cores, l2, l3;
+        std::vector<BYTE> classes;
+        DWORD length = 0;
+        GetLogicalProcessorInformationEx(RelationAll, nullptr, &length);
+        std::vector<BYTE> buffer(length);
+        if (length == 0 || !GetLogicalProcessorInformationEx(RelationAll,
+            reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+                buffer.data()), &length)) {
+            // No table: every processor counts as a core of its own
+            SYSTEM_INFO info;
+            GetSystemInfo(&info);
+            for (DWORD i = 0; i < info.dwNumberOfProcessors &&
+                i < sizeof(DWORD_PTR) * 8; i++) {
+                cores.push_back(DWORD_PTR(1) << i);
+            }
+            return Build(0, 0, 0, cores, {}, {});
+        }
+
+        for (DWORD offset = 0; offset < length;) {
+            auto entry = reinterpret_cast<PSYSTEM_LOGICAL_PROCESSOR_INFORMATION_EX>(
+                buffer.data() + offset);
+            if (entry->Relationship == RelationProcessorCore &&
+                entry->Processor.GroupMask[0].Group == 0) {
+                cores.push_back(entry->Processor.GroupMask[0].Mask);
+                classes.push_back(entry->Processor.EfficiencyClass);
+            } else if (entry->Relationship == RelationCache &&
+                entry->Cache.GroupMask.Group == 0 &&
+                (entry->Cache.Type == CacheUnified ||
+                    entry->Cache.Type == CacheData)) {
+                if (entry->Cache.Level == 2) {
+                    l2.push_back(entry->Cache.GroupMask.Mask);
+                } else if (entry->Cache.Level == 3) {
+                    l3.push_back(entry->Cache.GroupMask.Mask);
+                }
+            }
+            offset += entry->Size;
+        }
+
+        // Highest class: P-cores; lowest of three classes: LP E-cores
+        std::vector<BYTE> distinct = classes;
+        std::sort(distinct.begin(), distinct.end());
+        distinct.erase(std::unique(distinct.begin(), distinct.end()),
+            distinct.end());
+        DWORD_PTR p = 0, e = 0, lp = 0;
+        if (distinct.size() > 1) {
+            for (size_t i = 0; i < cores.size(); i++) {
+                if (classes[i] == distinct.back()) {
+                    p |= cores[i];
+                } else if (distinct.size() > 2 && classes[i] == distinct.front()) {
+                    lp |= cores[i];
+                } else {
+                    e |= cores[i];
+                }
+            }
+        }
+        return Build(p, e, lp, cores, l2, l3);
+    }
+
+    // 0 same processor, 1 SMT sibling, 2 same L2 cluster, 3 same L3,
+    // 4 anywhere else
+    static int Distance(const Processor& a, const Processor& b) {
+        if (a.number == b.number) {
+            return 0;
+        }
+        if (a.core >= 0 && a.core == b.core) {
+            return 1;
+        }
+        if (a.cluster >= 0 && a.cluster == b.cluster) {
+            return 2;
+        }
+        if (a.llc >= 0 && a.llc == b.llc) {
+            return 3;
+        }
+        return 4;
+    }
+
+private:
+    static bool ParseMasks(const std::wstring& text,
+        std::vector<DWORD_PTR>& masks) {
+        size_t start = 0;
+        while (start < text.size()) {
+            size_t end = text.find(L',', start);
+            if (end == std::wstring::npos) {
+                end = text.size();
+            }
+            std::wstring value = text.substr(start, end - start);
+            wchar_t* stop = nullptr;
+            unsigned long long mask = wcstoull(value.c_str(), &stop, 16);
+            if (value.empty() || *stop != L'\0') {
+                return false;
+            }
+            masks.push_back(static_cast<DWORD_PTR>(mask));
+            start = end + 1;
+        }
+        return true;
+    }
+
+    static int IndexOf(const std::vector<DWORD_PTR>& masks, DWORD_PTR bit) {
+        for (size_t i = 0; i < masks.size(); i++) {
+            if (masks[i] & bit) {
+                return static_cast<int>(i);
+            }
+        }
+        return -1;
+    }
+
+    static Topology Build(DWORD_PTR p, DWORD_PTR e, DWORD_PTR lp,
+        const std::vector<DWORD_PTR>& cores, const std::vector<DWORD_PTR>& l2,
+        const std::vector<DWORD_PTR>& l3) {
+        DWORD_PTR all = 0;
+        for (DWORD_PTR core : cores) {
+            all |= core;
+        }
+
+        Topology topology;
+        for (int number = 0; number < static_cast<int>(sizeof(DWORD_PTR) * 8);
+            number++) {
+            DWORD_PTR bit = DWORD_PTR(1) << number;
+            if (!(all & bit)) {
+                continue;
+            }
+            Processor processor;
+            processor.number = number;
+            processor.coreClass = (lp & bit) ? CoreClass::LOW_POWER
+                : (e & bit) ? CoreClass::EFFICIENCY : CoreClass::PERFORMANCE;
+            processor.core = IndexOf(cores, bit);
+            processor.cluster = IndexOf(l2, bit);
+            processor.llc = IndexOf(l3, bit);
+            topology.processors.push_back(processor);
+        }
+        return topology;
+    }
+};
+
+struct PoolOptions {
+    // Relative throughput of one worker per core class; a range is
+    // split between the workers in these proportions
+    double performanceWeight = 1.0;
+    double efficiencyWeight = 0.6;
+    double lowPowerWeight = 0.3;
+    // A worker whose SMT sibling also has a worker gets this share
+    double smtShare = 0.6;
+    // Pieces each worker's share is cut into, the units of stealing
+    int chunksPerWorker = 8;
+    bool pinWorkers = true;
+};
+
+class ThreadPool {
+public:
+    explicit ThreadPool(const Topology& topology = Topology::Current(),
+        const PoolOptions& options = PoolOptions()) : m_options(options) {
+        for (const auto& processor : topology.processors) {
+            auto worker = std::make_unique<Worker>();
+            worker->processor = processor;
+            m_workers.push_back(std::move(worker));
+        }
+
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            Worker& worker = *m_workers[i];
+            worker.weight = GetClassWeight(worker.processor.coreClass);
+            std::vector<std::pair<int, size_t>> others;
+            for (size_t j = 0; j < m_workers.size(); j++) {
+                if (j == i) {
+                    continue;
+                }
+                int distance = Topology::Distance(worker.processor,
+                    m_workers[j]->processor);
+                if (distance == 1) {
+                    worker.weight = GetClassWeight(worker.processor.coreClass) *
+                        options.smtShare;
+                }
+                // Rotated so equally distant victims are shared evenly
+                size_t order = (j + m_workers.size() - i) % m_workers.size();
+                others.push_back({ distance, order });
+            }
+            std::sort(others.begin(), others.end());
+            for (const auto& [distance, order] : others) {
+                worker.victims.push_back((order + i) % m_workers.size());
+            }
+        }
+
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            m_workers[i]->thread = std::thread([this, i]() { Run(i); });
+            if (options.pinWorkers) {
+                SetThreadAffinityMask(m_workers[i]->thread.native_handle(),
+                    DWORD_PTR(1) << m_workers[i]->processor.number);
+            }
+        }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+            m_stopping = true;
+        }
+        m_wake.notify_all();
+        for (auto& worker : m_workers) {
+            worker->thread.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t Size() const {
+        return m_workers.size();
+    }
+
+    const Processor& GetProcessor(size_t worker) const {
+        return m_workers[worker]->processor;
+    }
+
+    double GetWeight(size_t worker) const {
+        return m_workers[worker]->weight;
+    }
+
+    // Calls body(first, last) on disjoint pieces covering [begin, end) and
+    // returns once all of them ran; rethrows the first exception of body.
+    // Calls from several threads run one after the other
+    template <typename Body>
+    void ParallelFor(size_t begin, size_t end, Body&& body) {
+        if (begin >= end) {
+            return;
+        }
+        std::lock_guard<std::mutex> job(m_jobLock);
+
+        using BodyType = std::remove_reference_t<Body>;
+        m_context = const_cast<void*>(static_cast<const void*>(&body));
+        m_call = [](void* context, size_t first, size_t last) {
+            (*static_cast<BodyType*>(context))(first, last);
+        };
+        m_error = nullptr;
+        m_remaining = end - begin;
+
+        Distribute(begin, end);
+        {
+            std::lock_guard<std::mutex> guard(m_wakeLock);
+            m_generation++;
+        }
+        m_wake.notify_all();
+
+        std::unique_lock<std::mutex> done(m_doneLock);
+        m_done.wait(done, [this]() { return m_remaining.load() == 0; });
+        if (m_error) {
+            std::rethrow_exception(m_error);
+        }
+    }
+
+private:
+    struct Range {
+        size_t begin;
+        size_t end;
+    };
+
+    struct Worker {
+        Processor processor;
+        double weight = 1.0;
+        std::vector<size_t> victims;   // Nearest first
+        std::mutex lock;
+        std::deque<Range> ranges;
+        std::thread thread;
+    };
+
+    double GetClassWeight(CoreClass coreClass) const {
+        switch (coreClass) {
+        case CoreClass::EFFICIENCY:
+            return m_options.efficiencyWeight;
+        case CoreClass::LOW_POWER:
+            return m_options.lowPowerWeight;
+        default:
+            return m_options.performanceWeight;
+        }
+    }
+
+    // Gives every worker a share proportional to its weight, in chunks
+    void Distribute(size_t begin, size_t end) {
+        double totalWeight = 0.0;
+        for (const auto& worker : m_workers) {
+            totalWeight += worker->weight;
+        }
+
+        size_t total = end - begin;
+        size_t next = begin;
+        double assigned = 0.0;
+        for (size_t i = 0; i < m_workers.size(); i++) {
+            Worker& worker = *m_workers[i];
+            assigned += worker.weight;
+            size_t shareEnd = i + 1 == m_workers.size() ? end
+                : begin + static_cast<size_t>(total * (assigned / totalWeight));
+            size_t share = shareEnd - next;
+            size_t chunks = std::max<size_t>(1, std::min<size_t>(share,
+                static_cast<size_t>(std::max(1, m_options.chunksPerWorker))));
+
+            std::lock_guard<std::mutex> guard(worker.lock);
+            for (size_t c = 0; c < chunks && next < shareEnd; c++) {
+                size_t chunkEnd = c + 1 == chunks ? shareEnd
+                    : next + share / chunks;
+                worker.ranges.push_back({ next, chunkEnd });
+                next = chunkEnd;
+            }
+        }
+    }
+
+    // Own work from the front, stolen work from the back of the victim
+    bool TakeRange(size_t index, Range& range) {
+        Worker& self = *m_workers[index];
+        {
+            std::lock_guard<std::mutex> guard(self.lock);
+            if (!self.ranges.empty()) {
+                range = self.ranges.front();
+                self.ranges.pop_front();
+                return true;
+            }
+        }
+        for (size_t victim : self.victims) {
+            Worker& other = *m_workers[victim];
+            std::lock_guard<std::mutex> guard(other.lock);
+            if (!other.ranges.empty()) {
+                range = other.ranges.back();
+                other.ranges.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void Run(size_t index) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> wake(m_wakeLock);
+                m_wake.wait(wake, [this, seen]() {
+                    return m_stopping || m_generation != seen;
+                });
+                if (m_stopping) {
+                    return;
+                }
+                seen = m_generation;
+            }
+
+            Range range;
+            while (TakeRange(index, range)) {
+                try {
+                    m_call(m_context, range.begin, range.end);
+                }
+                catch (...) {
+                    std::lock_guard<std::mutex> guard(m_doneLock);
+                    if (!m_error) {
+                        m_error = std::current_exception();
+                    }
+                }
+                size_t count = range.end - range.begin;
+                if (m_remaining.fetch_sub(count) == count) {
+                    { std::lock_guard<std::mutex> guard(m_doneLock); }
+                    m_done.notify_all();
+                }
+            }
+        }
+    }
+
+    PoolOptions m_options;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_jobLock;              // One ParallelFor at a time
+    void* m_context = nullptr;
+    void (*m_call)(void*, size_t, size_t) = nullptr;
+    std::atomic<size_t> m_remaining{ 0 };
+    std::exception_ptr m_error;
+
+    std::mutex m_wakeLock;
+    std::condition_variable m_wake;
+    uint64_t m_generation = 0;
+    bool m_stopping = false;
+
+    std::mutex m_doneLock;
+    std::condition_variable m_done;
+};
+
+} // namespace capl::runtime
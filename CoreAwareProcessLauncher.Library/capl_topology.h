@@ -0,0 +1,110 @@
+/* capl_topology.h - the topology CAPL hands to a launched program
+ *
+ * With --share-topology, caplcli writes the topology it detected and the
+ * mask it launched the program with into a read-only file mapping the
+ * program inherits. CAPL_TOPOLOGY_FD holds the decimal value of that
+ * handle. Reading it maps one page and allocates nothing:
+ *
+ *     capl_topology_view view;
+ *     if (capl_topology_open(&view)) {
+ *         uint64_t p_cores = view.blob->p_cores;
+ *         ...
+ *         capl_topology_close(&view);
+ *     }
+ *
+ * Masks cover processor group 0: bit n is logical processor n.
+ */
+#ifndef CAPL_TOPOLOGY_H
+#define CAPL_TOPOLOGY_H
+
+#include <windows.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CAPL_TOPOLOGY_VARIABLE "CAPL_TOPOLOGY_FD"
+#define CAPL_TOPOLOGY_MAGIC 0x4C504143u /* "CAPL" */
+#define CAPL_TOPOLOGY_VERSION 1
+
+/* Fixed part of the blob; readers accept a larger header_size from later
+ * versions and find the mask arrays at header_size */
+typedef struct capl_topology_blob {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t header_size;
+    uint32_t total_size;
+    uint32_t is_hybrid;
+    uint64_t launch_mask;     /* Mask the program was started with */
+    uint64_t allowed_mask;    /* Processors CAPL itself could use */
+    uint64_t p_cores;
+    uint64_t e_cores;
+    uint64_t lp_e_cores;
+    uint32_t core_count;      /* Masks that follow, in this order: */
+    uint32_t l2_count;        /* physical cores, L2 domains, L3 domains */
+    uint32_t l3_count;
+    uint32_t reserved;
+} capl_topology_blob;
+
+typedef struct capl_topology_view {
+    const capl_topology_blob* blob;
+    const uint64_t* cores;
+    const uint64_t* l2_domains;
+    const uint64_t* l3_domains;
+} capl_topology_view;
+
+static inline int capl_topology_open(capl_topology_view* view) {
+    char text[32];
+    DWORD length = GetEnvironmentVariableA(CAPL_TOPOLOGY_VARIABLE, text,
+        sizeof(text));
+    uint64_t value = 0;
+    DWORD i;
+    const capl_topology_blob* blob;
+    uint64_t needed;
+
+    view->blob = NULL;
+    if (length == 0 || length >= sizeof(text)) {
+        return 0;
+    }
+    for (i = 0; i < length; i++) {
+        if (text[i] < '0' || text[i] > '9') {
+            return 0;
+        }
+        value = value * 10 + (uint64_t)(text[i] - '0');
+    }
+
+    blob = (const capl_topology_blob*)MapViewOfFile(
+        (HANDLE)(uintptr_t)value, FILE_MAP_READ, 0, 0, 0);
+    if (!blob) {
+        return 0;
+    }
+    needed = (uint64_t)blob->header_size + sizeof(uint64_t) *
+        ((uint64_t)blob->core_count + blob->l2_count + blob->l3_count);
+    if (blob->magic != CAPL_TOPOLOGY_MAGIC ||
+        blob->version < CAPL_TOPOLOGY_VERSION ||
+        blob->header_size < sizeof(capl_topology_blob) ||
+        needed > blob->total_size) {
+        UnmapViewOfFile(blob);
+        return 0;
+    }
+
+    view->blob = blob;
+    view->cores = (const uint64_t*)((const char*)blob + blob->header_size);
+    view->l2_domains = view->cores + blob->core_count;
+    view->l3_domains = view->l2_domains + blob->l2_count;
+    return 1;
+}
+
+static inline void capl_topology_close(capl_topology_view* view) {
+    if (view->blob) {
+        UnmapViewOfFile(view->blob);
+        view->blob = NULL;
+    }
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CAPL_TOPOLOGY_H */
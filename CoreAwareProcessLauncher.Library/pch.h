@@ -0,0 +1,17 @@
+#pragma once
+
+// Windows Header Files
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+
+// C++ Standard Library
+#include <string>
+#include <memory>
+#include <stdexcept>
+#include <format>
+#include <vector>
+
+// Project Headers
+#include "utilities.h"
+#include "process.h"
+#include "topology.h"
@@ -3,11 +3,66 @@
 #include "pch.h"
 #include "options.h"
 #include "utilities.h"
+#include "affinity.h"
+#include "benchmark.h"
+#include "profiles.h"
+#include "tuner.h"
+#include "sweep.h"
+#include "energy.h"
+#include "thermal.h"
+#include "scheduling.h"
+#include "latency.h"
+#include "powerplan.h"
+#include "monitor.h"
+#include "reservation.h"
+#include "daemon.h"
+#include "topology.h"
+#include "capl.h"
+#include "capl_runtime.h"
+#include "capl_topology.h"
+#include "cpu.h"
+#include "cpumodels.h"
+#include "trace.h"
+#include "schedtrace.h"
+#include "metrics.h"
+#include "top.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
 namespace CoreAwareProcessLauncherTests
 {
+    // caplcli.exe and TestExecutable.exe are project references of the
+    // tests and are built next to the test DLL; a missing one fails the
+    // test instead of letting it pass without running
+    static std::wstring FindBuiltExecutable(const std::wstring& name) {
+        HMODULE module = NULL;
+        GetModuleHandleExW(GET_MODULE_HANDLE_EX_FLAG_FROM_ADDRESS |
+            GET_MODULE_HANDLE_EX_FLAG_UNCHANGED_REFCOUNT,
+            reinterpret_cast<LPCWSTR>(&FindBuiltExecutable), &module);
+        WCHAR path[MAX_PATH];
+        GetModuleFileNameW(module, path, MAX_PATH);
+        std::wstring directory(path);
+        directory = directory.substr(0, directory.find_last_of(L'\\') + 1);
+        std::wstring executable = directory + name;
+        if (!Utilities::PathExists(executable)) {
+            Assert::Fail((name + L" was not built next to the test DLL").c_str());
+        }
+        return executable;
+    }
+
+    static std::wstring FindTestExecutable() {
+        return FindBuiltExecutable(L"TestExecutable.exe");
+    }
+
     TEST_CLASS(OptionsTests)
     {
     private:
@@ -309,5 +364,3283 @@ namespace CoreAwareProcessLauncherTests
                 }, L"Should throw on invalid mode");
             CleanupArgs(argv);
         }
+
+        TEST_METHOD(TestRepeatWithSeveralModes)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p,e",
+                L"--repeat", L"5",
+                L"--warmup", L"2",
+                L"--results", L"runs.csv",
+                L"--shuffle",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(5, options.repeatCount);
+            Assert::AreEqual(2, options.warmupCount);
+            Assert::AreEqual(L"runs.csv", options.resultsPath.c_str());
+            Assert::IsTrue(options.shuffleRuns);
+            Assert::AreEqual(size_t(2), options.benchmarkModes.size());
+            Assert::AreEqual(static_cast<int>(CommandLineOptions::CoreAffinityMode::E_CORES_ONLY),
+                static_cast<int>(options.benchmarkModes[1]));
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSeveralModesRequireRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p,e",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestWarmupRequiresRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--warmup", L"3",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestInvalidRepeatCount)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--repeat", L"0",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestTuneMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--tune",
+                L"--tune-runs", L"2",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.tuneMode);
+            Assert::AreEqual(2, options.tuneRuns);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestTuneWithModeFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--tune",
+                L"--mode", L"p",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestLearnedMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"learned",
+                L"--profiles", L"profiles.ini",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(static_cast<int>(CommandLineOptions::CoreAffinityMode::LEARNED),
+                static_cast<int>(options.affinityMode));
+            Assert::AreEqual(L"profiles.ini", options.profilePath.c_str());
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestTuneOptionsWithoutTuneFail)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--tune-runs", L"2",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+
+            auto [argc2, argv2] = PrepareArgs({
+                L"--mode", L"p",
+                L"--profiles", L"profiles.ini",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+                });
+            CleanupArgs(argv2);
+        }
+
+        TEST_METHOD(TestSweepMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--sweep",
+                L"--repeat", L"3",
+                L"--results", L"sweep.csv",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.sweepMode);
+            Assert::AreEqual(3, options.repeatCount);
+            Assert::AreEqual(L"sweep.csv", options.resultsPath.c_str());
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSweepWithCoresFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--sweep",
+                L"--cores", L"0,1",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSweepWithDropCache)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--sweep",
+                L"--drop-cache",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.sweepMode);
+            Assert::IsTrue(options.dropCache);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestDropCacheWithoutRepeatFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--drop-cache",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestEnergyWithRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"e,p",
+                L"--repeat", L"3",
+                L"--energy",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.measureEnergy);
+            Assert::AreEqual(3, options.repeatCount);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestEnergyWithQueryFails)
+        {
+            auto [argc, argv] = PrepareArgs({ L"--query", L"--energy" });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestThermalPolicy)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--thermal-policy", L"shift",
+                L"--temp-limit", L"90",
+                L"--poll-interval", L"250",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.thermalAction ==
+                CommandLineOptions::ThermalAction::SHIFT);
+            Assert::AreEqual(90.0, options.temperatureLimitCelsius, 1e-9);
+            Assert::AreEqual(250, options.pollIntervalMs);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestPowerBudgetRequiresThermalPolicy)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--power-budget", L"45",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestPollIntervalRequiresThermalPolicy)
+        {
+            // Giving the default value is still giving the option
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--poll-interval", L"1000",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSchedFifo)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--sched", L"fifo:50",
+                L"--ioprio", L"high",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.schedPolicy ==
+                CommandLineOptions::SchedPolicy::FIFO);
+            Assert::AreEqual(50, options.schedPriority);
+            Assert::AreEqual(3, options.ioPriority);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSchedPriorityOutOfRange)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--sched", L"rr:100",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestNiceWithPriorityFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"e",
+                L"--nice", L"10",
+                L"--priority", L"high",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestUclampWithoutMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--uclamp-max", L"256",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(256, options.uclampMax);
+            Assert::AreEqual(-1, options.uclampMin);
+            Assert::IsTrue(options.affinityMode ==
+                CommandLineOptions::CoreAffinityMode::NOT_SET);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestUclampMinAboveMaxFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--uclamp-min", L"800",
+                L"--uclamp-max", L"400",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSoftRequiresMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--uclamp-min", L"800",
+                L"--soft",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestLatencyCritical)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--latency-critical",
+                L"--memlock", L"512",
+                L"--idle-disable",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.latencyCritical);
+            Assert::AreEqual(512, options.memlockMB);
+            Assert::IsTrue(options.idleDisable);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestMemlockRequiresLatencyCritical)
+        {
+            // Giving the default value is still giving the option
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--memlock", L"256",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestLatencyCriticalWithModeFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--latency-critical",
+                L"--mode", L"e",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestFrequencyPinning)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--freq", L"min:2000000,max:4500000",
+                L"--epp", L"balance_power",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(2000000, options.freqMinKhz);
+            Assert::AreEqual(4500000, options.freqMaxKhz);
+            Assert::AreEqual(66, options.epp);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestFrequencyMinAboveMaxFails)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--freq", L"min:4000000,max:3000000",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestLlcDomain)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all",
+                L"--llc-domain", L"1",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(1, options.llcDomain);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestLlcDomainRequiresMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--latency-critical",
+                L"--llc-domain", L"0",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestMonitorInterval)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--monitor", L"run.json",
+                L"--monitor-interval", L"100",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(std::wstring(L"run.json"), options.monitorPath);
+            Assert::AreEqual(100, options.monitorIntervalMs);
+            CleanupArgs(argv);
+
+            // The thermal interval is not the monitor's
+            auto [argc2, argv2] = PrepareArgs({
+                L"--mode", L"p",
+                L"--monitor", L"run.json",
+                L"--poll-interval", L"100",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+                });
+            CleanupArgs(argv2);
+
+            auto [argc3, argv3] = PrepareArgs({
+                L"--mode", L"p",
+                L"--monitor-interval", L"1000",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc3, argv3);
+                });
+            CleanupArgs(argv3);
+        }
+
+        TEST_METHOD(TestMonitorRejectsRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--monitor", L"run.csv",
+                L"--repeat", L"3",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestFreeCoreSelector)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p:free:2",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.affinityMode ==
+                CommandLineOptions::CoreAffinityMode::P_CORES_ONLY);
+            Assert::AreEqual(2, options.freeCoreCount);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestExclusiveRejectsRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"e",
+                L"--exclusive",
+                L"--repeat", L"3",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestIdleMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"idle:4:p",
+                L"--idle-window", L"20",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.affinityMode ==
+                CommandLineOptions::CoreAffinityMode::IDLE);
+            Assert::IsTrue(options.idleClass ==
+                CommandLineOptions::CoreAffinityMode::P_CORES_ONLY);
+            Assert::AreEqual(4, options.idleCoreCount);
+            Assert::AreEqual(20, options.idleWindowMs);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestIdleWindowRequiresIdleMode)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"p",
+                L"--idle-window", L"20",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+
+            // Giving the default value is still giving the option
+            auto [argc2, argv2] = PrepareArgs({
+                L"--mode", L"p",
+                L"--idle-window", L"50",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+                });
+            CleanupArgs(argv2);
+        }
+
+        TEST_METHOD(TestParseDaemon)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--daemon",
+                L"--pipe", L"capld-test"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.daemonMode);
+            Assert::AreEqual(std::wstring(L"capld-test"), options.pipeName);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestDaemonRejectsLaunchOptions)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--daemon",
+                L"--mode", L"p",
+                L"--", L"TestExecutable.exe"
+                });
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+                });
+            CleanupArgs(argv);
+
+            // Run-time options belong to the clients as well
+            auto [argc2, argv2] = PrepareArgs({
+                L"--daemon",
+                L"--energy"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+                });
+            CleanupArgs(argv2);
+        }
+
+        TEST_METHOD(TestDaemonTakesLogging)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--daemon",
+                L"--pipe", L"capld-test",
+                L"--log"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.daemonMode);
+            Assert::IsTrue(options.enableLogging);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestParseShareTopology)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all",
+                L"--share-topology",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.shareTopology);
+            Assert::IsTrue(SchedulingResolver::Resolve(options).publishTopology);
+            Assert::IsFalse(SchedulingResolver::Resolve(options).exportTopology);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestParseExportTopology)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all",
+                L"--export-topology",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::IsTrue(options.exportTopology);
+            Assert::IsTrue(SchedulingResolver::Resolve(options).exportTopology);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestParseTrace)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all",
+                L"--trace", L"launch.json",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(std::wstring(L"launch.json"), options.tracePath);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestTraceRequiresPath)
+        {
+            auto [argc, argv] = PrepareArgs({ L"--trace" });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+            });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestParseSchedTrace)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all",
+                L"--sched-trace", L"run.sched",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(std::wstring(L"run.sched"), options.schedTracePath);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestSchedTraceRejectsRepeat)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"all", L"--repeat", L"3",
+                L"--sched-trace", L"run.sched",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+            });
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestParseAnalyze)
+        {
+            auto [argc, argv] = PrepareArgs({ L"analyze", L"run.sched" });
+            auto options = ParseCommandLine(argc, argv);
+            Assert::AreEqual(std::wstring(L"run.sched"), options.analyzePath);
+            CleanupArgs(argv);
+
+            auto [argc2, argv2] = PrepareArgs({ L"analyze" });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+            });
+            CleanupArgs(argv2);
+        }
+
+        TEST_METHOD(TestParseMetricsFile)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"e",
+                L"--metrics-file", L"job.prom",
+                L"--metrics-interval", L"1000",
+                L"--", L"TestExecutable.exe"
+                });
+
+            auto options = ParseCommandLine(argc, argv);
+
+            Assert::AreEqual(std::wstring(L"job.prom"), options.metricsPath);
+            Assert::AreEqual(1000, options.metricsIntervalMs);
+            CleanupArgs(argv);
+        }
+
+        TEST_METHOD(TestMetricsIntervalRequiresFile)
+        {
+            auto [argc, argv] = PrepareArgs({
+                L"--mode", L"e", L"--metrics-interval", L"1000",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc, argv);
+            });
+            CleanupArgs(argv);
+
+            auto [argc2, argv2] = PrepareArgs({
+                L"--mode", L"e", L"--metrics-file", L"job.prom",
+                L"--metrics-interval", L"10", L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+            });
+            CleanupArgs(argv2);
+
+            // Giving the default value is still giving the option
+            auto [argc3, argv3] = PrepareArgs({
+                L"--mode", L"e", L"--metrics-interval", L"5000",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc3, argv3);
+            });
+            CleanupArgs(argv3);
+        }
+
+        TEST_METHOD(TestParseTop)
+        {
+            auto [argc, argv] = PrepareArgs({ L"top", L"--refresh", L"500" });
+            auto options = ParseCommandLine(argc, argv);
+            Assert::IsTrue(options.topMode);
+            Assert::AreEqual(500, options.topRefreshMs);
+            CleanupArgs(argv);
+
+            auto [argc2, argv2] = PrepareArgs({ L"top", L"--refresh", L"10" });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+            });
+            CleanupArgs(argv2);
+        }
+
+        TEST_METHOD(TestParseQueryFormat)
+        {
+            auto [argc, argv] = PrepareArgs({ L"--query", L"--format", L"json" });
+            auto options = ParseCommandLine(argc, argv);
+            Assert::IsTrue(options.queryFormat ==
+                CommandLineOptions::QueryFormat::JSON);
+            CleanupArgs(argv);
+
+            auto [argc2, argv2] = PrepareArgs({
+                L"--mode", L"all", L"--format", L"json",
+                L"--", L"TestExecutable.exe"
+                });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc2, argv2);
+            });
+            CleanupArgs(argv2);
+
+            auto [argc3, argv3] = PrepareArgs({ L"--query", L"--format", L"xml" });
+            Assert::ExpectException<std::runtime_error>([&]() {
+                ParseCommandLine(argc3, argv3);
+            });
+            CleanupArgs(argv3);
+        }
+    };
+
+    TEST_CLASS(AffinityResolverTests)
+    {
+    public:
+        TEST_METHOD(TestMasksHonourAllowedSet)
+        {
+            DWORD_PTR processMask = 0, systemMask = 0;
+            GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask);
+            Assert::AreEqual(DWORD_PTR(0),
+                CpuInfo::GetAllowedMask() & ~CpuInfo::GetSystemMask());
+            if (CpuInfo::CountBits(processMask) < 2) {
+                return;
+            }
+
+            // Restrict this process the way a job object or parent would
+            DWORD_PTR allowed = processMask & (~processMask + 1);
+            Assert::IsTrue(SetProcessAffinityMask(GetCurrentProcess(), allowed));
+            DWORD_PTR all = AffinityResolver::GetModeMask(
+                CommandLineOptions::CoreAffinityMode::ALL_CORES, {});
+            DWORD_PTR inverted = AffinityResolver::InvertMask(0);
+            SetProcessAffinityMask(GetCurrentProcess(), processMask);
+
+            Assert::AreEqual(allowed, all);
+            Assert::AreEqual(allowed, inverted);
+        }
+
+        TEST_METHOD(TestPickIdlestCores)
+        {
+            // Four 2-thread cores, two L3 domains of two cores each
+            std::vector<DWORD_PTR> cores = { 0x03, 0x0C, 0x30, 0xC0 };
+            std::vector<DWORD_PTR> domains = { 0x0F, 0xF0 };
+            std::vector<double> busy = { 0.9, 0.0, 0.1, 0.1, 0.0, 0.0, 0.5, 0.5 };
+
+            // Ranked by whole-core load, one thread per core
+            Assert::AreEqual(DWORD_PTR(0x14),
+                AffinityResolver::PickIdlestCores(busy, 0xFF, 2, cores, {}));
+            // Kept in the cheaper domain, siblings last
+            Assert::AreEqual(DWORD_PTR(0x50),
+                AffinityResolver::PickIdlestCores(busy, 0xFF, 2, cores, domains));
+            Assert::AreEqual(DWORD_PTR(0x70),
+                AffinityResolver::PickIdlestCores(busy, 0xFF, 3, cores, domains));
+            // Limited to the class; no domain holds 3 of its threads
+            Assert::AreEqual(DWORD_PTR(0x34),
+                AffinityResolver::PickIdlestCores(busy, 0x3C, 3, cores, domains));
+        }
+
+        TEST_METHOD(TestRestrictToCacheDomain)
+        {
+            // Two 8-thread CCDs
+            std::vector<DWORD_PTR> domains = { 0x00FF, 0xFF00 };
+
+            Assert::AreEqual(DWORD_PTR(0x0F00),
+                AffinityResolver::RestrictToCacheDomain(0x0FF0, 1, domains));
+            Assert::AreEqual(DWORD_PTR(0),
+                AffinityResolver::RestrictToCacheDomain(0x00FF, 1, domains));
+            Assert::ExpectException<std::runtime_error>([&]() {
+                AffinityResolver::RestrictToCacheDomain(0xFFFF, 2, domains);
+                });
+        }
+    };
+
+    TEST_CLASS(BenchmarkTests)
+    {
+    public:
+        TEST_METHOD(TestStatisticsOfKnownSamples)
+        {
+            auto stats = Benchmark::ComputeStatistics({ 5.0, 1.0, 3.0, 2.0, 4.0 });
+
+            Assert::AreEqual(size_t(5), stats.count);
+            Assert::AreEqual(3.0, stats.mean, 1e-9);
+            Assert::AreEqual(3.0, stats.median, 1e-9);
+            Assert::AreEqual(1.0, stats.min, 1e-9);
+            Assert::AreEqual(5.0, stats.max, 1e-9);
+            Assert::AreEqual(1.5811388, stats.stddev, 1e-6);
+            Assert::AreEqual(4.8, stats.p95, 1e-9);
+            Assert::AreEqual(4.96, stats.p99, 1e-9);
+            // t(4) = 2.776
+            Assert::AreEqual(3.0 - 2.776 * 1.5811388 / std::sqrt(5.0), stats.ciLow, 1e-6);
+            Assert::AreEqual(3.0 + 2.776 * 1.5811388 / std::sqrt(5.0), stats.ciHigh, 1e-6);
+        }
+
+        TEST_METHOD(TestStatisticsOfSingleSample)
+        {
+            auto stats = Benchmark::ComputeStatistics({ 2.5 });
+
+            Assert::AreEqual(2.5, stats.mean, 1e-9);
+            Assert::AreEqual(2.5, stats.p99, 1e-9);
+            Assert::AreEqual(0.0, stats.stddev, 1e-9);
+            Assert::AreEqual(2.5, stats.ciLow, 1e-9);
+            Assert::AreEqual(2.5, stats.ciHigh, 1e-9);
+        }
+
+        TEST_METHOD(TestStatisticsOfNoSamples)
+        {
+            auto stats = Benchmark::ComputeStatistics({});
+
+            Assert::AreEqual(size_t(0), stats.count);
+            Assert::AreEqual(0.0, stats.mean, 1e-9);
+        }
+    };
+
+    TEST_CLASS(TunerTests)
+    {
+    private:
+        // 4 P-cores with SMT (threads 0-7), 4 E-cores (8-11), 2 LP E-cores (12-13)
+        AffinityTuner::CoreClasses MakeHybridClasses() {
+            AffinityTuner::CoreClasses classes;
+            classes.pCores = 0xFF;
+            classes.eCores = 0xF00;
+            classes.lpECores = 0x3000;
+            classes.allCores = 0x3FFF;
+            for (int core = 0; core < 4; core++) {
+                classes.physicalCores.push_back(DWORD_PTR(3) << (core * 2));
+            }
+            for (int thread = 8; thread < 14; thread++) {
+                classes.physicalCores.push_back(DWORD_PTR(1) << thread);
+            }
+            return classes;
+        }
+
+        const AffinityTuner::Candidate* Find(
+            const std::vector<AffinityTuner::Candidate>& candidates,
+            const std::wstring& label) {
+            for (const auto& candidate : candidates) {
+                if (candidate.label == label) {
+                    return &candidate;
+                }
+            }
+            return nullptr;
+        }
+
+    public:
+        TEST_METHOD_INITIALIZE(SetUp)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+        }
+
+        TEST_METHOD(TestHybridCandidates)
+        {
+            auto candidates = AffinityTuner::GenerateCandidates(MakeHybridClasses());
+
+            Assert::IsNotNull(Find(candidates, L"p"));
+            Assert::AreEqual(DWORD_PTR(0x55), Find(candidates, L"p-nosmt")->mask);
+            Assert::AreEqual(DWORD_PTR(0xFFF), Find(candidates, L"p+e")->mask);
+            Assert::AreEqual(DWORD_PTR(0x3000), Find(candidates, L"lp")->mask);
+            Assert::AreEqual(DWORD_PTR(0x05), Find(candidates, L"2-cores")->mask);
+            Assert::AreEqual(DWORD_PTR(0x01), Find(candidates, L"1-cores")->mask);
+
+            // Candidates with identical masks are only timed once
+            std::set<DWORD_PTR> masks;
+            for (const auto& candidate : candidates) {
+                Assert::IsTrue(masks.insert(candidate.mask).second);
+            }
+        }
+
+        TEST_METHOD(TestNonHybridCandidates)
+        {
+            AffinityTuner::CoreClasses classes;
+            classes.allCores = 0xF;
+            classes.physicalCores = { 0x3, 0xC };
+
+            auto candidates = AffinityTuner::GenerateCandidates(classes);
+
+            Assert::IsNull(Find(candidates, L"p"));
+            Assert::AreEqual(DWORD_PTR(0x5), Find(candidates, L"all-nosmt")->mask);
+        }
+
+        TEST_METHOD(TestPruneLosers)
+        {
+            std::vector<AffinityTuner::Candidate> candidates(3);
+            candidates[0].wallSeconds = { 1.0 };
+            candidates[1].wallSeconds = { 1.1 };
+            candidates[2].wallSeconds = { 2.0 };
+
+            AffinityTuner::PruneLosers(candidates, 1.5);
+
+            Assert::IsFalse(candidates[0].pruned);
+            Assert::IsFalse(candidates[1].pruned);
+            Assert::IsTrue(candidates[2].pruned);
+        }
+
+        TEST_METHOD(TestProfileRoundTrip)
+        {
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring database = std::wstring(tempDir) + L"capl_test_profiles.ini";
+            DeleteFileW(database.c_str());
+
+            ProfileStore::Profile profile;
+            profile.mask = 0x55;
+            profile.label = L"p-nosmt";
+            profile.wallSeconds = 1.25;
+            ProfileStore::Save(database, L"C:\\Tools\\Program.exe", profile);
+
+            // Lookups ignore the case of the executable path
+            auto loaded = ProfileStore::Load(database, L"c:\\tools\\program.exe");
+            Assert::IsTrue(loaded.has_value());
+            Assert::AreEqual(DWORD_PTR(0x55), loaded->mask);
+            Assert::AreEqual(L"p-nosmt", loaded->label.c_str());
+            Assert::AreEqual(1.25, loaded->wallSeconds, 1e-9);
+
+            Assert::IsFalse(ProfileStore::Load(database, L"C:\\Other.exe").has_value());
+            DeleteFileW(database.c_str());
+        }
+    };
+
+    TEST_CLASS(SweepTests)
+    {
+    public:
+        TEST_METHOD(TestStepsSpreadAcrossCacheDomains)
+        {
+            // 4 single-threaded E-cores in two L2 clusters: {8,9} and {10,11}
+            std::vector<DWORD_PTR> cores = { 0x100, 0x200, 0x400, 0x800 };
+            std::vector<DWORD_PTR> l2 = { 0x300, 0xC00 };
+
+            auto steps = ScalabilitySweep::BuildSteps(0xF00, cores, l2);
+
+            Assert::AreEqual(size_t(4), steps.size());
+            Assert::AreEqual(DWORD_PTR(0x100), steps[0]);
+            Assert::AreEqual(DWORD_PTR(0x500), steps[1]);  // Other cluster next
+            Assert::AreEqual(DWORD_PTR(0x700), steps[2]);
+            Assert::AreEqual(DWORD_PTR(0xF00), steps[3]);
+        }
+
+        TEST_METHOD(TestStepsAddSmtSiblingsLast)
+        {
+            // 2 P-cores with SMT: threads {0,1} and {2,3}
+            std::vector<DWORD_PTR> cores = { 0x3, 0xC };
+
+            auto steps = ScalabilitySweep::BuildSteps(0xF, cores, {});
+
+            Assert::AreEqual(size_t(4), steps.size());
+            Assert::AreEqual(DWORD_PTR(0x1), steps[0]);
+            Assert::AreEqual(DWORD_PTR(0x5), steps[1]);
+            Assert::AreEqual(DWORD_PTR(0x7), steps[2]);
+            Assert::AreEqual(DWORD_PTR(0xF), steps[3]);
+        }
+
+        TEST_METHOD(TestScaling)
+        {
+            std::vector<ScalabilitySweep::StepResult> steps(2);
+            steps[0].threads = 1;
+            steps[0].wallSeconds = 4.0;
+            steps[1].threads = 2;
+            steps[1].wallSeconds = 2.5;
+
+            ScalabilitySweep::ComputeScaling(steps);
+
+            Assert::AreEqual(0.25, steps[0].throughput, 1e-9);
+            Assert::AreEqual(1.6, steps[1].speedup, 1e-9);
+            Assert::AreEqual(0.8, steps[1].efficiency, 1e-9);
+        }
+    };
+
+    TEST_CLASS(EnergyTests)
+    {
+    private:
+        // Replays scripted counter readings instead of real RAPL devices
+        class FakeEnergyMeter : public EnergyMeter {
+        public:
+            std::vector<std::vector<EnergyCounter>> readings;
+            size_t next = 0;
+
+            std::vector<EnergyCounter> Read() override {
+                return readings[next++];
+            }
+        };
+
+        static EnergyCounter Counter(const wchar_t* domain, ULONGLONG raw,
+            ULONGLONG range = 0) {
+            EnergyCounter counter;
+            counter.domain = domain;
+            counter.raw = raw;
+            counter.range = range;
+            counter.joulesPerUnit = 1e-6;  // Microjoules, like powercap
+            return counter;
+        }
+
+    public:
+        TEST_METHOD(TestCounterDelta)
+        {
+            Assert::AreEqual(ULONGLONG(50), EnergyProfiler::CounterDelta(100, 150, 1000));
+            // Wrapped at the advertised range
+            Assert::AreEqual(ULONGLONG(150), EnergyProfiler::CounterDelta(900, 50, 1000));
+            // Full 64-bit counters wrap naturally
+            Assert::AreEqual(ULONGLONG(20), EnergyProfiler::CounterDelta(~0ULL - 9, 10, 0));
+        }
+
+        TEST_METHOD(TestProfilerReport)
+        {
+            FakeEnergyMeter meter;
+            meter.readings = {
+                { Counter(L"package", 262000000000ULL, 262143328850ULL),
+                  Counter(L"core", 1000000) },
+                { Counter(L"package", 1856672, 262143328850ULL),
+                  Counter(L"core", 5000000) },
+            };
+
+            EnergyProfiler profiler(meter);
+            profiler.Start();
+            auto report = profiler.Stop(2.0);
+
+            // 262143.32885 J range: wrapped from 262000 J to 1.856672 J
+            Assert::AreEqual(size_t(2), report.domains.size());
+            Assert::AreEqual(145.185522, report.packageJoules, 1e-6);
+            Assert::AreEqual(4.0, report.domains[1].joules, 1e-9);
+            Assert::AreEqual(145.185522 / 2.0, report.averageWatts, 1e-6);
+            Assert::AreEqual(145.185522 * 2.0, report.energyDelay, 1e-6);
+        }
+
+        TEST_METHOD(TestReportWithoutPackageDomain)
+        {
+            auto report = EnergyProfiler::BuildReport(
+                { Counter(L"core", 0), Counter(L"uncore", 0) },
+                { Counter(L"core", 3000000), Counter(L"uncore", 1000000) },
+                1.0);
+
+            Assert::AreEqual(4.0, report.packageJoules, 1e-9);
+        }
+
+        TEST_METHOD(TestFailedReadKeepsChannelsAligned)
+        {
+            // The first device failed after the run; its slots stay in place
+            EnergyCounter failed = Counter(L"package", 0);
+            failed.valid = false;
+            auto report = EnergyProfiler::BuildReport(
+                { Counter(L"package", 0), Counter(L"dram", 0) },
+                { failed, Counter(L"dram", 2000000) },
+                1.0);
+
+            Assert::AreEqual(size_t(1), report.domains.size());
+            Assert::AreEqual(L"dram", report.domains[0].name.c_str());
+            Assert::AreEqual(2.0, report.domains[0].joules, 1e-9);
+        }
+    };
+
+    TEST_CLASS(ThermalPolicyTests)
+    {
+    private:
+        static constexpr DWORD_PTR P_CORES = 0x0F;
+        static constexpr DWORD_PTR E_CORES = 0xF0;
+
+        static ThermalPolicy MakePolicy(ThermalPolicy::Action action) {
+            ThermalPolicy::Settings settings;
+            settings.action = action;
+            settings.powerBudgetWatts = 30.0;
+            settings.temperatureLimitCelsius = 95.0;
+            settings.recoverySamples = 2;
+            ThermalPolicy policy(settings, P_CORES, E_CORES, nullptr);
+            policy.OnStart(NULL, 0, 0x03);
+            return policy;
+        }
+
+        static ThermalSample Sample(double watts, double celsius, double ratio) {
+            ThermalSample sample;
+            sample.hasPower = true;
+            sample.packageWatts = watts;
+            sample.hasTemperature = true;
+            sample.maxZoneCelsius = celsius;
+            sample.hasFrequency = true;
+            sample.pCoreLimitRatio = ratio;
+            return sample;
+        }
+
+    public:
+        TEST_METHOD(TestShiftOnThrottleAndRecover)
+        {
+            auto policy = MakePolicy(ThermalPolicy::Action::SHIFT);
+            std::wstring reason;
+
+            Assert::IsFalse(policy.Evaluate(Sample(20.0, 70.0, 1.0), reason));
+            Assert::AreEqual(DWORD_PTR(0x03), policy.GetTargetMask());
+
+            Assert::IsTrue(policy.Evaluate(Sample(20.0, 70.0, 0.6), reason));
+            Assert::IsTrue(policy.IsDegraded());
+            Assert::AreEqual(E_CORES, policy.GetTargetMask());
+
+            // Needs two healthy samples in a row before moving back
+            Assert::IsFalse(policy.Evaluate(Sample(20.0, 70.0, 1.0), reason));
+            Assert::IsFalse(policy.Evaluate(Sample(20.0, 99.0, 1.0), reason));
+            Assert::IsFalse(policy.Evaluate(Sample(20.0, 70.0, 1.0), reason));
+            Assert::IsTrue(policy.Evaluate(Sample(20.0, 70.0, 1.0), reason));
+            Assert::AreEqual(DWORD_PTR(0x03), policy.GetTargetMask());
+        }
+
+        TEST_METHOD(TestWidenOnPowerBudget)
+        {
+            auto policy = MakePolicy(ThermalPolicy::Action::WIDEN);
+            std::wstring reason;
+
+            Assert::IsTrue(policy.Evaluate(Sample(42.0, 70.0, 1.0), reason));
+            Assert::AreEqual(DWORD_PTR(0xF3), policy.GetTargetMask());
+            Assert::IsTrue(reason.find(L"budget") != std::wstring::npos);
+        }
+
+        TEST_METHOD(TestMissingSensorsNeverDegrade)
+        {
+            auto policy = MakePolicy(ThermalPolicy::Action::SHIFT);
+            std::wstring reason;
+
+            Assert::IsFalse(policy.Evaluate(ThermalSample(), reason));
+            Assert::IsFalse(policy.IsDegraded());
+        }
+    };
+
+    TEST_CLASS(SchedulingTests)
+    {
+    public:
+        TEST_METHOD(TestNiceToPriorityClass)
+        {
+            Assert::AreEqual(DWORD(HIGH_PRIORITY_CLASS), SchedulingResolver::NiceToPriorityClass(-20));
+            Assert::AreEqual(DWORD(ABOVE_NORMAL_PRIORITY_CLASS), SchedulingResolver::NiceToPriorityClass(-5));
+            Assert::AreEqual(DWORD(NORMAL_PRIORITY_CLASS), SchedulingResolver::NiceToPriorityClass(0));
+            Assert::AreEqual(DWORD(BELOW_NORMAL_PRIORITY_CLASS), SchedulingResolver::NiceToPriorityClass(10));
+            Assert::AreEqual(DWORD(IDLE_PRIORITY_CLASS), SchedulingResolver::NiceToPriorityClass(19));
+        }
+
+        TEST_METHOD(TestRealtimeToThreadPriority)
+        {
+            Assert::AreEqual(-7, SchedulingResolver::RealtimeToThreadPriority(1));
+            Assert::AreEqual(6, SchedulingResolver::RealtimeToThreadPriority(99));
+        }
+
+        TEST_METHOD(TestResolveBatch)
+        {
+            CommandLineOptions options;
+            options.schedPolicy = CommandLineOptions::SchedPolicy::BATCH;
+            options.ecoQos = true;
+
+            auto settings = SchedulingResolver::Resolve(options);
+
+            Assert::AreEqual(DWORD(BELOW_NORMAL_PRIORITY_CLASS), settings.priorityClass);
+            Assert::IsFalse(settings.setThreadPriority);
+            Assert::IsTrue(settings.ecoQos);
+            Assert::AreEqual(-1, settings.ioPriority);
+        }
+
+        TEST_METHOD(TestResolveLatencyCritical)
+        {
+            CommandLineOptions options;
+            options.latencyCritical = true;
+
+            auto settings = SchedulingResolver::Resolve(options);
+
+            Assert::AreEqual(DWORD(REALTIME_PRIORITY_CLASS), settings.priorityClass);
+            Assert::IsTrue(settings.setThreadPriority);
+            Assert::IsTrue(settings.highQos);
+            Assert::IsFalse(settings.ecoQos);
+        }
+
+        TEST_METHOD(TestResolveUclamp)
+        {
+            CommandLineOptions options;
+            options.uclampMax = 300;
+            auto background = SchedulingResolver::Resolve(options);
+            Assert::IsTrue(background.ecoQos);
+            Assert::IsFalse(background.highQos);
+
+            options.uclampMax = -1;
+            options.uclampMin = 900;
+            auto interactive = SchedulingResolver::Resolve(options);
+            Assert::IsFalse(interactive.ecoQos);
+            Assert::IsTrue(interactive.highQos);
+
+            // A mid-range floor is neutral
+            options.uclampMin = 200;
+            auto neutral = SchedulingResolver::Resolve(options);
+            Assert::IsFalse(neutral.ecoQos || neutral.highQos);
+        }
+    };
+
+    // Checks the priority and QoS a launched child actually runs with
+    TEST_CLASS(AppliedSchedulingTests)
+    {
+    private:
+        // Starts TestExecutable with settings and returns what it runs with
+        static void StartAndInspect(const std::wstring& executable,
+            const SchedulingSettings& settings, DWORD& priorityClass,
+            int& threadPriority, ULONG& throttlingState) {
+            PROCESS_INFORMATION info = {};
+            Assert::IsTrue(ProcessManager::StartProcess(executable,
+                { L"--work", L"5000", L"--threads", L"1", L"--no-progress" },
+                L"", 0x1, settings, info));
+
+            priorityClass = GetPriorityClass(info.hProcess);
+            threadPriority = GetThreadPriority(info.hThread);
+            PROCESS_POWER_THROTTLING_STATE throttling = {};
+            throttling.Version = PROCESS_POWER_THROTTLING_CURRENT_VERSION;
+            throttlingState = GetProcessInformation(info.hProcess,
+                ProcessPowerThrottling, &throttling, sizeof(throttling))
+                ? throttling.StateMask : ~0UL;
+
+            TerminateProcess(info.hProcess, 0);
+            WaitForSingleObject(info.hProcess, 5000);
+            CloseHandle(info.hThread);
+            CloseHandle(info.hProcess);
+        }
+
+    public:
+        TEST_METHOD_INITIALIZE(SetUp)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+        }
+
+        TEST_METHOD(TestIdleEcoQosIsApplied)
+        {
+            std::wstring executable = FindTestExecutable();
+
+            CommandLineOptions options;
+            options.schedPolicy = CommandLineOptions::SchedPolicy::IDLE;
+            options.ecoQos = true;
+            auto settings = SchedulingResolver::Resolve(options);
+
+            DWORD priorityClass = 0;
+            int threadPriority = 0;
+            ULONG throttling = 0;
+            StartAndInspect(executable, settings, priorityClass,
+                threadPriority, throttling);
+
+            Assert::AreEqual(DWORD(IDLE_PRIORITY_CLASS), priorityClass);
+            Assert::AreEqual(ULONG(PROCESS_POWER_THROTTLING_EXECUTION_SPEED),
+                throttling & PROCESS_POWER_THROTTLING_EXECUTION_SPEED);
+        }
+
+        TEST_METHOD(TestThreadPriorityAndHighQosAreApplied)
+        {
+            std::wstring executable = FindTestExecutable();
+
+            // Realtime needs SeIncreaseBasePriorityPrivilege, so the test
+            // stays below it
+            SchedulingSettings settings;
+            settings.priorityClass = ABOVE_NORMAL_PRIORITY_CLASS;
+            settings.setThreadPriority = true;
+            settings.threadPriority = THREAD_PRIORITY_HIGHEST;
+            settings.highQos = true;
+
+            DWORD priorityClass = 0;
+            int threadPriority = 0;
+            ULONG throttling = 0;
+            StartAndInspect(executable, settings, priorityClass,
+                threadPriority, throttling);
+
+            Assert::AreEqual(DWORD(ABOVE_NORMAL_PRIORITY_CLASS), priorityClass);
+            Assert::AreEqual(int(THREAD_PRIORITY_HIGHEST), threadPriority);
+            Assert::AreEqual(ULONG(0),
+                throttling & PROCESS_POWER_THROTTLING_EXECUTION_SPEED);
+        }
+
+        TEST_METHOD(TestSoftHintWithoutCpuSetsFails)
+        {
+            if (GetActiveProcessorCount(0) >= sizeof(DWORD_PTR) * 8) {
+                Logger::WriteMessage(L"Needs a free mask bit; skipped");
+                return;
+            }
+            std::wstring executable = FindTestExecutable();
+
+            // No processor has the top bit, so no CPU set matches
+            SchedulingSettings soft;
+            soft.softAffinity = true;
+            PROCESS_INFORMATION info = {};
+            Assert::IsFalse(ProcessManager::StartProcess(executable,
+                { L"--work", L"10", L"--no-progress" }, L"",
+                DWORD_PTR(1) << (sizeof(DWORD_PTR) * 8 - 1), soft, info));
+            Assert::AreEqual(DWORD(ERROR_INVALID_PARAMETER), GetLastError());
+        }
+
+        // Compares hard masks with the soft hints on a hybrid CPU; the
+        // timings are written to the test log for inspection
+        TEST_METHOD(TestSoftHintsAgainstHardAffinity)
+        {
+            if (!CpuInfo::GetCapabilities().isHybrid) {
+                Logger::WriteMessage(L"Needs a hybrid CPU; skipped");
+                return;
+            }
+            std::wstring executable = FindTestExecutable();
+
+            DWORD_PTR pCores = CpuInfo::GetPCoreMask();
+            DWORD_PTR eCores = CpuInfo::GetECoreMask() | CpuInfo::GetLpECoreMask();
+            DWORD_PTR allCores = pCores | eCores;
+
+            SchedulingSettings hard;
+            SchedulingSettings softE;
+            softE.softAffinity = true;
+            SchedulingSettings eco;
+            eco.ecoQos = true;
+            SchedulingSettings high;
+            high.highQos = true;
+
+            struct Variant {
+                const wchar_t* name;
+                DWORD_PTR mask;
+                SchedulingSettings settings;
+            };
+            std::vector<Variant> variants = {
+                { L"hard P-cores", pCores, hard },
+                { L"hard E-cores", eCores, hard },
+                { L"soft E-cores (CPU sets)", eCores, softE },
+                { L"uclamp-max 256 (EcoQoS)", allCores, eco },
+                { L"uclamp-min 1024 (HighQoS)", allCores, high },
+            };
+
+            for (const auto& variant : variants) {
+                ProcessStats stats;
+                Assert::IsTrue(ProcessManager::LaunchProcess(executable,
+                    { L"--work", L"300", L"--threads", L"2", L"--no-progress" },
+                    L"", variant.mask, &stats, {}, variant.settings));
+                Logger::WriteMessage(std::format(L"{:<28} {:.3f} s\n",
+                    variant.name, stats.wallSeconds).c_str());
+            }
+        }
+    };
+
+    TEST_CLASS(FrequencyPinningTests)
+    {
+    private:
+        using Values = std::map<std::wstring, std::pair<DWORD, DWORD>>;
+
+        // Keeps AC/DC values in a map owned by the test
+        class FakePowerStore : public PowerSettingStore {
+        public:
+            explicit FakePowerStore(Values& values) : values(values) {}
+
+            bool Read(const PowerSetting& setting, DWORD& ac, DWORD& dc) override {
+                auto it = values.find(setting.name);
+                if (it == values.end()) {
+                    return false;
+                }
+                ac = it->second.first;
+                dc = it->second.second;
+                return true;
+            }
+
+            bool Write(const PowerSetting& setting, DWORD ac, DWORD dc) override {
+                values[setting.name] = { ac, dc };
+                return true;
+            }
+
+            bool Apply() override {
+                return true;
+            }
+
+            std::wstring GetPlanId() const override {
+                return L"{381b4222-f694-41f0-9685-ff5bb260df2e}";
+            }
+
+            Values& values;
+        };
+
+        std::wstring journal;
+        std::wstring other;
+
+        static Values DefaultValues() {
+            return {
+                { L"PROCTHROTTLEMIN1", { 5, 5 } },
+                { L"PROCFREQMAX1", { 0, 0 } },
+                { L"PERFEPP1", { 33, 50 } },
+            };
+        }
+
+    public:
+        TEST_METHOD_INITIALIZE(SetUp)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            // Named like the launcher's journals, so runs see each other
+            journal = std::wstring(tempDir) + L"capl_power_journal_test.ini";
+            other = std::wstring(tempDir) + L"capl_power_journal_test2.ini";
+            DeleteFileW(journal.c_str());
+            DeleteFileW(other.c_str());
+        }
+
+        TEST_METHOD_CLEANUP(TearDown)
+        {
+            DeleteFileW(journal.c_str());
+            DeleteFileW(other.c_str());
+        }
+
+        TEST_METHOD(TestPlanChangesForPCores)
+        {
+            FrequencyPinning::Request request;
+            request.minKhz = 2500000;
+            request.epp = 0;
+            FrequencyPinning::Target target;
+            target.performanceClass = true;
+            target.maxMhz = 5000;
+
+            auto changes = FrequencyPinning::PlanChanges(request, target);
+
+            // Only the class 1 settings; 2.5 GHz of 5 GHz is 50%
+            Assert::AreEqual(size_t(2), changes.size());
+            Assert::AreEqual(L"PROCTHROTTLEMIN1", changes[0].setting->name);
+            Assert::AreEqual(DWORD(50), changes[0].value);
+            Assert::AreEqual(L"PERFEPP1", changes[1].setting->name);
+            Assert::AreEqual(DWORD(0), changes[1].value);
+        }
+
+        TEST_METHOD(TestPlanChangesForIdleDisable)
+        {
+            FrequencyPinning::Request request;
+            request.disableIdle = true;
+
+            // Not tied to a core class
+            auto changes = FrequencyPinning::PlanChanges(request,
+                FrequencyPinning::Target());
+
+            Assert::AreEqual(size_t(1), changes.size());
+            Assert::AreEqual(L"IDLEDISABLE", changes[0].setting->name);
+            Assert::AreEqual(DWORD(1), changes[0].value);
+        }
+
+        TEST_METHOD(TestPinAndRestore)
+        {
+            Values values = DefaultValues();
+            FrequencyPinning::Request request;
+            request.maxKhz = 3000000;
+            request.epp = 100;
+            FrequencyPinning::Target target;
+            target.performanceClass = true;
+            target.maxMhz = 5000;
+
+            {
+                FrequencyPinning pinning(request, target,
+                    std::make_unique<FakePowerStore>(values), journal);
+                pinning.Pin();
+
+                Assert::AreEqual(DWORD(3000), values[L"PROCFREQMAX1"].first);
+                Assert::AreEqual(DWORD(100), values[L"PERFEPP1"].second);
+                Assert::IsTrue(Utilities::PathExists(journal));
+            }
+
+            Assert::IsTrue(values == DefaultValues());
+            Assert::IsFalse(Utilities::PathExists(journal));
+        }
+
+        TEST_METHOD(TestPinnedSettingIsNotPinnedAgain)
+        {
+            Values values = DefaultValues();
+            FrequencyPinning::Request request;
+            request.epp = 100;
+            FrequencyPinning::Target target;
+            target.performanceClass = true;
+
+            {
+                FrequencyPinning first(request, target,
+                    std::make_unique<FakePowerStore>(values), journal);
+                first.Pin();
+
+                // A second run would journal 100 as the original
+                FrequencyPinning::Request overlapping;
+                overlapping.epp = 0;
+                FrequencyPinning second(overlapping, target,
+                    std::make_unique<FakePowerStore>(values), other);
+                Assert::ExpectException<std::runtime_error>([&]() {
+                    second.Pin();
+                    });
+                Assert::IsFalse(Utilities::PathExists(other));
+                Assert::AreEqual(DWORD(100), values[L"PERFEPP1"].first);
+
+                // Other settings are free to pin
+                FrequencyPinning::Request disjoint;
+                disjoint.maxKhz = 3000000;
+                FrequencyPinning third(disjoint, target,
+                    std::make_unique<FakePowerStore>(values), other);
+                third.Pin();
+                Assert::AreEqual(DWORD(3000), values[L"PROCFREQMAX1"].first);
+            }
+
+            Assert::IsTrue(values == DefaultValues());
+        }
+
+        TEST_METHOD(TestRecoverAfterCrash)
+        {
+            Values values = DefaultValues();
+            FrequencyPinning::Request request;
+            request.epp = 100;
+            FrequencyPinning::Target target;
+            target.performanceClass = true;
+
+            // Keep a copy of the journal as a crashed run would have left it
+            std::wstring crashed = journal + L".crashed";
+            {
+                FrequencyPinning pinning(request, target,
+                    std::make_unique<FakePowerStore>(values), journal);
+                pinning.Pin();
+                CopyFileW(journal.c_str(), crashed.c_str(), FALSE);
+            }
+            values[L"PERFEPP1"] = { 100, 100 };
+
+            FakePowerStore store(values);
+            Assert::IsTrue(FrequencyPinning::RecoverJournal(crashed, store));
+            Assert::IsTrue(values == DefaultValues());
+            Assert::IsFalse(Utilities::PathExists(crashed));
+            Assert::IsFalse(FrequencyPinning::RecoverJournal(crashed, store));
+        }
+
+        TEST_METHOD(TestJournalOwnerIsChecked)
+        {
+            Values values = DefaultValues();
+            FrequencyPinning::Request request;
+            request.epp = 100;
+            FrequencyPinning::Target target;
+            target.performanceClass = true;
+
+            FrequencyPinning pinning(request, target,
+                std::make_unique<FakePowerStore>(values), journal);
+            pinning.Pin();
+
+            // Written by this process, which is still running
+            Assert::IsTrue(FrequencyPinning::IsJournalOwnerAlive(journal));
+
+            // The same id with another creation time is a reused id
+            WritePrivateProfileStringW(L"Journal", L"Created", L"1",
+                journal.c_str());
+            Assert::IsFalse(FrequencyPinning::IsJournalOwnerAlive(journal));
+
+            // Journals without an owner come from older versions
+            WritePrivateProfileStringW(L"Journal", L"Pid", NULL,
+                journal.c_str());
+            Assert::IsFalse(FrequencyPinning::IsJournalOwnerAlive(journal));
+        }
+
+        TEST_METHOD(TestUnreadableJournalIsDiscarded)
+        {
+            WritePrivateProfileStringW(L"Journal", L"Plan", L"not-a-guid",
+                journal.c_str());
+            WritePrivateProfileStringW(L"Journal", L"Settings", L"PERFEPP1",
+                journal.c_str());
+
+            Assert::IsFalse(FrequencyPinning::RecoverJournal(journal));
+            Assert::IsFalse(Utilities::PathExists(journal));
+        }
+
+        TEST_METHOD(TestJournalPathIsPerRun)
+        {
+            std::wstring frequency = FrequencyPinning::GetDefaultJournalPath();
+            std::wstring idle = FrequencyPinning::GetDefaultJournalPath(L"idle");
+
+            Assert::AreNotEqual(frequency, idle);
+            Assert::IsTrue(frequency.find(std::format(L"_{}_",
+                GetCurrentProcessId())) != std::wstring::npos);
+        }
+    };
+
+    TEST_CLASS(ResourceMonitorTests)
+    {
+    public:
+        TEST_METHOD(TestUtilization)
+        {
+            std::vector<CpuLoadSampler::Times> before = {
+                { 100, 200 }, { 100, 200 }, { 100, 200 } };
+            std::vector<CpuLoadSampler::Times> after = {
+                { 200, 300 }, { 125, 300 }, { 100, 200 } };
+
+            auto busy = CpuLoadSampler::Utilization(before, after);
+
+            Assert::AreEqual(size_t(3), busy.size());
+            Assert::AreEqual(0.0, busy[0], 1e-9);
+            Assert::AreEqual(0.75, busy[1], 1e-9);
+            Assert::AreEqual(0.0, busy[2], 1e-9); // No time passed
+            Assert::AreEqual(0.375, CpuLoadSampler::Average(busy, 0x3), 1e-9);
+        }
+
+        TEST_METHOD(TestSummarize)
+        {
+            ResourceSample first;
+            first.seconds = 1.0;
+            first.cycles = 1000;
+            first.workingSetBytes = 4096;
+            first.pageFaults = 10;
+            first.readBytes = 100;
+            first.domainBusy = { 0.2, 0.6 };
+            ResourceSample second = first;
+            second.seconds = 2.0;
+            second.workingSetBytes = 2048;
+            second.domainBusy = { 0.4, 0.2 };
+
+            auto summary = ResourceMonitor::Summarize({ first, second }, 2);
+
+            Assert::AreEqual(2.0, summary.seconds, 1e-9);
+            Assert::AreEqual(2000ULL, summary.totalCycles);
+            Assert::AreEqual(SIZE_T(4096), summary.peakWorkingSetBytes);
+            Assert::AreEqual(20ULL, summary.totalPageFaults);
+            Assert::AreEqual(200ULL, summary.totalReadBytes);
+            Assert::AreEqual(0.3, summary.meanDomainBusy[0], 1e-9);
+            Assert::AreEqual(0.6, summary.peakDomainBusy[1], 1e-9);
+            Assert::IsFalse(summary.hasLlc);
+        }
+
+        TEST_METHOD(TestSummarizeLlcCounters)
+        {
+            ResourceSample first;
+            first.hasLlc = true;
+            first.llcMisses = 300;
+            first.llcReferences = 1000;
+            ResourceSample second = first;
+            second.llcMisses = 100;
+
+            auto summary = ResourceMonitor::Summarize({ first, second }, 0);
+
+            Assert::IsTrue(summary.hasLlc);
+            Assert::AreEqual(400ULL, summary.totalLlcMisses);
+            Assert::AreEqual(2000ULL, summary.totalLlcReferences);
+        }
+
+        TEST_METHOD(TestMonitorWritesLlcColumns)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+            std::wstring executable = FindTestExecutable();
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring path = std::wstring(tempDir) + L"capl_test_monitor.csv";
+
+            ResourceMonitor monitor(50, { AffinityResolver::GetAllCoresMask() });
+            Assert::IsTrue(ProcessManager::LaunchProcess(executable,
+                { L"--work", L"200", L"--threads", L"1", L"--no-progress" },
+                L"", AffinityResolver::GetAllCoresMask(), nullptr,
+                { &monitor }));
+            monitor.WriteResults(path);
+
+            std::ifstream in(path);
+            std::string header;
+            std::getline(in, header);
+            in.close();
+            DeleteFileW(path.c_str());
+            Assert::IsTrue(header.find(",llc_misses,llc_references") !=
+                std::string::npos);
+
+            // Elevated runs on a PMU with LLC sources also count misses;
+            // the rest fall back to the process counters
+            auto summary = ResourceMonitor::Summarize(monitor.GetSamples(), 1);
+            Logger::WriteMessage(summary.hasLlc
+                ? L"LLC counters read\n" : L"LLC counters not available\n");
+            Assert::IsTrue(summary.totalCycles > 0);
+            if (summary.hasLlc) {
+                Assert::IsTrue(summary.totalLlcReferences > 0);
+            }
+        }
+    };
+
+    TEST_CLASS(CoreReservationTests)
+    {
+    public:
+        TEST_METHOD_INITIALIZE(SetUp)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+        }
+
+        TEST_METHOD(TestPickFreeCoresPrefersIdlePhysicalCores)
+        {
+            // Four cores with two threads each; core 0 is half taken
+            std::vector<DWORD_PTR> cores = { 0x03, 0x0C, 0x30, 0xC0 };
+
+            Assert::AreEqual(DWORD_PTR(0x14),
+                CoreReservation::PickFreeCores(0xFF, 0x01, 2, cores));
+            // Siblings are used once every idle core has a thread
+            Assert::AreEqual(DWORD_PTR(0x56),
+                CoreReservation::PickFreeCores(0xFF, 0x01, 4, cores));
+            Assert::AreEqual(DWORD_PTR(0x00),
+                CoreReservation::PickFreeCores(0x03, 0x03, 1, cores));
+        }
+
+        TEST_METHOD(TestExclusiveConflict)
+        {
+            auto first = CoreReservation::Acquire(0x3, 0, true);
+            Assert::AreEqual(DWORD_PTR(0x3), first->GetMask());
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                CoreReservation::Acquire(0x2, 0, true);
+                });
+
+            first->Release();
+            auto second = CoreReservation::Acquire(0x2, 0, true);
+            Assert::AreEqual(DWORD_PTR(0x2), second->GetMask());
+        }
+
+        TEST_METHOD(TestPlainLaunchAvoidsExclusiveCores)
+        {
+            auto exclusive = CoreReservation::Acquire(0x3, 0, true);
+
+            // Only the cores nobody holds exclusively are left
+            auto plain = CoreReservation::Acquire(0x7, 0, false);
+            Assert::AreEqual(DWORD_PTR(0x4), plain->GetMask());
+            Assert::ExpectException<std::runtime_error>([&]() {
+                CoreReservation::Acquire(0x3, 0, false);
+                });
+
+            exclusive->Release();
+            auto later = CoreReservation::Acquire(0x3, 0, false);
+            Assert::AreEqual(DWORD_PTR(0x3), later->GetMask());
+        }
+
+        TEST_METHOD(TestConcurrentFreeLaunchesNeverOverlap)
+        {
+            // Far more launches than cores, so most attempts collide with
+            // a racing one or find every core taken and have to retry
+            const int LAUNCHES = 256;
+            const int ROUNDS = 4;
+            std::atomic<DWORD_PTR> occupied{ 0 };
+            std::atomic<int> overlaps{ 0 };
+            std::atomic<int> granted{ 0 };
+            std::atomic<int> refused{ 0 };
+
+            std::vector<std::thread> threads;
+            for (int i = 0; i < LAUNCHES; i++) {
+                threads.emplace_back([&]() {
+                    for (int round = 0; round < ROUNDS; round++) {
+                        try {
+                            auto reservation = CoreReservation::Acquire(
+                                ~DWORD_PTR(0), 1, false);
+                            DWORD_PTR mask = reservation->GetMask();
+                            if (occupied.fetch_or(mask) & mask) {
+                                overlaps++;
+                            }
+                            granted++;
+                            Sleep(1);
+                            occupied.fetch_and(~mask);
+                            reservation->Release();
+                        } catch (const std::runtime_error&) {
+                            refused++;  // Every core held at that moment
+                        }
+                    }
+                    });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+
+            Logger::WriteMessage(std::format(L"{} granted, {} refused\n",
+                granted.load(), refused.load()).c_str());
+            Assert::AreEqual(0, overlaps.load());
+            Assert::AreEqual(LAUNCHES * ROUNDS, granted.load() + refused.load());
+            Assert::IsTrue(granted.load() > 0);
+        }
+    };
+
+    TEST_CLASS(LaunchDaemonTests)
+    {
+    public:
+        TEST_METHOD_INITIALIZE(SetUp)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+        }
+
+        TEST_METHOD(TestRequestRoundTrip)
+        {
+            std::vector<std::wstring> args = {
+                L"--mode", L"e", L"--", L"C:\\Program Files\\job.exe", L"" };
+
+            std::wstring workingDir;
+            auto decoded = LaunchDaemon::DecodeRequest(
+                LaunchDaemon::EncodeRequest(L"C:\\Work", args), workingDir);
+
+            Assert::AreEqual(std::wstring(L"C:\\Work"), workingDir);
+            Assert::IsTrue(decoded == args);
+        }
+
+        TEST_METHOD(TestResolveClientDirectory)
+        {
+            std::vector<std::wstring> args = { L"--dir", L"build\\..\\out",
+                L"--mode", L"p", L"--", L"job.exe", L"--dir", L"data" };
+            LaunchDaemon::ResolveClientDirectory(args, L"C:\\Work");
+
+            std::vector<std::wstring> expected = { L"--dir", L"C:\\Work\\out",
+                L"--mode", L"p", L"--", L"job.exe", L"--dir", L"data" };
+            Assert::IsTrue(args == expected);
+
+            // Absolute directories are taken as given
+            std::vector<std::wstring> absolute = { L"-d", L"D:\\Jobs",
+                L"--", L"job.exe" };
+            LaunchDaemon::ResolveClientDirectory(absolute, L"C:\\Work");
+            Assert::AreEqual(std::wstring(L"D:\\Jobs"), absolute[1]);
+        }
+
+        TEST_METHOD(TestTakeDaemonArguments)
+        {
+            std::vector<std::wstring> source = { L"caplcli", L"--via-daemon",
+                L"--pipe", L"test", L"--mode", L"p", L"--", L"job.exe",
+                L"--via-daemon" };
+            std::vector<wchar_t*> argv;
+            for (auto& arg : source) {
+                argv.push_back(arg.data());
+            }
+
+            std::vector<std::wstring> args;
+            std::wstring pipeName;
+            Assert::IsTrue(DaemonClient::TakeDaemonArguments(
+                static_cast<int>(argv.size()), argv.data(), args, pipeName));
+
+            Assert::AreEqual(std::wstring(L"test"), pipeName);
+            // The program's own arguments are passed through untouched
+            std::vector<std::wstring> expected = { L"--mode", L"p", L"--",
+                L"job.exe", L"--via-daemon" };
+            Assert::IsTrue(args == expected);
+        }
+
+        // Launches per second through the daemon against starting caplcli
+        // for every launch; the rates are written to the test log
+        TEST_METHOD(TestLaunchRateAgainstDirectInvocation)
+        {
+            std::wstring testExecutable = FindTestExecutable();
+            std::wstring caplcli = FindBuiltExecutable(L"caplcli.exe");
+
+            const int LAUNCHES = 50;
+            std::wstring pipeName = std::format(L"capld-test-{}",
+                GetCurrentProcessId());
+            LaunchDaemon daemon(pipeName);
+            std::thread server([&daemon]() { daemon.Run(); });
+            Assert::IsTrue(daemon.WaitUntilListening(5000));
+
+            // TestExecutable --help prints its usage and exits at once
+            std::vector<std::wstring> launch = { L"--mode", L"all", L"--",
+                testExecutable, L"--help" };
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+
+            QueryPerformanceCounter(&start);
+            for (int i = 0; i < LAUNCHES; i++) {
+                Assert::AreEqual(DWORD(0), DaemonClient::Launch(pipeName, L"", launch));
+            }
+            QueryPerformanceCounter(&end);
+            double viaDaemon = LAUNCHES * static_cast<double>(frequency.QuadPart) /
+                (end.QuadPart - start.QuadPart);
+
+            daemon.Stop();
+            server.join();
+
+            QueryPerformanceCounter(&start);
+            for (int i = 0; i < LAUNCHES; i++) {
+                ProcessStats stats;
+                Assert::IsTrue(ProcessManager::LaunchProcess(caplcli, launch, L"",
+                    AffinityResolver::GetAllCoresMask(), &stats));
+                Assert::AreEqual(DWORD(0), stats.exitCode);
+            }
+            QueryPerformanceCounter(&end);
+            double direct = LAUNCHES * static_cast<double>(frequency.QuadPart) /
+                (end.QuadPart - start.QuadPart);
+
+            Logger::WriteMessage(std::format(
+                L"via daemon {:.1f} launches/s, direct caplcli {:.1f} launches/s\n",
+                viaDaemon, direct).c_str());
+        }
+
+        TEST_METHOD(TestPipeNameAlreadyTaken)
+        {
+            // Another process created the pipe first
+            std::wstring pipeName = std::format(L"capld-squat-{}",
+                GetCurrentProcessId());
+            HANDLE squatter = CreateNamedPipeW(
+                (L"\\\\.\\pipe\\" + pipeName).c_str(), PIPE_ACCESS_DUPLEX,
+                PIPE_TYPE_MESSAGE, PIPE_UNLIMITED_INSTANCES, 4096, 4096, 0, NULL);
+            Assert::IsTrue(squatter != INVALID_HANDLE_VALUE);
+
+            LaunchDaemon daemon(pipeName);
+            Assert::ExpectException<std::runtime_error>([&]() {
+                daemon.Run();
+                });
+            Assert::IsFalse(daemon.WaitUntilListening(0));
+            CloseHandle(squatter);
+        }
+    };
+
+    TEST_CLASS(CpuSetSpecTests)
+    {
+    private:
+        // 4 P-cores with SMT (0-7), 4 E-cores (8-11), 2 LP E-cores (12-13)
+        static TopologySnapshot MakeHybridTopology() {
+            TopologySnapshot topology;
+            topology.isHybrid = true;
+            topology.systemMask = 0x3FFF;
+            topology.allowedMask = 0x3FFF;
+            topology.pCoreMask = 0xFF;
+            topology.eCoreMask = 0xF00;
+            topology.lpECoreMask = 0x3000;
+            topology.l3Domains = { 0x0FFF, 0x3000 };
+            return topology;
+        }
+
+    public:
+        TEST_METHOD(TestModes)
+        {
+            auto topology = MakeHybridTopology();
+            Assert::AreEqual(DWORD_PTR(0xFF), CpuSetSpec::Evaluate("p", topology));
+            Assert::AreEqual(DWORD_PTR(0xF00), CpuSetSpec::Evaluate("e", topology));
+            Assert::AreEqual(DWORD_PTR(0x3000), CpuSetSpec::Evaluate("lp", topology));
+            Assert::AreEqual(DWORD_PTR(0x3F00), CpuSetSpec::Evaluate("alle", topology));
+            Assert::AreEqual(DWORD_PTR(0x3FFF), CpuSetSpec::Evaluate("all", topology));
+        }
+
+        TEST_METHOD(TestCoreLists)
+        {
+            auto topology = MakeHybridTopology();
+            Assert::AreEqual(DWORD_PTR(0x15), CpuSetSpec::Evaluate("0,2,4", topology));
+            Assert::AreEqual(DWORD_PTR(0xF1), CpuSetSpec::Evaluate("0,4-7", topology));
+        }
+
+        TEST_METHOD(TestInvertAndCacheDomain)
+        {
+            auto topology = MakeHybridTopology();
+            Assert::AreEqual(DWORD_PTR(0x3F00), CpuSetSpec::Evaluate("~p", topology));
+            Assert::AreEqual(DWORD_PTR(0xF00), CpuSetSpec::Evaluate("~p@0", topology));
+            Assert::AreEqual(DWORD_PTR(0x3000), CpuSetSpec::Evaluate("all@1", topology));
+        }
+
+        TEST_METHOD(TestLimitedToAllowedSet)
+        {
+            auto topology = MakeHybridTopology();
+            topology.allowedMask = 0x0F0F;
+            Assert::AreEqual(DWORD_PTR(0x0F), CpuSetSpec::Evaluate("p", topology));
+            Assert::ExpectException<std::runtime_error>([&]() {
+                CpuSetSpec::Evaluate("lp", topology);
+                });
+        }
+
+        TEST_METHOD(TestPublishedBlobRoundTrip)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+            auto topology = MakeHybridTopology();
+            topology.l2Domains = { 0x03, 0x0C, 0xF00 };
+            topology.physicalCores = { 0x3, 0xC, 0x30, 0xC0 };
+
+            HANDLE blobHandle = topology.Publish(0x0F);
+            Assert::IsNotNull(blobHandle);
+            // The handle only allows reading
+            Assert::IsNull(MapViewOfFile(blobHandle, FILE_MAP_WRITE, 0, 0, 0));
+            // and no child CAPL starts inherits it unless it is listed
+            DWORD flags = 0;
+            Assert::IsTrue(GetHandleInformation(blobHandle, &flags) != FALSE);
+            Assert::AreEqual(DWORD(0), flags & HANDLE_FLAG_INHERIT);
+
+            SetEnvironmentVariableA(CAPL_TOPOLOGY_VARIABLE, std::to_string(
+                reinterpret_cast<uintptr_t>(blobHandle)).c_str());
+            capl_topology_view view;
+            Assert::AreEqual(1, capl_topology_open(&view));
+            Assert::AreEqual(uint64_t(0x0F), view.blob->launch_mask);
+            Assert::AreEqual(uint64_t(0xFF), view.blob->p_cores);
+            Assert::AreEqual(uint64_t(0x3000), view.blob->lp_e_cores);
+            Assert::AreEqual(4u, view.blob->core_count);
+            Assert::AreEqual(uint64_t(0xC0), view.cores[3]);
+            Assert::AreEqual(uint64_t(0xF00), view.l2_domains[2]);
+            Assert::AreEqual(uint64_t(0x3000), view.l3_domains[1]);
+            capl_topology_close(&view);
+
+            SetEnvironmentVariableA(CAPL_TOPOLOGY_VARIABLE, "not-a-handle");
+            Assert::AreEqual(0, capl_topology_open(&view));
+            SetEnvironmentVariableA(CAPL_TOPOLOGY_VARIABLE, NULL);
+            CloseHandle(blobHandle);
+        }
+
+        TEST_METHOD(TestRejectsInvalidSpecs)
+        {
+            auto topology = MakeHybridTopology();
+            for (const char* spec : { "", "x", "0,", "3-1", "0-64", "1;2",
+                "p@", "p@2", "~" }) {
+                Assert::ExpectException<std::runtime_error>([&]() {
+                    CpuSetSpec::Evaluate(spec, topology);
+                    });
+            }
+
+            topology.isHybrid = false;
+            Assert::ExpectException<std::runtime_error>([&]() {
+                CpuSetSpec::Evaluate("p", topology);
+                });
+            Assert::AreEqual(DWORD_PTR(0x3FFF), CpuSetSpec::Evaluate("all", topology));
+        }
+    };
+
+    TEST_CLASS(CaplApiTests)
+    {
+    public:
+        TEST_METHOD(TestTopology)
+        {
+            capl_topology topology = {};
+            Assert::AreEqual(int(CAPL_E_INVALID_ARGUMENT),
+                int(capl_get_topology(&topology)));
+
+            topology.size = sizeof(topology);
+            Assert::AreEqual(int(CAPL_OK), int(capl_get_topology(&topology)));
+            Assert::AreEqual(capl_cpuset(CpuInfo::GetAllowedMask()), topology.allowed);
+            Assert::IsTrue(topology.physical_cores > 0);
+            Assert::AreEqual(uint32_t(CAPL_API_VERSION), capl_api_version());
+        }
+
+        TEST_METHOD(TestEvaluateErrors)
+        {
+            capl_cpuset cpus = 0;
+            Assert::AreEqual(int(CAPL_E_INVALID_SPEC),
+                int(capl_evaluate("0-", &cpus)));
+            Assert::AreNotEqual(std::string(), std::string(capl_last_error()));
+            Assert::AreEqual(int(CAPL_E_INVALID_ARGUMENT),
+                int(capl_evaluate(nullptr, &cpus)));
+        }
+
+        TEST_METHOD(TestSpawnReportsTheFailingError)
+        {
+            capl_cpuset allowed = 0;
+            Assert::AreEqual(int(CAPL_OK), int(capl_evaluate("all", &allowed)));
+            capl_process process = {};
+            // The directory does not exist, so CreateProcess itself fails
+            capl_status status = capl_spawn(L"cmd.exe", nullptr, 0,
+                L"Z:\\capl\\missing\\directory", allowed, &process);
+
+            Assert::AreEqual(int(CAPL_E_SYSTEM), int(status));
+            std::string error = capl_last_error();
+            Assert::IsTrue(error.find(std::format("error {}",
+                ERROR_DIRECTORY)) != std::string::npos ||
+                error.find(std::format("error {}",
+                    ERROR_PATH_NOT_FOUND)) != std::string::npos);
+        }
+
+        TEST_METHOD(TestThreadAffinity)
+        {
+            capl_cpuset allowed = 0;
+            Assert::AreEqual(int(CAPL_OK), int(capl_evaluate("all", &allowed)));
+            Assert::AreEqual(int(CAPL_OK),
+                int(capl_set_thread_affinity(GetCurrentThreadId(), allowed)));
+            Assert::AreEqual(int(CAPL_E_INVALID_ARGUMENT),
+                int(capl_set_thread_affinity(GetCurrentThreadId(), 0)));
+        }
+
+        // Mean latency of capl_evaluate, alone and from several threads at
+        // once; the figures are written to the test log
+        TEST_METHOD(TestEvaluateLatency)
+        {
+            const int ITERATIONS = 200000;
+            const char* specs[] = { "all", "0", "~0", "0-1@0" };
+            capl_cpuset expected[4] = {};
+            for (int i = 0; i < 4; i++) {
+                if (capl_evaluate(specs[i], &expected[i]) != CAPL_OK) {
+                    expected[i] = 0;  // Single-processor machine
+                }
+            }
+
+            auto run = [&](int iterations) {
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                capl_cpuset cpus = 0;
+                for (int i = 0; i < iterations; i++) {
+                    int index = i & 3;
+                    if (expected[index] != 0 &&
+                        (capl_evaluate(specs[index], &cpus) != CAPL_OK ||
+                            cpus != expected[index])) {
+                        return -1.0;
+                    }
+                }
+                QueryPerformanceCounter(&end);
+                return static_cast<double>(end.QuadPart - start.QuadPart);
+            };
+
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+            double single = run(ITERATIONS);
+            Assert::IsTrue(single >= 0.0);
+            double singleNs = single * 1e9 / frequency.QuadPart / ITERATIONS;
+
+            const int THREADS = 4;
+            std::vector<double> ticks(THREADS);
+            std::vector<std::thread> threads;
+            for (int t = 0; t < THREADS; t++) {
+                threads.emplace_back([&, t]() { ticks[t] = run(ITERATIONS); });
+            }
+            for (auto& thread : threads) {
+                thread.join();
+            }
+            double worst = 0.0;
+            for (double t : ticks) {
+                Assert::IsTrue(t >= 0.0);
+                worst = std::max(worst, t);
+            }
+            double parallelNs = worst * 1e9 / frequency.QuadPart / ITERATIONS;
+
+            Logger::WriteMessage(std::format(
+                L"capl_evaluate: {:.0f} ns/call, {:.0f} ns/call with {} threads\n",
+                singleNs, parallelNs, THREADS).c_str());
+        }
+    };
+
+    TEST_CLASS(RuntimePoolTests)
+    {
+    private:
+        // Two P-cores with SMT (0-3) and four E-cores in one cluster (4-7)
+        static capl::runtime::Topology MakeHybridTopology() {
+            capl::runtime::Topology topology;
+            Assert::IsTrue(capl::runtime::Topology::Parse(
+                L"p=F;e=F0;lp=0;core=3,C,10,20,40,80;l2=3,C,F0;l3=FF",
+                topology));
+            return topology;
+        }
+
+        // The spin loop of TestExecutable's load threads, one unit per item
+        // Counts every item it runs so the benchmarks can check the split
+        static void SpinKernel(size_t first, size_t last, int spins,
+            std::vector<std::atomic<int>>& hits) {
+            for (size_t item = first; item < last; item++) {
+                for (volatile int i = 0; i < spins; i++) {}
+                hits[item]++;
+            }
+        }
+
+        static void AssertRanOnce(const std::vector<std::atomic<int>>& hits) {
+            for (const auto& hit : hits) {
+                Assert::AreEqual(1, hit.load());
+            }
+        }
+
+        // Splits the range evenly over unpinned threads, like a pool that
+        // does not know about core classes
+        static void NaiveParallelFor(size_t count, size_t threads, int spins,
+            std::vector<std::atomic<int>>& hits) {
+            std::vector<std::thread> workers;
+            for (size_t t = 0; t < threads; t++) {
+                workers.emplace_back([=, &hits]() {
+                    SpinKernel(count * t / threads, count * (t + 1) / threads,
+                        spins, hits);
+                });
+            }
+            for (auto& worker : workers) {
+                worker.join();
+            }
+        }
+
+    public:
+        TEST_METHOD(TestParseEnvironment)
+        {
+            auto topology = MakeHybridTopology();
+            Assert::AreEqual(size_t(8), topology.processors.size());
+            Assert::IsTrue(topology.processors[1].coreClass ==
+                capl::runtime::CoreClass::PERFORMANCE);
+            Assert::IsTrue(topology.processors[5].coreClass ==
+                capl::runtime::CoreClass::EFFICIENCY);
+            Assert::AreEqual(1, topology.processors[2].core);
+            Assert::AreEqual(2, topology.processors[6].cluster);
+
+            capl::runtime::Topology invalid;
+            Assert::IsFalse(capl::runtime::Topology::Parse(L"p=F;core=xyz", invalid));
+        }
+
+        TEST_METHOD(TestEnvironmentMatchesCapture)
+        {
+            auto snapshot = TopologySnapshot::Capture();
+            capl::runtime::Topology topology;
+            Assert::IsTrue(capl::runtime::Topology::Parse(
+                snapshot.FormatEnvironment(), topology));
+            for (const auto& processor : topology.processors) {
+                DWORD_PTR bit = DWORD_PTR(1) << processor.number;
+                Assert::AreEqual(bool(snapshot.eCoreMask & bit),
+                    processor.coreClass == capl::runtime::CoreClass::EFFICIENCY);
+            }
+        }
+
+        TEST_METHOD(TestStealOrderAndWeights)
+        {
+            capl::runtime::PoolOptions options;
+            options.pinWorkers = false;
+            capl::runtime::ThreadPool pool(MakeHybridTopology(), options);
+
+            // SMT sibling, then the other P-core, then the E-core cluster
+            auto topology = MakeHybridTopology();
+            Assert::AreEqual(1, capl::runtime::Topology::Distance(
+                topology.processors[0], topology.processors[1]));
+            Assert::AreEqual(2, capl::runtime::Topology::Distance(
+                topology.processors[4], topology.processors[7]));
+            Assert::AreEqual(3, capl::runtime::Topology::Distance(
+                topology.processors[0], topology.processors[4]));
+
+            // P-core threads share their core with a sibling
+            Assert::AreEqual(options.performanceWeight * options.smtShare,
+                pool.GetWeight(0), 1e-9);
+            Assert::AreEqual(options.efficiencyWeight, pool.GetWeight(4), 1e-9);
+        }
+
+        TEST_METHOD(TestParallelForCoversRangeOnce)
+        {
+            capl::runtime::ThreadPool pool;
+            for (size_t count : { size_t(1), size_t(7), size_t(10000) }) {
+                std::vector<std::atomic<int>> hits(count);
+                pool.ParallelFor(0, count, [&hits](size_t first, size_t last) {
+                    for (size_t i = first; i < last; i++) {
+                        hits[i]++;
+                    }
+                });
+                for (auto& hit : hits) {
+                    Assert::AreEqual(1, hit.load());
+                }
+            }
+
+            Assert::ExpectException<std::runtime_error>([&pool]() {
+                pool.ParallelFor(0, 100, [](size_t first, size_t) {
+                    if (first == 0) {
+                        throw std::runtime_error("kernel failed");
+                    }
+                });
+            });
+        }
+
+        // Same kernel through the topology-aware pool and an even split;
+        // the times are written to the test log, and both must run every
+        // item exactly once while the workers steal under load
+        TEST_METHOD(TestPoolAgainstNaiveSplit)
+        {
+            const size_t ITEMS = 4096;
+            const int SPINS = 20000;
+            capl::runtime::ThreadPool pool;
+
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+            auto seconds = [&]() {
+                return static_cast<double>(end.QuadPart - start.QuadPart) /
+                    frequency.QuadPart;
+            };
+
+            std::vector<std::atomic<int>> warmup(ITEMS / 16);
+            pool.ParallelFor(0, warmup.size(), [&](size_t first, size_t last) {
+                SpinKernel(first, last, SPINS, warmup);
+            });
+            std::vector<std::atomic<int>> pooled(ITEMS);
+            QueryPerformanceCounter(&start);
+            pool.ParallelFor(0, ITEMS, [&](size_t first, size_t last) {
+                SpinKernel(first, last, SPINS, pooled);
+            });
+            QueryPerformanceCounter(&end);
+            double stealing = seconds();
+            AssertRanOnce(pooled);
+
+            std::vector<std::atomic<int>> split(ITEMS);
+            QueryPerformanceCounter(&start);
+            NaiveParallelFor(ITEMS, pool.Size(), SPINS, split);
+            QueryPerformanceCounter(&end);
+            double naive = seconds();
+            AssertRanOnce(split);
+
+            Logger::WriteMessage(std::format(
+                L"{} workers: work-stealing pool {:.3f}s, even split {:.3f}s\n",
+                pool.Size(), stealing, naive).c_str());
+        }
+    };
+
+    TEST_CLASS(LoggerTests)
+    {
+    private:
+        static std::wstring TempLog(const wchar_t* name) {
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring path = std::wstring(tempDir) + name;
+            DeleteFileW(path.c_str());
+            return path;
+        }
+
+        static std::vector<std::string> ReadLines(const std::wstring& path) {
+            std::ifstream file(path);
+            std::vector<std::string> lines;
+            std::string line;
+            while (std::getline(file, line)) {
+                lines.push_back(line);
+            }
+            return lines;
+        }
+
+    public:
+        TEST_METHOD(TestRecordsAreFormattedByFlusher)
+        {
+            std::wstring path = TempLog(L"capl_test_logger.log");
+            {
+                ApplicationLogger logger(true, path);
+                logger.Log(ApplicationLogger::Level::INFO, "plain message");
+                logger.Log(ApplicationLogger::Level::WARNING,
+                    "mask {:X} on {} cores", DWORD_PTR(0xF0), 4);
+                logger.Log(ApplicationLogger::Level::DEBUG,
+                    "path {} and {}", std::wstring(L"C:\\x\\app.exe"),
+                    std::string("narrow"));
+                logger.Log(ApplicationLogger::Level::ERR, "long {}",
+                    std::string(2000, 'x'));
+            }
+
+            auto lines = ReadLines(path);
+            DeleteFileW(path.c_str());
+            Assert::AreEqual(size_t(4), lines.size());
+            Assert::IsTrue(lines[0].ends_with("[INFO] plain message"));
+            Assert::IsTrue(lines[1].ends_with("[WARNING] mask F0 on 4 cores"));
+            Assert::IsTrue(lines[2].ends_with(
+                "[DEBUG] path C:\\x\\app.exe and narrow"));
+            // Oversized records are formatted at once, cut and marked
+            Assert::IsTrue(lines[3].find("[ERROR] long xxx") != std::string::npos);
+            Assert::IsTrue(lines[3].ends_with("... [truncated, 2005 bytes]"));
+            Assert::IsTrue(lines[3].size() < 600);
+        }
+
+        TEST_METHOD(TestLongPlainMessageIsMarked)
+        {
+            std::wstring path = TempLog(L"capl_test_logger_long.log");
+            {
+                ApplicationLogger logger(true, path);
+                std::string message = "start " + std::string(1000, 'y');
+                logger.Log(ApplicationLogger::Level::INFO, message);
+                logger.Log(ApplicationLogger::Level::INFO,
+                    std::string(480, 'z'));  // Exactly one slot
+            }
+
+            auto lines = ReadLines(path);
+            DeleteFileW(path.c_str());
+            Assert::AreEqual(size_t(2), lines.size());
+            Assert::IsTrue(lines[0].find("[INFO] start yyy") != std::string::npos);
+            Assert::IsTrue(lines[0].ends_with("y... [truncated, 1006 bytes]"));
+            Assert::IsTrue(lines[1].ends_with(std::string(480, 'z')));
+        }
+
+        TEST_METHOD(TestConcurrentProducersKeepEveryRecord)
+        {
+            std::wstring path = TempLog(L"capl_test_logger_threads.log");
+            const int THREADS = 4;
+            const int PER_THREAD = 5000;
+            uint64_t dropped = 0;
+            {
+                ApplicationLogger logger(true, path);
+                std::vector<std::thread> threads;
+                for (int t = 0; t < THREADS; t++) {
+                    threads.emplace_back([&, t]() {
+                        for (int i = 0; i < PER_THREAD; i++) {
+                            logger.Log(ApplicationLogger::Level::INFO,
+                                "thread {} record {}", t, i);
+                        }
+                    });
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+                logger.Flush();
+                dropped = logger.GetDroppedCount();
+            }
+
+            // Each thread's records stay in order; a full ring drops
+            // records and says how many
+            std::vector<int> next(THREADS, 0);
+            size_t records = 0;
+            for (const auto& line : ReadLines(path)) {
+                int t, i;
+                size_t at = line.find("thread ");
+                if (at == std::string::npos ||
+                    sscanf_s(line.c_str() + at, "thread %d record %d", &t, &i) != 2) {
+                    continue;
+                }
+                Assert::IsTrue(t >= 0 && t < THREADS && i >= next[t]);
+                next[t] = i + 1;
+                records++;
+            }
+            DeleteFileW(path.c_str());
+            Assert::IsTrue(records > 0);
+            Assert::AreEqual(size_t(THREADS * PER_THREAD), records + size_t(dropped));
+        }
+
+        TEST_METHOD(TestLoggingThroughput)
+        {
+            std::wstring path = TempLog(L"capl_test_logger_bench.log");
+            const int THREADS = 4;
+            const int PER_THREAD = 50000;
+            LARGE_INTEGER frequency;
+            QueryPerformanceFrequency(&frequency);
+
+            // Caller-side cost: time every call and keep the distribution
+            std::vector<std::vector<double>> latencies(THREADS);
+            double elapsed = 0.0;
+            uint64_t dropped = 0;
+            {
+                ApplicationLogger logger(true, path);
+                LARGE_INTEGER start, end;
+                QueryPerformanceCounter(&start);
+                std::vector<std::thread> threads;
+                for (int t = 0; t < THREADS; t++) {
+                    threads.emplace_back([&, t]() {
+                        latencies[t].reserve(PER_THREAD);
+                        std::wstring target = L"C:\\Program Files\\app.exe";
+                        for (int i = 0; i < PER_THREAD; i++) {
+                            LARGE_INTEGER before, after;
+                            QueryPerformanceCounter(&before);
+                            logger.Log(ApplicationLogger::Level::DEBUG,
+                                "Launching {} with mask {:X} ({})", target,
+                                DWORD_PTR(0xFF00), i);
+                            QueryPerformanceCounter(&after);
+                            latencies[t].push_back(static_cast<double>(
+                                after.QuadPart - before.QuadPart));
+                        }
+                    });
+                }
+                for (auto& thread : threads) {
+                    thread.join();
+                }
+                logger.Flush();
+                QueryPerformanceCounter(&end);
+                elapsed = static_cast<double>(end.QuadPart - start.QuadPart) /
+                    frequency.QuadPart;
+                dropped = logger.GetDroppedCount();
+            }
+            DeleteFileW(path.c_str());
+
+            std::vector<double> all;
+            for (const auto& list : latencies) {
+                all.insert(all.end(), list.begin(), list.end());
+            }
+            std::sort(all.begin(), all.end());
+            double total = 0.0;
+            for (double ticks : all) {
+                total += ticks;
+            }
+            double toNs = 1e9 / frequency.QuadPart;
+            double meanNs = total / all.size() * toNs;
+            double p99Ns = all[all.size() * 99 / 100] * toNs;
+
+            // A disabled logger only tests a flag; written to the test log
+            ApplicationLogger disabled(false);
+            const int DISABLED_CALLS = 10000000;
+            LARGE_INTEGER start, end;
+            QueryPerformanceCounter(&start);
+            for (int i = 0; i < DISABLED_CALLS; i++) {
+                disabled.Log(ApplicationLogger::Level::DEBUG,
+                    "Launching {} with mask {:X}", L"app.exe", DWORD_PTR(i));
+            }
+            QueryPerformanceCounter(&end);
+            double disabledNs = static_cast<double>(end.QuadPart -
+                start.QuadPart) * toNs / DISABLED_CALLS;
+
+            double messages = static_cast<double>(THREADS) * PER_THREAD;
+            Logger::WriteMessage(std::format(
+                L"Logger: {:.0f} messages/s with {} threads ({} dropped), "
+                L"caller {:.0f} ns mean / {:.0f} ns p99, disabled {:.2f} ns\n",
+                messages / elapsed, THREADS, dropped, meanNs, p99Ns,
+                disabledNs).c_str());
+        }
+    };
+
+    TEST_CLASS(PhaseTraceTests)
+    {
+    public:
+        TEST_METHOD_CLEANUP(StopTracing)
+        {
+            PhaseTrace::Stop();
+            PhaseTrace::Clear();
+        }
+
+        TEST_METHOD(TestScopesRecordOnlyWhileTracing)
+        {
+            PhaseTrace::Clear();
+            {
+                PhaseTrace::Scope trace("before start");
+            }
+            PhaseTrace::Start();
+            {
+                PhaseTrace::Scope outer("outer phase");
+                PhaseTrace::Scope inner("inner \"quoted\" phase");
+                Sleep(2);
+            }
+            PhaseTrace::Stop();
+
+            std::string json = PhaseTrace::Format();
+            Assert::IsTrue(json.starts_with("{\"traceEvents\": ["));
+            Assert::IsTrue(json.find("\"before start\"") == std::string::npos);
+            Assert::IsTrue(json.find("\"name\": \"outer phase\", \"cat\": \"capl\", "
+                "\"ph\": \"X\", \"ts\": ") != std::string::npos);
+            Assert::IsTrue(json.find("inner \\\"quoted\\\" phase") !=
+                std::string::npos);
+            Assert::IsTrue(json.find("\"droppedEvents\": 0") != std::string::npos);
+        }
+
+        TEST_METHOD(TestLaunchIsTraced)
+        {
+            std::wstring executable = FindTestExecutable();
+            PhaseTrace::Clear();
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring path = std::wstring(tempDir) + L"capl_test_trace.json";
+            {
+                PhaseTrace::Session session(path);
+                Assert::IsTrue(ProcessManager::LaunchProcess(executable,
+                    { L"--help" }, L"", CpuInfo::GetAllowedMask()));
+            }
+            Assert::IsFalse(PhaseTrace::IsEnabled());
+
+            std::ifstream file(path);
+            std::string json((std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+            file.close();
+            DeleteFileW(path.c_str());
+            for (const char* phase : { "SearchPathW", "CreateProcessW",
+                "Affinity and scheduling", "ResumeThread", "Program running" }) {
+                Assert::IsTrue(json.find(std::format("\"{}\"", phase)) !=
+                    std::string::npos);
+            }
+        }
+
+        TEST_METHOD(TestSessionReportsWriteFailure)
+        {
+            if (!g_logger) {
+                g_logger = std::make_unique<ApplicationLogger>(false);
+            }
+            std::ostringstream captured;
+            std::streambuf* original = std::cerr.rdbuf(captured.rdbuf());
+            {
+                PhaseTrace::Session session(
+                    L"Z:\\capl\\missing\\directory\\trace.json");
+            }
+            std::cerr.rdbuf(original);
+            Assert::IsTrue(captured.str().find("Cannot write trace file") !=
+                std::string::npos);
+        }
+
+        TEST_METHOD(TestFullBufferCountsDroppedPhases)
+        {
+            PhaseTrace::Clear();
+            PhaseTrace::Start();
+            for (size_t i = 0; i < PhaseTrace::MAX_EVENTS + 10; i++) {
+                PhaseTrace::Scope trace("phase");
+            }
+            PhaseTrace::Stop();
+            Assert::AreEqual(size_t(10), PhaseTrace::GetDroppedCount());
+            Assert::IsTrue(PhaseTrace::Format().find("\"droppedEvents\": 10") !=
+                std::string::npos);
+        }
+
+        TEST_METHOD(TestDisabledScopeCost)
+        {
+            PhaseTrace::Clear();
+            const int ITERATIONS = 10000000;
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&start);
+            for (int i = 0; i < ITERATIONS; i++) {
+                PhaseTrace::Scope trace("disabled");
+            }
+            QueryPerformanceCounter(&end);
+            double ns = static_cast<double>(end.QuadPart - start.QuadPart) *
+                1e9 / frequency.QuadPart / ITERATIONS;
+
+            Logger::WriteMessage(std::format(
+                L"Disabled trace scope: {:.2f} ns\n", ns).c_str());
+            Assert::AreEqual(size_t(0), PhaseTrace::GetDroppedCount());
+        }
+    };
+
+    TEST_CLASS(SchedTraceTests)
+    {
+    private:
+        // 1000 ticks per second; processors 0-1 are P-cores, 2-3 E-cores
+        static SchedTrace MakeTrace() {
+            SchedTrace trace;
+            memcpy(trace.header.magic, "CAPLSCHD", 8);
+            trace.header.version = SchedTrace::VERSION;
+            trace.header.processId = 42;
+            trace.header.frequency = 1000;
+            trace.header.launchMask = 0x3;
+            trace.header.pCoreMask = 0x3;
+            trace.header.eCoreMask = 0xC;
+            auto add = [&](int64_t time, uint32_t thread, uint16_t processor,
+                SchedRecord::Type type) {
+                trace.records.push_back({ time, thread, processor,
+                    static_cast<uint8_t>(type), 0 });
+            };
+            add(0, 7, 0, SchedRecord::SWITCH_IN);
+            add(100, 7, 0, SchedRecord::SWITCH_OUT);
+            add(150, 7, 0, SchedRecord::READY);
+            add(160, 7, 1, SchedRecord::SWITCH_IN);     // Migrated, waited 10
+            add(260, 7, 1, SchedRecord::SWITCH_OUT);
+            add(300, 8, 2, SchedRecord::THREAD_START);
+            add(300, 8, 2, SchedRecord::SWITCH_IN);     // Outside the mask
+            add(350, 8, 2, SchedRecord::SWITCH_OUT);
+            add(400, 7, 1, SchedRecord::SWITCH_IN);
+            add(500, 8, 0, SchedRecord::SWITCH_IN);     // Still running at end
+            add(600, 7, 1, SchedRecord::SWITCH_OUT);
+            return trace;
+        }
+
+    public:
+        TEST_METHOD(TestResidencyMigrationsAndWaits)
+        {
+            auto analysis = SchedTraceAnalyzer::Analyze(MakeTrace());
+
+            Assert::AreEqual(0.6, analysis.seconds, 1e-9);
+            Assert::AreEqual(size_t(2), analysis.threads.size());
+            const auto& first = analysis.threads[0];
+            Assert::AreEqual(DWORD(7), first.threadId);
+            Assert::AreEqual(0.4, first.runSeconds, 1e-9);
+            Assert::AreEqual(3, first.switches);
+            Assert::AreEqual(1, first.migrations);
+            Assert::AreEqual(1, first.waits);
+            Assert::AreEqual(0.01, first.waitSeconds, 1e-9);
+            Assert::AreEqual(0.1, first.processorSeconds.at(0), 1e-9);
+            Assert::AreEqual(0.3, first.processorSeconds.at(1), 1e-9);
+            Assert::AreEqual(0.4, first.classSeconds[0], 1e-9);
+            Assert::AreEqual(0.0, first.outsideMaskSeconds, 1e-9);
+
+            const auto& second = analysis.threads[1];
+            Assert::AreEqual(0.15, second.runSeconds, 1e-9);
+            Assert::AreEqual(1, second.migrations);
+            Assert::AreEqual(0.05, second.classSeconds[1], 1e-9);
+            Assert::AreEqual(0.05, second.outsideMaskSeconds, 1e-9);
+
+            Assert::AreEqual(0.55, analysis.total.runSeconds, 1e-9);
+            Assert::AreEqual(2, analysis.total.migrations);
+            Assert::AreEqual(0.2, analysis.total.processorSeconds.at(0), 1e-9);
+
+            auto report = SchedTraceAnalyzer::FormatReport(analysis);
+            Assert::IsTrue(report.find(L"9.1% outside the launch mask") !=
+                std::wstring::npos);
+            Assert::IsTrue(report.find(L"2!:") != std::wstring::npos);
+        }
+
+        TEST_METHOD(TestFileRoundTrip)
+        {
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring path = std::wstring(tempDir) + L"capl_test_trace.sched";
+            SchedTrace written = MakeTrace();
+            written.Write(path);
+            SchedTrace read = SchedTrace::Read(path);
+
+            Assert::AreEqual(written.records.size(), read.records.size());
+            Assert::AreEqual(uint32_t(written.records.size()),
+                read.header.recordCount);
+            Assert::AreEqual(uint64_t(0x3), read.header.launchMask);
+            Assert::AreEqual(int64_t(160), read.records[3].time);
+            Assert::AreEqual(1, int(read.records[3].processor));
+
+            // Anything else is rejected
+            std::ofstream(path, std::ios::trunc) << "not a trace";
+            Assert::ExpectException<std::runtime_error>([&]() {
+                SchedTrace::Read(path);
+            });
+            DeleteFileW(path.c_str());
+        }
+
+        TEST_METHOD(TestRecordsLaunchedProgram)
+        {
+            std::unique_ptr<SchedTraceRecorder> recorder;
+            try {
+                recorder = std::make_unique<SchedTraceRecorder>();
+            }
+            catch (const std::runtime_error&) {
+                Logger::WriteMessage(L"No administrator rights; skipped");
+                return;
+            }
+            Assert::IsTrue(ProcessManager::LaunchProcess(L"cmd.exe",
+                { L"/c", L"exit" }, L"", CpuInfo::GetAllowedMask(), nullptr,
+                { recorder.get() }));
+
+            auto analysis = SchedTraceAnalyzer::Analyze(recorder->GetTrace());
+            Assert::IsTrue(analysis.threads.size() >= 1);
+            Assert::IsTrue(analysis.total.switches >= 1);
+            Assert::AreEqual(0.0, analysis.total.outsideMaskSeconds, 1e-9);
+        }
+
+        TEST_METHOD(TestOneRecordingAtATime)
+        {
+            std::unique_ptr<SchedTraceRecorder> recorder;
+            try {
+                recorder = std::make_unique<SchedTraceRecorder>();
+            }
+            catch (const std::runtime_error&) {
+                Logger::WriteMessage(L"No administrator rights; skipped");
+                return;
+            }
+
+            // The lock belongs to a thread, as in the daemon's requests
+            bool refused = false;
+            std::thread([&refused]() {
+                try {
+                    SchedTraceRecorder second;
+                }
+                catch (const std::runtime_error&) {
+                    refused = true;
+                }
+            }).join();
+            Assert::IsTrue(refused);
+
+            recorder.reset();
+            recorder = std::make_unique<SchedTraceRecorder>();
+        }
+
+        TEST_METHOD(TestStaleSessionIsStopped)
+        {
+            // A session under the fixed name that no recorder owns, as a
+            // killed launcher leaves it
+            struct {
+                EVENT_TRACE_PROPERTIES properties;
+                wchar_t name[64];
+            } buffer = {};
+            buffer.properties.Wnode.BufferSize = sizeof(buffer);
+            buffer.properties.Wnode.Flags = WNODE_FLAG_TRACED_GUID;
+            buffer.properties.Wnode.ClientContext = 1;
+            buffer.properties.LogFileMode = EVENT_TRACE_REAL_TIME_MODE;
+            buffer.properties.LoggerNameOffset = sizeof(EVENT_TRACE_PROPERTIES);
+            TRACEHANDLE stale = 0;
+            if (StartTraceW(&stale, SchedTraceRecorder::SESSION_NAME,
+                &buffer.properties) != ERROR_SUCCESS) {
+                Logger::WriteMessage(L"No administrator rights; skipped");
+                return;
+            }
+
+            // The recorder replaces it instead of failing
+            SchedTraceRecorder recorder;
+        }
+    };
+
+    TEST_CLASS(MetricsExporterTests)
+    {
+    public:
+        TEST_METHOD(TestFormatMetrics)
+        {
+            MetricsSample sample;
+            sample.cpuSeconds[MetricsSample::P_CORES] = 1.5;
+            sample.cpuSeconds[MetricsSample::E_CORES] = 0.25;
+            sample.threads = 4;
+            sample.residentBytes = 1048576;
+            sample.frequencyLimitRatio[MetricsSample::P_CORES] = 0.5;
+            sample.frequencyLimited[MetricsSample::P_CORES] = true;
+            sample.frequencyLimitRatio[MetricsSample::E_CORES] = 1.0;
+            sample.running = false;
+            const DWORD_PTR classMasks[MetricsSample::CLASS_COUNT] = {
+                0x0F, 0xF0, 0, 0 };
+
+            std::string text;
+            MetricsExporter::FormatMetrics(sample,
+                "pid=\"42\",program=\"job.exe\"", classMasks, text);
+
+            Assert::IsTrue(text.find("# TYPE capl_cpu_seconds counter\n") !=
+                std::string::npos);
+            Assert::IsTrue(text.find("capl_cpu_seconds_total{pid=\"42\","
+                "program=\"job.exe\",class=\"p\"} 1.500000\n") !=
+                std::string::npos);
+            Assert::IsTrue(text.find("class=\"e\"} 0.250000\n") !=
+                std::string::npos);
+            Assert::IsTrue(text.find("class=\"lp\"") == std::string::npos);
+            Assert::IsTrue(text.find("capl_threads{pid=\"42\",program=\"job.exe\"} "
+                "4\n") != std::string::npos);
+            Assert::IsTrue(text.find("capl_resident_memory_bytes{pid=\"42\","
+                "program=\"job.exe\"} 1048576\n") != std::string::npos);
+            Assert::IsTrue(text.find("capl_frequency_limited{pid=\"42\","
+                "program=\"job.exe\",class=\"p\"} 1\n") != std::string::npos);
+            Assert::IsTrue(text.find("capl_up{pid=\"42\",program=\"job.exe\"} "
+                "0\n") != std::string::npos);
+            Assert::IsTrue(text.ends_with("# EOF\n"));
+
+            // Refreshing into the cleared string does not reallocate
+            const char* storage = text.data();
+            text.clear();
+            MetricsExporter::FormatMetrics(sample,
+                "pid=\"42\",program=\"job.exe\"", classMasks, text);
+            Assert::IsTrue(storage == text.data());
+        }
+
+        TEST_METHOD(TestSplitByClass)
+        {
+            // Processors 0-1 are P-cores, 2-3 E-cores; the P-cores were
+            // three times as busy
+            std::vector<CpuLoadSampler::Times> before(4, { 0, 0 });
+            std::vector<CpuLoadSampler::Times> after = {
+                { 25, 100 }, { 25, 100 }, { 75, 100 }, { 75, 100 } };
+            const DWORD_PTR classMasks[MetricsSample::CLASS_COUNT] = {
+                0x3, 0xC, 0, 0 };
+            double cpuSeconds[MetricsSample::CLASS_COUNT] = {};
+
+            MetricsExporter::SplitByClass(4.0, before, after, 0xF, classMasks,
+                cpuSeconds);
+            Assert::AreEqual(3.0, cpuSeconds[MetricsSample::P_CORES], 1e-9);
+            Assert::AreEqual(1.0, cpuSeconds[MetricsSample::E_CORES], 1e-9);
+
+            // A mask inside one class keeps all the time there
+            MetricsExporter::SplitByClass(2.0, before, after, 0xC, classMasks,
+                cpuSeconds);
+            Assert::AreEqual(3.0, cpuSeconds[MetricsSample::P_CORES], 1e-9);
+            Assert::AreEqual(3.0, cpuSeconds[MetricsSample::E_CORES], 1e-9);
+        }
+
+        TEST_METHOD(TestLaunchWritesMetricsFile)
+        {
+            std::wstring executable = FindTestExecutable();
+            WCHAR tempDir[MAX_PATH];
+            GetTempPathW(MAX_PATH, tempDir);
+            std::wstring path = std::wstring(tempDir) + L"capl_test_metrics.prom";
+            MetricsExporter exporter(path, 100, CpuInfo::GetCoreTypeMasks());
+
+            Assert::IsTrue(ProcessManager::LaunchProcess(executable,
+                { L"--time", L"1", L"--threads", L"2" }, L"",
+                CpuInfo::GetAllowedMask(), nullptr, { &exporter }));
+
+            std::ifstream file(path);
+            std::string text((std::istreambuf_iterator<char>(file)),
+                std::istreambuf_iterator<char>());
+            file.close();
+            DeleteFileW(path.c_str());
+            Assert::IsFalse(Utilities::PathExists(path + L".tmp"));
+            Assert::IsTrue(text.find("program=\"TestExecutable.exe\"") !=
+                std::string::npos);
+            Assert::IsTrue(text.find("capl_up{") != std::string::npos);
+            Assert::IsTrue(text.ends_with("# EOF\n"));
+
+            const MetricsSample& sample = exporter.GetLastSample();
+            Assert::IsFalse(sample.running);
+            double cpuSeconds = 0.0;
+            for (double seconds : sample.cpuSeconds) {
+                cpuSeconds += seconds;
+            }
+            Assert::IsTrue(cpuSeconds > 0.5);
+        }
+    };
+
+    TEST_CLASS(TopViewTests)
+    {
+    public:
+        TEST_METHOD(TestLayoutGroupsClassesByL2)
+        {
+            CpuInfo::CoreTypeMasks masks = { 0x0F, 0xF0, 0x300 };
+            auto layout = TopView::BuildLayout(masks, 0xFF,
+                { 0x3, 0xC, 0xF0, 0x300 });
+
+            // LP E-cores are outside the allowed set
+            Assert::AreEqual(size_t(2), layout.size());
+            Assert::AreEqual(std::wstring(L"P-cores"), layout[0].name);
+            Assert::AreEqual(size_t(2), layout[0].clusters.size());
+            Assert::AreEqual(DWORD_PTR(0xC), layout[0].clusters[1]);
+            Assert::AreEqual(std::wstring(L"E-cores"), layout[1].name);
+            Assert::AreEqual(DWORD_PTR(0xF0), layout[1].clusters[0]);
+
+            // Non-hybrid without L2 data: one group, one block
+            layout = TopView::BuildLayout({ 0, 0, 0 }, 0xF, {});
+            Assert::AreEqual(size_t(1), layout.size());
+            Assert::AreEqual(std::wstring(L"Cores"), layout[0].name);
+            Assert::AreEqual(DWORD_PTR(0xF), layout[0].clusters[0]);
+        }
+
+        TEST_METHOD(TestFormatFrame)
+        {
+            std::vector<TopView::Group> layout = {
+                { L"P-cores", { 0x3 } }, { L"E-cores", { 0xC } } };
+            std::vector<double> busy = { 1.0, 0.5, 0.0, 0.0 };
+            std::vector<CpuInfo::ProcessorFrequency> frequencies = {
+                { 0, 5000, 4800, 5000 }, { 1, 5000, 2000, 2500 } };
+            std::vector<TopView::Program> programs = {
+                { 1234, L"job.exe", 0x6, 8, 2 } };
+
+            std::wstring frame;
+            TopView::FormatFrame(layout, busy, frequencies, programs, 1000,
+                frame);
+
+            Assert::IsTrue(frame.find(L"4 processors, every 1000 ms") !=
+                std::wstring::npos);
+            Assert::IsTrue(frame.find(L"P-cores\x1b[0m   75.0% busy") !=
+                std::wstring::npos);
+            Assert::IsTrue(frame.find(L"L2 0x3") != std::wstring::npos);
+            Assert::IsTrue(frame.find(L"4800/5000 MHz  pid") ==
+                std::wstring::npos);
+            Assert::IsTrue(frame.find(L"2000/5000 MHz \x1b[31mlimited\x1b[0m"
+                L"  pid 1234") != std::wstring::npos);
+            Assert::IsTrue(frame.find(L"   1234        8        2  0x6") !=
+                std::wstring::npos);
+            Assert::IsTrue(frame.find(L"job.exe") != std::wstring::npos);
+
+            frame.clear();
+            TopView::FormatFrame(layout, busy, frequencies, {}, 1000, frame);
+            Assert::IsTrue(frame.find(L"No programs launched by CAPL") !=
+                std::wstring::npos);
+        }
+    };
+
+    TEST_CLASS(TopologySnapshotTests)
+    {
+    public:
+        TEST_METHOD(TestCaptureMatchesCpuInfo)
+        {
+            auto snapshot = TopologySnapshot::Capture(true);
+
+            Assert::AreEqual(CpuInfo::CountBits(snapshot.systemMask),
+                static_cast<int>(snapshot.processors.size()));
+            Assert::IsTrue(snapshot.physicalCores == CpuInfo::GetPhysicalCoreMasks());
+            Assert::IsTrue(snapshot.l2Domains == CpuInfo::GetCacheDomainMasks(2));
+            Assert::IsTrue(snapshot.l3Domains == CpuInfo::GetCacheDomainMasks(3));
+            for (const auto& processor : snapshot.processors) {
+                DWORD_PTR bit = DWORD_PTR(1) << processor.number;
+                Assert::AreEqual(bool(snapshot.allowedMask & bit), processor.allowed);
+                Assert::IsTrue(processor.core >= 0);
+                DWORD_PTR core = snapshot.physicalCores[processor.core];
+                Assert::IsTrue((core & bit) != 0);
+                Assert::AreEqual(core & ~bit, processor.smtSiblings);
+                Assert::IsTrue(processor.package >= 0);
+                Assert::IsTrue(processor.numaNode >= 0);
+            }
+        }
+
+        TEST_METHOD(TestFormatJson)
+        {
+            TopologySnapshot topology;
+            topology.brandString = L"Test \"CPU\"";
+            topology.logicalProcessors = 2;
+            topology.isHybrid = true;
+            topology.systemMask = 0x3;
+            topology.allowedMask = 0x1;
+            topology.pCoreMask = 0x1;
+            topology.lpECoreMask = 0x2;
+            topology.physicalCores = { 0x1, 0x2 };
+            topology.caches = { { 2, CacheUnified, 2097152, 64, 16, 0x3 } };
+            topology.numaNodes = { { 0, 0x3 } };
+
+            TopologySnapshot::Processor first;
+            first.number = 0;
+            first.coreType = TopologySnapshot::CoreType::PERFORMANCE;
+            first.allowed = true;
+            first.core = 0;
+            first.maxMhz = 5000;
+            first.currentMhz = 4000;
+            first.mhzLimit = 5000;
+            TopologySnapshot::Processor second;
+            second.number = 1;
+            second.coreType = TopologySnapshot::CoreType::LOW_POWER;
+            second.core = 1;
+            topology.processors = { first, second };
+
+            std::string json = topology.FormatJson();
+            Assert::IsTrue(json.find("\"brand\": \"Test \\\"CPU\\\"\"") !=
+                std::string::npos);
+            Assert::IsTrue(json.find("\"allowed\": [0],") != std::string::npos);
+            Assert::IsTrue(json.find("{\"number\": 0, \"core_type\": \"p\", "
+                "\"low_power\": false, \"allowed\": true, \"smt_siblings\": [], "
+                "\"core\": 0, \"module\": null") != std::string::npos);
+            Assert::IsTrue(json.find("\"max_mhz\": 5000, \"current_mhz\": 4000")
+                != std::string::npos);
+            Assert::IsTrue(json.find("\"core_type\": \"lp\", \"low_power\": true, "
+                "\"allowed\": false") != std::string::npos);
+            Assert::IsTrue(json.find("\"max_mhz\": null") != std::string::npos);
+            Assert::IsTrue(json.find("{\"level\": 2, \"type\": \"unified\", "
+                "\"size_bytes\": 2097152, \"line_size\": 64, "
+                "\"associativity\": 16, \"processors\": [0, 1]}") !=
+                std::string::npos);
+            Assert::IsTrue(json.find("\"cores\": [[0], [1]]") != std::string::npos);
+            Assert::IsTrue(json.ends_with("}\n"));
+        }
+
+        TEST_METHOD(TestJsonQueryTime)
+        {
+            LARGE_INTEGER frequency, start, end;
+            QueryPerformanceFrequency(&frequency);
+            QueryPerformanceCounter(&start);
+            TopologySnapshot topology = TopologySnapshot::Capture(true);
+            std::string json = topology.FormatJson();
+            QueryPerformanceCounter(&end);
+            double ms = static_cast<double>(end.QuadPart - start.QuadPart) *
+                1000.0 / frequency.QuadPart;
+
+            // Reported only; the first capture's cost depends on the machine
+            Logger::WriteMessage(std::format(
+                L"--query --format json: {:.3f} ms\n", ms).c_str());
+            Assert::IsTrue(json.ends_with("}\n"));
+
+            // The core types are cached by then, so a second query does no
+            // CPUID sweep and no model table match
+            QueryPerformanceCounter(&start);
+            std::string again = TopologySnapshot::Capture(true).FormatJson();
+            QueryPerformanceCounter(&end);
+            double warmMs = static_cast<double>(end.QuadPart - start.QuadPart) *
+                1000.0 / frequency.QuadPart;
+            Logger::WriteMessage(std::format(
+                L"warm --query --format json: {:.3f} ms\n", warmMs).c_str());
+            Assert::IsTrue(warmMs < 50.0);
+            Assert::IsTrue(again.ends_with("}\n"));
+
+            // Every module index points into the module list, including the
+            // L2 fallback on Windows 10
+            for (const auto& processor : topology.processors) {
+                Assert::IsTrue(processor.module < static_cast<int>(
+                    topology.modules.size()));
+            }
+        }
+    };
+
+    TEST_CLASS(CpuModelTests)
+    {
+    public:
+        // The cores Windows would report for entry: P-cores first with their
+        // SMT siblings, then the E and LP E-cores, one processor each
+        static std::vector<CpuModels::Core> Synthesize(const CpuModel& entry) {
+            std::vector<CpuModels::Core> cores;
+            int next = 0;
+            for (int i = 0; i < entry.PhysicalCores(); i++) {
+                bool pCore = i < entry.pCores;
+                int threads = pCore ? entry.pThreadsPerCore : 1;
+                DWORD_PTR mask = ((DWORD_PTR(1) << threads) - 1) << next;
+                cores.push_back({ mask, static_cast<BYTE>(pCore ? 1 : 0) });
+                next += threads;
+            }
+            return cores;
+        }
+
+        TEST_METHOD(TestEveryEntryBuildsItsLayout)
+        {
+            for (const CpuModel& entry : CpuModels::TABLE) {
+                std::wstring name = Utilities::ConvertToWideString(entry.name);
+                auto cores = Synthesize(entry);
+                // Windows does not promise an order; the layout must not care
+                std::reverse(cores.begin(), cores.end());
+
+                CpuModels::Layout layout;
+                Assert::IsTrue(CpuModels::BuildLayout(entry, cores, layout),
+                    name.c_str());
+                Assert::AreEqual(entry.pCores * entry.pThreadsPerCore,
+                    CpuInfo::CountBits(layout.pCoreMask), name.c_str());
+                Assert::AreEqual(entry.eCores,
+                    CpuInfo::CountBits(layout.eCoreMask), name.c_str());
+                Assert::AreEqual(entry.lpECores,
+                    CpuInfo::CountBits(layout.lpECoreMask), name.c_str());
+                Assert::AreEqual(DWORD_PTR(0), layout.pCoreMask & layout.eCoreMask);
+                Assert::AreEqual(DWORD_PTR(0), layout.pCoreMask & layout.lpECoreMask);
+                Assert::AreEqual(DWORD_PTR(0), layout.eCoreMask & layout.lpECoreMask);
+                Assert::AreEqual(
+                    (DWORD_PTR(1) << entry.LogicalProcessors()) - 1,
+                    layout.pCoreMask | layout.eCoreMask | layout.lpECoreMask,
+                    name.c_str());
+
+                // P-cores come first and the classes keep processor order
+                if (layout.eCoreMask) {
+                    Assert::IsTrue(layout.pCoreMask < (layout.eCoreMask &
+                        (~layout.eCoreMask + 1)), name.c_str());
+                }
+                if (layout.lpECoreMask && layout.eCoreMask) {
+                    Assert::IsTrue(layout.eCoreMask < (layout.lpECoreMask &
+                        (~layout.lpECoreMask + 1)), name.c_str());
+                }
+
+                Assert::IsTrue(&entry == CpuModels::Find(entry.family, entry.model,
+                    entry.minStepping, entry.PhysicalCores(),
+                    entry.LogicalProcessors()), name.c_str());
+            }
+        }
+
+        TEST_METHOD(TestModesResolveOnTableLayouts)
+        {
+            using Mode = CommandLineOptions::CoreAffinityMode;
+            for (const CpuModel& entry : CpuModels::TABLE) {
+                std::wstring name = Utilities::ConvertToWideString(entry.name);
+                CpuModels::Layout layout;
+                Assert::IsTrue(CpuModels::BuildLayout(entry, Synthesize(entry),
+                    layout), name.c_str());
+                CpuInfo::CoreTypeMasks types = { layout.pCoreMask,
+                    layout.eCoreMask, layout.lpECoreMask };
+
+                // P-core threads are numbered first, the LP E-cores last
+                int pThreads = entry.pCores * entry.pThreadsPerCore;
+                DWORD_PTR all = (DWORD_PTR(1) << entry.LogicalProcessors()) - 1;
+                DWORD_PTR lp = all & ~((DWORD_PTR(1) <<
+                    (pThreads + entry.eCores)) - 1);
+                Assert::AreEqual((DWORD_PTR(1) << pThreads) - 1,
+                    AffinityResolver::GetClassMask(Mode::P_CORES_ONLY, types),
+                    name.c_str());
+                Assert::AreEqual(all & ~((DWORD_PTR(1) << pThreads) - 1),
+                    AffinityResolver::GetClassMask(Mode::ALL_E_CORES, types),
+                    name.c_str());
+                Assert::AreEqual(lp,
+                    AffinityResolver::GetClassMask(Mode::LP_CORES_ONLY, types),
+                    name.c_str());
+                Assert::AreEqual(all & ~((DWORD_PTR(1) << pThreads) - 1) & ~lp,
+                    AffinityResolver::GetClassMask(Mode::E_CORES_ONLY, types),
+                    name.c_str());
+            }
+
+            // Meteor Lake-H 6P+8E+2LP as Windows numbers it
+            const CpuModel* meteorLake = CpuModels::Find(6, 0xAA, 4, 16, 22);
+            Assert::IsNotNull(meteorLake);
+            CpuModels::Layout layout;
+            Assert::IsTrue(CpuModels::BuildLayout(*meteorLake,
+                Synthesize(*meteorLake), layout));
+            CpuInfo::CoreTypeMasks types = { layout.pCoreMask,
+                layout.eCoreMask, layout.lpECoreMask };
+            Assert::AreEqual(DWORD_PTR(0xFFF),
+                AffinityResolver::GetClassMask(Mode::P_CORES_ONLY, types));
+            Assert::AreEqual(DWORD_PTR(0xFF000),
+                AffinityResolver::GetClassMask(Mode::E_CORES_ONLY, types));
+            Assert::AreEqual(DWORD_PTR(0x300000),
+                AffinityResolver::GetClassMask(Mode::LP_CORES_ONLY, types));
+            Assert::AreEqual(DWORD_PTR(0x3FF000),
+                AffinityResolver::GetClassMask(Mode::ALL_E_CORES, types));
+
+            Assert::ExpectException<std::runtime_error>([&]() {
+                AffinityResolver::GetClassMask(Mode::ALL_CORES, types);
+                });
+        }
+
+        TEST_METHOD(TestMismatchedCoresAreRejected)
+        {
+            const CpuModel* entry = CpuModels::Find(6, 0x97, 2, 16, 24);
+            Assert::IsNotNull(entry);
+            CpuModels::Layout layout;
+
+            // Same counts, but Windows ranks every core alike
+            auto cores = Synthesize(*entry);
+            for (auto& core : cores) {
+                core.efficiencyClass = 0;
+            }
+            Assert::IsFalse(CpuModels::BuildLayout(*entry, cores, layout));
+
+            // Hyper-Threading disabled in the firmware
+            cores = Synthesize(*entry);
+            cores[0].mask &= cores[0].mask - 1;
+            Assert::IsFalse(CpuModels::BuildLayout(*entry, cores, layout));
+
+            // A core missing (a VM with fewer processors)
+            cores = Synthesize(*entry);
+            cores.pop_back();
+            Assert::IsFalse(CpuModels::BuildLayout(*entry, cores, layout));
+
+            Assert::IsNull(CpuModels::Find(6, 0x97, 2, 16, 32));
+            Assert::IsNull(CpuModels::Find(6, 0x8C, 1, 4, 8));
+            Assert::IsNull(CpuModels::Find(25, 0x61, 2, 16, 32));
+        }
+
+        TEST_METHOD(TestTableMatchesProbeOnThisMachine)
+        {
+            if (!CpuInfo::GetKnownModel()) {
+                Logger::WriteMessage(L"CPU not in the model table; nothing to verify");
+                return;
+            }
+            auto table = CpuInfo::GetCoreTypeMasks();
+            auto probed = CpuInfo::ProbeCoreTypes(CpuInfo::GetAllowedMask());
+            // CPUID tells P-cores from the rest; its LP E-core bit is not
+            // reliable, so E and LP E are compared as one class
+            Assert::AreEqual(probed.pCoreMask, table.pCoreMask);
+            Assert::AreEqual(probed.eCoreMask | probed.lpECoreMask,
+                table.eCoreMask | table.lpECoreMask);
+
+            // Windows ranks the P-cores alike and above every other core
+            auto classes = CpuInfo::GetEfficiencyClasses();
+            int pClass = -1;
+            for (int i = 0; i < static_cast<int>(classes.size()); i++) {
+                if (table.pCoreMask & (DWORD_PTR(1) << i)) {
+                    if (pClass < 0) {
+                        pClass = classes[i];
+                    }
+                    Assert::AreEqual(pClass, static_cast<int>(classes[i]));
+                }
+            }
+            for (int i = 0; i < static_cast<int>(classes.size()); i++) {
+                if ((table.eCoreMask | table.lpECoreMask) & (DWORD_PTR(1) << i)) {
+                    Assert::IsTrue(classes[i] < pClass);
+                }
+            }
+        }
     };
 }
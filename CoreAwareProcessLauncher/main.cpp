@@ -3,6 +3,7 @@
 #include "utilities.h"
 #include "cpu.h"
 #include "process.h"
+#include "affinity.h"
 #include <iostream>
 #include <format>
 
@@ -42,6 +43,7 @@ int WINAPI wWinMain(
 		if (options.enableLogging) {
 			g_logger = std::make_unique<ApplicationLogger>(true,
 				options.logPath.empty() ? L"capl.log" : options.logPath);
+			ApplicationLogger::FlushOnFailure();
 			g_logger->Log(ApplicationLogger::Level::INFO, "CAPL starting...");
 		}
 
@@ -63,68 +65,7 @@ int WINAPI wWinMain(
 		}
 
 		// Get appropriate core mask based on affinity mode
-		DWORD_PTR coreMask = 0;
-		auto caps = CpuInfo::GetCapabilities();
-
-		switch (options.affinityMode) {
-		case CommandLineOptions::CoreAffinityMode::P_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetPCoreMask();
-			break;
-
-		case CommandLineOptions::CoreAffinityMode::E_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetECoreMask();
-			break;
-
-		case CommandLineOptions::CoreAffinityMode::LP_CORES_ONLY:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetLpECoreMask();
-			break;
-
-		case CommandLineOptions::CoreAffinityMode::ALL_E_CORES:
-			if (!caps.isHybrid || !caps.supportsLeaf1A) {
-				throw std::runtime_error(Utilities::ConvertToNarrowString(L"This CPU does not support hybrid architecture"));
-			}
-			coreMask = CpuInfo::GetECoreMask() | CpuInfo::GetLpECoreMask();
-			break;
-
-		case CommandLineOptions::CoreAffinityMode::ALL_CORES:
-		{
-			SYSTEM_INFO sysInfo;
-			GetSystemInfo(&sysInfo);
-			coreMask = (1ULL << sysInfo.dwNumberOfProcessors) - 1;
-		}
-		break;
-
-		case CommandLineOptions::CoreAffinityMode::CUSTOM:
-			coreMask = CpuInfo::CoreListToMask(options.cores);
-			break;
-
-		default:
-			throw std::runtime_error(Utilities::ConvertToNarrowString(L"Invalid affinity mode"));
-		}
-
-		// Apply inversion if requested
-		if (options.invertSelection) {
-			SYSTEM_INFO sysInfo;
-			GetSystemInfo(&sysInfo);
-			DWORD_PTR fullMask = (1ULL << sysInfo.dwNumberOfProcessors) - 1;
-			coreMask = fullMask & ~coreMask;
-			g_logger->Log(ApplicationLogger::Level::INFO,
-				"Inverted core mask: 0x" + std::format("{:X}", coreMask));
-		}
-
-		// Validate final mask
-		if (coreMask == 0) {
-			throw std::runtime_error(Utilities::ConvertToNarrowString(L"Resulting core mask is empty"));
-		}
+		DWORD_PTR coreMask = AffinityResolver::Resolve(options);
 
 		// Launch the process
 		if (!ProcessManager::LaunchProcess(
@@ -137,8 +78,8 @@ int WINAPI wWinMain(
 	}
 	catch (const std::exception& e) {
 		if (g_logger) {
-			g_logger->Log(ApplicationLogger::Level::ERR,
-				"Fatal error: " + std::string(e.what()));
+			g_logger->Log(ApplicationLogger::Level::ERR, "Fatal error: {}",
+				e.what());
 		}
 		//if (hasConsole) {
 		std::cerr << "Error: " << e.what() << std::endl;
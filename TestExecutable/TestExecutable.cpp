@@ -6,6 +6,8 @@
 #include <atomic>
 #include <chrono>
 #include <csignal>
+#include <algorithm>
+#include <iomanip>
 
 // Global control flag for threads
 std::atomic<bool> g_running = true;
@@ -25,13 +27,17 @@ void ShowArgs(int argc, wchar_t* argv[]) {
     }
 }
 
-void CpuLoadThread(int threadId, bool showProgress) {
-    // Simple CPU load with yield
-    while (g_running) {
+void CpuLoadThread(int threadId, bool showProgress, int workUnits) {
+    // Simple CPU load with yield; a fixed amount of work when workUnits > 0
+    for (int unit = 0; g_running && (workUnits == 0 || unit < workUnits);
+        unit++) {
         // Spin for a while
         for (volatile int i = 0; i < 1000000 && g_running; i++) {}
-        // Yield to prevent system lockup
-        Sleep(1);
+        // Yield to prevent system lockup; fixed work stays CPU-bound so
+        // its run time reflects the CPU share it got
+        if (workUnits == 0) {
+            Sleep(1);
+        }
 
         if (showProgress && threadId == 0) { // Only first thread reports
             std::wcout << L"." << std::flush; // Progress indicator
@@ -39,6 +45,76 @@ void CpuLoadThread(int threadId, bool showProgress) {
     }
 }
 
+// Arms a 1 ms high-resolution timer over and over, measures how late the
+// thread wakes up each time and prints a histogram of those latencies
+int RunLatencyTest(int seconds) {
+    HANDLE timer = CreateWaitableTimerExW(NULL, NULL,
+        CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+    if (!timer) {
+        timer = CreateWaitableTimerW(NULL, FALSE, NULL);  // Older Windows
+    }
+    if (!timer) {
+        std::wcerr << L"Could not create a waitable timer\n";
+        return 1;
+    }
+
+    const double periodUs = 1000.0;
+    LARGE_INTEGER frequency, start, armed, woke;
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&start);
+
+    std::vector<double> latencies;
+    while (g_running) {
+        LARGE_INTEGER due;
+        due.QuadPart = -static_cast<LONGLONG>(periodUs * 10);  // 100 ns, relative
+        QueryPerformanceCounter(&armed);
+        SetWaitableTimer(timer, &due, 0, NULL, NULL, FALSE);
+        WaitForSingleObject(timer, INFINITE);
+        QueryPerformanceCounter(&woke);
+
+        double elapsedUs = (woke.QuadPart - armed.QuadPart) * 1e6 /
+            frequency.QuadPart;
+        latencies.push_back((std::max)(0.0, elapsedUs - periodUs));
+        if (woke.QuadPart - start.QuadPart >= seconds * frequency.QuadPart) {
+            break;
+        }
+    }
+    CloseHandle(timer);
+
+    if (latencies.empty()) {
+        return 1;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    auto percentile = [&latencies](double p) {
+        return latencies[static_cast<size_t>(p * (latencies.size() - 1))];
+    };
+
+    std::wcout << std::fixed << std::setprecision(1)
+        << L"Wake-ups: " << latencies.size()
+        << L"  p50: " << percentile(0.50) << L" us"
+        << L"  p99: " << percentile(0.99) << L" us"
+        << L"  p99.9: " << percentile(0.999) << L" us"
+        << L"  max: " << latencies.back() << L" us\n";
+
+    const double limits[] = { 10, 20, 50, 100, 200, 500, 1000, 2000 };
+    size_t next = 0;
+    for (size_t bucket = 0; bucket <= std::size(limits); bucket++) {
+        size_t count = 0;
+        while (next < latencies.size() &&
+            (bucket == std::size(limits) || latencies[next] < limits[bucket])) {
+            count++;
+            next++;
+        }
+        std::wstring label = bucket == std::size(limits)
+            ? L">= " + std::to_wstring(static_cast<int>(limits[bucket - 1]))
+            : L"<  " + std::to_wstring(static_cast<int>(limits[bucket]));
+        size_t bar = count * 50 / latencies.size();
+        std::wcout << std::setw(8) << label << L" us " << std::setw(8) << count
+            << L" " << std::wstring(bar, L'#') << L"\n";
+    }
+    return 0;
+}
+
 int wmain(int argc, wchar_t* argv[]) {
     // Register signal handler
     signal(SIGINT, SignalHandler);
@@ -50,6 +126,8 @@ int wmain(int argc, wchar_t* argv[]) {
             << L"Options:\n"
             << L"  --time <seconds>     Run duration (default: 30)\n"
             << L"  --threads <count>    Number of threads (default: all)\n"
+            << L"  --work <units>       Fixed work per thread instead of --time\n"
+            << L"  --latency-test <s>   Timer wake-up latency histogram\n"
             << L"  --show-args          Show command line arguments\n"
             << L"  --help               Show detailed help\n"
             << L"\nNote: Press Ctrl+C to stop before timeout\n"
@@ -59,6 +137,7 @@ int wmain(int argc, wchar_t* argv[]) {
     // Parse command line
     int duration = 30; // Default 30 seconds
     int threadCount = 0; // Default: use all available threads
+    int workUnits = 0;   // Default: run for the whole duration
     bool showArgs = false;
     bool showProgress = true;
 
@@ -73,6 +152,12 @@ int wmain(int argc, wchar_t* argv[]) {
         else if (arg == L"--threads" && i + 1 < argc) {
             threadCount = _wtoi(argv[++i]);
         }
+        else if (arg == L"--work" && i + 1 < argc) {
+            workUnits = _wtoi(argv[++i]);
+        }
+        else if (arg == L"--latency-test" && i + 1 < argc) {
+            return RunLatencyTest(_wtoi(argv[++i]));
+        }
         else if (arg == L"--show-args") {
             showArgs = true;
         }
@@ -82,6 +167,10 @@ int wmain(int argc, wchar_t* argv[]) {
                 << L"\nOptions:\n"
                 << L"  --time <seconds>     Run duration (default: 30)\n"
                 << L"  --threads <count>    Number of threads (default: all)\n"
+                << L"  --work <units>       Fixed work per thread, then exit; the\n"
+                << L"                       run time measures throughput\n"
+                << L"  --latency-test <s>   Measure timer wake-up latency for s\n"
+                << L"                       seconds and print a histogram\n"
                 << L"  --no-progress        Disable progress bar\n"
                 << L"  --show-args          Show command line arguments\n"
                 << L"  --help               Show this detailed help\n"
@@ -107,13 +196,27 @@ int wmain(int argc, wchar_t* argv[]) {
         threadCount = std::thread::hardware_concurrency();
     }
 
-    std::wcout << L"Starting " << threadCount << L" threads for "
-        << duration << L" seconds...\n";
+    if (workUnits > 0) {
+        std::wcout << L"Starting " << threadCount << L" threads for "
+            << workUnits << L" work units each...\n";
+    } else {
+        std::wcout << L"Starting " << threadCount << L" threads for "
+            << duration << L" seconds...\n";
+    }
 
     // Create threads
     std::vector<std::thread> threads;
     for (int i = 0; i < threadCount; i++) {
-        threads.emplace_back(CpuLoadThread, i,showProgress);
+        threads.emplace_back(CpuLoadThread, i, showProgress, workUnits);
+    }
+
+    // Fixed work: the threads finish on their own
+    if (workUnits > 0) {
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        std::wcout << L"\nTest complete.\n";
+        return 0;
     }
 
     // Wait for specified duration